@@ -0,0 +1 @@
+../../src/index_cache.h
\ No newline at end of file
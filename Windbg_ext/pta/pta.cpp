@@ -9,6 +9,8 @@
 #include "heap.h"
 #include "stl_container.h"
 #include "decode.h"
+#include "parallel.h"
+#include "ptr_index.h"
 
 extern size_t g_align;
 
@@ -500,6 +502,50 @@ max_indirection_level(PDEBUG_CLIENT4 Client, PCSTR args)
     return S_OK;
 }
 
+HRESULT CALLBACK
+ref_index(PDEBUG_CLIENT4 Client, PCSTR args)
+{
+	if (!enter_command(Client))
+		return E_FAIL;
+
+	if (args && strlen(args))
+		ptr_index_command(args);
+	else
+		ptr_index_command(NULL);
+
+	leave_command();
+	return S_OK;
+}
+
+HRESULT CALLBACK
+eager_bitvec(PDEBUG_CLIENT4 Client, PCSTR args)
+{
+	if (!enter_command(Client))
+		return E_FAIL;
+
+	if (args && strlen(args))
+		bit_vec_command(args);
+	else
+		bit_vec_command(NULL);
+
+	leave_command();
+	return S_OK;
+}
+
+HRESULT CALLBACK
+ca_threads(PDEBUG_CLIENT4 Client, PCSTR args)
+{
+	unsigned int value;
+    if (!args || strlen(args)==0)
+    	value = 0;
+    else
+    	value = (unsigned int) GetExpression(args);
+
+    set_num_workers(value);
+
+    return S_OK;
+}
+
 HRESULT CALLBACK
 info_local(PDEBUG_CLIENT4 Client, PCSTR args)
 {
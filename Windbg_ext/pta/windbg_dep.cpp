@@ -2124,7 +2124,7 @@ address_t ca_eval_address(const char* expr)
 	return GetExpression (expr);
 }
 
-void calc_heap_usage(char *expr)
+void calc_heap_usage(char *expr, CA_BOOL retained)
 {
 	size_t var_len = 0;
 	size_t ptr_sz = g_ptr_bit >> 3;
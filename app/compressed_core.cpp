@@ -0,0 +1 @@
+../src/compressed_core.cpp
\ No newline at end of file
@@ -35,6 +35,8 @@
 #include "search.h"
 #include "heap.h"
 #include "stl_container.h"
+#include "ptr_index.h"
+#include "index_cache.h"
 
 // forward declaration
 static int AskChoice(const char** options);
@@ -46,6 +48,16 @@ CA_BOOL gbBatchMode = CA_FALSE;
 CA_BOOL gbVerbose   = CA_FALSE;
 CA_BOOL g_debug_core = CA_TRUE;
 
+#ifdef CA_COMPRESSED_CORE
+static MmapFile* gpCoreMmap = NULL;
+
+// Scans keep the data they are working on in memory
+static void PinCoreData(const char* ipAddr, size_t iLen, CA_BOOL ibPin)
+{
+	gpCoreMmap->Pin(ipAddr, iLen, ibPin ? true : false);
+}
+#endif
+
 static void PrintBanner()
 {
 	printf("******************************************************************\n");
@@ -63,21 +75,43 @@ int main(int argc, char** argv)
 	need_exec_file = CA_FALSE;
 	if (argc < 2)
 	{
-		printf("Usage: %s [-b] core_file\n", argv[0]);
+		printf("Usage: %s [-b] [-e] [-c] [-d] [-w] [-m <MB>] core_file\n", argv[0]);
 		return 0;
 	}
 #else
 	if (argc < 3)
 	{
-		printf("Usage: %s [-b] prog_name core_file\n", argv[0]);
+		printf("Usage: %s [-b] [-e] [-c] [-d] [-w] [-m <MB>] prog_name core_file\n", argv[0]);
 		return 0;
 	}
 #endif
 
 	int nextarg = 1;
-	if (0 == strcmp(argv[nextarg], "-b"))
+	CA_BOOL eager_bitvec = CA_FALSE;
+	CA_BOOL use_index_cache = CA_FALSE;
+	while (nextarg < argc - 1 && argv[nextarg][0] == '-')
 	{
-		gbBatchMode = CA_TRUE;
+		if (0 == strcmp(argv[nextarg], "-b"))
+			gbBatchMode = CA_TRUE;
+		// build bit vectors of all segments upfront
+		else if (0 == strcmp(argv[nextarg], "-e"))
+			eager_bitvec = CA_TRUE;
+		// load indexes from and save them to a sidecar file of the core
+		else if (0 == strcmp(argv[nextarg], "-c"))
+			use_index_cache = CA_TRUE;
+		// drop pages of the core from memory after they are scanned
+		else if (0 == strcmp(argv[nextarg], "-d"))
+			prefetch_command("drop");
+#ifdef CA_COMPRESSED_CORE
+		// memory budget of inflated data of a compressed core
+		else if (0 == strcmp(argv[nextarg], "-m") && nextarg < argc - 2)
+			MmapFile::SetCacheBudget(atoi(argv[++nextarg]));
+		// map a core bigger than the memory budget in windows
+		else if (0 == strcmp(argv[nextarg], "-w"))
+			MmapFile::SetWindowed(true);
+#endif
+		else
+			break;
 		nextarg++;
 	}
 
@@ -94,6 +128,10 @@ int main(int argc, char** argv)
 		// error message is issued by MmapFile class
 		return -1;
 	}
+#ifdef CA_COMPRESSED_CORE
+	gpCoreMmap = &lCoreMmap;
+	g_pin_core_data = PinCoreData;
+#endif
 	gpInputExecName = lpExecName;
 
 	// sanity check
@@ -110,6 +148,10 @@ int main(int argc, char** argv)
 		fprintf(stderr, "Fail to initialize core analyzer\n");
 		return -1;
 	}
+	if (use_index_cache)
+		load_index_cache(lpCoreFile);
+	if (eager_bitvec)
+		build_all_bit_vecs();
 
 	// Batch mode
 	if (gbBatchMode)
@@ -134,7 +176,8 @@ int main(int argc, char** argv)
 		/* 8 */ "Biggest Heap Memory Blocks",
 		/* 9 */ "Biggest Heap Memory Owners(variables)",
 		/* 10 */ "Heap Memory Leak Candidates",
-		/* 11 */ "Quit",
+		/* 11 */ "Build Reverse Pointer Index (faster repeated searches)",
+		/* 12 */ "Quit",
 		/*    */ NULL
 	};
 
@@ -237,7 +280,7 @@ int main(int argc, char** argv)
 		else if (opt == 8)
 		{
 			unsigned int num = AskParam("Number of in-use top-sized heap memory blocks", NULL, CA_TRUE);
-			if (!biggest_blocks(num))
+			if (!biggest_blocks(num, NULL))
 			{
 				//break;
 			}
@@ -246,7 +289,7 @@ int main(int argc, char** argv)
 		else if (opt == 9)
 		{
 			unsigned int num = AskParam("Number of top users(variables) of heap memory", NULL, CA_TRUE);
-			if (!biggest_heap_owners_generic(num, CA_FALSE))
+			if (!biggest_heap_owners_generic(num, CA_FALSE, CA_FALSE, CA_FALSE))
 			{
 				//break;
 			}
@@ -259,9 +302,16 @@ int main(int argc, char** argv)
 			}
 		}
 		else if (opt == 11)
+		{
+			build_ptr_index();
+		}
+		else if (opt == 12)
 			break;
 	}
 
+	if (use_index_cache && index_cache_stale())
+		save_index_cache(lpCoreFile);
+
 	// Core file is unmapped and closed here
 	return 0;
 }
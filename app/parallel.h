@@ -0,0 +1 @@
+../src/parallel.h
\ No newline at end of file
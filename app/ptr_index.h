@@ -0,0 +1 @@
+../src/ptr_index.h
\ No newline at end of file
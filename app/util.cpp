@@ -536,7 +536,7 @@ address_t ca_eval_address(const char* expr)
 	return atol(expr);
 }
 
-void calc_heap_usage(char *exp)
+void calc_heap_usage(char *exp, CA_BOOL retained)
 {
 }
 
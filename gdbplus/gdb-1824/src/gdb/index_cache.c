@@ -0,0 +1 @@
+../../../../src/index_cache.cpp
\ No newline at end of file
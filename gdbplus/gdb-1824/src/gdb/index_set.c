@@ -0,0 +1 @@
+../../../../src/index_set.cpp
\ No newline at end of file
@@ -0,0 +1 @@
+../../../../src/index_set.h
\ No newline at end of file
@@ -0,0 +1 @@
+../../../../src/parallel.cpp
\ No newline at end of file
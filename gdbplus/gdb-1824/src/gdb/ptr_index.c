@@ -0,0 +1 @@
+../../../../src/ptr_index.cpp
\ No newline at end of file
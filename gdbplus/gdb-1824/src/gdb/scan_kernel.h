@@ -0,0 +1 @@
+../../../../src/scan_kernel.h
\ No newline at end of file
@@ -2489,7 +2489,7 @@ void print_op_value_context(size_t op_value, int op_size, address_t loc, int off
 	printf_filtered ("\n");
 }
 
-void calc_heap_usage(char *exp)
+void calc_heap_usage(char *exp, CA_BOOL retained)
 {
 	struct expression *expr;
 	struct cleanup *old_chain = make_cleanup (null_cleanup, NULL);
@@ -2546,12 +2546,11 @@ void calc_heap_usage(char *exp)
 			// we understand the input expression enough
 			if (ref.vaddr)
 			{
-				struct inuse_block *inuse_blocks = NULL;
-				unsigned long num_inuse_blocks;
+				struct inuse_block_table *inuse_blocks = NULL;
 
-				// First, create and populate an array of all in-use blocks
-				inuse_blocks = build_inuse_heap_blocks(&num_inuse_blocks);
-				if (!inuse_blocks || num_inuse_blocks == 0)
+				// First, create and populate the table of all in-use blocks
+				inuse_blocks = build_inuse_heap_blocks();
+				if (!inuse_blocks)
 				{
 					printf_filtered("Failed: no in-use heap block is found\n");
 				}
@@ -2563,7 +2562,7 @@ void calc_heap_usage(char *exp)
 					CA_PRINT("Heap memory consumed by ");
 					print_ref(&ref, 0, CA_FALSE, CA_FALSE);
 					// Include all reachable blocks
-					if (calc_aggregate_size(&ref, var_len, CA_TRUE, inuse_blocks, num_inuse_blocks, &aggr_size, &aggr_count))
+					if (calc_aggregate_size(&ref, var_len, CA_TRUE, inuse_blocks, &aggr_size, &aggr_count))
 					{
 						CA_PRINT("All reachable:\n");
 						CA_PRINT("    |--> ");
@@ -2572,8 +2571,16 @@ void calc_heap_usage(char *exp)
 					}
 					else
 						CA_PRINT("Failed to calculate heap usage\n");
+					// Reachable blocks that are freed with it, which examines all owners
+					if (retained && calc_retained_size(&ref, var_len, inuse_blocks, &aggr_size, &aggr_count))
+					{
+						CA_PRINT("Retained:\n");
+						CA_PRINT("    |--> ");
+						print_size(aggr_size);
+						CA_PRINT(" (%ld blocks)\n", aggr_count);
+					}
 					// Directly referenced heap blocks only
-					if (calc_aggregate_size(&ref, var_len, CA_FALSE, inuse_blocks, num_inuse_blocks, &aggr_size, &aggr_count))
+					if (calc_aggregate_size(&ref, var_len, CA_FALSE, inuse_blocks, &aggr_size, &aggr_count))
 					{
 						CA_PRINT("Directly referenced:\n");
 						CA_PRINT("    |--> ");
@@ -2581,7 +2588,7 @@ void calc_heap_usage(char *exp)
 						CA_PRINT(" (%ld blocks)\n", aggr_count);
 					}
 					// remember to cleanup
-					free_inuse_heap_blocks (inuse_blocks, num_inuse_blocks);
+					free_inuse_heap_blocks (inuse_blocks);
 				}
 			}
 			else
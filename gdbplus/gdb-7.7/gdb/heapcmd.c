@@ -10,6 +10,9 @@
 #include "search.h"
 #include "decode.h"
 #include "stl_container.h"
+#include "parallel.h"
+#include "ptr_index.h"
+#include "index_cache.h"
 
 /***************************************************************************
 * gdb commands
@@ -198,6 +201,48 @@ max_indirection_level_command (char *arg, int from_tty)
 	set_max_indirection_level(level);
 }
 
+static void
+ref_index_command (char *arg, int from_tty)
+{
+	/* We depend on typed segments */
+	if (!update_memory_segments_and_heaps())
+		return;
+	ptr_index_command(arg);
+}
+
+static void
+index_cache_command_impl (char *arg, int from_tty)
+{
+	/* We depend on typed segments */
+	if (!update_memory_segments_and_heaps())
+		return;
+	index_cache_command(arg, g_debug_core && core_bfd ? bfd_get_filename(core_bfd) : NULL);
+}
+
+static void
+eager_bitvec_command (char *arg, int from_tty)
+{
+	if (!update_memory_segments_and_heaps())
+		return;
+	bit_vec_command(arg);
+}
+
+static void
+prefetch_command_impl (char *arg, int from_tty)
+{
+	prefetch_command(arg);
+}
+
+static void
+ca_threads_command (char *arg, int from_tty)
+{
+	unsigned int num = 0;
+	if (arg)
+		num = parse_and_eval_address (arg);
+
+	set_num_workers(num);
+}
+
 #define IS_BLANK(c) ((c)==' ' || (c)=='\t')
 
 static void
@@ -273,7 +318,7 @@ _initialize_heapcmd (void)
 	add_cmd("obj", class_info, obj_command, _("Search for object and reference to object of the same type as the input expression\nobj <type|variable>"), &cmdlist);
 	add_cmd("shrobj", class_info, shrobj_command, _("Find objects that currently referenced from multiple threads\nshrobj [tid0] [tid1] [...]"), &cmdlist);
 
-	add_cmd("heap", class_info, heap_command, _("Heap walk, heap data validation, memory usage statistics, etc.\nheap [/verbose or /v] [/leak or /l]\nheap [/block or /b] [/cluster or /c] <addr_exp>\nheap [/usage or /u] <var_exp>\nheap [/topblock or /tb] [/topuser or /tu] <num>\n"), &cmdlist);
+	add_cmd("heap", class_info, heap_command, _("Heap walk, heap data validation, memory usage statistics, etc.\nheap [/verbose or /v] [/leak or /l]\nheap [/block or /b] [/cluster or /c] <addr_exp>\nheap [/usage or /u] [/retained or /r] <var_exp>\nheap [/topblock or /tb] [/topuser or /tu] [/retained or /r] [/estimate or /e] <num>\n"), &cmdlist);
 
 	add_cmd("pattern", class_info, pattern_command, _("Reveal memory pattern\npattern <start> <end>"), &cmdlist);
 	add_cmd("segment", class_info, segment_command, _("Display memory segments"), &cmdlist);
@@ -282,6 +327,11 @@ _initialize_heapcmd (void)
 	// Settings
 	add_cmd("shrobj_level", class_info, shrobj_level_command, _("Set/Show the indirection level of shared-object search"), &cmdlist);
 	add_cmd("max_indirection_level", class_info, max_indirection_level_command, _("Set/Show the maximum indirection level of reference search"), &cmdlist);
+	add_cmd("ca_threads", class_info, ca_threads_command, _("Set/Show the number of threads to scan the core file"), &cmdlist);
+	add_cmd("ref_index", class_info, ref_index_command, _("Build/Release/Show the reverse pointer index of the core file\nref_index [on|off]"), &cmdlist);
+	add_cmd("eager_bitvec", class_info, eager_bitvec_command, _("Build pointer bit vectors of all segments upfront in parallel, or on demand\neager_bitvec [on|off]"), &cmdlist);
+	add_cmd("prefetch", class_info, prefetch_command_impl, _("Read core data ahead of scans, and optionally drop scanned pages from memory\nprefetch [on|off|drop]"), &cmdlist);
+	add_cmd("index_cache", class_info, index_cache_command_impl, _("Load/Save indexes derived from the core file in a sidecar file <core>.caidx\nindex_cache [load|save]"), &cmdlist);
 	add_cmd("assign", class_info, assign_command, _("Pretend the memory data is the given value\nassign [addr] [value]"), &cmdlist);
 	add_cmd("unassign", class_info, unassign_command, _("Remove the fake value at the given address\nunassign <addr>"), &cmdlist);
 	add_cmd("include_free", class_info, include_free_command, _("Reference search includes free heap memory blocks"), &cmdlist);
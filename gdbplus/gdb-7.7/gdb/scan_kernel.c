@@ -0,0 +1 @@
+../../../src/scan_kernel.cpp
\ No newline at end of file
@@ -0,0 +1,811 @@
+/************************************************************************
+** FILE NAME..... compressed_core.cpp
+**
+** FUNCTION......... Present a gzip-compressed core file as one
+**                   contiguous read-only memory image.
+**                   See compressed_core.h
+**
+************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <linux/userfaultfd.h>
+#include <zlib.h>
+
+#include "mmap_file.h"
+#include "compressed_core.h"
+
+#ifndef UFFD_USER_MODE_ONLY
+#define UFFD_USER_MODE_ONLY 1
+#endif
+
+#define GZ_WINSIZE 32768			// dictionary of deflate
+#define GZ_CHUNK   (256*1024)		// compressed input read at a time
+#define GZ_INDEX_MAGIC "CAGZI\0\0"
+#define GZ_INDEX_VERSION 1
+
+#define GZ_ALIGN(x,s) ( ((x) + (s) - 1) & (~((s) - 1)) )
+
+// State of a block
+#define GZ_LOADED    0x1u
+#define GZ_PROTECTED 0x2u
+#define GZ_SEEN      0x4u	// has been loaded and dropped before
+
+// A ring of block numbers in the order they are loaded
+struct gz_queue
+{
+	size_t* slots;
+	size_t  capacity;
+	size_t  first;
+	size_t  count;
+};
+
+// An access point of the deflate stream
+struct gz_point
+{
+	unsigned long long out;		// offset in the uncompressed data
+	unsigned long long in;		// offset in the compressed file of the first full byte
+	int                bits;	// bits of the byte before "in", -1 at the start of a gzip member
+	int                pad;
+	unsigned long long window;	// offset of its dictionary in the index file
+};
+
+struct gz_index_header
+{
+	char               magic[8];
+	unsigned int       version;
+	unsigned int       span;
+	unsigned long long compressed_size;
+	long long          mtime;
+	unsigned long long size;
+	unsigned long long num_points;	// written last, a partial file is never used
+	unsigned long long points_offset;
+};
+
+size_t MmapFile::mCacheBudgetMB = GZ_DEFAULT_BUDGET_MB;
+bool   MmapFile::mbWindowed = false;
+
+static double
+gz_now()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static struct gz_queue*
+gz_queue_new(size_t capacity)
+{
+	struct gz_queue* q = (struct gz_queue*) calloc(1, sizeof(struct gz_queue));
+	if (q)
+	{
+		q->slots = (size_t*) malloc(capacity * sizeof(size_t));
+		if (!q->slots)
+		{
+			free(q);
+			return NULL;
+		}
+		q->capacity = capacity;
+	}
+	return q;
+}
+
+static void
+gz_queue_free(struct gz_queue* q)
+{
+	if (q)
+	{
+		free(q->slots);
+		free(q);
+	}
+}
+
+static void
+gz_queue_push(struct gz_queue* q, size_t block)
+{
+	q->slots[(q->first + q->count) % q->capacity] = block;
+	q->count++;
+}
+
+static size_t
+gz_queue_pop(struct gz_queue* q)
+{
+	size_t block = q->slots[q->first];
+	q->first = (q->first + 1) % q->capacity;
+	q->count--;
+	return block;
+}
+
+CompressedCore::CompressedCore(int iFileDescriptor, const char* ipFileName, size_t iBudgetMB, bool ibCompressed)
+	: mpFileName(ipFileName), mFileDescriptor(iFileDescriptor), mIndexDescriptor(-1),
+	mCompressedSize(0), mSize(0), mbCompressed(ibCompressed), mpPoints(NULL), mNumPoints(0),
+	mpImage(NULL), mImageSize(0), mFaultDescriptor(-1), mThreadStarted(false),
+	mpStaging(NULL), mMaxLoaded(0), mpProbation(NULL), mpProtected(NULL), mpState(NULL), mpPins(NULL)
+{
+	mStopPipe[0] = mStopPipe[1] = -1;
+	mMaxLoaded = (iBudgetMB * 1024 * 1024) / GZ_BLOCK;
+	if (mMaxLoaded < GZ_MIN_BLOCKS)
+		mMaxLoaded = GZ_MIN_BLOCKS;
+}
+
+CompressedCore::~CompressedCore()
+{
+	if (mThreadStarted)
+	{
+		char c = 0;
+		if (::write(mStopPipe[1], &c, 1) == 1)
+			::pthread_join(mThread, NULL);
+	}
+	if (mStopPipe[0] >= 0)
+	{
+		::close(mStopPipe[0]);
+		::close(mStopPipe[1]);
+	}
+	if (mFaultDescriptor >= 0)
+		::close(mFaultDescriptor);
+	if (mpImage)
+		::munmap(mpImage, mImageSize);
+	if (mpStaging)
+		::munmap(mpStaging, GZ_BLOCK);
+	if (mIndexDescriptor >= 0)
+		::close(mIndexDescriptor);
+	free(mpPoints);
+	gz_queue_free(mpProbation);
+	gz_queue_free(mpProtected);
+	free(mpState);
+	free(mpPins);
+}
+
+bool CompressedCore::IsCompressed(int iFileDescriptor)
+{
+	unsigned char magic[2];
+	return ::pread(iFileDescriptor, magic, 2, 0) == 2 && magic[0] == 0x1f && magic[1] == 0x8b;
+}
+
+char* CompressedCore::Map()
+{
+	struct stat lStatBuf;
+	struct uffdio_api api;
+	struct uffdio_register reg;
+	size_t num_blocks;
+	size_t page_size = ::sysconf(_SC_PAGE_SIZE);
+
+	if (::fstat(mFileDescriptor, &lStatBuf))
+		return NULL;
+	mCompressedSize = lStatBuf.st_size;
+	if (!mbCompressed)
+		mSize = mCompressedSize;
+	else if (!LoadIndex() && !BuildIndex())
+		return NULL;
+	if (mSize == 0)
+	{
+		::fprintf(stderr, "Compressed file %s is empty\n", mpFileName);
+		return NULL;
+	}
+
+	// pinned blocks may keep the queues over the budget
+	num_blocks = (mSize + GZ_BLOCK - 1) / GZ_BLOCK;
+	mpState = (unsigned char*) calloc(num_blocks, 1);
+	mpPins = (unsigned int*) calloc(num_blocks, sizeof(unsigned int));
+	mpProbation = gz_queue_new(num_blocks);
+	mpProtected = gz_queue_new(num_blocks);
+	mpStaging = (char*) ::mmap(NULL, GZ_BLOCK, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	if (!mpState || !mpPins || !mpProbation || !mpProtected || mpStaging == MAP_FAILED)
+	{
+		mpStaging = NULL;
+		::fprintf(stderr, "Failed to allocate memory for file %s\n", mpFileName);
+		return NULL;
+	}
+
+	// Reserve address space only, pages are filled by the fault handler
+	mImageSize = GZ_ALIGN(mSize, page_size);
+	mpImage = (char*) ::mmap(NULL, mImageSize, PROT_READ, MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+	if (mpImage == MAP_FAILED)
+	{
+		mpImage = NULL;
+		::fprintf(stderr, "Failed to reserve %ld bytes for file %s\n", (long)mImageSize, mpFileName);
+		return NULL;
+	}
+
+	mFaultDescriptor = ::syscall(__NR_userfaultfd, O_CLOEXEC | O_NONBLOCK);
+	// Unprivileged users may only handle faults of user mode
+	if (mFaultDescriptor < 0 && errno == EPERM)
+		mFaultDescriptor = ::syscall(__NR_userfaultfd, O_CLOEXEC | O_NONBLOCK | UFFD_USER_MODE_ONLY);
+	memset(&api, 0, sizeof(api));
+	api.api = UFFD_API;
+	memset(&reg, 0, sizeof(reg));
+	reg.range.start = (unsigned long) mpImage;
+	reg.range.len = mImageSize;
+	reg.mode = UFFDIO_REGISTER_MODE_MISSING;
+	if (mFaultDescriptor < 0
+		|| ::ioctl(mFaultDescriptor, UFFDIO_API, &api)
+		|| ::ioctl(mFaultDescriptor, UFFDIO_REGISTER, &reg)
+		|| !(reg.ioctls & ((__u64)1 << _UFFDIO_COPY)))
+	{
+		::fprintf(stderr, "Failed to set up userfaultfd for file %s, errno=%d\n", mpFileName, errno);
+		return NULL;
+	}
+
+	if (::pipe(mStopPipe) || ::pthread_create(&mThread, NULL, FaultThread, this))
+	{
+		::fprintf(stderr, "Failed to start the page fault handler of file %s\n", mpFileName);
+		return NULL;
+	}
+	mThreadStarted = true;
+
+	return mpImage;
+}
+
+bool CompressedCore::LoadIndex()
+{
+	struct stat lStatBuf;
+	struct gz_index_header hdr;
+	size_t len = strlen(mpFileName) + sizeof(GZ_INDEX_SUFFIX);
+	char* fname = (char*) malloc(len);
+	int fd;
+
+	if (!fname)
+		return false;
+	snprintf(fname, len, "%s%s", mpFileName, GZ_INDEX_SUFFIX);
+	fd = ::open(fname, O_RDONLY);
+	free(fname);
+	if (fd < 0)
+		return false;
+	if (::fstat(mFileDescriptor, &lStatBuf)
+		|| ::pread(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr)
+		|| memcmp(hdr.magic, GZ_INDEX_MAGIC, sizeof(hdr.magic))
+		|| hdr.version != GZ_INDEX_VERSION
+		|| hdr.span != GZ_SPAN
+		|| hdr.compressed_size != mCompressedSize
+		|| hdr.mtime != lStatBuf.st_mtime
+		|| hdr.num_points == 0)
+	{
+		::close(fd);
+		return false;
+	}
+	mpPoints = (struct gz_point*) malloc(hdr.num_points * sizeof(struct gz_point));
+	if (!mpPoints
+		|| ::pread(fd, mpPoints, hdr.num_points * sizeof(struct gz_point), hdr.points_offset)
+			!= (ssize_t)(hdr.num_points * sizeof(struct gz_point)))
+	{
+		free(mpPoints);
+		mpPoints = NULL;
+		::close(fd);
+		return false;
+	}
+	mNumPoints = hdr.num_points;
+	mSize = hdr.size;
+	mIndexDescriptor = fd;
+	return true;
+}
+
+/*
+ * Open the index file for writing, unless it exists and is not ours,
+ * e.g. some other tool's index which happens to have the same name
+ */
+static int gz_open_index(const char* fname)
+{
+	struct gz_index_header hdr;
+	struct stat lStatBuf;
+	int fd = ::open(fname, O_RDWR | O_CREAT, 0644);
+
+	if (fd < 0)
+		return -1;
+	if (::fstat(fd, &lStatBuf)
+		|| (lStatBuf.st_size
+			&& (::pread(fd, &hdr, sizeof(hdr.magic), 0) != sizeof(hdr.magic)
+				|| memcmp(hdr.magic, GZ_INDEX_MAGIC, sizeof(hdr.magic))))
+		|| ::ftruncate(fd, 0))
+	{
+		::close(fd);
+		return -1;
+	}
+	// claim the file before anything else, it is not complete without access points
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, GZ_INDEX_MAGIC, sizeof(hdr.magic));
+	if (::pwrite(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr))
+	{
+		::close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/*
+ * One pass of the whole stream to record an access point every GZ_SPAN
+ * bytes of output, at deflate block boundaries, along with the last 32KB
+ * of output which is the dictionary to resume from there.
+ */
+bool CompressedCore::BuildIndex()
+{
+	struct stat lStatBuf;
+	struct gz_index_header hdr;
+	z_stream strm;
+	unsigned char* input = (unsigned char*) malloc(GZ_CHUNK);
+	unsigned char* window = (unsigned char*) calloc(1, GZ_WINSIZE);
+	unsigned char* dict = (unsigned char*) malloc(GZ_WINSIZE);
+	size_t max_points = 1024;
+	unsigned long long totin = 0, totout = 0, last = 0;
+	unsigned long long window_offset = GZ_ALIGN(sizeof(hdr), 4096);
+	size_t len = strlen(mpFileName) + sizeof(GZ_INDEX_SUFFIX);
+	char* fname = (char*) malloc(len);
+	bool member_end = false;
+	bool persistent = true;
+	bool rc = false;
+	double start_time = gz_now();
+	int ret;
+
+	mpPoints = (struct gz_point*) malloc(max_points * sizeof(struct gz_point));
+	memset(&strm, 0, sizeof(strm));
+	if (!input || !window || !dict || !fname || !mpPoints || inflateInit2(&strm, 47) != Z_OK)
+	{
+		free(input);
+		free(window);
+		free(dict);
+		free(fname);
+		return false;
+	}
+
+	// Dictionaries are kept on disk, in the index file or a temporary one
+	snprintf(fname, len, "%s%s", mpFileName, GZ_INDEX_SUFFIX);
+	mIndexDescriptor = gz_open_index(fname);
+	if (mIndexDescriptor < 0)
+	{
+		FILE* fp = tmpfile();
+		if (fp)
+		{
+			mIndexDescriptor = ::dup(fileno(fp));
+			fclose(fp);
+		}
+		persistent = false;
+	}
+	if (mIndexDescriptor < 0)
+		goto out;
+
+	::printf("Indexing compressed core file %s, it is done only once ...\n", mpFileName);
+	::fflush(stdout);
+	::lseek(mFileDescriptor, 0, SEEK_SET);
+	// the 1st member starts at the beginning
+	mpPoints[0].out = 0;
+	mpPoints[0].in = 0;
+	mpPoints[0].bits = -1;
+	mpPoints[0].window = 0;
+	mNumPoints = 1;
+	strm.avail_out = 0;
+	for (;;)
+	{
+		if (strm.avail_in == 0)
+		{
+			ssize_t n = ::read(mFileDescriptor, input, GZ_CHUNK);
+			if (n < 0)
+			{
+				::fprintf(stderr, "Failed to read compressed file %s, errno=%d\n", mpFileName, errno);
+				goto out;
+			}
+			if (n == 0)
+			{
+				if (member_end)
+					break;
+				::fprintf(stderr, "Compressed file %s is truncated\n", mpFileName);
+				goto out;
+			}
+			strm.avail_in = n;
+			strm.next_in = input;
+		}
+		if (member_end)
+		{
+			// another gzip member follows
+			inflateReset(&strm);
+			member_end = false;
+			if (mNumPoints == max_points)
+			{
+				max_points *= 2;
+				mpPoints = (struct gz_point*) realloc(mpPoints, max_points * sizeof(struct gz_point));
+				if (!mpPoints)
+					goto out;
+			}
+			mpPoints[mNumPoints].out = totout;
+			mpPoints[mNumPoints].in = totin;
+			mpPoints[mNumPoints].bits = -1;
+			mpPoints[mNumPoints].window = 0;
+			mNumPoints++;
+			last = totout;
+		}
+		if (strm.avail_out == 0)
+		{
+			strm.avail_out = GZ_WINSIZE;
+			strm.next_out = window;
+		}
+		totin += strm.avail_in;
+		totout += strm.avail_out;
+		ret = inflate(&strm, Z_BLOCK);
+		totin -= strm.avail_in;
+		totout -= strm.avail_out;
+		if (ret == Z_STREAM_END)
+		{
+			member_end = true;
+			continue;
+		}
+		if (ret != Z_OK && ret != Z_BUF_ERROR)
+		{
+			// trailing garbage, e.g. zero padding, after the last member
+			if (mNumPoints > 1 && mpPoints[mNumPoints - 1].bits < 0 && mpPoints[mNumPoints - 1].out == totout)
+			{
+				mNumPoints--;
+				break;
+			}
+			::fprintf(stderr, "Compressed file %s is corrupted at offset %lld\n", mpFileName, totin);
+			goto out;
+		}
+		// at the end of a deflate block header, which isn't the last one
+		if ((strm.data_type & 128) && !(strm.data_type & 64) && totout - last > GZ_SPAN)
+		{
+			unsigned int left = strm.avail_out;
+			struct gz_point* point;
+			if (mNumPoints == max_points)
+			{
+				max_points *= 2;
+				mpPoints = (struct gz_point*) realloc(mpPoints, max_points * sizeof(struct gz_point));
+				if (!mpPoints)
+					goto out;
+			}
+			point = &mpPoints[mNumPoints++];
+			point->out = totout;
+			point->in = totin;
+			point->bits = strm.data_type & 7;
+			point->window = window_offset;
+			// the window is circular
+			if (left)
+				memcpy(dict, window + GZ_WINSIZE - left, left);
+			if (left < GZ_WINSIZE)
+				memcpy(dict + left, window, GZ_WINSIZE - left);
+			if (::pwrite(mIndexDescriptor, dict, GZ_WINSIZE, window_offset) != GZ_WINSIZE)
+			{
+				::fprintf(stderr, "Failed to write index of compressed file %s, errno=%d\n", mpFileName, errno);
+				goto out;
+			}
+			window_offset += GZ_WINSIZE;
+			last = totout;
+		}
+	}
+	mSize = totout;
+
+	// points then the header
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.version = GZ_INDEX_VERSION;
+	hdr.span = GZ_SPAN;
+	hdr.compressed_size = mCompressedSize;
+	hdr.mtime = ::fstat(mFileDescriptor, &lStatBuf) ? 0 : lStatBuf.st_mtime;
+	hdr.size = mSize;
+	hdr.num_points = mNumPoints;
+	hdr.points_offset = window_offset;
+	if (::pwrite(mIndexDescriptor, mpPoints, mNumPoints * sizeof(struct gz_point), window_offset)
+			!= (ssize_t)(mNumPoints * sizeof(struct gz_point)))
+		goto out;
+	if (persistent)
+	{
+		memcpy(hdr.magic, GZ_INDEX_MAGIC, sizeof(hdr.magic));
+		if (::pwrite(mIndexDescriptor, &hdr, sizeof(hdr), 0) != sizeof(hdr))
+			goto out;
+	}
+	::printf("%lld MB of compressed core is indexed with %ld access points in %.1f seconds%s\n",
+			(long long)(mSize >> 20), (long)mNumPoints, gz_now() - start_time,
+			persistent ? "" : " (not saved)");
+	rc = true;
+
+out:
+	inflateEnd(&strm);
+	free(input);
+	free(window);
+	free(dict);
+	if (!rc && persistent && mIndexDescriptor >= 0)
+		::unlink(fname);
+	free(fname);
+	return rc;
+}
+
+/*
+ * Inflate [iBlock * GZ_BLOCK, iBlock * GZ_BLOCK + iLen) of the uncompressed
+ * data from the nearest access point before it
+ */
+bool CompressedCore::InflateBlock(size_t iBlock, char* opBuf, size_t iLen)
+{
+	unsigned long long start = (unsigned long long) iBlock * GZ_BLOCK;
+	unsigned long long pos;
+	unsigned long long in;
+	size_t lo = 0, hi = mNumPoints;
+	size_t point_index, produced = 0;
+	unsigned char* input = (unsigned char*) malloc(GZ_CHUNK);
+	unsigned char* discard = (unsigned char*) malloc(GZ_WINSIZE);
+	z_stream strm;
+	bool rc = false;
+	int ret;
+
+	memset(&strm, 0, sizeof(strm));
+	if (!input || !discard)
+		goto out;
+
+	// the last point at or before start
+	while (hi - lo > 1)
+	{
+		size_t mid = (lo + hi) / 2;
+		if (mpPoints[mid].out <= start)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	point_index = lo;
+
+restart:
+	{
+		const struct gz_point* point = &mpPoints[point_index];
+		pos = point->out;
+		in = point->in;
+		if (point->bits < 0)
+		{
+			if (inflateInit2(&strm, 47) != Z_OK)
+				goto out;
+		}
+		else
+		{
+			unsigned char dict[GZ_WINSIZE];
+			if (inflateInit2(&strm, -15) != Z_OK)
+				goto out;
+			if (point->bits)
+			{
+				unsigned char c;
+				if (::pread(mFileDescriptor, &c, 1, in - 1) != 1)
+					goto out;
+				inflatePrime(&strm, point->bits, c >> (8 - point->bits));
+			}
+			if (::pread(mIndexDescriptor, dict, GZ_WINSIZE, point->window) != GZ_WINSIZE)
+				goto out;
+			inflateSetDictionary(&strm, dict, GZ_WINSIZE);
+		}
+	}
+
+	while (produced < iLen)
+	{
+		size_t before;
+		if (strm.avail_in == 0)
+		{
+			ssize_t n = ::pread(mFileDescriptor, input, GZ_CHUNK, in);
+			if (n <= 0)
+				goto out;
+			in += n;
+			strm.avail_in = n;
+			strm.next_in = input;
+		}
+		if (pos < start)
+		{
+			strm.next_out = discard;
+			strm.avail_out = start - pos < GZ_WINSIZE ? start - pos : GZ_WINSIZE;
+		}
+		else
+		{
+			strm.next_out = (unsigned char*) opBuf + produced;
+			strm.avail_out = iLen - produced;
+		}
+		before = strm.avail_out;
+		ret = inflate(&strm, Z_NO_FLUSH);
+		if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR)
+			goto out;
+		if (pos >= start)
+			produced += before - strm.avail_out;
+		pos += before - strm.avail_out;
+		if (ret == Z_STREAM_END && produced < iLen)
+		{
+			// resume at the next member, which is an access point by itself
+			size_t k;
+			inflateEnd(&strm);
+			memset(&strm, 0, sizeof(strm));
+			for (k = point_index + 1; k < mNumPoints && mpPoints[k].out <= pos; k++)
+			{
+				if (mpPoints[k].bits < 0 && mpPoints[k].out == pos)
+					break;
+			}
+			if (k >= mNumPoints || mpPoints[k].out != pos)
+				goto out;
+			point_index = k;
+			goto restart;
+		}
+	}
+	rc = true;
+
+out:
+	inflateEnd(&strm);
+	free(input);
+	free(discard);
+	return rc;
+}
+
+// Windowed mode reads the block as it is
+bool CompressedCore::ReadBlock(size_t iBlock, char* opBuf, size_t iLen)
+{
+	size_t done = 0;
+	while (done < iLen)
+	{
+		ssize_t n = ::pread(mFileDescriptor, opBuf + done, iLen - done, (off_t)iBlock * GZ_BLOCK + done);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return false;
+		done += n;
+	}
+	return true;
+}
+
+void CompressedCore::Pin(const char* ipAddr, size_t iLen, bool ibPin)
+{
+	size_t first, last, block;
+
+	if (iLen == 0 || ipAddr < mpImage || ipAddr + iLen > mpImage + mSize)
+		return;
+	first = (ipAddr - mpImage) / GZ_BLOCK;
+	last  = (ipAddr + iLen - 1 - mpImage) / GZ_BLOCK;
+	for (block = first; block <= last; block++)
+	{
+		if (ibPin)
+			__sync_fetch_and_add(&mpPins[block], 1);
+		else
+			__sync_fetch_and_sub(&mpPins[block], 1);
+	}
+}
+
+/*
+ * Drop the oldest unpinned block of probation, or else of protected.
+ * Pinned ones are moved to the tail of their queue.
+ * Return false if all loaded blocks are pinned.
+ */
+bool CompressedCore::EvictOne()
+{
+	size_t page_size = ::sysconf(_SC_PAGE_SIZE);
+	struct gz_queue* queues[2] = { mpProbation, mpProtected };
+	int q;
+
+	for (q = 0; q < 2; q++)
+	{
+		size_t tries = queues[q]->count;
+		while (tries-- > 0)
+		{
+			size_t victim = gz_queue_pop(queues[q]);
+			size_t victim_len;
+			if (mpPins[victim])
+			{
+				gz_queue_push(queues[q], victim);
+				continue;
+			}
+			victim_len = GZ_ALIGN(mSize - victim * GZ_BLOCK < GZ_BLOCK ? mSize - victim * GZ_BLOCK : GZ_BLOCK, page_size);
+			::madvise(mpImage + victim * GZ_BLOCK, victim_len, MADV_DONTNEED);
+			mpState[victim] = GZ_SEEN;
+			return true;
+		}
+	}
+	return false;
+}
+
+void CompressedCore::HandleFault(char* ipAddr)
+{
+	size_t page_size = ::sysconf(_SC_PAGE_SIZE);
+	size_t block = (ipAddr - mpImage) / GZ_BLOCK;
+	size_t start = block * GZ_BLOCK;
+	size_t len = mSize - start < GZ_BLOCK ? mSize - start : GZ_BLOCK;
+	size_t copy_len = GZ_ALIGN(len, page_size);
+	size_t copied = 0;
+	bool refill = false;
+
+	if (mpState[block] & GZ_LOADED)
+	{
+		char* page = (char*) ((unsigned long) ipAddr & ~(page_size - 1));
+		unsigned char resident = 0;
+		if (::mincore(page, page_size, &resident) == 0 && (resident & 0x1))
+		{
+			// another thread faulted on the block before it was filled
+			struct uffdio_range range;
+			range.start = (unsigned long) page;
+			range.len = page_size;
+			::ioctl(mFaultDescriptor, UFFDIO_WAKE, &range);
+			return;
+		}
+		// pages were dropped by the reader, fill the block again in place
+		refill = true;
+	}
+
+	// drop old blocks to stay within the budget
+	while (!refill && mpProbation->count + mpProtected->count >= mMaxLoaded)
+	{
+		if (!EvictOne())
+			break;
+	}
+
+	if (mbCompressed ? !InflateBlock(block, mpStaging, len) : !ReadBlock(block, mpStaging, len))
+	{
+		// a fault can't fail, so the reader sees zeros
+		::fprintf(stderr, "Failed to %s core file %s at offset %ld\n",
+				mbCompressed ? "inflate compressed" : "read", mpFileName, (long)start);
+		memset(mpStaging, 0, len);
+	}
+	memset(mpStaging + len, 0, copy_len - len);
+
+	while (copied < copy_len)
+	{
+		struct uffdio_copy copy;
+		copy.dst = (unsigned long) mpImage + start + copied;
+		copy.src = (unsigned long) mpStaging + copied;
+		copy.len = copy_len - copied;
+		copy.mode = 0;
+		copy.copy = 0;
+		if (::ioctl(mFaultDescriptor, UFFDIO_COPY, &copy) == 0)
+			break;
+		if (copy.copy > 0)
+			copied += copy.copy;
+		else if (errno == EEXIST)
+			copied += page_size;	// present already
+		else if (errno != EAGAIN)
+		{
+			::fprintf(stderr, "Failed to fill compressed core image, errno=%d\n", errno);
+			break;
+		}
+	}
+
+	if (refill)
+		return;
+	if (mpState[block] & GZ_SEEN)
+	{
+		mpState[block] = GZ_LOADED | GZ_PROTECTED | GZ_SEEN;
+		gz_queue_push(mpProtected, block);
+		// protected segment takes no more than half of the budget
+		if (mpProtected->count > mMaxLoaded / 2)
+		{
+			size_t demoted = gz_queue_pop(mpProtected);
+			mpState[demoted] = GZ_LOADED | GZ_SEEN;
+			gz_queue_push(mpProbation, demoted);
+		}
+	}
+	else
+	{
+		mpState[block] = GZ_LOADED;
+		gz_queue_push(mpProbation, block);
+	}
+}
+
+void CompressedCore::FaultLoop()
+{
+	struct pollfd fds[2];
+
+	fds[0].fd = mFaultDescriptor;
+	fds[0].events = POLLIN;
+	fds[1].fd = mStopPipe[0];
+	fds[1].events = POLLIN;
+	for (;;)
+	{
+		struct uffd_msg msg;
+		if (::poll(fds, 2, -1) < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		if (fds[1].revents)
+			break;
+		if (::read(mFaultDescriptor, &msg, sizeof(msg)) != sizeof(msg))
+			continue;
+		if (msg.event == UFFD_EVENT_PAGEFAULT)
+			HandleFault((char*) msg.arg.pagefault.address);
+	}
+}
+
+void* CompressedCore::FaultThread(void* ipThis)
+{
+	((CompressedCore*) ipThis)->FaultLoop();
+	return NULL;
+}
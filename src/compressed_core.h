@@ -0,0 +1,112 @@
+/************************************************************************
+** FILE NAME..... compressed_core.h
+**
+** FUNCTION......... Present a gzip-compressed core file as one
+**                   contiguous read-only memory image, as if the
+**                   uncompressed file were mmap-ed.
+**
+** NOTES............ The image is reserved address space registered
+**                   with userfaultfd. A page fault anywhere in it is
+**                   served by a handler thread, which inflates the
+**                   enclosing block from the nearest access point of
+**                   the stream. Loaded blocks are dropped to stay
+**                   within a memory budget, and fault in again when
+**                   they are touched later.
+**
+**                   Only faults are seen, hits are not, so the cache is
+**                   a segmented FIFO rather than LRU. A block faulting
+**                   in again after it was dropped is deemed hot and
+**                   goes to the protected segment, which gives up
+**                   blocks only after the probation segment is empty.
+**
+**                   Access points (offsets and 32KB dictionaries of
+**                   the deflate stream) are found by one pass over the
+**                   whole file and saved to <core>.cagzi for later runs.
+**
+**                   An uncompressed core larger than the budget may be
+**                   served the same way in windowed mode, its blocks are
+**                   read from the file instead of inflated. Either way,
+**                   blocks pinned by a scan are not dropped until they
+**                   are unpinned, the budget is exceeded if need be.
+**
+** LIMITATIONS...... Linux only, gzip (including multi-member files
+**                   like those of bgzip or pigz --independent).
+**
+************************************************************************/
+#ifndef _COMPRESSED_CORE_H
+#define _COMPRESSED_CORE_H
+
+#include <stddef.h>
+#include <pthread.h>
+
+// Uncompressed bytes between two access points of the stream
+#define GZ_SPAN (1024*1024)
+// Unit of the cache, inflated and dropped as a whole
+#define GZ_BLOCK (4*1024*1024)
+// Default memory budget of loaded blocks in MB
+#define GZ_DEFAULT_BUDGET_MB 1024
+// An access may straddle two blocks, each worker thread must be able to
+// keep two of them at the same time, or it would never make progress
+#define GZ_MIN_BLOCKS (2*64)
+
+#define GZ_INDEX_SUFFIX ".cagzi"
+
+struct gz_point;
+struct gz_queue;
+
+class CompressedCore
+{
+public:
+	CompressedCore(int iFileDescriptor, const char* ipFileName, size_t iBudgetMB, bool ibCompressed=true);
+
+	~CompressedCore();
+
+	// Check the file's magic number
+	static bool IsCompressed(int iFileDescriptor);
+
+	// Return the start of the uncompressed image, NULL on failure
+	char* Map();
+
+	size_t GetSize() { return mSize; }
+
+	// Keep blocks of [ipAddr, ipAddr+iLen) loaded, or let them go
+	// Thread safe, the range must be within the image
+	void Pin(const char* ipAddr, size_t iLen, bool ibPin);
+
+private:
+	bool LoadIndex();
+	bool BuildIndex();
+	bool InflateBlock(size_t iBlock, char* opBuf, size_t iLen);
+	bool ReadBlock(size_t iBlock, char* opBuf, size_t iLen);
+	bool EvictOne();
+	void HandleFault(char* ipAddr);
+	void FaultLoop();
+	static void* FaultThread(void* ipThis);
+
+	const char* mpFileName;
+	int     mFileDescriptor;	// the compressed file
+	int     mIndexDescriptor;	// the access points and their dictionaries
+	size_t  mCompressedSize;
+	size_t  mSize;				// uncompressed
+	bool    mbCompressed;		// false in windowed mode
+
+	struct gz_point* mpPoints;
+	size_t  mNumPoints;
+
+	char*   mpImage;
+	size_t  mImageSize;			// page aligned
+	int     mFaultDescriptor;	// userfaultfd
+	int     mStopPipe[2];
+	pthread_t mThread;
+	bool    mThreadStarted;
+
+	// loaded blocks of both segments in the order they are loaded
+	char*   mpStaging;
+	size_t  mMaxLoaded;
+	struct gz_queue* mpProbation;
+	struct gz_queue* mpProtected;
+	unsigned char* mpState;
+	unsigned int*  mpPins;	// pin count of each block
+};
+
+#endif // _COMPRESSED_CORE_H
@@ -9,6 +9,8 @@
 #include "segment.h"
 #include "stl_container.h"
 #include "search.h"
+#include "index_set.h"
+#include "parallel.h"
 
 // Used to search for variables that allocate/reach the most heap memory
 struct heap_owner
@@ -18,32 +20,108 @@ struct heap_owner
 	unsigned long aggr_count;
 };
 
+/*
+ * FIFO of blocks found but not processed yet
+ * 	a block enters it at most once since it is marked visited at the same time
+ */
+struct block_worklist
+{
+	unsigned long* queue;
+	unsigned long  head;
+	unsigned long  tail;
+};
+
+/*
+ * Flow graph of the dominator tree
+ * 	nodes [0, N) are the in-use blocks, [N, N+R) are their owners, i.e. registers
+ * 	and variables which reference heap, and N+R is the super root of all owners
+ */
+struct dom_graph
+{
+	struct inuse_block_table* blocks;
+	unsigned long  num_roots;
+	unsigned long  roots_capacity;
+	struct object_reference* roots;
+	// blocks referenced by owner r are root_edges[root_offsets[r], root_offsets[r+1])
+	size_t*        root_offsets;
+	unsigned long* root_edges;
+	size_t         num_root_edges;
+	size_t         root_edges_capacity;
+	// owner that is replaced by the queried one
+	const struct object_reference* exclude;
+	size_t         exclude_len;
+	struct inuse_ptr_batch batch;
+	CA_BOOL        failed;
+};
+
+/*
+ * Nodes reachable from the super root, which is the last one in postorder,
+ * are identified by their postorder numbers
+ */
+struct dom_tree
+{
+	unsigned long  num_reachable;
+	unsigned long* post;		// postorder number of a node, DOM_NONE if unreachable
+	unsigned long* idom;		// immediate dominator
+	size_t*        retained_sizes;	// sum of the dominated subtree
+	unsigned long* retained_counts;
+};
+
+#define DOM_NONE    ((unsigned long)-1)
+#define DOM_PENDING ((unsigned long)-2)
+
 #define LINE_BUF_SZ 1024
 
+// Number of candidate pointers classified at once
+#define INUSE_PTR_BATCH 1024
+
+// Memory of exact reachable sets alive at once, and blocks sampled by an estimate
+#define REACH_SET_BUDGET (1024UL*1024*1024)
+#define REACH_SKETCH_K   256
+
 // Forward declaration
 static CA_BOOL
-mark_blocks_referenced_by_globals_locals(struct inuse_block*, unsigned long, unsigned int*);
+mark_blocks_referenced_by_globals_locals(struct inuse_block_table*, unsigned int*, struct block_worklist*);
 
 static void
 display_histogram(const char*, unsigned int,
 				const size_t*, const unsigned long*, const size_t*);
 
-static unsigned long
-get_next_queued_index(unsigned int*, unsigned long, unsigned long);
-
 static void add_owner(struct heap_owner*, unsigned int, struct heap_owner*);
 
 static size_t
-heap_aggregate_size(struct inuse_block*, struct inuse_block*, unsigned long, unsigned int*,	unsigned long*);
+heap_aggregate_size(unsigned long, struct inuse_block_table*, unsigned int*, unsigned long*);
 
-static CA_BOOL
-build_block_index_map(struct inuse_block*, struct inuse_block*, unsigned long);
+struct heap_traverse_stat;
+
+static size_t
+traverse_block_worklist(struct inuse_block_table*, unsigned int*, struct block_worklist*, unsigned long*,
+				struct heap_traverse_stat*);
+
+static unsigned long*
+build_block_index_map(unsigned long, struct inuse_block_table*, unsigned long*);
+
+static CA_BOOL build_heap_ref_graph(struct inuse_block_table*);
+
+static CA_BOOL parallel_mark_heap_blocks(struct inuse_block_table*, unsigned int*);
+
+static unsigned long
+read_inuse_ptr_batch(struct ca_segment*, address_t, address_t, struct inuse_ptr_batch*);
+
+static CA_BOOL init_dom_graph(struct dom_graph*, struct inuse_block_table*);
+static void release_dom_graph(struct dom_graph*);
+static void add_dom_root(void*, struct object_reference*, size_t);
+static CA_BOOL build_dom_tree(struct dom_graph*, struct dom_tree*);
+static void release_dom_tree(struct dom_tree*);
+static void rank_retained_owners(struct dom_graph*, struct dom_tree*, struct heap_owner*, unsigned int);
+
+static CA_BOOL fill_reachable_sizes(struct inuse_block_table*, CA_BOOL);
+static void reset_reachable_sizes(struct inuse_block_table*);
 
 // Global Vars
 static struct MemHistogram g_mem_hist;
 
-static struct inuse_block *g_inuse_blocks = NULL;
-static unsigned long       g_num_inuse_blocks = 0;
+static struct inuse_block_table g_inuse_table;
 
 char ca_help_msg[] = "Commands of core_analyzer "CA_VERSION_STRING"\n"
 		"   ref <addr_exp>\n"
@@ -65,11 +143,14 @@ char ca_help_msg[] = "Commands of core_analyzer "CA_VERSION_STRING"\n"
         "   heap [/block or /b] [/cluster or /c] <addr_exp>\n"
 		"           option [/block] displays information about the memory block containing the given address\n"
 		"           option [/cluster] displays a cluster of memory blocks surrounding the given address\n"
-        "   heap [/usage or /u] <var_exp>\n"
+        "   heap [/usage or /u] [/retained or /r] <var_exp>\n"
 		"           option [/usage] calculates heap memory consumption by input variable or memory object\n"
-        "   heap [/topblock or /tb] [/topuser or /tu] <num>\n"
-		"           option [/topblock] lists biggest <num> heap memory blocks\n"
+		"           option [/retained] also calculates the heap memory it retains, which examines all variables\n"
+        "   heap [/topblock or /tb] [/topuser or /tu] [/retained or /r] [/estimate or /e] <num> [file]\n"
+		"           option [/topblock] lists biggest <num> heap memory blocks, or saves them sorted by size in [file]\n"
 		"           option [/topuser] lists the top <num> local/global variables that consume the most heap memory\n"
+		"           option [/retained] ranks them by the heap memory they retain, i.e. that is freed with them\n"
+		"           option [/estimate] ranks them by the heap memory they reach, estimated from samples of blocks\n"
         //"   heap [/fragmentation or /f]\n"
 		"\n"
 		"   segment [addr_exp]\n"
@@ -85,6 +166,11 @@ char ca_help_msg[] = "Commands of core_analyzer "CA_VERSION_STRING"\n"
 		"\n"
 		"   shrobj_level [n]   - Set/Show the indirection level of shared-object search\n"
 		"   max_indirection_level [n] - Set/Show the maximum levels of indirection\n"
+		"   ca_threads [n]     - Set/Show the number of threads to scan the core file\n"
+		"   ref_index [on|off] - Build/Release/Show the reverse pointer index of the core file\n"
+		"   eager_bitvec [on|off] - Build pointer bit vectors of all segments upfront in parallel, or on demand\n"
+		"   prefetch [on|off|drop] - Read core data ahead of scans, and optionally drop scanned pages from memory\n"
+		"   index_cache [load|save] - Load/Save indexes derived from the core file in a sidecar file <core>.caidx\n"
 		"   set/assign <addr> <val>   - Set a pseudo value at address\n"
 		"   unset/unassign <addr>     - Undo the pseudo value at address\n";
 
@@ -104,6 +190,8 @@ CA_BOOL heap_command_impl(char* args)
 	CA_BOOL top_block = CA_FALSE;
 	CA_BOOL top_user = CA_FALSE;
 	CA_BOOL all_reachable_blocks = CA_FALSE;	// experimental option
+	CA_BOOL retained = CA_FALSE;
+	CA_BOOL estimate = CA_FALSE;
 	char* expr = NULL;
 
 	// Parse user input options
@@ -178,6 +266,10 @@ CA_BOOL heap_command_impl(char* args)
 				}
 				else if (strcmp(option, "/all") == 0 || strcmp(option, "/a") == 0)
 					all_reachable_blocks = CA_TRUE;
+				else if (strcmp(option, "/retained") == 0 || strcmp(option, "/r") == 0)
+					retained = CA_TRUE;
+				else if (strcmp(option, "/estimate") == 0 || strcmp(option, "/e") == 0)
+					all_reachable_blocks = estimate = CA_TRUE;
 				else
 				{
 					CA_PRINT("Invalid option: [%s]\n", option);
@@ -191,6 +283,8 @@ CA_BOOL heap_command_impl(char* args)
 			}
 			else if (addr == 0)
 				addr = ca_eval_address (option);
+			else if (top_block && !expr)
+				expr = option;	// file to save the biggest blocks
 			else
 			{
 				CA_PRINT("Invalid option: [%s]\n", option);
@@ -239,7 +333,7 @@ CA_BOOL heap_command_impl(char* args)
 	else if (calc_usage)
 	{
 		if (expr)
-			calc_heap_usage(expr);
+			calc_heap_usage(expr, retained);
 		else
 			CA_PRINT("An expression of heap memory owner is expected\n");
 	}
@@ -249,9 +343,9 @@ CA_BOOL heap_command_impl(char* args)
 		if (n == 0)
 			CA_PRINT("A number is expected\n");
 		else if (top_user)
-			biggest_heap_owners_generic(n, all_reachable_blocks);
+			biggest_heap_owners_generic(n, all_reachable_blocks, retained, estimate);
 		else
-			biggest_blocks(n);
+			biggest_blocks(n, expr);
 	}
 	else
 	{
@@ -517,41 +611,186 @@ CA_BOOL pattern_command_impl(char* args)
 }
 
 /*
- * Return an array of struct inuse_block, of all in-use blocks
- * 	the array is cached for repeated usage unless a live process has changed
+ * Page index of the in-use block table
+ * 	Blocks are grouped into spans at big address gaps. Each page of a span
+ * 	records the first block ending above the page start, hence the block that
+ * 	contains an address is found between the records of its page and the next
+ */
+struct inuse_page_span
+{
+	address_t     start;		// start of the first block
+	address_t     end;			// end of the last block
+	address_t     base;			// start aligned to page
+	unsigned long first_block;
+	unsigned long end_block;
+	unsigned long first_page;	// offset into page_first[]
+	unsigned int  page_shift;
+};
+
+#define INUSE_PAGE_SHIFT 12
+#define INUSE_SPAN_GAP   (1024*1024)
+
+// Pages of a span, plus one record as the upper bound of the last page
+static unsigned long
+span_page_records(const struct inuse_block_table* table, const struct inuse_page_span* span, unsigned int shift)
+{
+	address_t start = table->addrs[span->first_block] & ~(((address_t)1 << shift) - 1);
+	return ((span->end - 1 - start) >> shift) + 2;
+}
+
+static CA_BOOL build_inuse_page_index(struct inuse_block_table* table)
+{
+	unsigned long i, num_spans, total_pages;
+
+	// block indexes are recorded in 32 bits, like the index maps
+	if (table->count == 0 || table->count >= UINT_MAX)
+		return CA_TRUE;
+
+	// spans are split at big gaps, e.g. between arenas or mmap-ed blocks
+	num_spans = 1;
+	for (i = 1; i < table->count; i++)
+	{
+		if (table->addrs[i] - (table->addrs[i-1] + table->sizes[i-1]) > INUSE_SPAN_GAP)
+			num_spans++;
+	}
+	table->spans = (struct inuse_page_span*) malloc(num_spans * sizeof(struct inuse_page_span));
+	if (!table->spans)
+		return CA_FALSE;
+	table->num_spans = num_spans;
+	num_spans = 0;
+	for (i = 0; i < table->count; i++)
+	{
+		if (i == 0 || table->addrs[i] - (table->addrs[i-1] + table->sizes[i-1]) > INUSE_SPAN_GAP)
+		{
+			if (i > 0)
+				table->spans[num_spans - 1].end_block = i;
+			table->spans[num_spans].first_block = i;
+			num_spans++;
+		}
+		table->spans[num_spans - 1].end = table->addrs[i] + table->sizes[i];
+	}
+	table->spans[num_spans - 1].end_block = table->count;
+
+	// a span of few huge blocks uses coarse pages, its index is no bigger than its blocks
+	total_pages = 0;
+	for (i = 0; i < table->num_spans; i++)
+	{
+		struct inuse_page_span* span = &table->spans[i];
+		unsigned long limit = 2 * (span->end_block - span->first_block) + 16;
+		unsigned int shift = INUSE_PAGE_SHIFT;
+
+		while (span_page_records(table, span, shift) > limit)
+			shift++;
+		span->page_shift = shift;
+		span->start = table->addrs[span->first_block];
+		span->base = span->start & ~(((address_t)1 << shift) - 1);
+		span->first_page = total_pages;
+		total_pages += span_page_records(table, span, shift);
+	}
+	table->page_first = (unsigned int*) malloc(total_pages * sizeof(unsigned int));
+	if (!table->page_first)
+	{
+		free(table->spans);
+		table->spans = NULL;
+		table->num_spans = 0;
+		return CA_FALSE;
+	}
+
+	for (i = 0; i < table->num_spans; i++)
+	{
+		struct inuse_page_span* span = &table->spans[i];
+		unsigned int* pages = &table->page_first[span->first_page];
+		unsigned long blk_index = span->first_block;
+		unsigned long npages = span_page_records(table, span, span->page_shift);
+		unsigned long p;
+
+		for (p = 0; p < npages; p++)
+		{
+			address_t page_start = span->base + ((address_t)p << span->page_shift);
+			while (blk_index < span->end_block
+				&& table->addrs[blk_index] + table->sizes[blk_index] <= page_start)
+				blk_index++;
+			pages[p] = (unsigned int) blk_index;
+		}
+	}
+	return CA_TRUE;
+}
+
+static void release_inuse_block_table(struct inuse_block_table* table)
+{
+	if (table->edge_offsets)
+		free(table->edge_offsets);
+	if (table->edges)
+		free(table->edges);
+	if (table->addrs)
+		free(table->addrs);
+	if (table->sizes)
+		free(table->sizes);
+	if (table->aggr_sizes)
+		free(table->aggr_sizes);
+	if (table->aggr_counts)
+		free(table->aggr_counts);
+	if (table->spans)
+		free(table->spans);
+	if (table->page_first)
+		free(table->page_first);
+	memset(table, 0, sizeof(struct inuse_block_table));
+}
+
+/*
+ * Split the array of in-use blocks into the columns of the table
+ */
+static CA_BOOL
+fill_inuse_block_table(struct inuse_block_table* table, const struct inuse_block* blocks, unsigned long count)
+{
+	unsigned long i;
+
+	memset(table, 0, sizeof(struct inuse_block_table));
+	table->addrs = (address_t*) malloc(count * sizeof(address_t));
+	table->sizes = (size_t*) malloc(count * sizeof(size_t));
+	table->aggr_sizes = (size_t*) calloc(count, sizeof(size_t));
+	table->aggr_counts = (unsigned long*) calloc(count, sizeof(unsigned long));
+	if (!table->addrs || !table->sizes || !table->aggr_sizes || !table->aggr_counts)
+	{
+		release_inuse_block_table(table);
+		return CA_FALSE;
+	}
+	table->count = count;
+	for (i = 0; i < count; i++)
+	{
+		table->addrs[i] = blocks[i].addr;
+		table->sizes[i] = blocks[i].size;
+	}
+	// lookup falls back to binary search over all blocks without the page index
+	if (!build_inuse_page_index(table))
+		CA_PRINT("Out of Memory: in-use blocks are not indexed by page\n");
+	return CA_TRUE;
+}
+
+/*
+ * Return the table of all in-use blocks
+ * 	the table is cached for repeated usage unless a live process has changed
  */
-struct inuse_block* build_inuse_heap_blocks(unsigned long* opCount)
+struct inuse_block_table* build_inuse_heap_blocks(void)
 {
 	struct inuse_block* blocks = NULL;
 	unsigned long total_inuse = 0;
+	unsigned long count = 0;
 
-	if (g_inuse_blocks && g_num_inuse_blocks)
+	if (g_inuse_table.count)
 	{
 		if (g_debug_core)
-		{
-			*opCount = g_num_inuse_blocks;
-			return g_inuse_blocks;
-		}
+			return &g_inuse_table;
 		else
 		{
 			// FIXME
 			// Even for a live process, return here if it hasn't change since last time
-			unsigned long i;
-			for (i = 0; i < g_num_inuse_blocks; i++)
-			{
-				if (g_inuse_blocks[i].reachable.index_map)
-				{
-					free(g_inuse_blocks[i].reachable.index_map);
-					g_inuse_blocks[i].reachable.index_map = (unsigned int*)0xdeadbeefdeadbeef;
-				}
-			}
-			free(g_inuse_blocks);
-			g_num_inuse_blocks = 0;
+			release_inuse_block_table(&g_inuse_table);
 		}
 	}
 
-	*opCount = 0;
 	// 1st walk counts the number of in-use blocks
+	// it is cheap if the allocator has indexed them, e.g. ptmalloc
 	if (walk_inuse_blocks(NULL, &total_inuse) && total_inuse)
 	{
 		// allocate memory for inuse_block array
@@ -562,17 +801,15 @@ struct inuse_block* build_inuse_heap_blocks(unsigned long* opCount)
 			return NULL;
 		}
 		// 2nd walk populate the array for in-use block info
-		if (!walk_inuse_blocks(blocks, opCount) || *opCount != total_inuse)
+		if (!walk_inuse_blocks(blocks, &count) || count != total_inuse)
 		{
 			CA_PRINT("Unexpected error while walking in-use blocks\n");
-			*opCount = 0;
 			free (blocks);
 			return NULL;
 		}
 		// sanity check whether the array is sorted by address, as required.
 		if (total_inuse >= 2)
 		{
-			unsigned long count;
 			struct inuse_block* cursor;
 			for (count = 0, cursor = blocks; count < total_inuse - 1; count++, cursor++)
 			{
@@ -582,24 +819,92 @@ struct inuse_block* build_inuse_heap_blocks(unsigned long* opCount)
 					CA_PRINT("\t[%ld] "PRINT_FORMAT_POINTER" size=%ld\n", count, cursor->addr, cursor->size);
 					CA_PRINT("\t[%ld] "PRINT_FORMAT_POINTER"\n", count+1, (cursor+1)->addr);
 					free (blocks);
-					*opCount = 0;
 					return NULL;
 				}
 			}
 		}
+		// cache the data
+		if (!fill_inuse_block_table(&g_inuse_table, blocks, total_inuse))
+			CA_PRINT("Failed: Out of Memory\n");
+		free (blocks);
 	}
-	// cache the data
-	g_inuse_blocks = blocks;
-	g_num_inuse_blocks = total_inuse;
 
-	return blocks;
+	return g_inuse_table.count ? &g_inuse_table : NULL;
+}
+
+/*
+ * Take over an array of in-use blocks, e.g. from the index cache
+ */
+void adopt_inuse_heap_blocks(struct inuse_block* blocks, unsigned long count)
+{
+	release_inuse_block_table(&g_inuse_table);
+	if (count && !fill_inuse_block_table(&g_inuse_table, blocks, count))
+		CA_PRINT("Failed: Out of Memory\n");
+	free(blocks);
 }
 
-void free_inuse_heap_blocks(struct inuse_block *blocks, unsigned long num)
+void free_inuse_heap_blocks(struct inuse_block_table *blocks)
 {
 	// No op
 }
 
+/*
+ * Edges of the reference graph are encoded as the zigzag varint of the delta
+ * 	from the previous edge, the first one from the block itself
+ */
+#define MAX_EDGE_BYTES 10
+
+static size_t encode_ref_edge(unsigned char* buf, unsigned long prev, unsigned long index)
+{
+	unsigned long delta = index - prev;
+	unsigned long zz = (delta << 1) ^ (0UL - (delta >> (sizeof(unsigned long) * 8 - 1)));
+	size_t len = 0;
+
+	while (zz >= 0x80)
+	{
+		buf[len++] = (unsigned char)(zz | 0x80);
+		zz >>= 7;
+	}
+	buf[len++] = (unsigned char) zz;
+	return len;
+}
+
+/*
+ * Cursor over the outgoing edges of one block
+ */
+struct ref_edge_cursor
+{
+	const unsigned char* pos;
+	const unsigned char* end;
+	unsigned long        prev;
+};
+
+static inline void
+init_ref_edge_cursor(struct ref_edge_cursor* it, const struct inuse_block_table* table, unsigned long blk_index)
+{
+	it->pos  = table->edges + table->edge_offsets[blk_index];
+	it->end  = table->edges + table->edge_offsets[blk_index + 1];
+	it->prev = blk_index;
+}
+
+static inline CA_BOOL next_ref_edge(struct ref_edge_cursor* it, unsigned long* index)
+{
+	unsigned long zz = 0;
+	unsigned int shift = 0;
+
+	if (it->pos >= it->end)
+		return CA_FALSE;
+	while (*it->pos & 0x80)
+	{
+		zz |= (unsigned long)(*it->pos++ & 0x7f) << shift;
+		shift += 7;
+	}
+	zz |= (unsigned long)(*it->pos++) << shift;
+	it->prev += (zz >> 1) ^ (0UL - (zz & 1));
+	*index = it->prev;
+	return CA_TRUE;
+}
+
 /*
  * Bitmap for in-use blocks is used
  *   Each block uses two bits(queued/visited)
@@ -645,6 +950,57 @@ static inline unsigned int is_queued(unsigned int* bitmap, unsigned long index)
 #define is_visited(bitmap,index)   (bitmap[(index) >> 4] & (VISITED << (((index) & 0xf) << 1)))
 #define set_queued_and_visited(bitmap,index)   bitmap[(index) >> 4] |= ((QUEUED | VISITED) << (((index) & 0xf) << 1))
 
+/*
+ * Work done by traversals of the reference graph, each edge probes one bitmap word
+ */
+struct heap_traverse_stat
+{
+	unsigned long blocks_processed;
+	unsigned long bitmap_words_scanned;
+};
+
+static struct heap_traverse_stat g_traverse_stat;
+
+static inline void
+push_unvisited_block(unsigned int* bitmap, struct block_worklist* wl, unsigned long index,
+					struct heap_traverse_stat* stat)
+{
+	stat->bitmap_words_scanned++;
+	if (!is_queued_or_visited(bitmap, index))
+	{
+		set_visited(bitmap, index);
+		wl->queue[wl->tail++] = index;
+	}
+}
+
+/*
+ * Pointer mapped from the core file, which is read by workers without the debugger
+ */
+static inline address_t load_core_ptr(const char* p, size_t ptr_sz)
+{
+	address_t value;
+
+	if (ptr_sz == 8)
+	{
+#ifdef sun
+		// sparcv9 core aligns on 4-byte only
+		if ((address_t)p & 0x7ul)
+			memcpy(&value, p, 8);
+		else
+#endif
+			value = *(address_t*)p;
+	}
+	else
+		value = *(unsigned int*)p;
+	return value;
+}
+
+static void print_traverse_stat(void)
+{
+	CA_PRINT("Traversal: %ld blocks processed, %ld bitmap words scanned\n",
+			g_traverse_stat.blocks_processed, g_traverse_stat.bitmap_words_scanned);
+}
+
 static const size_t GB = 1024*1024*1024;
 static const size_t MB = 1024*1024;
 static const size_t KB = 1024;
@@ -674,35 +1030,113 @@ static void fprint_size(char* buf, size_t sz)
 		sprintf(buf, PRINT_FORMAT_SIZE, sz);
 }
 
-// Find the top n memory blocks in term of size
-CA_BOOL biggest_blocks(unsigned int num)
+/*
+ * Selection of the biggest blocks
+ *   The first count blocks of blks[] form a min-heap by size, the root is the
+ *   smallest selected block and is replaced if a bigger one comes along
+ */
+static void sift_down_big_blocks(struct heap_block* blks, unsigned int count, unsigned int i)
+{
+	struct heap_block blk = blks[i];
+
+	while (2 * i + 1 < count)
+	{
+		unsigned int child = 2 * i + 1;
+		if (child + 1 < count && blks[child + 1].size < blks[child].size)
+			child++;
+		if (blks[child].size >= blk.size)
+			break;
+		blks[i] = blks[child];
+		i = child;
+	}
+	blks[i] = blk;
+}
+
+void add_big_block_candidate(struct heap_block* blks, unsigned int num, unsigned int* count, const struct heap_block* blk)
+{
+	unsigned int i;
+
+	if (*count < num)
+	{
+		// sift up
+		i = (*count)++;
+		while (i > 0 && blks[(i - 1) / 2].size > blk->size)
+		{
+			blks[i] = blks[(i - 1) / 2];
+			i = (i - 1) / 2;
+		}
+		blks[i] = *blk;
+	}
+	else if (num > 0 && blk->size > blks[0].size)
+	{
+		blks[0] = *blk;
+		sift_down_big_blocks(blks, num, 0);
+	}
+}
+
+/*
+ * Heap sort the selected blocks in place, the biggest first
+ */
+void sort_big_blocks(struct heap_block* blks, unsigned int count)
+{
+	while (count > 1)
+	{
+		struct heap_block smallest = blks[0];
+		blks[0] = blks[--count];
+		sift_down_big_blocks(blks, count, 0);
+		blks[count] = smallest;
+	}
+}
+
+// Find the top n memory blocks in term of size, save them in a file if it is given
+CA_BOOL biggest_blocks(unsigned int num, const char* fname)
 {
 	CA_BOOL rc = CA_TRUE;
 	struct heap_block* blocks;
+	unsigned int i, count;
 
 	if (num == 0)
 		return CA_TRUE;
-	else if (num > 1024 * 1024)
-	{
-		CA_PRINT("The number %d is too big, I am not sure I can do it\n", num);
-		return CA_FALSE;
-	}
 
 	blocks = (struct heap_block*) calloc (num, sizeof(struct heap_block));
 	if (!blocks)
+	{
+		CA_PRINT("Failed to allocate memory for %d blocks\n", num);
 		return CA_FALSE;
+	}
 
 	if (get_biggest_blocks (blocks, num))
 	{
-		unsigned int i;
-		// display big blocks
-		CA_PRINT("Top %d biggest in-use heap memory blocks:\n", num);
-		for (i=0; i<num; i++)
+		// fewer blocks than requested are zero-filled
+		for (count = 0; count < num && blocks[count].size > 0; count++)
+			;
+		if (fname)
 		{
-			CA_PRINT("\taddr="PRINT_FORMAT_POINTER"  size="PRINT_FORMAT_SIZE" (",
-					blocks[i].addr, blocks[i].size);
-			print_size (blocks[i].size);
-			CA_PRINT(")\n");
+			FILE* fp = fopen(fname, "w");
+			if (fp)
+			{
+				for (i=0; i<count; i++)
+					fprintf(fp, PRINT_FORMAT_POINTER" "PRINT_FORMAT_SIZE"\n", blocks[i].addr, blocks[i].size);
+				fclose(fp);
+				CA_PRINT("Top %d biggest in-use heap memory blocks are saved in %s\n", count, fname);
+			}
+			else
+			{
+				CA_PRINT("Failed to open file %s\n", fname);
+				rc = CA_FALSE;
+			}
+		}
+		else
+		{
+			// display big blocks
+			CA_PRINT("Top %d biggest in-use heap memory blocks:\n", num);
+			for (i=0; i<num; i++)
+			{
+				CA_PRINT("\taddr="PRINT_FORMAT_POINTER"  size="PRINT_FORMAT_SIZE" (",
+						blocks[i].addr, blocks[i].size);
+				print_size (blocks[i].size);
+				CA_PRINT(")\n");
+			}
 		}
 	}
 	else
@@ -715,1005 +1149,3341 @@ CA_BOOL biggest_blocks(unsigned int num)
 }
 
 /*
- * Find/display global/local variables which own the most heap memory in bytes
+ * Candidate owners of heap memory of a segment
+ * 	registers of a thread holding heap pointers, and variables or raw pointers
+ * 	of the thread's stack above the stack pointer, or of a module's .data
  */
-CA_BOOL biggest_heap_owners_generic(unsigned int num, CA_BOOL all_reachable_blocks)
-{
-	CA_BOOL rc = CA_FALSE;
-	unsigned int i;
-	int nregs = 0;
-	struct reg_value *regs_buf = NULL;
-	size_t ptr_sz = g_ptr_bit >> 3;
-	struct heap_owner *owners;
-	struct heap_owner *smallest;
-
-	struct ca_segment *segment;
-	size_t total_bytes = 0;
-	size_t processed_bytes = 0;
+typedef void (*heap_owner_func)(void* arg, struct object_reference* ref, size_t var_len);
 
-	struct inuse_block *inuse_blocks = NULL;
-	unsigned long num_inuse_blocks;
-	unsigned long inuse_index;
+/*
+ * Memory region of a segment searched for owners
+ */
+static CA_BOOL
+get_owner_range(struct ca_segment* segment, address_t* start, address_t* end)
+{
+	if (segment->m_type == ENUM_STACK)
+	{
+		*start = get_rsp(segment);
+		if (*start < segment->m_vaddr || *start >= segment->m_vaddr + segment->m_vsize)
+			*start = segment->m_vaddr;
+		if (*start - segment->m_vaddr >= segment->m_fsize)
+			*end = *start;
+		else
+			*end = segment->m_vaddr + segment->m_fsize;
+	}
+	else if (segment->m_type == ENUM_MODULE_DATA)
+	{
+		*start = segment->m_vaddr;
+		*end = segment->m_vaddr + segment->m_fsize;
+	}
+	else
+		return CA_FALSE;
+	return CA_TRUE;
+}
 
-	struct inuse_block *blk;
+static void
+enum_segment_heap_owners(struct ca_segment* segment,
+						struct inuse_block_table* inuse_blocks,
+						struct reg_value* regs_buf,
+						int nregs,
+						heap_owner_func func,
+						void* arg)
+{
+	size_t ptr_sz = g_ptr_bit >> 3;
 	struct object_reference ref;
-	size_t aggr_size;
-	unsigned long aggr_count;
 	address_t start, end, cursor;
+	int tid = 0;
 
-	// Allocate an array for the biggest num of owners
-	if (num == 0)
-		return CA_FALSE;
-	owners = (struct heap_owner *) calloc(num, sizeof(struct heap_owner));
-	if (!owners)
-		goto clean_out;
-	smallest = &owners[num - 1];
-
-	// First, create and populate an array of all in-use blocks
-	inuse_blocks = build_inuse_heap_blocks(&num_inuse_blocks);
-	if (!inuse_blocks || num_inuse_blocks == 0)
+	// check registers if it is a thread's stack segment
+	if (segment->m_type == ENUM_STACK)
 	{
-		CA_PRINT("Failed: no in-use heap block is found\n");
-		goto clean_out;
+		tid = get_thread_id (segment);
+		// check each register for heap reference
+		if (nregs && regs_buf)
+		{
+			int k;
+			int nread = read_registers (segment, regs_buf, nregs);
+			for (k = 0; k < nread; k++)
+			{
+				if (regs_buf[k].reg_width == ptr_sz)
+				{
+					unsigned long blk = find_inuse_block(regs_buf[k].value, inuse_blocks);
+					if (blk != INUSE_BLOCK_NONE)
+					{
+						ref.storage_type = ENUM_REGISTER;
+						ref.vaddr = 0;
+						ref.value = inuse_blocks->addrs[blk];
+						ref.where.reg.tid = tid;
+						ref.where.reg.reg_num = k;
+						ref.where.reg.name = NULL;
+						func(arg, &ref, ptr_sz);
+					}
+				}
+			}
+		}
 	}
 
-	// estimate the work to enable progress bar
-	for (i=0; i<g_segment_count; i++)
-	{
-		segment = &g_segments[i];
-		if (segment->m_type == ENUM_STACK || segment->m_type == ENUM_MODULE_DATA)
-			total_bytes += segment->m_fsize;
-	}
-	init_progress_bar(total_bytes);
+	// Calculate the memory region to search
+	if (!get_owner_range(segment, &start, &end))
+		return;
 
-	// Walk through all segments of threads' registers/stacks or globals
-	for (i=0; i<g_segment_count; i++)
+	// Evaluate each variable or raw pointer in the target memory region
+	cursor = ALIGN(start, ptr_sz);
+	while (cursor < end)
 	{
-		// bail out if user is impatient for the long searching
-		if (user_request_break())
+		size_t val_len = ptr_sz;
+		address_t sym_addr;
+		size_t    sym_sz;
+		CA_BOOL known_sym = CA_FALSE;
+
+		// If the address belongs to a known variable, include all its subfields
+		// FIXME
+		// consider subfields that are of pointer-like types, however, it will miss
+		// references in an unstructured buffer
+		ref.storage_type = segment->m_type;
+		ref.vaddr = cursor;
+		ref.value = 0;
+		if (segment->m_type == ENUM_STACK)
 		{
-			CA_PRINT("Abort searching biggest heap memory owners\n");
-			goto clean_out;
+			ref.where.stack.tid = tid;
+			ref.where.stack.frame = get_frame_number(segment, cursor, &ref.where.stack.offset);
+			if (known_stack_sym(&ref, &sym_addr, &sym_sz) && sym_sz)
+				known_sym = CA_TRUE;
 		}
-
-		// Only thread stack and global .data sections are considered
+		else if (segment->m_type == ENUM_MODULE_DATA)
+		{
+			ref.where.module.base = segment->m_vaddr;
+			ref.where.module.size = segment->m_vsize;
+			ref.where.module.name = segment->m_module_name;
+			if (known_global_sym(&ref, &sym_addr, &sym_sz) && sym_sz)
+				known_sym = CA_TRUE;
+		}
+		if (known_sym)
+		{
+			if (cursor != sym_addr)
+				ref.vaddr = cursor = sym_addr;	// we should never come to here!
+			val_len = sym_sz;
+		}
+
+		// a variable smaller than a pointer is passed too, for it is skipped
+		func(arg, &ref, val_len);
+		cursor = ALIGN(cursor + val_len, ptr_sz);
+	}
+}
+
+/*
+ * Walk through all segments of threads' registers/stacks or globals
+ * Return false if user breaks the long walk
+ */
+static CA_BOOL
+walk_heap_owners(struct inuse_block_table* inuse_blocks, heap_owner_func func, void* arg)
+{
+	CA_BOOL rc = CA_TRUE;
+	unsigned int i;
+	int nregs = 0;
+	struct reg_value *regs_buf = NULL;
+	struct ca_segment *segment;
+	size_t total_bytes = 0;
+	size_t processed_bytes = 0;
+
+	// estimate the work to enable progress bar
+	for (i=0; i<g_segment_count; i++)
+	{
+		segment = &g_segments[i];
+		if (segment->m_type == ENUM_STACK || segment->m_type == ENUM_MODULE_DATA)
+			total_bytes += segment->m_fsize;
+	}
+	init_progress_bar(total_bytes);
+
+	for (i=0; i<g_segment_count; i++)
+	{
+		// bail out if user is impatient for the long searching
+		if (user_request_break())
+		{
+			CA_PRINT("Abort searching biggest heap memory owners\n");
+			rc = CA_FALSE;
+			break;
+		}
+
+		// Only thread stack and global .data sections are considered
 		segment = &g_segments[i];
 		if (segment->m_type == ENUM_STACK || segment->m_type == ENUM_MODULE_DATA)
 		{
-			int tid;
-			// check registers if it is a thread's stack segment
-			if (segment->m_type == ENUM_STACK)
+			// allocate register value buffer for once
+			if (segment->m_type == ENUM_STACK && !nregs && !regs_buf)
+			{
+				nregs = read_registers (NULL, NULL, 0);
+				if (nregs)
+					regs_buf = (struct reg_value*) malloc(nregs * sizeof(struct reg_value));
+			}
+			enum_segment_heap_owners(segment, inuse_blocks, regs_buf, nregs, func, arg);
+			processed_bytes += segment->m_fsize;
+			set_current_progress(processed_bytes);
+		}
+	}
+	end_progress_bar();
+
+	if (regs_buf)
+		free (regs_buf);
+	return rc;
+}
+
+/*
+ * Top owners by the size of memory they reach, directly or indirectly
+ */
+struct owner_ranking
+{
+	struct heap_owner* owners;
+	unsigned int num;
+	CA_BOOL all_reachable_blocks;
+	struct inuse_block_table* inuse_blocks;
+};
+
+static void rank_heap_owner(void* arg, struct object_reference* ref, size_t var_len)
+{
+	struct owner_ranking* ranking = (struct owner_ranking*) arg;
+	struct heap_owner *smallest = &ranking->owners[ranking->num - 1];
+	size_t ptr_sz = g_ptr_bit >> 3;
+	size_t aggr_size;
+	unsigned long aggr_count;
+	struct heap_owner newowner;
+
+	// a variable smaller than a pointer can't reference heap
+	if (var_len < ptr_sz)
+		return;
+	// Query heap for aggregated memory size/count originated from the candidate
+	calc_aggregate_size(ref, var_len, ranking->all_reachable_blocks, ranking->inuse_blocks, &aggr_size, &aggr_count);
+	// update the top list if applies
+	if (ref->storage_type == ENUM_REGISTER)
+	{
+		if (aggr_size <= smallest->aggr_size)
+			return;
+	}
+	else
+	{
+		if (aggr_size < smallest->aggr_size)
+			return;
+		if (var_len == ptr_sz)
+			read_memory_wrapper(NULL, ref->vaddr, (void*)&ref->value, ptr_sz);
+		else
+			ref->value = 0;
+	}
+	newowner.ref = *ref;
+	newowner.aggr_size = aggr_size;
+	newowner.aggr_count = aggr_count;
+	add_owner(ranking->owners, ranking->num, &newowner);
+}
+
+/*
+ * Owners ranked by all workers, one task per segment
+ * 	the debugger knows variables, so they are found on the calling thread first,
+ * 	those other than raw pointers are recorded as spans of their segments. Then
+ * 	each worker reads its segments mapped from the core, computes what an owner
+ * 	reaches with its own bitmap, and keeps its own top list. The lists are merged
+ * 	in the end with the same rules of aliases as the serial ranking
+ */
+struct owner_span
+{
+	address_t at;		// cursor of the walk when the variable is found
+	address_t vaddr;
+	size_t    len;
+};
+
+struct owner_segment
+{
+	struct ca_segment* segment;
+	address_t start;
+	address_t end;
+	size_t    first_span;	// spans of the segment are spans[first_span, next segment's first_span)
+};
+
+struct owner_worker
+{
+	unsigned int* bitmap;
+	struct block_worklist wl;
+	struct inuse_ptr_batch batch;
+	struct heap_owner* owners;
+	struct heap_traverse_stat stat;
+	char pad[64];		// workers don't share cache lines of hot fields
+};
+
+struct owner_job
+{
+	struct owner_ranking* ranking;
+	struct owner_segment* segments;
+	size_t num_segments;
+	size_t cur;			// segment being walked, and the cursor the walk is expected at
+	address_t next;
+	struct owner_span* spans;
+	size_t num_spans;
+	size_t spans_capacity;
+	struct owner_worker* workers;
+	unsigned int num_workers;
+	CA_BOOL failed;
+};
+
+/*
+ * Callback of the walk on the calling thread
+ * 	registers are ranked at once, a variable is recorded if it is not a raw pointer
+ * 	at the cursor, so workers follow the walk with the recorded ones only
+ */
+static void collect_owner_span(void* arg, struct object_reference* ref, size_t var_len)
+{
+	struct owner_job* job = (struct owner_job*) arg;
+	size_t ptr_sz = g_ptr_bit >> 3;
+
+	if (ref->storage_type == ENUM_REGISTER)
+	{
+		rank_heap_owner(job->ranking, ref, var_len);
+		return;
+	}
+	if (job->failed)
+		return;
+
+	// the walk of a segment ends when the cursor reaches its end
+	if (job->next >= job->segments[job->cur].end)
+	{
+		if (job->cur + 1 == job->num_segments)
+		{
+			job->failed = CA_TRUE;
+			return;
+		}
+		job->cur++;
+		job->segments[job->cur].first_span = job->num_spans;
+		job->next = ALIGN(job->segments[job->cur].start, ptr_sz);
+	}
+
+	if (ref->vaddr != job->next || var_len != ptr_sz)
+	{
+		struct owner_span* span;
+
+		if (job->num_spans == job->spans_capacity)
+		{
+			size_t capacity = job->spans_capacity ? job->spans_capacity * 2 : 1024;
+			struct owner_span* bigger = (struct owner_span*) realloc(job->spans, capacity * sizeof(struct owner_span));
+			if (!bigger)
+			{
+				CA_PRINT("Out of Memory\n");
+				job->failed = CA_TRUE;
+				return;
+			}
+			job->spans = bigger;
+			job->spans_capacity = capacity;
+		}
+		span = &job->spans[job->num_spans++];
+		span->at = job->next;
+		span->vaddr = ref->vaddr;
+		span->len = var_len;
+	}
+	job->next = ALIGN(ref->vaddr + var_len, ptr_sz);
+}
+
+static void add_worker_owner(struct owner_job* job,
+						struct owner_worker* me,
+						struct ca_segment* segment,
+						address_t vaddr,
+						address_t value,
+						size_t aggr_size,
+						unsigned long aggr_count)
+{
+	struct heap_owner newowner;
+
+	if (aggr_size == 0 || aggr_size < me->owners[job->ranking->num - 1].aggr_size)
+		return;
+	// the location is filled by the calling thread for owners that make the list
+	memset(&newowner, 0, sizeof(newowner));
+	newowner.ref.storage_type = segment->m_type;
+	newowner.ref.vaddr = vaddr;
+	newowner.ref.value = value;
+	newowner.aggr_size = aggr_size;
+	newowner.aggr_count = aggr_count;
+	add_owner(me->owners, job->ranking->num, &newowner);
+}
+
+/*
+ * Blocks queued by the worker are reached by the owner, their bits are cleared
+ * 	afterwards so the bitmap is clean for the next owner
+ */
+static size_t reach_queued_blocks(struct owner_job* job, struct owner_worker* me, unsigned long* aggr_count)
+{
+	struct inuse_block_table* blocks = job->ranking->inuse_blocks;
+	size_t aggr_size = 0;
+	unsigned long k;
+
+	*aggr_count = 0;
+	if (job->ranking->all_reachable_blocks)
+		aggr_size = traverse_block_worklist(blocks, me->bitmap, &me->wl, aggr_count, &me->stat);
+	else
+	{
+		for (k = 0; k < me->wl.tail; k++)
+			aggr_size += blocks->sizes[me->wl.queue[k]];
+		*aggr_count = me->wl.tail;
+	}
+	for (k = 0; k < me->wl.tail; k++)
+		me->bitmap[me->wl.queue[k] >> 4] = 0;
+	me->wl.head = me->wl.tail = 0;
+	return aggr_size;
+}
+
+/*
+ * Rank raw pointers [first, last) of the segment, or else a variable of them
+ */
+static void rank_segment_ptrs(struct owner_job* job,
+						struct owner_worker* me,
+						struct ca_segment* segment,
+						size_t first,
+						size_t last,
+						CA_BOOL variable)
+{
+	struct inuse_block_table* blocks = job->ranking->inuse_blocks;
+	size_t ptr_sz = g_ptr_bit >> 3;
+	size_t aggr_size;
+	unsigned long aggr_count;
+	size_t i = first;
+
+	while (i < last)
+	{
+		unsigned long n = me->batch.capacity;
+		unsigned long k;
+
+		if (n > last - i)
+			n = last - i;
+		for (k = 0; k < n; k++)
+			me->batch.values[k] = load_core_ptr(segment->m_faddr + (i + k) * ptr_sz, ptr_sz);
+		me->batch.count = n;
+		if (find_inuse_blocks(blocks, &me->batch))
+		{
+			for (k = 0; k < n; k++)
+			{
+				unsigned long index = me->batch.indexes[k];
+				if (index == INUSE_BLOCK_NONE)
+					continue;
+				if (!variable && job->ranking->all_reachable_blocks && blocks->aggr_sizes[index])
+				{
+					// cached result of a pointer
+					add_worker_owner(job, me, segment, segment->m_vaddr + (i + k) * ptr_sz,
+							me->batch.values[k], blocks->aggr_sizes[index], blocks->aggr_counts[index]);
+					continue;
+				}
+				push_unvisited_block(me->bitmap, &me->wl, index, &me->stat);
+				if (!variable)
+				{
+					aggr_size = reach_queued_blocks(job, me, &aggr_count);
+					add_worker_owner(job, me, segment, segment->m_vaddr + (i + k) * ptr_sz,
+							me->batch.values[k], aggr_size, aggr_count);
+				}
+			}
+		}
+		i += n;
+	}
+}
+
+static void rank_segment_owners_task(void* arg, size_t task, unsigned int worker)
+{
+	struct owner_job* job = (struct owner_job*) arg;
+	struct owner_segment* os = &job->segments[task];
+	struct ca_segment* segment = os->segment;
+	struct owner_worker* me = &job->workers[worker];
+	struct owner_span* span = &job->spans[os->first_span];
+	struct owner_span* spans_end = &job->spans[task + 1 < job->num_segments ? os[1].first_span : job->num_spans];
+	size_t ptr_sz = g_ptr_bit >> 3;
+	size_t first = (ALIGN(os->start, ptr_sz) - segment->m_vaddr) / ptr_sz;
+	size_t last = segment->m_fsize / ptr_sz;
+	size_t i = first;
+
+	pin_segment_range(segment, first, last);
+	while (i < last)
+	{
+		address_t cursor = segment->m_vaddr + i * ptr_sz;
+
+		if (span < spans_end && span->at <= cursor)
+		{
+			// a variable of the segment's mapped memory
+			if (span->len >= ptr_sz)
+			{
+				size_t lo = first, hi = last;
+				size_t aggr_size;
+				unsigned long aggr_count;
+				address_t value = 0;
+
+				if (span->vaddr > segment->m_vaddr + lo * ptr_sz)
+					lo = (ALIGN(span->vaddr, ptr_sz) - segment->m_vaddr) / ptr_sz;
+				if (span->vaddr + span->len < segment->m_vaddr + hi * ptr_sz)
+					hi = (ALIGN(span->vaddr + span->len, ptr_sz) - segment->m_vaddr) / ptr_sz;
+				if (span->len == ptr_sz && lo < hi)
+					value = load_core_ptr(segment->m_faddr + lo * ptr_sz, ptr_sz);
+				if (span->len == ptr_sz && job->ranking->all_reachable_blocks)
+					rank_segment_ptrs(job, me, segment, lo, hi, CA_FALSE);
+				else
+				{
+					rank_segment_ptrs(job, me, segment, lo, hi, CA_TRUE);
+					aggr_size = reach_queued_blocks(job, me, &aggr_count);
+					add_worker_owner(job, me, segment, span->vaddr, value, aggr_size, aggr_count);
+				}
+			}
+			cursor = ALIGN(span->vaddr + span->len, ptr_sz);
+			i = (cursor > segment->m_vaddr + i * ptr_sz) ? (cursor - segment->m_vaddr) / ptr_sz : i + 1;
+			span++;
+		}
+		else
+		{
+			// raw pointers up to the next variable
+			size_t stop = last;
+
+			if (span < spans_end && (span->at - segment->m_vaddr) / ptr_sz < stop)
+				stop = (span->at - segment->m_vaddr) / ptr_sz;
+			rank_segment_ptrs(job, me, segment, i, stop, CA_FALSE);
+			i = stop;
+		}
+	}
+	unpin_segment_range(segment, first, last);
+	release_segment_range(segment, first, last);
+}
+
+/*
+ * Location of an owner ranked by a worker
+ */
+static void set_owner_location(struct object_reference* ref)
+{
+	struct ca_segment* segment = get_segment(ref->vaddr, 1);
+
+	if (!segment)
+		return;
+	if (ref->storage_type == ENUM_STACK)
+	{
+		ref->where.stack.tid = get_thread_id(segment);
+		ref->where.stack.frame = get_frame_number(segment, ref->vaddr, &ref->where.stack.offset);
+	}
+	else
+	{
+		ref->where.module.base = segment->m_vaddr;
+		ref->where.module.size = segment->m_vsize;
+		ref->where.module.name = segment->m_module_name;
+	}
+}
+
+/*
+ * Rank owners of all segments with all workers, set [ranked] if it applies
+ * 	it doesn't apply to a live process or a single worker, nor to reachable sizes
+ * 	cached lazily, which workers can't write
+ * Return false if user breaks the long walk
+ */
+static CA_BOOL parallel_rank_heap_owners(struct owner_ranking* ranking, CA_BOOL* ranked)
+{
+	struct inuse_block_table* blocks = ranking->inuse_blocks;
+	size_t ptr_sz = g_ptr_bit >> 3;
+	size_t bitmap_sz = ((blocks->count+15)*2/32) * sizeof(unsigned int);
+	struct owner_job job;
+	unsigned int i, k;
+	CA_BOOL rc = CA_TRUE;
+
+	*ranked = CA_FALSE;
+	if (!g_debug_core || ca_num_workers() < 2 || blocks->count == 0
+		|| (ranking->all_reachable_blocks && blocks->aggr_state == AGGR_LAZY))
+		return CA_TRUE;
+
+	memset(&job, 0, sizeof(job));
+	job.ranking = ranking;
+	// segments with memory to search, all of which must be mapped from the core
+	job.segments = (struct owner_segment*) malloc(g_segment_count * sizeof(struct owner_segment));
+	if (!job.segments)
+		goto parallel_rank_out;
+	for (i = 0; i < g_segment_count; i++)
+	{
+		struct ca_segment* segment = &g_segments[i];
+		struct owner_segment* os = &job.segments[job.num_segments];
+
+		if (!get_owner_range(segment, &os->start, &os->end) || ALIGN(os->start, ptr_sz) >= os->end)
+			continue;
+		if (!segment->m_faddr)
+			goto parallel_rank_out;
+		os->segment = segment;
+		os->first_span = 0;
+		job.num_segments++;
+	}
+	if (job.num_segments == 0)
+		goto parallel_rank_out;
+
+	job.num_workers = ca_num_workers();
+	job.workers = (struct owner_worker*) calloc(job.num_workers, sizeof(struct owner_worker));
+	if (!job.workers)
+		goto parallel_rank_out;
+	for (i = 0; i < job.num_workers; i++)
+	{
+		struct owner_worker* w = &job.workers[i];
+		w->bitmap = (unsigned int*) calloc(1, bitmap_sz);
+		w->wl.queue = (unsigned long*) malloc(blocks->count * sizeof(unsigned long));
+		w->owners = (struct heap_owner*) calloc(ranking->num, sizeof(struct heap_owner));
+		if (!w->bitmap || !w->wl.queue || !w->owners || !init_inuse_ptr_batch(&w->batch, INUSE_PTR_BATCH))
+			goto parallel_rank_out;
+	}
+
+	// variables are found by the debugger on this thread
+	job.next = ALIGN(job.segments[0].start, ptr_sz);
+	if (!walk_heap_owners(blocks, collect_owner_span, &job))
+	{
+		rc = CA_FALSE;
+		goto parallel_rank_out;
+	}
+	if (job.failed || job.cur + 1 != job.num_segments)
+		goto parallel_rank_out;
+
+	*ranked = CA_TRUE;
+	if (!ca_parallel_run(job.num_segments, rank_segment_owners_task, &job, CA_TRUE))
+	{
+		CA_PRINT("Abort searching biggest heap memory owners\n");
+		rc = CA_FALSE;
+		goto parallel_rank_out;
+	}
+	for (i = 0; i < job.num_workers; i++)
+	{
+		struct owner_worker* w = &job.workers[i];
+
+		g_traverse_stat.blocks_processed += w->stat.blocks_processed;
+		g_traverse_stat.bitmap_words_scanned += w->stat.bitmap_words_scanned;
+		for (k = 0; k < ranking->num && w->owners[k].aggr_size; k++)
+		{
+			set_owner_location(&w->owners[k].ref);
+			add_owner(ranking->owners, ranking->num, &w->owners[k]);
+		}
+	}
+
+parallel_rank_out:
+	if (job.workers)
+	{
+		for (i = 0; i < job.num_workers; i++)
+		{
+			struct owner_worker* w = &job.workers[i];
+			if (w->bitmap)
+				free(w->bitmap);
+			if (w->wl.queue)
+				free(w->wl.queue);
+			if (w->owners)
+				free(w->owners);
+			release_inuse_ptr_batch(&w->batch);
+		}
+		free(job.workers);
+	}
+	if (job.segments)
+		free(job.segments);
+	if (job.spans)
+		free(job.spans);
+	return rc;
+}
+
+/*
+ * Find/display global/local variables which own the most heap memory in bytes
+ * 	with [retained], the memory an owner retains, i.e. that is freed with it
+ * 	with [estimate], the memory it reaches is estimated
+ */
+CA_BOOL biggest_heap_owners_generic(unsigned int num, CA_BOOL all_reachable_blocks, CA_BOOL retained, CA_BOOL estimate)
+{
+	CA_BOOL rc = CA_FALSE;
+	unsigned int i;
+	size_t ptr_sz = g_ptr_bit >> 3;
+	struct heap_owner *owners;
+	struct heap_owner *smallest;
+
+	struct inuse_block_table *inuse_blocks = NULL;
+	unsigned long inuse_index;
+
+	struct object_reference ref;
+	size_t aggr_size;
+	unsigned long aggr_count;
+
+	struct owner_ranking ranking;
+	CA_BOOL ranked;
+	struct dom_graph graph;
+	struct dom_tree tree;
+
+	memset(&graph, 0, sizeof(graph));
+	memset(&tree, 0, sizeof(tree));
+
+	// Allocate an array for the biggest num of owners
+	if (num == 0)
+		return CA_FALSE;
+	owners = (struct heap_owner *) calloc(num, sizeof(struct heap_owner));
+	if (!owners)
+		goto clean_out;
+	smallest = &owners[num - 1];
+
+	// First, create and populate an array of all in-use blocks
+	inuse_blocks = build_inuse_heap_blocks();
+	if (!inuse_blocks)
+	{
+		CA_PRINT("Failed: no in-use heap block is found\n");
+		goto clean_out;
+	}
+	if ((all_reachable_blocks || retained) && !build_heap_ref_graph(inuse_blocks))
+		goto clean_out;
+	memset(&g_traverse_stat, 0, sizeof(g_traverse_stat));
+
+	if (retained)
+	{
+		// all owners are collected, then one dominator tree ranks them
+		if (!init_dom_graph(&graph, inuse_blocks)
+			|| !walk_heap_owners(inuse_blocks, add_dom_root, &graph)
+			|| graph.failed
+			|| !build_dom_tree(&graph, &tree))
+			goto clean_out;
+		rank_retained_owners(&graph, &tree, owners, num);
+	}
+	else
+	{
+		// reachable sizes of all blocks at once, or else of those owners reference
+		if (all_reachable_blocks && !fill_reachable_sizes(inuse_blocks, estimate) && estimate)
+			goto clean_out;
+		ranking.owners = owners;
+		ranking.num = num;
+		ranking.all_reachable_blocks = all_reachable_blocks;
+		ranking.inuse_blocks = inuse_blocks;
+		if (!parallel_rank_heap_owners(&ranking, &ranked)
+			|| (!ranked && !walk_heap_owners(inuse_blocks, rank_heap_owner, &ranking)))
+			goto clean_out;
+	}
+
+	if (!all_reachable_blocks && !retained)
+	{
+		// Big memory blocks may be referenced indirectly by local/global variables
+		// check all in-use blocks
+		for (inuse_index = 0; inuse_index < inuse_blocks->count; inuse_index++)
+		{
+			ref.storage_type = ENUM_HEAP;
+			ref.vaddr = inuse_blocks->addrs[inuse_index];
+			ref.where.heap.addr = inuse_blocks->addrs[inuse_index];
+			ref.where.heap.size = inuse_blocks->sizes[inuse_index];
+			ref.where.heap.inuse = 1;
+			calc_aggregate_size(&ref, ptr_sz, CA_FALSE, inuse_blocks, &aggr_size, &aggr_count);
+			// update the top list if applies
+			if (aggr_size >= smallest->aggr_size)
+			{
+				struct heap_owner newowner;
+				ref.value = 0;
+				newowner.ref = ref;
+				newowner.aggr_size = aggr_size;
+				newowner.aggr_count = aggr_count;
+				add_owner(owners, num, &newowner);
+			}
+		}
+	}
+
+	// Print the result
+	for (i = 0; i < num; i++)
+	{
+		struct heap_owner *owner = &owners[i];
+		if (owner->aggr_size)
+		{
+			CA_PRINT("[%d] ", i+1);
+			print_ref(&owner->ref, 0, CA_FALSE, CA_FALSE);
+			CA_PRINT("    |--> ");
+			print_size(owner->aggr_size);
+			CA_PRINT(" (%ld blocks)\n", owner->aggr_count);
+		}
+	}
+	if (all_reachable_blocks && !retained)
+		print_traverse_stat();
+	if (estimate && !retained && inuse_blocks->aggr_state == AGGR_ESTIMATED)
+		CA_PRINT("Sizes are estimated from samples of up to %d blocks\n", REACH_SKETCH_K);
+	rc = CA_TRUE;
+
+clean_out:
+	// clean up
+	// estimates are not cached beyond the command
+	if (inuse_blocks && inuse_blocks->aggr_state == AGGR_ESTIMATED)
+		reset_reachable_sizes(inuse_blocks);
+	release_dom_tree(&tree);
+	release_dom_graph(&graph);
+	if (owners)
+		free (owners);
+	if (inuse_blocks)
+		free_inuse_heap_blocks (inuse_blocks);
+
+	return rc;
+}
+
+/*
+ * Given a reference, a variable or a pointer to a heap block, with known size,
+ * 	Return its aggregated reachable in-use blocks
+ */
+CA_BOOL
+calc_aggregate_size(const struct object_reference *ref,
+					size_t var_len,
+					CA_BOOL all_reachable_blocks,
+					struct inuse_block_table *inuse_blocks,
+					size_t *total_size,
+					unsigned long *total_count)
+{
+	address_t addr, cursor, end;
+	size_t ptr_sz = g_ptr_bit >> 3;
+	size_t aggr_size = 0;
+	unsigned long aggr_count = 0;
+	unsigned long num_inuse_blocks = inuse_blocks->count;
+	unsigned long blk;
+	size_t bitmap_sz = ((num_inuse_blocks+15)*2/32) * sizeof(unsigned int);
+
+	static unsigned int* qv_bitmap = NULL;	// Bit flags of whether a block is queued/visited
+	static unsigned long bitmap_capacity = 0;	// in terms of number of blocks handled
+	static struct inuse_ptr_batch batch;
+
+	// ground return values
+	*total_size = 0;
+	*total_count = 0;
+
+	// Prepare bitmap with the clean state
+	if (bitmap_capacity < num_inuse_blocks)
+	{
+		if (qv_bitmap)
+			free (qv_bitmap);
+		// Each block uses two bits(queued/visited)
+		qv_bitmap = (unsigned int*) malloc(bitmap_sz);
+		if (!qv_bitmap)
+		{
+			bitmap_capacity = 0;
+			CA_PRINT("Out of Memory\n");
+			return CA_FALSE;
+		}
+		bitmap_capacity = num_inuse_blocks;
+	}
+	memset(qv_bitmap, 0, bitmap_sz);
+	if (!batch.capacity && !init_inuse_ptr_batch(&batch, INUSE_PTR_BATCH))
+		return CA_FALSE;
+	if (all_reachable_blocks && !build_heap_ref_graph(inuse_blocks))
+		return CA_FALSE;
+
+	// Input is a pointer to an in-use memory block
+	if (ref->storage_type == ENUM_REGISTER || ref->storage_type == ENUM_HEAP)
+	{
+		if (var_len != ptr_sz)
+			return CA_FALSE;
+		blk = find_inuse_block(ref->vaddr, inuse_blocks);
+		if (blk != INUSE_BLOCK_NONE)
+		{
+			// cached result is available, return now
+			if (all_reachable_blocks && inuse_blocks->aggr_sizes[blk])
+			{
+				*total_size  = inuse_blocks->aggr_sizes[blk];
+				*total_count = inuse_blocks->aggr_counts[blk];
+				return CA_TRUE;
+			}
+			else
+			{
+				// search starts with the memory block
+				cursor = inuse_blocks->addrs[blk];
+				end  = cursor + inuse_blocks->sizes[blk];
+				aggr_size  = inuse_blocks->sizes[blk];
+				aggr_count = 1;
+				set_visited(qv_bitmap, blk);
+			}
+		}
+		else
+			return CA_FALSE;
+	}
+	// input reference is an object with given size, e.g. a local/global variable
+	else
+	{
+		if (all_reachable_blocks && var_len == ptr_sz)
+		{
+			// input is of pointer size, which is candidate for cache value
+			if(read_memory_wrapper(NULL, ref->vaddr, (void*)&addr, ptr_sz))
+			{
+				blk = find_inuse_block(addr, inuse_blocks);
+				if (blk != INUSE_BLOCK_NONE)
+				{
+					if (inuse_blocks->aggr_sizes[blk])
+					{
+						*total_size  = inuse_blocks->aggr_sizes[blk];
+						*total_count = inuse_blocks->aggr_counts[blk];
+						return CA_TRUE;
+					}
+				}
+				else
+					return CA_FALSE;
+			}
+			else
+				return CA_FALSE;
+		}
+		cursor = ref->vaddr;
+		end  = cursor + var_len;
+	}
+
+	// We now have a range of memory to search
+	cursor = ALIGN(cursor, ptr_sz);
+	while (cursor < end)
+	{
+		unsigned long n, k;
+
+		n = read_inuse_ptr_batch(NULL, cursor, ALIGN(end, ptr_sz), &batch);
+		if (n == 0)
+			break;
+		cursor += n * ptr_sz;
+		if (!find_inuse_blocks(inuse_blocks, &batch))
+			continue;
+		for (k = 0; k < n; k++)
+		{
+			blk = batch.indexes[k];
+			if (blk != INUSE_BLOCK_NONE && !is_queued_or_visited(qv_bitmap, blk))
+			{
+				if (all_reachable_blocks)
+				{
+					unsigned long sub_count = 0;
+					aggr_size += heap_aggregate_size(blk, inuse_blocks, qv_bitmap, &sub_count);
+					aggr_count += sub_count;
+				}
+				else
+				{
+					aggr_size += inuse_blocks->sizes[blk];
+					aggr_count++;
+					set_visited(qv_bitmap, blk);
+				}
+			}
+		}
+	}
+
+	// can we cache the result?
+	if (all_reachable_blocks && aggr_size)
+	{
+		if (ref->storage_type == ENUM_REGISTER || ref->storage_type == ENUM_HEAP)
+		{
+			blk = find_inuse_block(ref->vaddr, inuse_blocks);
+			inuse_blocks->aggr_sizes[blk] = aggr_size;
+			inuse_blocks->aggr_counts[blk] = aggr_count;
+		}
+		else if (var_len == ptr_sz)
+		{
+			if (read_memory_wrapper(NULL, ref->vaddr, (void*)&addr, ptr_sz))
+			{
+				blk = find_inuse_block(addr, inuse_blocks);
+				if (blk != INUSE_BLOCK_NONE)
+				{
+					inuse_blocks->aggr_sizes[blk] = aggr_size;
+					inuse_blocks->aggr_counts[blk] = aggr_count;
+				}
+			}
+		}
+	}
+
+	// return happily
+	*total_size  = aggr_size;
+	*total_count = aggr_count;
+	return CA_TRUE;
+}
+
+// A not-so-fast leak checking based on the concept what a heap block without any
+// reference directly/indirectly from a global/local variable is a lost one
+CA_BOOL display_heap_leak_candidates(void)
+{
+	CA_BOOL rc = CA_TRUE;
+	unsigned long total_blocks = 0;
+	struct inuse_block_table* blocks = NULL;
+	unsigned int* qv_bitmap = NULL;	// Bit flags of whether a block is queued/visited
+	struct block_worklist wl;
+	unsigned long reachable_count = 0;
+	unsigned long cur_index;
+	size_t total_leak_bytes;
+	size_t total_bytes;
+	unsigned long leak_count;
+
+	// create and populate an array of all in-use blocks
+	blocks = build_inuse_heap_blocks();
+	if (!blocks)
+	{
+		CA_PRINT("Failed: no in-use heap block is found\n");
+		return CA_FALSE;
+	}
+	total_blocks = blocks->count;
+	memset(&g_traverse_stat, 0, sizeof(g_traverse_stat));
+
+	// Prepare bitmap with the clean state
+	// Each block uses two bits(queued/visited)
+	qv_bitmap = (unsigned int*) calloc((total_blocks+15)*2/32, sizeof(unsigned int));
+	// a block enters the worklist at most once
+	wl.head = wl.tail = 0;
+	wl.queue = (unsigned long*) malloc(total_blocks * sizeof(unsigned long));
+	if (!qv_bitmap || !wl.queue)
+	{
+		CA_PRINT("Out of Memory\n");
+		rc = CA_FALSE;
+		goto leak_check_out;
+	}
+
+	// references among in-use blocks
+	if (!build_heap_ref_graph(blocks))
+	{
+		rc = CA_FALSE;
+		goto leak_check_out;
+	}
+
+	// mark reachable blocks of a core with all workers, or else serially
+	if (!parallel_mark_heap_blocks(blocks, qv_bitmap))
+	{
+		// search global/local(module's .text/.data/.bss and thread stack) memory
+		// for all references to these in-use blocks, mark them visited and queue them
+		if (!mark_blocks_referenced_by_globals_locals(blocks, qv_bitmap, &wl))
+		{
+			rc = CA_FALSE;
+			goto leak_check_out;
+		}
+
+		// Within in-use blocks,
+		// process queued blocks to find unvisited ones through reference,
+		// which are marked visited and queued in turn, until the worklist is empty
+		traverse_block_worklist(blocks, qv_bitmap, &wl, &reachable_count, &g_traverse_stat);
+	}
+
+	// Display blocks that found no references to them directly or indirectly from global/local areas
+	CA_PRINT("Potentially leaked heap memory blocks:\n");
+	total_leak_bytes = 0;
+	total_bytes = 0;
+	leak_count = 0;
+	for (cur_index = 0; cur_index < total_blocks; cur_index++)
+	{
+		total_bytes += blocks->sizes[cur_index];
+		if (!is_visited(qv_bitmap, cur_index))
+		{
+			leak_count++;
+			CA_PRINT("[%ld] addr="PRINT_FORMAT_POINTER" size="PRINT_FORMAT_SIZE"\n",
+					leak_count, blocks->addrs[cur_index], blocks->sizes[cur_index]);
+			total_leak_bytes += blocks->sizes[cur_index];
+		}
+	}
+	if (leak_count)
+	{
+		CA_PRINT("Total %ld (", leak_count);
+		print_size(total_leak_bytes);
+		CA_PRINT(") leak candidates out of %ld (", total_blocks);
+		print_size(total_bytes);
+		CA_PRINT(") in-use memory blocks\n");
+	}
+	else
+		CA_PRINT("All %ld heap blocks are referenced, no leak candidate\n", total_blocks);
+	print_traverse_stat();
+
+leak_check_out:
+	if (blocks)
+		free_inuse_heap_blocks(blocks);
+	if (qv_bitmap)
+		free (qv_bitmap);
+	if (wl.queue)
+		free (wl.queue);
+	return rc;
+}
+
+/*
+ * Histogram functions
+ */
+void display_mem_histogram(const char* prefix)
+{
+
+	if (!g_mem_hist.num_buckets || !g_mem_hist.bucket_sizes
+		|| !g_mem_hist.inuse_cnt || !g_mem_hist.inuse_bytes
+		|| !g_mem_hist.free_cnt || !g_mem_hist.free_bytes)
+		return;
+
+	CA_PRINT("%s========== In-use Memory Histogram ==========\n", prefix);
+	display_histogram(prefix, g_mem_hist.num_buckets, g_mem_hist.bucket_sizes, g_mem_hist.inuse_cnt, g_mem_hist.inuse_bytes);
+
+	CA_PRINT("%s========== Free Memory Histogram ==========\n", prefix);
+	display_histogram(prefix, g_mem_hist.num_buckets, g_mem_hist.bucket_sizes, g_mem_hist.free_cnt, g_mem_hist.free_bytes);
+}
+
+void release_mem_histogram(void)
+{
+	if (g_mem_hist.bucket_sizes)
+		free(g_mem_hist.bucket_sizes);
+	if (g_mem_hist.inuse_cnt)
+		free(g_mem_hist.inuse_cnt);
+	if (g_mem_hist.inuse_bytes)
+		free(g_mem_hist.inuse_bytes);
+	if (g_mem_hist.free_cnt)
+		free(g_mem_hist.free_cnt);
+	if (g_mem_hist.free_bytes)
+		free(g_mem_hist.free_bytes);
+	memset(&g_mem_hist, 0, sizeof(g_mem_hist));
+}
+
+void init_mem_histogram(unsigned int nbuckets)
+{
+	unsigned int i;
+
+	release_mem_histogram();
+
+	g_mem_hist.num_buckets = nbuckets;
+	g_mem_hist.bucket_sizes = (size_t*)malloc(nbuckets * sizeof(size_t));
+	for (i = 0; i < nbuckets; i++)
+		g_mem_hist.bucket_sizes[i] = 16 << i;
+	g_mem_hist.inuse_cnt = (unsigned long*)malloc((nbuckets+1) * sizeof(unsigned long));
+	g_mem_hist.inuse_bytes = (size_t*)malloc((nbuckets+1) * sizeof(size_t));
+	g_mem_hist.free_cnt = (unsigned long*)malloc((nbuckets+1) * sizeof(unsigned long));
+	g_mem_hist.free_bytes = (size_t*)malloc((nbuckets+1) * sizeof(size_t));
+	for (i = 0; i < nbuckets + 1; i++)
+	{
+		g_mem_hist.inuse_cnt[i] = 0;
+		g_mem_hist.inuse_bytes[i] = 0;
+		g_mem_hist.free_cnt[i] = 0;
+		g_mem_hist.free_bytes[i] = 0;
+	}
+}
+
+void add_block_mem_histogram(size_t size, CA_BOOL inuse, unsigned int num_block)
+{
+	add_block_local_mem_histogram(&g_mem_hist, size, inuse, num_block);
+}
+
+void add_block_local_mem_histogram(struct MemHistogram* hist, size_t size, CA_BOOL inuse, unsigned int num_block)
+{
+	unsigned int n;
+
+	if (!hist->num_buckets || !hist->bucket_sizes
+		|| !hist->inuse_cnt || !hist->inuse_bytes
+		|| !hist->free_cnt || !hist->free_bytes)
+		return;
+
+	for (n = 0; n < hist->num_buckets; n++)
+	{
+		if (size <= hist->bucket_sizes[n])
+			break;
+	}
+	if (inuse)
+	{
+		hist->inuse_cnt[n] += num_block;
+		hist->inuse_bytes[n] += size * num_block;
+	}
+	else
+	{
+		hist->free_cnt[n] += num_block;
+		hist->free_bytes[n] += size * num_block;
+	}
+}
+
+/*
+ * A worker thread counts blocks in its own histogram with the same buckets
+ * as the global one, it is merged into the global one when the work is done
+ */
+void init_local_mem_histogram(struct MemHistogram* hist)
+{
+	unsigned int i, nbuckets = g_mem_hist.num_buckets;
+
+	memset(hist, 0, sizeof(struct MemHistogram));
+	if (!nbuckets || !g_mem_hist.bucket_sizes)
+		return;
+
+	hist->bucket_sizes = (size_t*)malloc(nbuckets * sizeof(size_t));
+	hist->inuse_cnt = (unsigned long*)calloc(nbuckets + 1, sizeof(unsigned long));
+	hist->inuse_bytes = (size_t*)calloc(nbuckets + 1, sizeof(size_t));
+	hist->free_cnt = (unsigned long*)calloc(nbuckets + 1, sizeof(unsigned long));
+	hist->free_bytes = (size_t*)calloc(nbuckets + 1, sizeof(size_t));
+	if (hist->bucket_sizes)
+	{
+		for (i = 0; i < nbuckets; i++)
+			hist->bucket_sizes[i] = g_mem_hist.bucket_sizes[i];
+	}
+	hist->num_buckets = nbuckets;
+}
+
+void merge_local_mem_histogram(struct MemHistogram* hist)
+{
+	unsigned int i;
+
+	if (hist->num_buckets == g_mem_hist.num_buckets
+		&& hist->inuse_cnt && hist->inuse_bytes && hist->free_cnt && hist->free_bytes
+		&& g_mem_hist.inuse_cnt && g_mem_hist.inuse_bytes && g_mem_hist.free_cnt && g_mem_hist.free_bytes)
+	{
+		for (i = 0; i < hist->num_buckets + 1; i++)
+		{
+			g_mem_hist.inuse_cnt[i] += hist->inuse_cnt[i];
+			g_mem_hist.inuse_bytes[i] += hist->inuse_bytes[i];
+			g_mem_hist.free_cnt[i] += hist->free_cnt[i];
+			g_mem_hist.free_bytes[i] += hist->free_bytes[i];
+		}
+	}
+	if (hist->bucket_sizes)
+		free(hist->bucket_sizes);
+	if (hist->inuse_cnt)
+		free(hist->inuse_cnt);
+	if (hist->inuse_bytes)
+		free(hist->inuse_bytes);
+	if (hist->free_cnt)
+		free(hist->free_cnt);
+	if (hist->free_bytes)
+		free(hist->free_bytes);
+	memset(hist, 0, sizeof(struct MemHistogram));
+}
+
+static void fill_space_til_pos(char* buf, size_t to_pos)
+{
+	size_t len = strlen(buf);
+	if (len < to_pos - 1)
+	{
+		while (len < to_pos - 1)
+			buf[len++] = ' ';
+		buf[len] = '\0';
+	}
+	else
+	{
+		buf[len] = ' ';
+		buf[len+1] = '\0';
+	}
+}
+
+/*
+ * Helper functions
+ */
+static void display_histogram(const char* prefix,
+			unsigned int   nbuckets,
+			const size_t*        bucket_sizes,
+			const unsigned long* block_cnt,
+			const size_t*        block_bytes)
+{
+	unsigned int n;
+	unsigned long total_cnt, total_cnt2;
+	size_t total_bytes;
+	char linebuf[LINE_BUF_SZ];
+	int pos = 0;
+	const int second_col_pos = 16;
+	const int third_col_pos = 28;
+
+	// title
+	sprintf(linebuf, "%sSize-Range", prefix);
+	fill_space_til_pos(linebuf, strlen(prefix)+second_col_pos);
+	pos = strlen(linebuf);
+	sprintf(linebuf + pos, "Count");
+	fill_space_til_pos(linebuf, strlen(prefix)+third_col_pos);
+	pos = strlen(linebuf);
+	sprintf(linebuf + pos, "Total-Bytes");
+	CA_PRINT("%s\n", linebuf);
+
+	total_cnt = 0;
+	total_bytes = 0;
+	for (n = 0; n <= nbuckets; n++)
+	{
+		total_cnt += block_cnt[n];
+		total_bytes += block_bytes[n];
+	}
+
+	total_cnt2 = 0;
+	for (n = 0; n <= nbuckets && total_cnt2 < total_cnt; n++)
+	{
+		if (block_cnt[n] > 0)
+		{
+			sprintf(linebuf, "%s", prefix);
+			pos = strlen(linebuf);
+
+			// bucket size range
+			if (n == 0)
+			{
+				strcat(linebuf, "0 - ");
+				pos = strlen(linebuf);
+				fprint_size(linebuf + pos, bucket_sizes[n]);
+				pos = strlen(linebuf);
+			}
+			else if (n == nbuckets)
+			{
+				fprint_size(linebuf + pos, bucket_sizes[n-1]);
+				pos = strlen(linebuf);
+				strcat(linebuf, " -    ");
+				pos = strlen(linebuf);
+			}
+			else
+			{
+				fprint_size(linebuf + pos, bucket_sizes[n-1]);
+				pos = strlen(linebuf);
+				strcat(linebuf, " - ");
+				pos = strlen(linebuf);
+				fprint_size(linebuf + pos, bucket_sizes[n]);
+				pos = strlen(linebuf);
+			}
+			fill_space_til_pos(linebuf, strlen(prefix)+second_col_pos);
+			pos = strlen(linebuf);
+
+			// count
+			sprintf(linebuf + pos, "%ld(%ld%%)",
+					block_cnt[n], block_cnt[n] * 100 / total_cnt);
+			fill_space_til_pos(linebuf, strlen(prefix)+third_col_pos);
+			pos = strlen(linebuf);
+
+			// total bytes
+			fprint_size(linebuf + pos, block_bytes[n]);
+			pos = strlen(linebuf);
+			sprintf(linebuf + pos, "(%ld%%)", block_bytes[n] * 100 / total_bytes);
+
+			// output
+			CA_PRINT("%s\n", linebuf);
+
+			total_cnt2 += block_cnt[n];
+		}
+	}
+	sprintf(linebuf, "%sTotal", prefix);
+	fill_space_til_pos(linebuf, strlen(prefix)+second_col_pos);
+	pos = strlen(linebuf);
+	sprintf(linebuf + pos, "%ld", total_cnt);
+	fill_space_til_pos(linebuf, strlen(prefix)+third_col_pos);
+	pos = strlen(linebuf);
+	fprint_size(linebuf + pos, total_bytes);
+	CA_PRINT("%s\n", linebuf);
+}
+
+/*
+ * Return the index of the first block ending above addr, i.e. the block that addr
+ * belongs to if there is one; the page index narrows the binary search to blocks
+ * overlapping addr's page
+ */
+static unsigned long
+lower_bound_inuse_block(address_t addr, const struct inuse_block_table* table)
+{
+	unsigned long l_index = 0;
+	unsigned long u_index = table->count;
+
+	// out of bound addr
+	if (u_index == 0 || addr < table->addrs[0])
+		return 0;
+	if (addr >= table->addrs[u_index-1] + table->sizes[u_index-1])
+		return u_index;
+
+	if (table->num_spans)
+	{
+		const struct inuse_page_span* span;
+		const unsigned int* pages;
+		unsigned long s_lo = 0, s_hi = table->num_spans;
+
+		// the last span starting at or below addr
+		while (s_hi - s_lo > 1)
+		{
+			unsigned long s_mid = (s_lo + s_hi) / 2;
+			if (table->spans[s_mid].start <= addr)
+				s_lo = s_mid;
+			else
+				s_hi = s_mid;
+		}
+		span = &table->spans[s_lo];
+		if (addr >= span->end)
+			return span->end_block;
+		pages = &table->page_first[span->first_page + ((addr - span->base) >> span->page_shift)];
+		l_index = pages[0];
+		u_index = pages[1];
+	}
+
+	while (l_index < u_index)
+	{
+		unsigned long m_index = (l_index + u_index) / 2;
+		if (table->addrs[m_index] + table->sizes[m_index] <= addr)
+			l_index = m_index + 1;
+		else
+			u_index = m_index;
+	}
+	return l_index;
+}
+
+/*
+ * Return the index of the block that addr belongs to, or INUSE_BLOCK_NONE
+ */
+unsigned long find_inuse_block(address_t addr, const struct inuse_block_table* table)
+{
+	unsigned long index = lower_bound_inuse_block(addr, table);
+
+	if (index < table->count && addr >= table->addrs[index])
+		return index;
+	return INUSE_BLOCK_NONE;
+}
+
+/*
+ * A batch of candidate pointers, e.g. read from a range of memory
+ */
+struct inuse_ptr_candidate
+{
+	address_t     value;
+	unsigned long pos;		// position in the batch
+};
+
+CA_BOOL init_inuse_ptr_batch(struct inuse_ptr_batch* batch, unsigned long capacity)
+{
+	memset(batch, 0, sizeof(struct inuse_ptr_batch));
+	batch->values = (address_t*) malloc(capacity * sizeof(address_t));
+	batch->indexes = (unsigned long*) malloc(capacity * sizeof(unsigned long));
+	batch->sorted = (struct inuse_ptr_candidate*) malloc(capacity * sizeof(struct inuse_ptr_candidate));
+	if (!batch->values || !batch->indexes || !batch->sorted)
+	{
+		release_inuse_ptr_batch(batch);
+		CA_PRINT("Out of Memory\n");
+		return CA_FALSE;
+	}
+	batch->capacity = capacity;
+	return CA_TRUE;
+}
+
+void release_inuse_ptr_batch(struct inuse_ptr_batch* batch)
+{
+	if (batch->values)
+		free(batch->values);
+	if (batch->indexes)
+		free(batch->indexes);
+	if (batch->sorted)
+		free(batch->sorted);
+	memset(batch, 0, sizeof(struct inuse_ptr_batch));
+}
+
+static int compare_inuse_ptr_candidate(const void* lhs, const void* rhs)
+{
+	const struct inuse_ptr_candidate* left = (const struct inuse_ptr_candidate*) lhs;
+	const struct inuse_ptr_candidate* right = (const struct inuse_ptr_candidate*) rhs;
+
+	if (left->value < right->value)
+		return -1;
+	else if (left->value > right->value)
+		return 1;
+	return 0;
+}
+
+/*
+ * Resolve all values of the batch to the indexes of the in-use blocks they point into,
+ * 	or INUSE_BLOCK_NONE. Values out of the heap bounds are dropped upfront, the rest
+ * 	are sorted and merge-joined with the block table, which is walked forward rather
+ * 	than searched at random. Return the number of values pointing to in-use blocks
+ */
+unsigned long find_inuse_blocks(const struct inuse_block_table* table, struct inuse_ptr_batch* batch)
+{
+	unsigned long i, num_sorted = 0, found = 0;
+	unsigned long index = 0;
+	address_t lo, hi;
+
+	if (table->count == 0)
+	{
+		for (i = 0; i < batch->count; i++)
+			batch->indexes[i] = INUSE_BLOCK_NONE;
+		return 0;
+	}
+
+	// filter with the heap bounds
+	lo = table->addrs[0];
+	hi = table->addrs[table->count - 1] + table->sizes[table->count - 1];
+	for (i = 0; i < batch->count; i++)
+	{
+		address_t value = batch->values[i];
+		batch->indexes[i] = INUSE_BLOCK_NONE;
+		if (value >= lo && value < hi)
+		{
+			batch->sorted[num_sorted].value = value;
+			batch->sorted[num_sorted].pos = i;
+			num_sorted++;
+		}
+	}
+	if (num_sorted == 0)
+		return 0;
+	if (num_sorted > 1)
+		qsort(batch->sorted, num_sorted, sizeof(struct inuse_ptr_candidate), compare_inuse_ptr_candidate);
+
+	// merge join, stay with the current or the next block if possible
+	index = lower_bound_inuse_block(batch->sorted[0].value, table);
+	for (i = 0; i < num_sorted; i++)
+	{
+		address_t value = batch->sorted[i].value;
+		if (value >= table->addrs[index] + table->sizes[index])
+		{
+			if (index + 1 < table->count && value < table->addrs[index + 1] + table->sizes[index + 1])
+				index++;
+			else
+				index = lower_bound_inuse_block(value, table);
+		}
+		if (value >= table->addrs[index])
+		{
+			batch->indexes[batch->sorted[i].pos] = index;
+			found++;
+		}
+	}
+	return found;
+}
+
+/*
+ * Read up to the batch capacity of pointers in [addr, end) into the batch
+ * 	Return the number of pointers read, which is short at the first unreadable one
+ */
+static unsigned long
+read_inuse_ptr_batch(struct ca_segment* segment, address_t addr, address_t end, struct inuse_ptr_batch* batch)
+{
+	size_t ptr_sz = g_ptr_bit >> 3;
+	unsigned long n = (end - addr) / ptr_sz;
+	unsigned long i;
+
+	if (n > batch->capacity)
+		n = batch->capacity;
+	batch->count = 0;
+	if (n == 0)
+		return 0;
+	if (!read_memory_wrapper(segment, addr, batch->values, n * ptr_sz))
+	{
+		// find out the first pointer which can't be read
+		for (i = 0; i < n; i++)
+		{
+			address_t ptr = 0;
+			if (!read_memory_wrapper(segment, addr + i * ptr_sz, &ptr, ptr_sz))
+				break;
+			if (ptr_sz == sizeof(address_t))
+				batch->values[i] = ptr;
+			else
+				memcpy((char*)batch->values + i * ptr_sz, &ptr, ptr_sz);
+		}
+		n = i;
+	}
+	// widen 32-bit pointers in place, from the back
+	if (ptr_sz == 4 && sizeof(address_t) == 8)
+	{
+		const unsigned int* raw = (const unsigned int*) batch->values;
+		for (i = n; i > 0; i--)
+			batch->values[i - 1] = raw[i - 1];
+	}
+	batch->count = n;
+	return n;
+}
+
+static CA_BOOL
+mark_blocks_referenced_by_globals_locals(struct inuse_block_table* blocks, unsigned int* qv_bitmap,
+						struct block_worklist* wl)
+{
+	unsigned int seg_index;
+	size_t ptr_sz = g_ptr_bit >> 3;
+	struct inuse_ptr_batch batch;
+
+	if (!init_inuse_ptr_batch(&batch, INUSE_PTR_BATCH))
+		return CA_FALSE;
+
+	for (seg_index = 0; seg_index < g_segment_count; seg_index++)
+	{
+		struct ca_segment* segment = &g_segments[seg_index];
+
+		// This search may take long, bail out if user is impatient
+		if (user_request_break())
+		{
+			CA_PRINT("Abort searching\n");
+			break;
+		}
+
+		if (segment->m_fsize == 0)
+			continue;
+
+		// Only local/global variables are checked
+		if (segment->m_type == ENUM_STACK
+			|| segment->m_type == ENUM_MODULE_DATA
+			|| segment->m_type == ENUM_MODULE_TEXT)
+		{
+			address_t start, next, end;
+
+			start = segment->m_vaddr;
+			end   = start + segment->m_fsize;
+			// ignore stack memory below stack pointer
+			if (segment->m_type == ENUM_STACK)
+			{
+				address_t rsp = get_rsp(segment);
+				if (rsp >= segment->m_vaddr && rsp < segment->m_vaddr + segment->m_vsize)
+					start = rsp;
+			}
+
+			next = ALIGN(start, ptr_sz);
+			while (next + ptr_sz <= end)
+			{
+				unsigned long n, k;
+
+				// stop at unreadable memory
+				n = read_inuse_ptr_batch(segment, next, end, &batch);
+				if (n == 0)
+					break;
+				if (find_inuse_blocks(blocks, &batch))
+				{
+					for (k = 0; k < n; k++)
+					{
+						if (batch.indexes[k] != INUSE_BLOCK_NONE)
+							push_unvisited_block(qv_bitmap, wl, batch.indexes[k], &g_traverse_stat);
+					}
+				}
+				next += n * ptr_sz;
+			}
+		}
+	}
+	release_inuse_ptr_batch(&batch);
+
+	return CA_TRUE;
+}
+
+static unsigned long* get_edge_buffer(unsigned long len)
+{
+	static unsigned long* g_edge_buffer = NULL;
+	static unsigned long  g_edge_buffer_size = 0;
+	if (g_edge_buffer_size < len)
+	{
+		// free previous, smaller buffer
+		if (g_edge_buffer)
+			free (g_edge_buffer);
+		// allocate a buffer big enough for current request
+		g_edge_buffer_size = len;
+		g_edge_buffer = (unsigned long*) malloc(g_edge_buffer_size * sizeof(unsigned long));
+		if (!g_edge_buffer)
+		{
+			g_edge_buffer_size = 0;
+			CA_PRINT("Out-of-memory\n");
+			return NULL;
+		}
+	}
+	return g_edge_buffer;
+}
+
+/*
+ * Collect the indexes of sub blocks referenced by a block, without duplicates
+ * 	Return the buffer of indexes, which is reused by the next call
+ */
+static unsigned long* build_block_index_map(unsigned long blk_index,
+						struct inuse_block_table* inuse_blocks,
+						unsigned long* opCount)
+{
+	size_t ptr_sz = g_ptr_bit >> 3;
+	address_t start, end, cursor;
+	unsigned long max_sub_blocks, total_sub_blocks;
+	unsigned long* index_buf = NULL;
+	static struct inuse_ptr_batch batch;
+	static struct index_set dedup;
+
+	*opCount = 0;
+	if (!batch.capacity && !init_inuse_ptr_batch(&batch, INUSE_PTR_BATCH))
+		return NULL;
+
+	// Queue possible pointers to heap memory contained by this block
+	start = ALIGN(inuse_blocks->addrs[blk_index], ptr_sz);
+	end   = start + inuse_blocks->sizes[blk_index];
+	cursor = start;
+
+	max_sub_blocks = (ALIGN(end, ptr_sz) - start) / ptr_sz;
+	total_sub_blocks = 0;
+	index_buf = get_edge_buffer(max_sub_blocks + 1);
+	if (!index_buf)
+		return NULL;
+	while (cursor < end)
+	{
+		unsigned long n, k;
+
+		n = read_inuse_ptr_batch(NULL, cursor, ALIGN(end, ptr_sz), &batch);
+		if (n == 0)
+		{
+			// skip the unreadable pointer
+			cursor += ptr_sz;
+			continue;
+		}
+		cursor += n * ptr_sz;
+		if (!find_inuse_blocks(inuse_blocks, &batch))
+			continue;
+		for (k = 0; k < n; k++)
+		{
+			if (batch.indexes[k] != INUSE_BLOCK_NONE)
+				index_buf[total_sub_blocks++] = batch.indexes[k];
+		}
+	}
+	// avoid duplicate, which is not uncommon, e.g. a pointer array or hash table
+	*opCount = unique_indexes(&dedup, index_buf, total_sub_blocks);
+	return index_buf;
+}
+
+/*
+ * Build the reference graph of all in-use blocks in CSR form, once
+ * 	edges of block i are bytes [edge_offsets[i], edge_offsets[i+1]) of edges[]
+ */
+static CA_BOOL build_heap_ref_graph(struct inuse_block_table* table)
+{
+	unsigned long i;
+	size_t used = 0;
+	size_t capacity;
+	size_t* offsets;
+	unsigned char* edges;
+
+	if (table->edge_offsets)
+		return CA_TRUE;
+
+	offsets = (size_t*) malloc((table->count + 1) * sizeof(size_t));
+	capacity = table->count * 2 + 4096;
+	edges = (unsigned char*) malloc(capacity);
+	if (!offsets || !edges)
+		goto fail;
+
+	for (i = 0; i < table->count; i++)
+	{
+		unsigned long* index_buf;
+		unsigned long num_sub_blocks, k, prev;
+
+		// This may take long, bail out if user is impatient
+		if ((i & 0xfff) == 0 && user_request_break())
+		{
+			CA_PRINT("Abort building heap reference graph\n");
+			goto fail;
+		}
+
+		offsets[i] = used;
+		index_buf = build_block_index_map(i, table, &num_sub_blocks);
+		if (!index_buf)
+			goto fail;
+		if (used + num_sub_blocks * MAX_EDGE_BYTES > capacity)
+		{
+			unsigned char* bigger;
+			capacity = (capacity + num_sub_blocks * MAX_EDGE_BYTES) * 2;
+			bigger = (unsigned char*) realloc(edges, capacity);
+			if (!bigger)
+				goto fail;
+			edges = bigger;
+		}
+		for (k = 0, prev = i; k < num_sub_blocks; k++)
+		{
+			used += encode_ref_edge(edges + used, prev, index_buf[k]);
+			prev = index_buf[k];
+		}
+	}
+	offsets[table->count] = used;
+
+	// give back the slack
+	if (used)
+	{
+		unsigned char* exact = (unsigned char*) realloc(edges, used);
+		if (exact)
+			edges = exact;
+	}
+	table->edge_offsets = offsets;
+	table->edges = edges;
+	table->edges_size = used;
+	return CA_TRUE;
+
+fail:
+	CA_PRINT("Failed to build heap reference graph\n");
+	if (offsets)
+		free(offsets);
+	if (edges)
+		free(edges);
+	return CA_FALSE;
+}
+
+/*
+ * Process blocks of the worklist until it is empty, blocks referenced by them
+ * are marked visited and appended to it
+ * Return the sum of sizes of processed blocks, and their count
+ */
+static size_t traverse_block_worklist(struct inuse_block_table *inuse_blocks,
+								unsigned int* qv_bitmap,
+								struct block_worklist* wl,
+								unsigned long *count,
+								struct heap_traverse_stat* stat)
+{
+	size_t sum = 0;
+
+	while (wl->head < wl->tail)
+	{
+		unsigned long blk_index = wl->queue[wl->head++];
+		unsigned long index;
+		struct ref_edge_cursor it;
+
+		sum += inuse_blocks->sizes[blk_index];
+		(*count)++;
+		stat->blocks_processed++;
+
+		init_ref_edge_cursor(&it, inuse_blocks, blk_index);
+		while (next_ref_edge(&it, &index))
+			push_unvisited_block(qv_bitmap, wl, index, stat);
+	}
+	return sum;
+}
+
+/*
+ * Input is a heap memory address
+ * Return the sum of sizes of all memory blocks (and their count) reachable by the block
+ * 		i.e. referenced directly or indirectly by it (avoid duplicates)
+ */
+static size_t heap_aggregate_size(unsigned long blk_index,
+								struct inuse_block_table *inuse_blocks,
+								unsigned int* qv_bitmap,
+								unsigned long *aggr_count)
+{
+	static struct block_worklist wl;
+	static unsigned long wl_capacity = 0;
+
+	*aggr_count = 0;
+	if (is_queued_or_visited(qv_bitmap, blk_index))
+		return 0;
+
+	// a block is queued at most once
+	if (wl_capacity < inuse_blocks->count)
+	{
+		if (wl.queue)
+			free(wl.queue);
+		wl.queue = (unsigned long*) malloc(inuse_blocks->count * sizeof(unsigned long));
+		if (!wl.queue)
+		{
+			wl_capacity = 0;
+			CA_PRINT("Out of Memory\n");
+			return 0;
+		}
+		wl_capacity = inuse_blocks->count;
+	}
+	wl.head = wl.tail = 0;
+	push_unvisited_block(qv_bitmap, &wl, blk_index, &g_traverse_stat);
+
+	return traverse_block_worklist(inuse_blocks, qv_bitmap, &wl, aggr_count, &g_traverse_stat);
+}
+
+/*
+ * Parallel mark of the leak check, in the way of a concurrent GC's mark phase
+ * 	[1] workers scan slices of stacks and module data/text for roots
+ * 	[2] workers process blocks of their own deques, and steal from others'
+ * 	    when theirs run dry, until no block is queued or being processed
+ * A block is pushed only by the worker which sets its visited bit atomically,
+ * hence every reachable block is visited once and the leak candidates, i.e.
+ * blocks left unvisited, are the same as those of the serial mark.
+ */
+#define ROOT_SLICE_SZ (4*1024*1024)
+
+// Number of blocks moved at once between the private stack and the deque
+#define MARK_CHUNK 256
+
+struct root_slice
+{
+	struct ca_segment* segment;
+	size_t first;		// index of the first pointer of the slice
+	size_t last;		// index past the last pointer of the slice
+};
+
+/*
+ * Blocks queued by one worker
+ * 	the private stack is used by its owner only, without locking
+ * 	the deque is shared, the owner appends to its bottom and thieves take from its top
+ */
+struct mark_worker
+{
+	unsigned long* stack;
+	unsigned long  depth;
+	unsigned long  stack_capacity;
+
+	volatile long  lock;
+	unsigned long* items;
+	volatile unsigned long top;
+	volatile unsigned long bottom;
+	unsigned long  capacity;
+
+	struct inuse_ptr_batch batch;
+	struct heap_traverse_stat stat;
+	char pad[64];		// workers don't share cache lines of hot fields
+};
+
+struct mark_job
+{
+	struct inuse_block_table* blocks;
+	unsigned int* bitmap;
+	struct root_slice* slices;
+	size_t num_slices;
+	size_t ahead;		// distance of the slice to read ahead
+	struct mark_worker* workers;
+	unsigned int num_workers;
+	volatile long busy;	// number of workers holding blocks
+	volatile CA_BOOL failed;	// out of memory
+};
+
+/*
+ * Set the visited bit of the block, return true if it is not set before
+ */
+static inline CA_BOOL mark_visited_atomic(unsigned int* bitmap, unsigned long index)
+{
+	volatile unsigned int* word = &bitmap[index >> 4];
+	unsigned int bit = VISITED << ((index & 0xf) << 1);
+
+	// most edges lead to visited blocks, read before the atomic operation
+	if (*word & bit)
+		return CA_FALSE;
+	return (ca_atomic_or(word, bit) & bit) ? CA_FALSE : CA_TRUE;
+}
+
+static CA_BOOL push_marked_block(struct mark_worker* me, unsigned long index)
+{
+	if (me->depth == me->stack_capacity)
+	{
+		unsigned long capacity = me->stack_capacity * 2;
+		unsigned long* bigger = (unsigned long*) realloc(me->stack, capacity * sizeof(unsigned long));
+		if (!bigger)
+			return CA_FALSE;
+		me->stack = bigger;
+		me->stack_capacity = capacity;
+	}
+	me->stack[me->depth++] = index;
+	return CA_TRUE;
+}
+
+/*
+ * Move the latest n blocks of the private stack to the bottom of the deque
+ */
+static CA_BOOL publish_marked_blocks(struct mark_worker* me, unsigned long n)
+{
+	CA_BOOL rc = CA_TRUE;
+
+	ca_spin_lock(&me->lock);
+	if (me->top == me->bottom)
+		me->top = me->bottom = 0;
+	if (me->bottom + n > me->capacity)
+	{
+		unsigned long capacity = (me->bottom + n) * 2;
+		unsigned long* bigger = (unsigned long*) realloc(me->items, capacity * sizeof(unsigned long));
+		if (bigger)
+		{
+			me->items = bigger;
+			me->capacity = capacity;
+		}
+		else
+			rc = CA_FALSE;
+	}
+	if (rc)
+	{
+		memcpy(&me->items[me->bottom], &me->stack[me->depth - n], n * sizeof(unsigned long));
+		me->bottom += n;
+		me->depth -= n;
+	}
+	ca_spin_unlock(&me->lock);
+	return rc;
+}
+
+/*
+ * Fill the empty private stack of worker from its own deque, or else steal
+ * half of the blocks of another worker's deque.
+ * The worker counts as busy before it takes any block out of a deque, so
+ * that no block is in transit while the job looks finished to others
+ */
+static CA_BOOL take_marked_blocks(struct mark_job* job, unsigned int worker, CA_BOOL* busy)
+{
+	struct mark_worker* me = &job->workers[worker];
+	unsigned int i;
+
+	for (i = 0; i < job->num_workers; i++)
+	{
+		unsigned int victim_index = (worker + i) % job->num_workers;
+		struct mark_worker* victim = &job->workers[victim_index];
+		unsigned long n;
+
+		// a hint without lock, skip empty deques quickly
+		if (victim->top == victim->bottom)
+			continue;
+		ca_spin_lock(&victim->lock);
+		n = victim->bottom - victim->top;
+		if (n > 0)
+		{
+			if (!*busy)
+			{
+				ca_atomic_add(&job->busy, 1);
+				*busy = CA_TRUE;
+			}
+			if (victim == me)
+			{
+				// the owner takes the latest blocks from the bottom
+				if (n > MARK_CHUNK)
+					n = MARK_CHUNK;
+				victim->bottom -= n;
+				memcpy(me->stack, &victim->items[victim->bottom], n * sizeof(unsigned long));
+			}
+			else
+			{
+				// thieves take the oldest half from the top
+				n = (n + 1) / 2;
+				if (n > MARK_CHUNK)
+					n = MARK_CHUNK;
+				memcpy(me->stack, &victim->items[victim->top], n * sizeof(unsigned long));
+				victim->top += n;
+			}
+			me->depth = n;
+		}
+		ca_spin_unlock(&victim->lock);
+		if (n > 0)
+			return CA_TRUE;
+	}
+	return CA_FALSE;
+}
+
+static CA_BOOL has_queued_blocks(struct mark_job* job)
+{
+	unsigned int i;
+
+	for (i = 0; i < job->num_workers; i++)
+	{
+		struct mark_worker* w = &job->workers[i];
+		CA_BOOL queued;
+
+		ca_spin_lock(&w->lock);
+		queued = (w->top != w->bottom) ? CA_TRUE : CA_FALSE;
+		ca_spin_unlock(&w->lock);
+		if (queued)
+			return CA_TRUE;
+	}
+	return CA_FALSE;
+}
+
+static void prefetch_root_slice(struct mark_job* job, size_t task)
+{
+	if (task < job->num_slices)
+		prefetch_segment_range(job->slices[task].segment, job->slices[task].first, job->slices[task].last);
+}
+
+static void scan_root_slice_task(void* arg, size_t task, unsigned int worker)
+{
+	struct mark_job* job = (struct mark_job*) arg;
+	struct root_slice* slice = &job->slices[task];
+	struct ca_segment* segment = slice->segment;
+	struct mark_worker* me = &job->workers[worker];
+	size_t ptr_sz = g_ptr_bit >> 3;
+	size_t i = slice->first;
+
+	prefetch_root_slice(job, task + job->ahead);
+	pin_segment_range(segment, slice->first, slice->last);
+	while (i < slice->last && !job->failed)
+	{
+		unsigned long n = me->batch.capacity;
+		unsigned long k;
+
+		if (n > slice->last - i)
+			n = slice->last - i;
+		for (k = 0; k < n; k++)
+			me->batch.values[k] = load_core_ptr(segment->m_faddr + (i + k) * ptr_sz, ptr_sz);
+		me->batch.count = n;
+		if (find_inuse_blocks(job->blocks, &me->batch))
+		{
+			for (k = 0; k < n; k++)
 			{
-				tid = get_thread_id (segment);
-				// allocate register value buffer for once
-				if (!nregs && !regs_buf)
-				{
-					nregs = read_registers (NULL, NULL, 0);
-					if (nregs)
-						regs_buf = (struct reg_value*) malloc(nregs * sizeof(struct reg_value));
-				}
-				// check each register for heap reference
-				if (nregs && regs_buf)
+				unsigned long index = me->batch.indexes[k];
+				if (index == INUSE_BLOCK_NONE)
+					continue;
+				me->stat.bitmap_words_scanned++;
+				if (mark_visited_atomic(job->bitmap, index) && !push_marked_block(me, index))
 				{
-					int k;
-					int nread = read_registers (segment, regs_buf, nregs);
-					for (k = 0; k < nread; k++)
-					{
-						if (regs_buf[k].reg_width == ptr_sz)
-						{
-							blk = find_inuse_block(regs_buf[k].value, inuse_blocks, num_inuse_blocks);
-							if (blk)
-							{
-								ref.storage_type = ENUM_REGISTER;
-								ref.vaddr = 0;
-								ref.value = blk->addr;
-								ref.where.reg.tid = tid;
-								ref.where.reg.reg_num = k;
-								ref.where.reg.name = NULL;
-								calc_aggregate_size(&ref, ptr_sz, all_reachable_blocks, inuse_blocks, num_inuse_blocks, &aggr_size, &aggr_count);
-								if (aggr_size > smallest->aggr_size)
-								{
-									struct heap_owner newowner;
-									newowner.ref = ref;
-									newowner.aggr_size = aggr_size;
-									newowner.aggr_count = aggr_count;
-									add_owner(owners, num, &newowner);
-								}
-							}
-						}
-					}
+					job->failed = CA_TRUE;
+					break;
 				}
 			}
+		}
+		i += n;
+	}
+	unpin_segment_range(segment, slice->first, slice->last);
+	release_segment_range(segment, slice->first, slice->last);
 
-			// Calculate the memory region to search
-			if (segment->m_type == ENUM_STACK)
+	// roots are processed in the next phase by any worker
+	if (me->depth && !publish_marked_blocks(me, me->depth))
+		job->failed = CA_TRUE;
+}
+
+static void mark_blocks_task(void* arg, size_t task, unsigned int worker)
+{
+	struct mark_job* job = (struct mark_job*) arg;
+	struct mark_worker* me = &job->workers[worker];
+	CA_BOOL busy = CA_FALSE;
+
+	while (!job->failed)
+	{
+		unsigned long blk_index, index;
+		struct ref_edge_cursor it;
+
+		if (me->depth == 0 && !take_marked_blocks(job, worker, &busy))
+		{
+			if (busy)
 			{
-				start = get_rsp(segment);
-				if (start < segment->m_vaddr || start >= segment->m_vaddr + segment->m_vsize)
-					start = segment->m_vaddr;
-				if (start - segment->m_vaddr >= segment->m_fsize)
-					end = start;
-				else
-					end = segment->m_vaddr + segment->m_fsize;
+				ca_atomic_add(&job->busy, -1);
+				busy = CA_FALSE;
 			}
-			else if (segment->m_type == ENUM_MODULE_DATA)
+			// a thief is busy before a deque is seen empty, check it again after
+			if (job->busy == 0 && !has_queued_blocks(job) && job->busy == 0)
+				break;
+			ca_yield();
+			continue;
+		}
+
+		blk_index = me->stack[--me->depth];
+		me->stat.blocks_processed++;
+		init_ref_edge_cursor(&it, job->blocks, blk_index);
+		while (next_ref_edge(&it, &index))
+		{
+			me->stat.bitmap_words_scanned++;
+			if (mark_visited_atomic(job->bitmap, index) && !push_marked_block(me, index))
 			{
-				start = segment->m_vaddr;
-				end = segment->m_vaddr + segment->m_fsize;
+				job->failed = CA_TRUE;
+				break;
 			}
-			else
+		}
+		// share work when others have taken all of it
+		if (me->depth >= 2 * MARK_CHUNK && me->top == me->bottom
+			&& !publish_marked_blocks(me, MARK_CHUNK))
+			job->failed = CA_TRUE;
+	}
+	if (busy)
+		ca_atomic_add(&job->busy, -1);
+}
+
+/*
+ * Slice root segments, i.e. thread stacks above the stack pointer and
+ * module data/text, all of which must be mapped from the core
+ */
+static CA_BOOL build_root_slices(struct mark_job* job)
+{
+	size_t ptr_sz = g_ptr_bit >> 3;
+	size_t slice_ptrs = ROOT_SLICE_SZ / ptr_sz;
+	unsigned int pass, seg_index;
+
+	// count slices first, then fill them
+	for (pass = 0; pass < 2; pass++)
+	{
+		job->num_slices = 0;
+		for (seg_index = 0; seg_index < g_segment_count; seg_index++)
+		{
+			struct ca_segment* segment = &g_segments[seg_index];
+			address_t start;
+			size_t first, last;
+
+			if (segment->m_fsize == 0)
 				continue;
+			if (segment->m_type != ENUM_STACK
+				&& segment->m_type != ENUM_MODULE_DATA
+				&& segment->m_type != ENUM_MODULE_TEXT)
+				continue;
+			if (!segment->m_faddr)
+				return CA_FALSE;
 
-			// Evaluate each variable or raw pointer in the target memory region
-			cursor = ALIGN(start, ptr_sz);
-			while (cursor < end)
+			start = segment->m_vaddr;
+			// ignore stack memory below stack pointer
+			if (segment->m_type == ENUM_STACK)
 			{
-				size_t val_len = ptr_sz;
-				address_t sym_addr;
-				size_t    sym_sz;
-				CA_BOOL known_sym = CA_FALSE;
-
-				// If the address belongs to a known variable, include all its subfields
-				// FIXME
-				// consider subfields that are of pointer-like types, however, it will miss
-				// references in an unstructured buffer
-				ref.storage_type = segment->m_type;
-				ref.vaddr = cursor;
-				if (segment->m_type == ENUM_STACK)
-				{
-					ref.where.stack.tid = tid;
-					ref.where.stack.frame = get_frame_number(segment, cursor, &ref.where.stack.offset);
-					if (known_stack_sym(&ref, &sym_addr, &sym_sz) && sym_sz)
-						known_sym = CA_TRUE;
-				}
-				else if (segment->m_type == ENUM_MODULE_DATA)
-				{
-					ref.where.module.base = segment->m_vaddr;
-					ref.where.module.size = segment->m_vsize;
-					ref.where.module.name = segment->m_module_name;
-					if (known_global_sym(&ref, &sym_addr, &sym_sz) && sym_sz)
-						known_sym = CA_TRUE;
-				}
-				if (known_sym)
-				{
-					if (cursor != sym_addr)
-						ref.vaddr = cursor = sym_addr;	// we should never come to here!
-					val_len = sym_sz;
-				}
-
-				// Query heap for aggregated memory size/count originated from the candidate variable
-				if (val_len >= ptr_sz)
+				address_t rsp = get_rsp(segment);
+				if (rsp >= segment->m_vaddr && rsp < segment->m_vaddr + segment->m_vsize)
+					start = rsp;
+			}
+			first = (ALIGN(start, ptr_sz) - segment->m_vaddr) / ptr_sz;
+			last  = segment->m_fsize / ptr_sz;
+			for (; first < last; first += slice_ptrs)
+			{
+				if (pass == 1)
 				{
-					calc_aggregate_size(&ref, val_len, all_reachable_blocks, inuse_blocks, num_inuse_blocks, &aggr_size, &aggr_count);
-					// update the top list if applies
-					if (aggr_size >= smallest->aggr_size)
-					{
-						struct heap_owner newowner;
-						if (val_len == ptr_sz)
-							read_memory_wrapper(NULL, ref.vaddr, (void*)&ref.value, ptr_sz);
-						else
-							ref.value = 0;
-						newowner.ref = ref;
-						newowner.aggr_size = aggr_size;
-						newowner.aggr_count = aggr_count;
-						add_owner(owners, num, &newowner);
-					}
+					struct root_slice* slice = &job->slices[job->num_slices];
+					slice->segment = segment;
+					slice->first = first;
+					slice->last = (last - first > slice_ptrs) ? first + slice_ptrs : last;
 				}
-				cursor = ALIGN(cursor + val_len, ptr_sz);
+				job->num_slices++;
 			}
-			processed_bytes += segment->m_fsize;
-			set_current_progress(processed_bytes);
+		}
+		if (pass == 0)
+		{
+			job->slices = (struct root_slice*) malloc((job->num_slices + 1) * sizeof(struct root_slice));
+			if (!job->slices)
+				return CA_FALSE;
 		}
 	}
-	end_progress_bar();
+	return CA_TRUE;
+}
+
+/*
+ * Mark all blocks reachable from global/local variables with all workers
+ * Return false if it doesn't apply, e.g. a live process or a single worker,
+ * 	or it runs out of memory, the bitmap is left clean for the serial mark
+ */
+static CA_BOOL parallel_mark_heap_blocks(struct inuse_block_table* blocks, unsigned int* qv_bitmap)
+{
+	struct mark_job job;
+	unsigned int i;
+	CA_BOOL rc = CA_FALSE;
+
+	if (!g_debug_core || ca_num_workers() < 2 || blocks->count == 0)
+		return CA_FALSE;
 
-	if (!all_reachable_blocks)
+	memset(&job, 0, sizeof(job));
+	job.blocks = blocks;
+	job.bitmap = qv_bitmap;
+	job.num_workers = ca_num_workers();
+	job.ahead = prefetch_distance();
+	job.workers = (struct mark_worker*) calloc(job.num_workers, sizeof(struct mark_worker));
+	if (!job.workers || !build_root_slices(&job))
+		goto parallel_mark_out;
+	for (i = 0; i < job.num_workers; i++)
 	{
-		// Big memory blocks may be referenced indirectly by local/global variables
-		// check all in-use blocks
-		for (inuse_index = 0; inuse_index < num_inuse_blocks; inuse_index++)
+		struct mark_worker* w = &job.workers[i];
+		w->stack_capacity = MARK_CHUNK * 4;
+		w->stack = (unsigned long*) malloc(w->stack_capacity * sizeof(unsigned long));
+		if (!w->stack || !init_inuse_ptr_batch(&w->batch, INUSE_PTR_BATCH))
+			goto parallel_mark_out;
+	}
+
+	prefetch_root_slice(&job, 0);
+	if (!ca_parallel_run(job.num_slices, scan_root_slice_task, &job, CA_TRUE))
+		CA_PRINT("Abort searching\n");
+	// one task per worker, each of them runs until all reachable blocks are marked
+	if (!job.failed)
+		ca_parallel_run(job.num_workers, mark_blocks_task, &job, CA_FALSE);
+	if (!job.failed)
+	{
+		for (i = 0; i < job.num_workers; i++)
 		{
-			blk = &inuse_blocks[inuse_index];
-			ref.storage_type = ENUM_HEAP;
-			ref.vaddr = blk->addr;
-			ref.where.heap.addr = blk->addr;
-			ref.where.heap.size = blk->size;
-			ref.where.heap.inuse = 1;
-			calc_aggregate_size(&ref, ptr_sz, CA_FALSE, inuse_blocks, num_inuse_blocks, &aggr_size, &aggr_count);
-			// update the top list if applies
-			if (aggr_size >= smallest->aggr_size)
-			{
-				struct heap_owner newowner;
-				ref.value = 0;
-				newowner.ref = ref;
-				newowner.aggr_size = aggr_size;
-				newowner.aggr_count = aggr_count;
-				add_owner(owners, num, &newowner);
-			}
+			g_traverse_stat.blocks_processed += job.workers[i].stat.blocks_processed;
+			g_traverse_stat.bitmap_words_scanned += job.workers[i].stat.bitmap_words_scanned;
 		}
+		rc = CA_TRUE;
 	}
+	else
+		memset(qv_bitmap, 0, (blocks->count+15)*2/32 * sizeof(unsigned int));
 
-	// Print the result
-	for (i = 0; i < num; i++)
+parallel_mark_out:
+	if (job.workers)
 	{
-		struct heap_owner *owner = &owners[i];
-		if (owner->aggr_size)
+		for (i = 0; i < job.num_workers; i++)
 		{
-			CA_PRINT("[%d] ", i+1);
-			print_ref(&owner->ref, 0, CA_FALSE, CA_FALSE);
-			CA_PRINT("    |--> ");
-			print_size(owner->aggr_size);
-			CA_PRINT(" (%ld blocks)\n", owner->aggr_count);
+			struct mark_worker* w = &job.workers[i];
+			if (w->stack)
+				free(w->stack);
+			if (w->items)
+				free(w->items);
+			release_inuse_ptr_batch(&w->batch);
 		}
+		free(job.workers);
 	}
-	rc = CA_TRUE;
+	if (job.slices)
+		free(job.slices);
+	return rc;
+}
 
-clean_out:
-	// clean up
-	if (regs_buf)
-		free (regs_buf);
-	if (owners)
-		free (owners);
-	if (inuse_blocks)
-		free_inuse_heap_blocks (inuse_blocks, num_inuse_blocks);
+/*
+ * Reachable size/count of every block in one pass
+ * 	blocks of a strongly connected component reach the same blocks, so the
+ * 	graph is condensed into components by Tarjan's algorithm, which finds a
+ * 	component after all components it reaches. Then a component reaches the
+ * 	union of what its successors reach, plus its own blocks, none of which is
+ * 	reached by a successor. A set is released when its last predecessor has
+ * 	taken it, and taken over without a copy by that one.
+ * 	Sets are exact, sparse or dense with a memory budget, or bottom-k sketches
+ * 	of the blocks with the smallest hashes, which estimate both count and size
+ */
+struct reach_set
+{
+	unsigned long  count;
+	size_t         size;
+	unsigned long  len;			// number of items
+	unsigned long  capacity;
+	unsigned long* items;		// block indexes, sorted by hash if it is a sketch
+	unsigned int*  bits;		// or else a bit per block of a dense set
+	CA_BOOL        truncated;	// a sketch has dropped items
+};
+
+struct reach_job
+{
+	struct inuse_block_table* blocks;
+	CA_BOOL        estimate;
+	unsigned long  num_comps;
+	unsigned long* comp;		// component of a block
+	unsigned long* comp_first;	// blocks of component c are members[comp_first[c], comp_first[c+1])
+	unsigned long* members;
+	unsigned long* mark;		// component whose sparse set has the block
+	size_t         live_bytes;
+	unsigned long* scratch;
+	unsigned long  scratch_capacity;
+};
+
+static inline unsigned long long reach_hash(unsigned long index)
+{
+	// both steps are bijective, distinct blocks never collide
+	unsigned long long h = (unsigned long long)index * 0x9E3779B97F4A7C15ull;
+	h ^= h >> 29;
+	h *= 0xBF58476D1CE4E5B9ull;
+	return h ^ (h >> 32);
+}
+
+static int compare_reach_hash(const void* lhs, const void* rhs)
+{
+	unsigned long long a = reach_hash(*(const unsigned long*)lhs);
+	unsigned long long b = reach_hash(*(const unsigned long*)rhs);
+	return (a < b) ? -1 : ((a > b) ? 1 : 0);
+}
+
+/*
+ * Number strongly connected components with Tarjan's algorithm, without recursion
+ */
+struct tarjan_frame
+{
+	unsigned long node;
+	struct ref_edge_cursor edges;
+};
+
+static CA_BOOL find_block_components(struct reach_job* job)
+{
+	struct inuse_block_table* blocks = job->blocks;
+	unsigned long n = blocks->count;
+	unsigned long* disc = (unsigned long*) malloc(n * sizeof(unsigned long));
+	unsigned long* low  = (unsigned long*) malloc(n * sizeof(unsigned long));
+	unsigned long* scc  = (unsigned long*) malloc(n * sizeof(unsigned long));
+	unsigned long capacity = 4096;
+	struct tarjan_frame* frames = (struct tarjan_frame*) malloc(capacity * sizeof(struct tarjan_frame));
+	unsigned long num_scc = 0, next = 0, depth, root, v, w, c;
+	CA_BOOL rc = CA_FALSE;
+
+	job->comp = (unsigned long*) malloc(n * sizeof(unsigned long));
+	job->comp_first = (unsigned long*) calloc(n + 1, sizeof(unsigned long));
+	job->members = (unsigned long*) malloc(n * sizeof(unsigned long));
+	if (!disc || !low || !scc || !frames || !job->comp || !job->comp_first || !job->members)
+		goto components_out;
+	for (v = 0; v < n; v++)
+	{
+		disc[v] = DOM_NONE;
+		job->comp[v] = DOM_NONE;
+	}
 
+	job->num_comps = 0;
+	for (root = 0; root < n; root++)
+	{
+		if (disc[root] != DOM_NONE)
+			continue;
+		if ((root & 0xfff) == 0 && user_request_break())
+		{
+			CA_PRINT("Abort searching strongly connected blocks\n");
+			goto components_out;
+		}
+		disc[root] = low[root] = next++;
+		scc[num_scc++] = root;
+		frames[0].node = root;
+		init_ref_edge_cursor(&frames[0].edges, blocks, root);
+		depth = 1;
+		while (depth)
+		{
+			struct tarjan_frame* frame = &frames[depth - 1];
+
+			v = frame->node;
+			if (next_ref_edge(&frame->edges, &w))
+			{
+				if (disc[w] == DOM_NONE)
+				{
+					if (depth == capacity)
+					{
+						struct tarjan_frame* bigger;
+						capacity *= 2;
+						bigger = (struct tarjan_frame*) realloc(frames, capacity * sizeof(struct tarjan_frame));
+						if (!bigger)
+							goto components_out;
+						frames = bigger;
+					}
+					disc[w] = low[w] = next++;
+					scc[num_scc++] = w;
+					frames[depth].node = w;
+					init_ref_edge_cursor(&frames[depth].edges, blocks, w);
+					depth++;
+				}
+				// w is on the stack of the current search unless its component is done
+				else if (job->comp[w] == DOM_NONE && disc[w] < low[v])
+					low[v] = disc[w];
+				continue;
+			}
+
+			depth--;
+			if (depth && low[v] < low[frames[depth - 1].node])
+				low[frames[depth - 1].node] = low[v];
+			if (low[v] == disc[v])
+			{
+				do
+				{
+					w = scc[--num_scc];
+					job->comp[w] = job->num_comps;
+					job->comp_first[job->num_comps + 1]++;
+				} while (w != v);
+				job->num_comps++;
+			}
+		}
+	}
+
+	// blocks grouped by component
+	for (c = 0; c < job->num_comps; c++)
+		job->comp_first[c + 1] += job->comp_first[c];
+	for (v = 0; v < n; v++)
+		job->members[job->comp_first[job->comp[v]]++] = v;
+	for (c = job->num_comps; c > 0; c--)
+		job->comp_first[c] = job->comp_first[c - 1];
+	job->comp_first[0] = 0;
+	rc = CA_TRUE;
+
+components_out:
+	if (disc)
+		free(disc);
+	if (low)
+		free(low);
+	if (scc)
+		free(scc);
+	if (frames)
+		free(frames);
 	return rc;
 }
 
+static void release_reach_set(struct reach_job* job, struct reach_set* set)
+{
+	if (!set)
+		return;
+	if (set->items)
+	{
+		job->live_bytes -= set->capacity * sizeof(unsigned long);
+		free(set->items);
+	}
+	if (set->bits)
+	{
+		job->live_bytes -= ((job->blocks->count + 31) / 32) * sizeof(unsigned int);
+		free(set->bits);
+	}
+	free(set);
+}
+
+static CA_BOOL reserve_reach_items(struct reach_job* job, struct reach_set* set, unsigned long len)
+{
+	unsigned long capacity;
+	unsigned long* bigger;
+
+	if (len <= set->capacity)
+		return CA_TRUE;
+	capacity = set->capacity ? set->capacity * 2 : 4;
+	if (capacity < len)
+		capacity = len;
+	if (!job->estimate && job->live_bytes + (capacity - set->capacity) * sizeof(unsigned long) > REACH_SET_BUDGET)
+		return CA_FALSE;
+	bigger = (unsigned long*) realloc(set->items, capacity * sizeof(unsigned long));
+	if (!bigger)
+		return CA_FALSE;
+	job->live_bytes += (capacity - set->capacity) * sizeof(unsigned long);
+	set->items = bigger;
+	set->capacity = capacity;
+	return CA_TRUE;
+}
+
+static inline void add_reach_block(struct reach_job* job, struct reach_set* set, unsigned long blk)
+{
+	set->count++;
+	set->size += job->blocks->sizes[blk];
+}
+
 /*
- * Given a reference, a variable or a pointer to a heap block, with known size,
- * 	Return its aggregated reachable in-use blocks
+ * A sparse set becomes dense when its items take as much memory as the bitmap
  */
-CA_BOOL
-calc_aggregate_size(const struct object_reference *ref,
-					size_t var_len,
-					CA_BOOL all_reachable_blocks,
-					struct inuse_block *inuse_blocks,
-					unsigned long num_inuse_blocks,
-					size_t *total_size,
-					unsigned long *total_count)
+static CA_BOOL make_reach_set_dense(struct reach_job* job, struct reach_set* set)
 {
-	address_t addr, cursor, end;
-	size_t ptr_sz = g_ptr_bit >> 3;
-	size_t aggr_size = 0;
-	unsigned long aggr_count = 0;
-	struct inuse_block *blk;
-	size_t bitmap_sz = ((num_inuse_blocks+15)*2/32) * sizeof(unsigned int);
+	size_t bitmap_sz = ((job->blocks->count + 31) / 32) * sizeof(unsigned int);
+	unsigned long i;
 
-	static unsigned int* qv_bitmap = NULL;	// Bit flags of whether a block is queued/visited
-	static unsigned long bitmap_capacity = 0;	// in terms of number of blocks handled
+	if (job->live_bytes + bitmap_sz > REACH_SET_BUDGET)
+		return CA_FALSE;
+	set->bits = (unsigned int*) calloc(1, bitmap_sz);
+	if (!set->bits)
+		return CA_FALSE;
+	job->live_bytes += bitmap_sz;
+	for (i = 0; i < set->len; i++)
+		set->bits[set->items[i] >> 5] |= 1u << (set->items[i] & 31);
+	job->live_bytes -= set->capacity * sizeof(unsigned long);
+	free(set->items);
+	set->items = NULL;
+	set->len = set->capacity = 0;
+	return CA_TRUE;
+}
 
-	// ground return values
-	*total_size = 0;
-	*total_count = 0;
+/*
+ * Exact union, blocks new to the set are counted
+ * 	items of a sparse set are marked with the component being processed
+ */
+static CA_BOOL merge_exact_reach_set(struct reach_job* job, struct reach_set* set, unsigned long c,
+								CA_BOOL* marked, const struct reach_set* other)
+{
+	unsigned long i;
 
-	// Prepare bitmap with the clean state
-	if (bitmap_capacity < num_inuse_blocks)
+	if (!set->bits && (other->bits || set->count + other->count > job->blocks->count / 64)
+		&& !make_reach_set_dense(job, set))
+		return CA_FALSE;
+
+	if (set->bits)
 	{
-		if (qv_bitmap)
-			free (qv_bitmap);
-		// Each block uses two bits(queued/visited)
-		qv_bitmap = (unsigned int*) malloc(bitmap_sz);
-		if (!qv_bitmap)
+		if (other->bits)
+		{
+			unsigned long num_words = (job->blocks->count + 31) / 32;
+			for (i = 0; i < num_words; i++)
+			{
+				unsigned int bits = other->bits[i] & ~set->bits[i];
+				unsigned long k;
+				if (!bits)
+					continue;
+				set->bits[i] |= bits;
+				for (k = 0; bits; k++, bits >>= 1)
+				{
+					if (bits & 1)
+						add_reach_block(job, set, (i << 5) + k);
+				}
+			}
+		}
+		else
+		{
+			for (i = 0; i < other->len; i++)
+			{
+				unsigned long blk = other->items[i];
+				if (!(set->bits[blk >> 5] & (1u << (blk & 31))))
+				{
+					set->bits[blk >> 5] |= 1u << (blk & 31);
+					add_reach_block(job, set, blk);
+				}
+			}
+		}
+		return CA_TRUE;
+	}
+
+	// both are sparse, a set taken over from a successor is marked at its first merge
+	if (!*marked)
+	{
+		for (i = 0; i < set->len; i++)
+			job->mark[set->items[i]] = c;
+		*marked = CA_TRUE;
+	}
+	if (!reserve_reach_items(job, set, set->len + other->len))
+		return CA_FALSE;
+	for (i = 0; i < other->len; i++)
+	{
+		unsigned long blk = other->items[i];
+		if (job->mark[blk] != c)
 		{
-			bitmap_capacity = 0;
-			CA_PRINT("Out of Memory\n");
-			return CA_FALSE;
+			job->mark[blk] = c;
+			set->items[set->len++] = blk;
+			add_reach_block(job, set, blk);
 		}
-		bitmap_capacity = num_inuse_blocks;
 	}
-	memset(qv_bitmap, 0, bitmap_sz);
+	return CA_TRUE;
+}
 
-	// Input is a pointer to an in-use memory block
-	if (ref->storage_type == ENUM_REGISTER || ref->storage_type == ENUM_HEAP)
+/*
+ * Union of sketches, the k smallest hashes of both sorted lists are kept
+ */
+static CA_BOOL merge_reach_sketch(struct reach_job* job, struct reach_set* set,
+								const unsigned long* items, unsigned long len)
+{
+	unsigned long i = 0, j = 0, n = 0;
+	unsigned long* out;
+
+	if (job->scratch_capacity < REACH_SKETCH_K)
 	{
-		if (var_len != ptr_sz)
+		job->scratch = (unsigned long*) malloc(REACH_SKETCH_K * sizeof(unsigned long));
+		if (!job->scratch)
 			return CA_FALSE;
-		blk = find_inuse_block(ref->vaddr, inuse_blocks, num_inuse_blocks);
-		if (blk)
+		job->scratch_capacity = REACH_SKETCH_K;
+	}
+	out = job->scratch;
+	while ((i < set->len || j < len) && n < REACH_SKETCH_K)
+	{
+		unsigned long long a = (i < set->len) ? reach_hash(set->items[i]) : ~0ull;
+		unsigned long long b = (j < len) ? reach_hash(items[j]) : ~0ull;
+		if (i < set->len && (j >= len || a <= b))
 		{
-			// cached result is available, return now
-			if (all_reachable_blocks && blk->reachable.aggr_size)
-			{
-				*total_size  = blk->reachable.aggr_size;
-				*total_count = blk->reachable.aggr_count;
-				return CA_TRUE;
-			}
-			else
-			{
-				// search starts with the memory block
-				cursor = blk->addr;
-				end  = cursor + blk->size;
-				aggr_size  = blk->size;
-				aggr_count = 1;
-				set_visited(qv_bitmap, blk - inuse_blocks);
-			}
+			// the same block is the same hash
+			if (j < len && a == b)
+				j++;
+			out[n++] = set->items[i++];
 		}
 		else
-			return CA_FALSE;
+			out[n++] = items[j++];
+	}
+	if (i < set->len || j < len)
+		set->truncated = CA_TRUE;
+	if (!reserve_reach_items(job, set, n))
+		return CA_FALSE;
+	memcpy(set->items, out, n * sizeof(unsigned long));
+	set->len = n;
+	return CA_TRUE;
+}
+
+// Count and size of a sketch, exact unless it has dropped items
+static void estimate_reach_sketch(struct reach_job* job, struct reach_set* set)
+{
+	size_t sample_size = 0;
+	unsigned long i;
+
+	for (i = 0; i < set->len; i++)
+		sample_size += job->blocks->sizes[set->items[i]];
+	if (!set->truncated)
+	{
+		set->count = set->len;
+		set->size  = sample_size;
 	}
-	// input reference is an object with given size, e.g. a local/global variable
 	else
 	{
-		if (all_reachable_blocks && var_len == ptr_sz)
+		// the k-th smallest of n uniform hashes is about k/n of the range
+		double kth = ((double)reach_hash(set->items[set->len - 1]) + 1.0) / 18446744073709551616.0;
+		double count = (double)(set->len - 1) / kth;
+		set->count = (unsigned long) count;
+		set->size  = (size_t)(count * sample_size / set->len);
+	}
+}
+
+/*
+ * Reachable set of component c from those of its successors
+ */
+static struct reach_set*
+build_component_reach_set(struct reach_job* job, unsigned long c, struct reach_set** sets,
+						unsigned long* refs, const unsigned long* succs, unsigned long num_succs)
+{
+	struct reach_set* set = NULL;
+	unsigned long first = job->comp_first[c];
+	unsigned long num_members = job->comp_first[c + 1] - first;
+	CA_BOOL marked = CA_FALSE;
+	unsigned long i, base = DOM_NONE;
+
+	// take over the biggest set that no other component needs
+	for (i = 0; i < num_succs; i++)
+	{
+		unsigned long d = succs[i];
+		if (refs[d] == 1 && (base == DOM_NONE || sets[d]->count > sets[succs[base]]->count))
+			base = i;
+	}
+	if (base != DOM_NONE)
+	{
+		set = sets[succs[base]];
+		sets[succs[base]] = NULL;
+		refs[succs[base]] = 0;
+	}
+	else
+	{
+		set = (struct reach_set*) calloc(1, sizeof(struct reach_set));
+		if (!set)
+			return NULL;
+	}
+
+	for (i = 0; i < num_succs; i++)
+	{
+		unsigned long d = succs[i];
+		CA_BOOL ok;
+		if (i == base)
+			continue;
+		if (job->estimate)
 		{
-			// input is of pointer size, which is candidate for cache value
-			if(read_memory_wrapper(NULL, ref->vaddr, (void*)&addr, ptr_sz))
-			{
-				blk = find_inuse_block(addr, inuse_blocks, num_inuse_blocks);
-				if (blk)
-				{
-					if (blk->reachable.aggr_size)
-					{
-						*total_size  = blk->reachable.aggr_size;
-						*total_count = blk->reachable.aggr_count;
-						return CA_TRUE;
-					}
-				}
-				else
-					return CA_FALSE;
-			}
-			else
-				return CA_FALSE;
+			ok = merge_reach_sketch(job, set, sets[d]->items, sets[d]->len);
+			if (sets[d]->truncated)
+				set->truncated = CA_TRUE;
+		}
+		else
+			ok = merge_exact_reach_set(job, set, c, &marked, sets[d]);
+		if (--refs[d] == 0)
+		{
+			release_reach_set(job, sets[d]);
+			sets[d] = NULL;
+		}
+		if (!ok)
+		{
+			release_reach_set(job, set);
+			return NULL;
 		}
-		cursor = ref->vaddr;
-		end  = cursor + var_len;
 	}
 
-	// We now have a range of memory to search
-	cursor = ALIGN(cursor, ptr_sz);
-	while (cursor < end)
+	// own blocks are new to the set
+	if (job->estimate)
 	{
-		if(!read_memory_wrapper(NULL, cursor, (void*)&addr, ptr_sz))
-			break;
-		blk = find_inuse_block(addr, inuse_blocks, num_inuse_blocks);
-		if (blk && !is_queued_or_visited(qv_bitmap, blk - inuse_blocks))
+		unsigned long* own = &job->members[first];
+		CA_BOOL ok;
+
+		// members stay grouped by component, a copy of them is sorted by hash
+		if (num_members > 1)
 		{
-			if (all_reachable_blocks)
-			{
-				unsigned long sub_count = 0;
-				aggr_size += heap_aggregate_size(blk, inuse_blocks, num_inuse_blocks, qv_bitmap, &sub_count);
-				aggr_count += sub_count;
-			}
-			else
+			own = (unsigned long*) malloc(num_members * sizeof(unsigned long));
+			if (!own)
 			{
-				aggr_size += blk->size;
-				aggr_count++;
-				set_visited(qv_bitmap, blk - inuse_blocks);
+				release_reach_set(job, set);
+				return NULL;
 			}
+			memcpy(own, &job->members[first], num_members * sizeof(unsigned long));
+			qsort(own, num_members, sizeof(unsigned long), compare_reach_hash);
 		}
-		cursor += ptr_sz;
-	}
-
-	// can we cache the result?
-	if (all_reachable_blocks && aggr_size)
-	{
-		if (ref->storage_type == ENUM_REGISTER || ref->storage_type == ENUM_HEAP)
+		ok = merge_reach_sketch(job, set, own, num_members);
+		if (own != &job->members[first])
+			free(own);
+		if (!ok)
 		{
-			blk = find_inuse_block(ref->vaddr, inuse_blocks, num_inuse_blocks);
-			blk->reachable.aggr_size = aggr_size;
-			blk->reachable.aggr_count = aggr_count;
+			release_reach_set(job, set);
+			return NULL;
 		}
-		else if (var_len == ptr_sz)
+	}
+	else
+	{
+		for (i = 0; i < num_members; i++)
 		{
-			if (read_memory_wrapper(NULL, ref->vaddr, (void*)&addr, ptr_sz))
+			unsigned long blk = job->members[first + i];
+			if (set->bits)
+				set->bits[blk >> 5] |= 1u << (blk & 31);
+			else
 			{
-				blk = find_inuse_block(addr, inuse_blocks, num_inuse_blocks);
-				if (blk)
+				if (!reserve_reach_items(job, set, set->len + 1))
 				{
-					blk->reachable.aggr_size = aggr_size;
-					blk->reachable.aggr_count = aggr_count;
+					release_reach_set(job, set);
+					return NULL;
 				}
+				set->items[set->len++] = blk;
+				job->mark[blk] = c;
 			}
+			add_reach_block(job, set, blk);
 		}
 	}
+	return set;
+}
 
-	// return happily
-	*total_size  = aggr_size;
-	*total_count = aggr_count;
-	return CA_TRUE;
+/*
+ * Clear the reachable size/count cache, which is filled lazily again
+ */
+static void reset_reachable_sizes(struct inuse_block_table* table)
+{
+	memset(table->aggr_sizes, 0, table->count * sizeof(size_t));
+	memset(table->aggr_counts, 0, table->count * sizeof(unsigned long));
+	table->aggr_state = AGGR_LAZY;
 }
 
-// A not-so-fast leak checking based on the concept what a heap block without any
-// reference directly/indirectly from a global/local variable is a lost one
-CA_BOOL display_heap_leak_candidates(void)
+/*
+ * Fill the reachable size/count cache of all blocks, exact or estimated
+ * Return false if the exact sets exceed the memory budget, or the user breaks
+ */
+static CA_BOOL fill_reachable_sizes(struct inuse_block_table* table, CA_BOOL estimate)
 {
-	CA_BOOL rc = CA_TRUE;
-	unsigned long total_blocks = 0;
-	struct inuse_block* blocks = NULL;
-	struct inuse_block* blk;
-	unsigned int* qv_bitmap = NULL;	// Bit flags of whether a block is queued/visited
-	unsigned long cur_index;
-	size_t total_leak_bytes;
-	size_t total_bytes;
-	unsigned long leak_count;
+	struct reach_job job;
+	struct reach_set** sets = NULL;
+	unsigned long* refs = NULL;
+	unsigned long* stamp = NULL;
+	unsigned long* succs = NULL;
+	unsigned long succs_capacity = 256;
+	unsigned long c, i, k, w;
+	CA_BOOL rc = CA_FALSE;
 
-	// create and populate an array of all in-use blocks
-	blocks = build_inuse_heap_blocks(&total_blocks);
-	if (!blocks || total_blocks == 0)
-	{
-		CA_PRINT("Failed: no in-use heap block is found\n");
+	// exact values are good for an estimate too
+	if (table->aggr_state == AGGR_EXACT || (estimate && table->aggr_state == AGGR_ESTIMATED))
+		return CA_TRUE;
+	if (!build_heap_ref_graph(table))
 		return CA_FALSE;
-	}
-
-	// Prepare bitmap with the clean state
-	// Each block uses two bits(queued/visited)
-	qv_bitmap = (unsigned int*) calloc((total_blocks+15)*2/32, sizeof(unsigned int));
-	if (!qv_bitmap)
-	{
-		CA_PRINT("Out of Memory\n");
-		rc = CA_FALSE;
-		goto leak_check_out;
-	}
 
-	// search global/local(module's .text/.data/.bss and thread stack) memory
-	// for all references to these in-use blocks, mark them queued and visited
-	if (!mark_blocks_referenced_by_globals_locals(blocks, total_blocks, qv_bitmap))
+	memset(&job, 0, sizeof(job));
+	job.blocks = table;
+	job.estimate = estimate;
+	if (!find_block_components(&job))
+		goto reach_out;
+
+	sets = (struct reach_set**) calloc(job.num_comps, sizeof(struct reach_set*));
+	refs = (unsigned long*) calloc(job.num_comps, sizeof(unsigned long));
+	stamp = (unsigned long*) malloc(job.num_comps * sizeof(unsigned long));
+	succs = (unsigned long*) malloc(succs_capacity * sizeof(unsigned long));
+	if (!estimate)
+		job.mark = (unsigned long*) malloc(table->count * sizeof(unsigned long));
+	if (!sets || !refs || !stamp || !succs || (!estimate && !job.mark))
+		goto reach_out;
+	for (c = 0; c < job.num_comps; c++)
+		stamp[c] = DOM_NONE;
+	if (job.mark)
 	{
-		rc = CA_FALSE;
-		goto leak_check_out;
+		for (i = 0; i < table->count; i++)
+			job.mark[i] = DOM_NONE;
 	}
 
-	// Within in-use blocks,
-	// repeatedly use queued blocks to find unvisited ones through reference
-	// mark newly found blocks queued and visited
-	// until no queued blocks any more to work with
-	cur_index = 0;
-	do
+	// a set is kept until all predecessor components have taken it
+	for (c = 0; c < job.num_comps; c++)
 	{
-		cur_index = get_next_queued_index(qv_bitmap, total_blocks, cur_index);
-		if (cur_index < total_blocks)
+		for (k = job.comp_first[c]; k < job.comp_first[c + 1]; k++)
 		{
-			unsigned int* indexp;
-			blk = blocks + cur_index;
-			if (!blk->reachable.index_map)
+			struct ref_edge_cursor it;
+			init_ref_edge_cursor(&it, table, job.members[k]);
+			while (next_ref_edge(&it, &w))
 			{
-				if (!build_block_index_map(blk, blocks, total_blocks))
+				unsigned long d = job.comp[w];
+				if (d != c && stamp[d] != c)
 				{
-					rc = CA_FALSE;
-					goto leak_check_out;
+					stamp[d] = c;
+					refs[d]++;
 				}
 			}
-			// We have index map to work with by now
-			indexp = blk->reachable.index_map;
-			while (*indexp != UINT_MAX)
+		}
+	}
+	for (c = 0; c < job.num_comps; c++)
+		stamp[c] = DOM_NONE;
+
+	// successors are found before predecessors
+	for (c = 0; c < job.num_comps; c++)
+	{
+		unsigned long num_succs = 0;
+		struct reach_set* set;
+
+		if ((c & 0xfff) == 0 && user_request_break())
+		{
+			CA_PRINT("Abort calculating reachable sizes\n");
+			goto reach_out;
+		}
+		for (k = job.comp_first[c]; k < job.comp_first[c + 1]; k++)
+		{
+			struct ref_edge_cursor it;
+			init_ref_edge_cursor(&it, table, job.members[k]);
+			while (next_ref_edge(&it, &w))
 			{
-				unsigned int index = *indexp;
-				if (!is_queued_or_visited(qv_bitmap, index))
+				unsigned long d = job.comp[w];
+				if (d == c || stamp[d] == c)
+					continue;
+				stamp[d] = c;
+				if (num_succs == succs_capacity)
 				{
-					set_queued_and_visited(qv_bitmap, index);
+					unsigned long* bigger;
+					succs_capacity *= 2;
+					bigger = (unsigned long*) realloc(succs, succs_capacity * sizeof(unsigned long));
+					if (!bigger)
+						goto reach_out;
+					succs = bigger;
 				}
-				indexp++;
+				succs[num_succs++] = d;
 			}
-			// done with this block
-			reset_queued(qv_bitmap, cur_index);
 		}
-		else
-			break;
-	} while (1);
 
-	// Display blocks that found no references to them directly or indirectly from global/local areas
-	CA_PRINT("Potentially leaked heap memory blocks:\n");
-	total_leak_bytes = 0;
-	total_bytes = 0;
-	leak_count = 0;
-	for (cur_index = 0, blk = blocks; cur_index < total_blocks; cur_index++, blk++)
-	{
-		total_bytes += blk->size;
-		if (!is_visited(qv_bitmap, cur_index))
+		set = build_component_reach_set(&job, c, sets, refs, succs, num_succs);
+		if (!set)
 		{
-			leak_count++;
-			CA_PRINT("[%ld] addr="PRINT_FORMAT_POINTER" size="PRINT_FORMAT_SIZE"\n",
-					leak_count, blk->addr, blk->size);
-			total_leak_bytes += blk->size;
+			if (!estimate)
+				CA_PRINT("Exact reachable sets exceed the memory budget of %ld MB\n", REACH_SET_BUDGET / (1024*1024));
+			goto reach_out;
+		}
+		if (estimate)
+			estimate_reach_sketch(&job, set);
+		for (k = job.comp_first[c]; k < job.comp_first[c + 1]; k++)
+		{
+			table->aggr_sizes[job.members[k]]  = set->size;
+			table->aggr_counts[job.members[k]] = set->count;
 		}
+		if (refs[c])
+			sets[c] = set;
+		else
+			release_reach_set(&job, set);
 	}
-	if (leak_count)
+	table->aggr_state = estimate ? AGGR_ESTIMATED : AGGR_EXACT;
+	rc = CA_TRUE;
+
+reach_out:
+	// values of the cache are partly filled, start over lazily
+	if (!rc)
+		reset_reachable_sizes(table);
+	if (sets)
 	{
-		CA_PRINT("Total %ld (", leak_count);
-		print_size(total_leak_bytes);
-		CA_PRINT(") leak candidates out of %ld (", total_blocks);
-		print_size(total_bytes);
-		CA_PRINT(") in-use memory blocks\n");
+		for (c = 0; c < job.num_comps; c++)
+			release_reach_set(&job, sets[c]);
+		free(sets);
 	}
-	else
-		CA_PRINT("All %ld heap blocks are referenced, no leak candidate\n", total_blocks);
-
-leak_check_out:
-	if (blocks)
-		free_inuse_heap_blocks(blocks, total_blocks);
-	if (qv_bitmap)
-		free (qv_bitmap);
+	if (refs)
+		free(refs);
+	if (stamp)
+		free(stamp);
+	if (succs)
+		free(succs);
+	if (job.comp)
+		free(job.comp);
+	if (job.comp_first)
+		free(job.comp_first);
+	if (job.members)
+		free(job.members);
+	if (job.mark)
+		free(job.mark);
+	if (job.scratch)
+		free(job.scratch);
 	return rc;
 }
 
 /*
- * Histogram functions
+ * Retained size, i.e. the memory freed with an owner, from the dominator tree
+ * of the heap reference graph, whose super root references all owners.
+ * A block is retained by the owner or block that dominates it, which is on
+ * every path to it from the super root. Dominators are found with the
+ * iterative algorithm of Cooper, Harvey and Kennedy in postorder numbers,
+ * then a block's size is added to all its dominators in one pass.
  */
-void display_mem_histogram(const char* prefix)
+static CA_BOOL init_dom_graph(struct dom_graph* graph, struct inuse_block_table* blocks)
 {
+	memset(graph, 0, sizeof(*graph));
+	graph->blocks = blocks;
+	graph->roots_capacity = 1024;
+	graph->roots = (struct object_reference*) malloc(graph->roots_capacity * sizeof(struct object_reference));
+	graph->root_offsets = (size_t*) malloc((graph->roots_capacity + 1) * sizeof(size_t));
+	graph->root_edges_capacity = 4096;
+	graph->root_edges = (unsigned long*) malloc(graph->root_edges_capacity * sizeof(unsigned long));
+	if (!graph->roots || !graph->root_offsets || !graph->root_edges
+		|| !init_inuse_ptr_batch(&graph->batch, INUSE_PTR_BATCH))
+	{
+		CA_PRINT("Out of Memory\n");
+		release_dom_graph(graph);
+		return CA_FALSE;
+	}
+	graph->root_offsets[0] = 0;
+	return CA_TRUE;
+}
 
-	if (!g_mem_hist.num_buckets || !g_mem_hist.bucket_sizes
-		|| !g_mem_hist.inuse_cnt || !g_mem_hist.inuse_bytes
-		|| !g_mem_hist.free_cnt || !g_mem_hist.free_bytes)
-		return;
-
-	CA_PRINT("%s========== In-use Memory Histogram ==========\n", prefix);
-	display_histogram(prefix, g_mem_hist.num_buckets, g_mem_hist.bucket_sizes, g_mem_hist.inuse_cnt, g_mem_hist.inuse_bytes);
+static void release_dom_graph(struct dom_graph* graph)
+{
+	if (graph->roots)
+		free(graph->roots);
+	if (graph->root_offsets)
+		free(graph->root_offsets);
+	if (graph->root_edges)
+		free(graph->root_edges);
+	release_inuse_ptr_batch(&graph->batch);
+	memset(graph, 0, sizeof(*graph));
+}
 
-	CA_PRINT("%s========== Free Memory Histogram ==========\n", prefix);
-	display_histogram(prefix, g_mem_hist.num_buckets, g_mem_hist.bucket_sizes, g_mem_hist.free_cnt, g_mem_hist.free_bytes);
+static CA_BOOL push_root_edge(struct dom_graph* graph, unsigned long blk)
+{
+	if (graph->num_root_edges == graph->root_edges_capacity)
+	{
+		size_t capacity = graph->root_edges_capacity * 2;
+		unsigned long* bigger = (unsigned long*) realloc(graph->root_edges, capacity * sizeof(unsigned long));
+		if (!bigger)
+			return CA_FALSE;
+		graph->root_edges = bigger;
+		graph->root_edges_capacity = capacity;
+	}
+	graph->root_edges[graph->num_root_edges++] = blk;
+	return CA_TRUE;
 }
 
-void release_mem_histogram(void)
+// Whether an owner is the same register or overlaps the same memory as the queried one
+static CA_BOOL is_excluded_owner(const struct dom_graph* graph, const struct object_reference* ref, size_t var_len)
 {
-	if (g_mem_hist.bucket_sizes)
-		free(g_mem_hist.bucket_sizes);
-	if (g_mem_hist.inuse_cnt)
-		free(g_mem_hist.inuse_cnt);
-	if (g_mem_hist.inuse_bytes)
-		free(g_mem_hist.inuse_bytes);
-	if (g_mem_hist.free_cnt)
-		free(g_mem_hist.free_cnt);
-	if (g_mem_hist.free_bytes)
-		free(g_mem_hist.free_bytes);
-	memset(&g_mem_hist, 0, sizeof(g_mem_hist));
+	const struct object_reference* query = graph->exclude;
+
+	if (!query)
+		return CA_FALSE;
+	if (query->storage_type == ENUM_REGISTER || ref->storage_type == ENUM_REGISTER)
+		return (query->storage_type == ref->storage_type
+			&& query->where.reg.tid == ref->where.reg.tid
+			&& query->where.reg.reg_num == ref->where.reg.reg_num) ? CA_TRUE : CA_FALSE;
+	return (ref->vaddr < query->vaddr + graph->exclude_len && query->vaddr < ref->vaddr + var_len) ? CA_TRUE : CA_FALSE;
 }
 
-void init_mem_histogram(unsigned int nbuckets)
+/*
+ * Add an owner to the graph with the blocks it references
+ * 	an owner that references no block retains nothing, it is left out
+ */
+static void add_dom_root(void* arg, struct object_reference* ref, size_t var_len)
 {
-	unsigned int i;
+	struct dom_graph* graph = (struct dom_graph*) arg;
+	struct inuse_block_table* blocks = graph->blocks;
+	size_t ptr_sz = g_ptr_bit >> 3;
+	size_t first = graph->num_root_edges;
+	unsigned long blk;
 
-	release_mem_histogram();
+	if (graph->failed || var_len < ptr_sz || is_excluded_owner(graph, ref, var_len))
+		return;
 
-	g_mem_hist.num_buckets = nbuckets;
-	g_mem_hist.bucket_sizes = (size_t*)malloc(nbuckets * sizeof(size_t));
-	for (i = 0; i < nbuckets; i++)
-		g_mem_hist.bucket_sizes[i] = 16 << i;
-	g_mem_hist.inuse_cnt = (unsigned long*)malloc((nbuckets+1) * sizeof(unsigned long));
-	g_mem_hist.inuse_bytes = (size_t*)malloc((nbuckets+1) * sizeof(size_t));
-	g_mem_hist.free_cnt = (unsigned long*)malloc((nbuckets+1) * sizeof(unsigned long));
-	g_mem_hist.free_bytes = (size_t*)malloc((nbuckets+1) * sizeof(size_t));
-	for (i = 0; i < nbuckets + 1; i++)
+	if (ref->storage_type == ENUM_REGISTER || ref->storage_type == ENUM_HEAP)
 	{
-		g_mem_hist.inuse_cnt[i] = 0;
-		g_mem_hist.inuse_bytes[i] = 0;
-		g_mem_hist.free_cnt[i] = 0;
-		g_mem_hist.free_bytes[i] = 0;
+		blk = find_inuse_block(ref->storage_type == ENUM_REGISTER ? ref->value : ref->vaddr, blocks);
+		if (blk != INUSE_BLOCK_NONE && !push_root_edge(graph, blk))
+			graph->failed = CA_TRUE;
+	}
+	else
+	{
+		address_t cursor = ALIGN(ref->vaddr, ptr_sz);
+		address_t end = ref->vaddr + var_len;
+
+		while (cursor < end && !graph->failed)
+		{
+			unsigned long n, k;
+
+			n = read_inuse_ptr_batch(NULL, cursor, ALIGN(end, ptr_sz), &graph->batch);
+			if (n == 0)
+				break;
+			// a pointer is displayed with its value
+			if (var_len == ptr_sz)
+				ref->value = graph->batch.values[0];
+			cursor += n * ptr_sz;
+			if (!find_inuse_blocks(blocks, &graph->batch))
+				continue;
+			for (k = 0; k < n; k++)
+			{
+				blk = graph->batch.indexes[k];
+				if (blk != INUSE_BLOCK_NONE && !push_root_edge(graph, blk))
+				{
+					graph->failed = CA_TRUE;
+					break;
+				}
+			}
+		}
+	}
+	if (graph->failed || graph->num_root_edges == first)
+		return;
+
+	if (graph->num_roots == graph->roots_capacity)
+	{
+		unsigned long capacity = graph->roots_capacity * 2;
+		struct object_reference* roots;
+		size_t* offsets;
+
+		roots = (struct object_reference*) realloc(graph->roots, capacity * sizeof(struct object_reference));
+		if (roots)
+			graph->roots = roots;
+		offsets = (size_t*) realloc(graph->root_offsets, (capacity + 1) * sizeof(size_t));
+		if (offsets)
+			graph->root_offsets = offsets;
+		if (!roots || !offsets)
+		{
+			graph->failed = CA_TRUE;
+			return;
+		}
+		graph->roots_capacity = capacity;
 	}
+	graph->roots[graph->num_roots++] = *ref;
+	graph->root_offsets[graph->num_roots] = graph->num_root_edges;
 }
 
-void add_block_mem_histogram(size_t size, CA_BOOL inuse, unsigned int num_block)
+/*
+ * Cursor over the successors of a node
+ * 	those of a block are decoded from the reference graph,
+ * 	or else they are [next, end) of root_edges[] of an owner,
+ * 	or nodes [next, end) themselves of the super root
+ */
+struct dom_edge_cursor
 {
-	unsigned int n;
+	struct ref_edge_cursor it;
+	const unsigned long* targets;
+	unsigned long next;
+	unsigned long end;
+	CA_BOOL is_block;
+};
 
-	if (!g_mem_hist.num_buckets || !g_mem_hist.bucket_sizes
-		|| !g_mem_hist.inuse_cnt || !g_mem_hist.inuse_bytes
-		|| !g_mem_hist.free_cnt || !g_mem_hist.free_bytes)
-		return;
+static inline void
+init_dom_edge_cursor(struct dom_edge_cursor* c, const struct dom_graph* graph, unsigned long node)
+{
+	unsigned long num_blocks = graph->blocks->count;
 
-	for (n = 0; n < g_mem_hist.num_buckets; n++)
+	memset(c, 0, sizeof(*c));
+	if (node < num_blocks)
 	{
-		if (size <= g_mem_hist.bucket_sizes[n])
-			break;
+		init_ref_edge_cursor(&c->it, graph->blocks, node);
+		c->is_block = CA_TRUE;
+		return;
 	}
-	if (inuse)
+	c->is_block = CA_FALSE;
+	if (node < num_blocks + graph->num_roots)
 	{
-		g_mem_hist.inuse_cnt[n] += num_block;
-		g_mem_hist.inuse_bytes[n] += size * num_block;
+		c->targets = graph->root_edges;
+		c->next = graph->root_offsets[node - num_blocks];
+		c->end  = graph->root_offsets[node - num_blocks + 1];
 	}
 	else
 	{
-		g_mem_hist.free_cnt[n] += num_block;
-		g_mem_hist.free_bytes[n] += size * num_block;
+		c->targets = NULL;
+		c->next = num_blocks;
+		c->end  = num_blocks + graph->num_roots;
 	}
 }
 
-static void fill_space_til_pos(char* buf, size_t to_pos)
+static inline CA_BOOL next_dom_edge(struct dom_edge_cursor* c, unsigned long* node)
 {
-	size_t len = strlen(buf);
-	if (len < to_pos - 1)
-	{
-		while (len < to_pos - 1)
-			buf[len++] = ' ';
-		buf[len] = '\0';
-	}
-	else
-	{
-		buf[len] = ' ';
-		buf[len+1] = '\0';
-	}
+	if (c->is_block)
+		return next_ref_edge(&c->it, node);
+	if (c->next >= c->end)
+		return CA_FALSE;
+	*node = c->targets ? c->targets[c->next] : c->next;
+	c->next++;
+	return CA_TRUE;
 }
 
+struct dom_dfs_frame
+{
+	unsigned long node;
+	struct dom_edge_cursor edges;
+};
+
 /*
- * Helper functions
+ * Number nodes reachable from the super root in postorder of a depth-first search
+ * 	the stack grows with the depth, e.g. of a long linked list
  */
-static void display_histogram(const char* prefix,
-			unsigned int   nbuckets,
-			const size_t*        bucket_sizes,
-			const unsigned long* block_cnt,
-			const size_t*        block_bytes)
+static CA_BOOL number_dom_nodes(const struct dom_graph* graph, struct dom_tree* tree)
 {
-	unsigned int n;
-	unsigned long total_cnt, total_cnt2;
-	size_t total_bytes;
-	char linebuf[LINE_BUF_SZ];
-	int pos = 0;
-	const int second_col_pos = 16;
-	const int third_col_pos = 28;
-
-	// title
-	sprintf(linebuf, "%sSize-Range", prefix);
-	fill_space_til_pos(linebuf, strlen(prefix)+second_col_pos);
-	pos = strlen(linebuf);
-	sprintf(linebuf + pos, "Count");
-	fill_space_til_pos(linebuf, strlen(prefix)+third_col_pos);
-	pos = strlen(linebuf);
-	sprintf(linebuf + pos, "Total-Bytes");
-	CA_PRINT("%s\n", linebuf);
-
-	total_cnt = 0;
-	total_bytes = 0;
-	for (n = 0; n <= nbuckets; n++)
+	unsigned long num_nodes = graph->blocks->count + graph->num_roots + 1;
+	unsigned long capacity = 4096;
+	unsigned long depth = 0;
+	unsigned long count = 0;
+	unsigned long i, node;
+	struct dom_dfs_frame* stack;
+
+	tree->post = (unsigned long*) malloc(num_nodes * sizeof(unsigned long));
+	stack = (struct dom_dfs_frame*) malloc(capacity * sizeof(struct dom_dfs_frame));
+	if (!tree->post || !stack)
 	{
-		total_cnt += block_cnt[n];
-		total_bytes += block_bytes[n];
+		if (stack)
+			free(stack);
+		return CA_FALSE;
 	}
-
-	total_cnt2 = 0;
-	for (n = 0; n <= nbuckets && total_cnt2 < total_cnt; n++)
+	for (i = 0; i < num_nodes; i++)
+		tree->post[i] = DOM_NONE;
+
+	// start from the super root
+	stack[0].node = num_nodes - 1;
+	init_dom_edge_cursor(&stack[0].edges, graph, num_nodes - 1);
+	tree->post[num_nodes - 1] = DOM_PENDING;
+	depth = 1;
+	while (depth)
 	{
-		if (block_cnt[n] > 0)
-		{
-			sprintf(linebuf, "%s", prefix);
-			pos = strlen(linebuf);
+		struct dom_dfs_frame* frame = &stack[depth - 1];
 
-			// bucket size range
-			if (n == 0)
-			{
-				strcat(linebuf, "0 - ");
-				pos = strlen(linebuf);
-				fprint_size(linebuf + pos, bucket_sizes[n]);
-				pos = strlen(linebuf);
-			}
-			else if (n == nbuckets)
-			{
-				fprint_size(linebuf + pos, bucket_sizes[n-1]);
-				pos = strlen(linebuf);
-				strcat(linebuf, " -    ");
-				pos = strlen(linebuf);
-			}
-			else
+		if (!next_dom_edge(&frame->edges, &node))
+		{
+			tree->post[frame->node] = count++;
+			depth--;
+			continue;
+		}
+		if (tree->post[node] != DOM_NONE)
+			continue;
+		if (depth == capacity)
+		{
+			struct dom_dfs_frame* bigger;
+			capacity *= 2;
+			bigger = (struct dom_dfs_frame*) realloc(stack, capacity * sizeof(struct dom_dfs_frame));
+			if (!bigger)
 			{
-				fprint_size(linebuf + pos, bucket_sizes[n-1]);
-				pos = strlen(linebuf);
-				strcat(linebuf, " - ");
-				pos = strlen(linebuf);
-				fprint_size(linebuf + pos, bucket_sizes[n]);
-				pos = strlen(linebuf);
+				free(stack);
+				return CA_FALSE;
 			}
-			fill_space_til_pos(linebuf, strlen(prefix)+second_col_pos);
-			pos = strlen(linebuf);
-
-			// count
-			sprintf(linebuf + pos, "%ld(%ld%%)",
-					block_cnt[n], block_cnt[n] * 100 / total_cnt);
-			fill_space_til_pos(linebuf, strlen(prefix)+third_col_pos);
-			pos = strlen(linebuf);
-
-			// total bytes
-			fprint_size(linebuf + pos, block_bytes[n]);
-			pos = strlen(linebuf);
-			sprintf(linebuf + pos, "(%ld%%)", block_bytes[n] * 100 / total_bytes);
-
-			// output
-			CA_PRINT("%s\n", linebuf);
-
-			total_cnt2 += block_cnt[n];
+			stack = bigger;
 		}
+		tree->post[node] = DOM_PENDING;
+		stack[depth].node = node;
+		init_dom_edge_cursor(&stack[depth].edges, graph, node);
+		depth++;
 	}
-	sprintf(linebuf, "%sTotal", prefix);
-	fill_space_til_pos(linebuf, strlen(prefix)+second_col_pos);
-	pos = strlen(linebuf);
-	sprintf(linebuf + pos, "%ld", total_cnt);
-	fill_space_til_pos(linebuf, strlen(prefix)+third_col_pos);
-	pos = strlen(linebuf);
-	fprint_size(linebuf + pos, total_bytes);
-	CA_PRINT("%s\n", linebuf);
+	free(stack);
+	tree->num_reachable = count;
+	return CA_TRUE;
 }
 
-// Binary search if addr belongs to one of the blocks
-struct inuse_block* find_inuse_block(address_t addr, struct inuse_block* blocks, unsigned long total_blocks)
+// The nearest common dominator of two nodes, walking up from the one lower in postorder
+static inline unsigned long
+intersect_dominators(const unsigned long* idom, unsigned long a, unsigned long b)
 {
-	unsigned long l_index = 0;
-	unsigned long u_index = total_blocks;
-
-	// bail out for out of bound addr
-	if (addr < blocks[0].addr || addr >= blocks[total_blocks-1].addr + blocks[total_blocks-1].size)
-		return NULL;
-
-	while (l_index < u_index)
+	while (a != b)
 	{
-		unsigned long m_index = (l_index + u_index) / 2;
-		struct inuse_block* blk = &blocks[m_index];
-		if (addr < blk->addr)
-			u_index = m_index;
-		else if (addr >= blk->addr + blk->size)
-			l_index = m_index + 1;
-		else
-			return blk;
+		while (a < b)
+			a = idom[a];
+		while (b < a)
+			b = idom[b];
 	}
-	return NULL;
+	return a;
 }
 
-static CA_BOOL
-mark_blocks_referenced_by_globals_locals(struct inuse_block* blocks,
-						unsigned long total_blocks, unsigned int* qv_bitmap)
+static CA_BOOL build_dom_tree(struct dom_graph* graph, struct dom_tree* tree)
 {
-	unsigned int seg_index;
-	size_t ptr_sz = g_ptr_bit >> 3;
+	unsigned long num_nodes = graph->blocks->count + graph->num_roots + 1;
+	unsigned long reach, start, u, v, p;
+	size_t* pred_offsets = NULL;
+	unsigned long* preds = NULL;
+	CA_BOOL changed;
+	CA_BOOL rc = CA_FALSE;
 
-	for (seg_index = 0; seg_index < g_segment_count; seg_index++)
+	memset(tree, 0, sizeof(*tree));
+	if (!number_dom_nodes(graph, tree))
+		goto dom_tree_out;
+	reach = tree->num_reachable;
+	start = reach - 1;
+
+	// predecessors of a node in postorder numbers
+	pred_offsets = (size_t*) calloc(reach + 1, sizeof(size_t));
+	if (!pred_offsets)
+		goto dom_tree_out;
+	for (u = 0; u < num_nodes; u++)
+	{
+		struct dom_edge_cursor c;
+		if (tree->post[u] == DOM_NONE)
+			continue;
+		init_dom_edge_cursor(&c, graph, u);
+		while (next_dom_edge(&c, &v))
+			pred_offsets[tree->post[v] + 1]++;
+	}
+	for (p = 0; p < reach; p++)
+		pred_offsets[p + 1] += pred_offsets[p];
+	preds = (unsigned long*) malloc((pred_offsets[reach] + 1) * sizeof(unsigned long));
+	if (!preds)
+		goto dom_tree_out;
+	for (u = 0; u < num_nodes; u++)
+	{
+		struct dom_edge_cursor c;
+		if (tree->post[u] == DOM_NONE)
+			continue;
+		init_dom_edge_cursor(&c, graph, u);
+		while (next_dom_edge(&c, &v))
+			preds[pred_offsets[tree->post[v]]++] = tree->post[u];
+	}
+	// offsets are moved to the ends of the lists by the fill, move them back
+	for (p = reach; p > 0; p--)
+		pred_offsets[p] = pred_offsets[p - 1];
+	pred_offsets[0] = 0;
+
+	tree->idom = (unsigned long*) malloc(reach * sizeof(unsigned long));
+	if (!tree->idom)
+		goto dom_tree_out;
+	for (p = 0; p < start; p++)
+		tree->idom[p] = DOM_NONE;
+	tree->idom[start] = start;
+
+	// iterate in reverse postorder until no dominator changes, a few passes for cycles
+	do
 	{
-		struct ca_segment* segment = &g_segments[seg_index];
-
-		// This search may take long, bail out if user is impatient
 		if (user_request_break())
 		{
-			CA_PRINT("Abort searching\n");
-			break;
+			CA_PRINT("Abort building dominator tree\n");
+			goto dom_tree_out;
 		}
-
-		if (segment->m_fsize == 0)
-			continue;
-
-		// Only local/global variables are checked
-		if (segment->m_type == ENUM_STACK
-			|| segment->m_type == ENUM_MODULE_DATA
-			|| segment->m_type == ENUM_MODULE_TEXT)
+		changed = CA_FALSE;
+		for (p = start; p-- > 0; )
 		{
-			address_t start, next, end;
+			unsigned long new_idom = DOM_NONE;
+			size_t e;
 
-			start = segment->m_vaddr;
-			end   = start + segment->m_fsize;
-			// ignore stack memory below stack pointer
-			if (segment->m_type == ENUM_STACK)
+			for (e = pred_offsets[p]; e < pred_offsets[p + 1]; e++)
 			{
-				address_t rsp = get_rsp(segment);
-				if (rsp >= segment->m_vaddr && rsp < segment->m_vaddr + segment->m_vsize)
-					start = rsp;
+				unsigned long q = preds[e];
+				if (tree->idom[q] == DOM_NONE)
+					continue;
+				new_idom = (new_idom == DOM_NONE) ? q : intersect_dominators(tree->idom, q, new_idom);
 			}
-
-			next = ALIGN(start, ptr_sz);
-			while (next + ptr_sz <= end)
+			if (tree->idom[p] != new_idom)
 			{
-				address_t ptr;
-				struct inuse_block* blk;
-
-				if (!read_memory_wrapper(segment, next, &ptr, ptr_sz))
-					break;
-
-				blk = find_inuse_block(ptr, blocks, total_blocks);
-				if (blk)
-				{
-					unsigned long index = blk - blocks;
-					set_queued_and_visited(qv_bitmap, index);
-				}
-				next += ptr_sz;
+				tree->idom[p] = new_idom;
+				changed = CA_TRUE;
 			}
 		}
-	}
-
-	return CA_TRUE;
-}
-
-static unsigned long get_next_queued_index(unsigned int* bitmap, unsigned long max_index, unsigned long cur_index)
-{
-	unsigned long next_index;
-	unsigned int indexes;
-
-	next_index = cur_index + 1;
-	while (next_index < max_index)
+	} while (changed);
+
+	// a dominator is numbered after all nodes it dominates
+	tree->retained_sizes = (size_t*) calloc(reach, sizeof(size_t));
+	tree->retained_counts = (unsigned long*) calloc(reach, sizeof(unsigned long));
+	if (!tree->retained_sizes || !tree->retained_counts)
+		goto dom_tree_out;
+	for (u = 0; u < graph->blocks->count; u++)
 	{
-		indexes = bitmap[next_index >> 4];
-		if (indexes & 0x55555555) // check 16 queue bits at once
-		{
-			unsigned long bit = (next_index & 0xf) << 1;
-			if (indexes & (QUEUED << bit))
-				return next_index;
-			next_index++;
-		}
-		else
+		if (tree->post[u] != DOM_NONE)
 		{
-			// skip all bits within this "int"
-			next_index = (next_index & (~0x0Ful)) + 16;
+			tree->retained_sizes[tree->post[u]] = graph->blocks->sizes[u];
+			tree->retained_counts[tree->post[u]] = 1;
 		}
 	}
-	next_index = 0;
-	while (next_index < cur_index)
+	for (p = 0; p < start; p++)
 	{
-		indexes = bitmap[next_index >> 4];
-		if (indexes & 0x55555555) // check 16 queue bits at once
-		{
-			unsigned long bit = (next_index & 0xf) << 1;
-			if (indexes & (QUEUED << bit))
-				return next_index;
-			next_index++;
-		}
-		else
-		{
-			// skip all bits within this "int"
-			next_index = (next_index & (~0x0Ful)) + 16;
-		}
+		tree->retained_sizes[tree->idom[p]] += tree->retained_sizes[p];
+		tree->retained_counts[tree->idom[p]] += tree->retained_counts[p];
 	}
-	return UINT_MAX;
-}
+	rc = CA_TRUE;
 
-static unsigned int* get_index_map_buffer(unsigned int len)
-{
-	static unsigned int* g_index_map_buffer = NULL;
-	static unsigned int  g_index_map_buffer_size = 0;
-	if (g_index_map_buffer_size < len)
+dom_tree_out:
+	if (!rc)
 	{
-		// beware of overflow
-		if (len == UINT_MAX)
-			g_index_map_buffer_size = UINT_MAX;
-		else
-			g_index_map_buffer_size = len + 1;
-		// free previous, smaller buffer
-		if (g_index_map_buffer)
-			free (g_index_map_buffer);
-		// allocate a buffer big enough for current request
-		g_index_map_buffer = (unsigned int*) malloc(g_index_map_buffer_size * sizeof(unsigned int));
-		if (!g_index_map_buffer)
-		{
-			CA_PRINT("Out-of-memory\n");
-			return NULL;
-		}
+		CA_PRINT("Failed to build dominator tree\n");
+		release_dom_tree(tree);
 	}
-	return g_index_map_buffer;
+	if (pred_offsets)
+		free(pred_offsets);
+	if (preds)
+		free(preds);
+	return rc;
+}
+
+static void release_dom_tree(struct dom_tree* tree)
+{
+	if (tree->post)
+		free(tree->post);
+	if (tree->idom)
+		free(tree->idom);
+	if (tree->retained_sizes)
+		free(tree->retained_sizes);
+	if (tree->retained_counts)
+		free(tree->retained_counts);
+	memset(tree, 0, sizeof(*tree));
 }
 
 /*
- * block's index map is an array of indexes of sub blocks
+ * Top owners by retained size, as well as blocks that are shared by owners,
+ * i.e. retained by none of them but the super root
  */
-static CA_BOOL build_block_index_map(struct inuse_block* blk,
-						struct inuse_block* inuse_blocks,
-						unsigned long num_inuse_blocks)
+static void rank_retained_owners(struct dom_graph* graph, struct dom_tree* tree,
+								struct heap_owner* owners, unsigned int num)
 {
-	size_t ptr_sz = g_ptr_bit >> 3;
-	// Prepare this
-	if (!blk->reachable.index_map)
-	{
-		address_t start, end, cursor;
-		unsigned int max_sub_blocks, total_sub_blocks;
-		unsigned int* index_buf = NULL;
-		unsigned int i, index;
-
-		// Queue possible pointers to heap memory contained by this block
-		start = ALIGN(blk->addr, ptr_sz);
-		end   = start + blk->size;
-		cursor = start;
-
-		max_sub_blocks = (end - start) / ptr_sz;
-		total_sub_blocks = 0;
-		index_buf = get_index_map_buffer(max_sub_blocks + 1);	// one for terminator
-		while (cursor < end)
-		{
-			address_t ptr;
-			struct inuse_block *sub_blk;
-			if (read_memory_wrapper(NULL, cursor, (void*)&ptr, ptr_sz) && ptr)
-			{
-				sub_blk = find_inuse_block(ptr, inuse_blocks, num_inuse_blocks);
-				if (sub_blk)
-				{
-					CA_BOOL found_dup = CA_FALSE;
-					// avoid duplicate, which is not uncommon
-					// FIXME, consider non-linear search
-					index = sub_blk - inuse_blocks;
-					for (i = 0; i < total_sub_blocks; i++)
-					{
-						if (index_buf[i] == index)
-						{
-							found_dup = CA_TRUE;
-							break;
-						}
-					}
-					if (!found_dup)
-					{
-						index_buf[total_sub_blocks++] = index;
-						if (total_sub_blocks == UINT_MAX)
-						{
-							CA_PRINT("Internal fatal error: number of sub blocks exceeds 4 billion\n");
-							return CA_FALSE;
-						}
-					}
-				}
-			}
-			cursor += ptr_sz;
+	struct inuse_block_table* blocks = graph->blocks;
+	struct heap_owner *smallest = &owners[num - 1];
+	unsigned long super_root = tree->num_reachable - 1;
+	unsigned long i;
+
+	for (i = 0; i < graph->num_roots; i++)
+	{
+		unsigned long p = tree->post[blocks->count + i];
+		if (tree->retained_sizes[p] >= smallest->aggr_size)
+		{
+			struct heap_owner newowner;
+			newowner.ref = graph->roots[i];
+			newowner.aggr_size = tree->retained_sizes[p];
+			newowner.aggr_count = tree->retained_counts[p];
+			add_owner(owners, num, &newowner);
 		}
-		// allocate cache to hold the indexes of this block
-		index_buf[total_sub_blocks++] = UINT_MAX;	// this value serves as terminator
-		blk->reachable.index_map = (unsigned int*) malloc(total_sub_blocks * sizeof(unsigned int));
-		if (!blk->reachable.index_map)
+	}
+	for (i = 0; i < blocks->count; i++)
+	{
+		unsigned long p = tree->post[i];
+		if (p != DOM_NONE && tree->idom[p] == super_root
+			&& tree->retained_sizes[p] >= smallest->aggr_size)
 		{
-			CA_PRINT("Out-of-memory\n");
-			return CA_FALSE;
+			struct heap_owner newowner;
+			newowner.ref.storage_type = ENUM_HEAP;
+			newowner.ref.vaddr = blocks->addrs[i];
+			newowner.ref.value = 0;
+			newowner.ref.where.heap.addr = blocks->addrs[i];
+			newowner.ref.where.heap.size = blocks->sizes[i];
+			newowner.ref.where.heap.inuse = 1;
+			newowner.aggr_size = tree->retained_sizes[p];
+			newowner.aggr_count = tree->retained_counts[p];
+			add_owner(owners, num, &newowner);
 		}
-		memcpy(blk->reachable.index_map, index_buf, total_sub_blocks * sizeof(unsigned int));
 	}
-	return CA_TRUE;
 }
 
 /*
- * Input is a heap memory address
- * Return the sum of sizes of all memory blocks (and their count) reachable by the block
- * 		i.e. referenced directly or indirectly by it (avoid duplicates)
+ * Given a reference, a variable or a pointer to a heap block, with known size,
+ * 	Return the in-use blocks it retains, i.e. which are freed with it
+ * 	the queried owner replaces the owners of the same register or memory
  */
-static size_t heap_aggregate_size(struct inuse_block *blk,
-								struct inuse_block *inuse_blocks,
-								unsigned long num_inuse_blocks,
-								unsigned int* qv_bitmap,
-								unsigned long *aggr_count)
+CA_BOOL
+calc_retained_size(const struct object_reference *ref,
+					size_t var_len,
+					struct inuse_block_table *inuse_blocks,
+					size_t *total_size,
+					unsigned long *total_count)
 {
-	size_t sum = 0;
+	struct dom_graph graph;
+	struct dom_tree tree;
+	struct object_reference query = *ref;
+	unsigned long node, p;
+	CA_BOOL rc = CA_FALSE;
 
-	// Get the inuse_block struct of the input address
-	*aggr_count = 0;
-	if (is_queued_or_visited(qv_bitmap, blk - inuse_blocks))
-		return 0;
+	// ground return values
+	*total_size = 0;
+	*total_count = 0;
+	memset(&tree, 0, sizeof(tree));
 
-	// Big loop until all reachable have been visited
-	while (blk)
+	if (!build_heap_ref_graph(inuse_blocks) || !init_dom_graph(&graph, inuse_blocks))
+		return CA_FALSE;
+	if (ref->storage_type != ENUM_HEAP)
 	{
-		struct inuse_block *nextblk = NULL;
-		unsigned int* indexp;
-		unsigned long blk_index = blk - inuse_blocks;
-
-		// mark this block is reachable and accounted for
-		sum += blk->size;
-		(*aggr_count)++;
-		reset_queued(qv_bitmap, blk_index);
-		set_visited(qv_bitmap, blk_index);
-
-		// Prepare this block's index map, which is an array of indexes of sub blocks
-		if (!blk->reachable.index_map)
-		{
-			if (!build_block_index_map(blk, inuse_blocks, num_inuse_blocks))
-				return 0;
-		}
-
-		// We have index map to work with by now
-		indexp = blk->reachable.index_map;
-		while (*indexp != UINT_MAX)
-		{
-			unsigned int index = *indexp;
-			//if (index >= num_inuse_blocks)
-			//{
-			//	CA_PRINT("Internal fatal error: sub block index out of bound\n");
-			//	return 0;
-			//}
-			if (!is_queued_or_visited(qv_bitmap, index))
-			{
-				set_queued(qv_bitmap, index);
-				if (!nextblk)
-					nextblk = inuse_blocks + index;
-			}
-			indexp++;
-		}
+		graph.exclude = ref;
+		graph.exclude_len = var_len;
+	}
+	if (!walk_heap_owners(inuse_blocks, add_dom_root, &graph))
+		goto retained_out;
+
+	// the block of a heap reference is reached from the super root directly,
+	// which doesn't change what it dominates
+	graph.exclude = NULL;
+	if (ref->storage_type == ENUM_HEAP)
+		node = find_inuse_block(ref->vaddr, inuse_blocks);
+	else
+		node = inuse_blocks->count + graph.num_roots;
+	add_dom_root(&graph, &query, var_len);
+	if (graph.failed || node == INUSE_BLOCK_NONE || !build_dom_tree(&graph, &tree))
+		goto retained_out;
 
-		// Get the next block that is queued
-		if (!nextblk)
+	if (node < inuse_blocks->count + graph.num_roots)
+	{
+		p = tree.post[node];
+		if (p != DOM_NONE)
 		{
-			// block processed doesn't have any subfield that points to an unvisited in-use block
-			// starts from the current block and wrap around
-			unsigned long next_index = get_next_queued_index(qv_bitmap, num_inuse_blocks, blk_index);
-			if (next_index < num_inuse_blocks)
-				nextblk = inuse_blocks + next_index;
+			*total_size  = tree.retained_sizes[p];
+			*total_count = tree.retained_counts[p];
 		}
-		blk = nextblk;
 	}
-	return sum;
+	rc = CA_TRUE;
+
+retained_out:
+	release_dom_tree(&tree);
+	release_dom_graph(&graph);
+	return rc;
 }
 
 // find the insertion point so that the array is sorted properly
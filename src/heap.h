@@ -24,26 +24,59 @@ extern CA_BOOL get_next_heap_block(address_t addr, struct heap_block* blk);
 
 extern CA_BOOL get_biggest_blocks(struct heap_block* blks, unsigned int num);
 
+extern void add_big_block_candidate(struct heap_block* blks, unsigned int num, unsigned int* count, const struct heap_block* blk);
+
+extern void sort_big_blocks(struct heap_block* blks, unsigned int count);
+
 extern void print_size(size_t sz);
 
 /*
  * Memory usage/leak
  * Aggregated memory is the collection of memory blocks that are reachable from a variable
  */
-struct reachable
-{
-	size_t        aggr_size;	// cached reachable count/size by me (solely)
-	unsigned long aggr_count;
-	unsigned int* index_map;	// cached indexes of all sub in-use blocks
-};
-
 struct inuse_block
 {
 	address_t addr;
 	size_t    size;
-	struct reachable reachable;
 };
 
+/*
+ * The reachable cache is filled block by block as it is needed, or for all blocks at once
+ */
+enum aggr_cache_state
+{
+	AGGR_LAZY,
+	AGGR_EXACT,
+	AGGR_ESTIMATED
+};
+
+/*
+ * All in-use blocks sorted by address, a block is identified by its index
+ * 	Columns are kept apart so that a lookup only touches addresses and sizes,
+ * 	the reachable cache is a cold side column. The page index narrows a lookup
+ * 	to the few blocks overlapping the page of the address
+ */
+struct inuse_block_table
+{
+	unsigned long  count;
+	address_t*     addrs;
+	size_t*        sizes;
+	// cached reachable count/size from a block
+	size_t*        aggr_sizes;
+	unsigned long* aggr_counts;
+	enum aggr_cache_state aggr_state;
+	// reference graph in CSR form, built at the first need
+	size_t*        edge_offsets;
+	unsigned char* edges;
+	size_t         edges_size;
+	// page index
+	struct inuse_page_span* spans;
+	unsigned long  num_spans;
+	unsigned int*  page_first;
+};
+
+#define INUSE_BLOCK_NONE ((unsigned long)-1)
+
 /*
  * Get all in-use memory blocks
  * 	If param opBlocks is NULL, return number of in-use only,
@@ -51,22 +84,50 @@ struct inuse_block
  */
 extern CA_BOOL walk_inuse_blocks(struct inuse_block* opBlocks, unsigned long* opCount);
 
-extern struct inuse_block* build_inuse_heap_blocks(unsigned long*);
-extern void free_inuse_heap_blocks(struct inuse_block*, unsigned long);
+extern struct inuse_block_table* build_inuse_heap_blocks(void);
+extern void free_inuse_heap_blocks(struct inuse_block_table*);
+extern void adopt_inuse_heap_blocks(struct inuse_block*, unsigned long);
+
+extern unsigned long find_inuse_block(address_t, const struct inuse_block_table*);
+
+/*
+ * Candidate pointers classified in bulk, indexes[i] is the in-use block
+ * that values[i] points into, or INUSE_BLOCK_NONE
+ */
+struct inuse_ptr_batch
+{
+	unsigned long  count;
+	unsigned long  capacity;
+	address_t*     values;
+	unsigned long* indexes;
+	struct inuse_ptr_candidate* sorted;	// scratch of the sort-merge join
+};
 
-extern struct inuse_block* find_inuse_block(address_t, struct inuse_block*, unsigned long);
+extern CA_BOOL init_inuse_ptr_batch(struct inuse_ptr_batch*, unsigned long);
+extern void release_inuse_ptr_batch(struct inuse_ptr_batch*);
+extern unsigned long find_inuse_blocks(const struct inuse_block_table*, struct inuse_ptr_batch*);
 
 extern CA_BOOL display_heap_leak_candidates(void);
 
-extern CA_BOOL biggest_blocks(unsigned int num);
-extern CA_BOOL biggest_heap_owners_generic(unsigned int num, CA_BOOL all_reachable_blocks);
+extern CA_BOOL biggest_blocks(unsigned int num, const char* fname);
+extern CA_BOOL biggest_heap_owners_generic(unsigned int num, CA_BOOL all_reachable_blocks, CA_BOOL retained, CA_BOOL estimate);
 
 extern CA_BOOL
 calc_aggregate_size(const struct object_reference *ref,
 					size_t var_len,
 					CA_BOOL all_reachable_blocks,
-					struct inuse_block *inuse_blocks,
-					unsigned long num_inuse_blocks,
+					struct inuse_block_table *inuse_blocks,
+					size_t *aggr_size,
+					unsigned long *count);
+
+/*
+ * Retained memory is the collection of reachable blocks that are freed with a variable,
+ * i.e. which it dominates in the reference graph from all variables
+ */
+extern CA_BOOL
+calc_retained_size(const struct object_reference *ref,
+					size_t var_len,
+					struct inuse_block_table *inuse_blocks,
 					size_t *aggr_size,
 					unsigned long *count);
 
@@ -86,5 +147,8 @@ extern void display_mem_histogram(const char*);
 extern void init_mem_histogram(unsigned int nbuckets);
 extern void release_mem_histogram(void);
 extern void add_block_mem_histogram(size_t, CA_BOOL, unsigned int);
+extern void init_local_mem_histogram(struct MemHistogram*);
+extern void add_block_local_mem_histogram(struct MemHistogram*, size_t, CA_BOOL, unsigned int);
+extern void merge_local_mem_histogram(struct MemHistogram*);
 
 #endif
@@ -8,6 +8,7 @@
 #include <assert.h>
 
 #include "segment.h"
+#include "parallel.h"
 #include "heap_ptmalloc.h"
 
 #pragma GCC diagnostic ignored "-Wint-to-pointer-cast"
@@ -29,6 +30,8 @@ struct ca_malloc_par
   INTERNAL_SIZE_T  mmapped_mem;
   INTERNAL_SIZE_T  max_total_mem;
   char*            sbrk_base;
+  size_t           tcache_bins;	// 0 if there is no per-thread cache
+  size_t           tcache_count;
 };
 
 struct ca_malloc_state {
@@ -51,11 +54,21 @@ union malloc_state
 	struct malloc_state_GLIBC_2_5 mstate_2_5;
 	struct malloc_state_GLIBC_2_12 mstate_2_12;
 	struct malloc_state_GLIBC_2_22 mstate_2_22;
+	struct malloc_state_GLIBC_2_27 mstate_2_27;
 	struct malloc_state_GLIBC_2_3_32 mstate_2_3_32;
 	struct malloc_state_GLIBC_2_4_32 mstate_2_4_32;
 	struct malloc_state_GLIBC_2_5_32 mstate_2_5_32;
 	struct malloc_state_GLIBC_2_12_32 mstate_2_12_32;
 	struct malloc_state_GLIBC_2_22_32 mstate_2_22_32;
+	struct malloc_state_GLIBC_2_27_32 mstate_2_27_32;
+};
+
+union tcache_perthread
+{
+	struct tcache_perthread_struct_GLIBC_2_26 tc_2_26;
+	struct tcache_perthread_struct_GLIBC_2_30 tc_2_30;
+	struct tcache_perthread_struct_GLIBC_2_26_32 tc_2_26_32;
+	struct tcache_perthread_struct_GLIBC_2_30_32 tc_2_30_32;
 };
 
 union ca_malloc_chunk
@@ -128,16 +141,69 @@ struct ca_heap
 	address_t            mEndAddr;		// core's addr space
 	address_t*           mChunks;		// sorted addresses of blocks belonging to this heap
 	unsigned int         mNumChunks;	// the size of previous array of addresses
+	unsigned int*        mInuse;		// indexes of in-use chunks in mChunks, ascending
+	unsigned int         mNumInuse;		// the size of previous array of indexes
 	unsigned int         mCorrupted:1;
 	unsigned int         mResearved:31;
 };
 
+/*
+ * Set of addresses of free chunks whose tags still indicate in-use,
+ * i.e. chunks in fastbins or tcaches. Open addressing with linear probing, 0 is empty
+ */
+struct chunk_set
+{
+	address_t* mSlots;
+	size_t     mNumSlots;	// power of 2
+	size_t     mCount;
+};
+
+/*
+ * Counters of a heap walk, which stops at a corrupted or unreadable chunk
+ */
+enum HEAP_WALK_STATUS
+{
+	HEAP_WALK_OK,
+	HEAP_WALK_SKIPPED,	// left to the main thread
+	HEAP_WALK_BAD_FIRST,	// failed to read the first chunk
+	HEAP_WALK_CORRUPTED,	// chunk size is out of range
+	HEAP_WALK_BAD_NEXT	// failed to read the next chunk
+};
+
+struct heap_walk_stat
+{
+	size_t                 inuse_bytes;
+	size_t                 free_bytes;
+	unsigned long          num_inuse;
+	unsigned long          num_free;
+	enum HEAP_WALK_STATUS  status;
+	address_t              bad_chunk;
+	size_t                 bad_tag;	// size tag of the corrupted chunk
+};
+
+struct big_block_job
+{
+	struct ca_heap**    heaps;
+	size_t              num_heaps;
+	unsigned int        num;		// number of biggest blocks to select
+	struct heap_block** blks;		// a min-heap of num blocks for each worker
+	unsigned int*       counts;		// number of blocks in each min-heap
+};
+
+struct heap_walk_job
+{
+	struct ca_heap**        heaps;
+	struct heap_walk_stat*  stats;
+	struct MemHistogram*    hists;		// one for each worker
+};
+
 struct ca_arena
 {
 	enum HEAP_TYPE          mType;
 	struct ca_heap*         mpHeap;		// singly-linked list of heaps
 	address_t               mArenaAddr;	// core's addr space
 	struct ca_malloc_state  mpState;	// point to struct malloc_state
+	struct chunk_set        mCachedChunks;	// chunks in fastbins or tcaches, collected once
 };
 
 #define COPY_MALLOC_PAR(pars) \
@@ -164,6 +230,24 @@ struct ca_arena
 		mparams.sbrk_base      = (char*) pars.sbrk_base; \
 	} while(0)
 
+#define COPY_MALLOC_PAR_NO_MAX_TOTAL(pars) \
+	do { \
+		mparams.mmap_threshold = pars.mmap_threshold; \
+		mparams.n_mmaps        = pars.n_mmaps; \
+		mparams.n_mmaps_max    = pars.n_mmaps_max; \
+		mparams.max_total_mem  = 0; \
+		mparams.max_n_mmaps    = pars.max_n_mmaps; \
+		mparams.pagesize       = 4096; \
+		mparams.mmapped_mem    = pars.mmapped_mem; \
+		mparams.sbrk_base      = (char*) pars.sbrk_base; \
+	} while(0)
+
+#define COPY_TCACHE_PAR(pars) \
+	do { \
+		mparams.tcache_bins    = pars.tcache_bins; \
+		mparams.tcache_count   = pars.tcache_count; \
+	} while(0)
+
 #define copy_mstate(arena, orig, orig_32)								\
 	do {												\
 		if (g_ptr_bit == 64) {									\
@@ -214,6 +298,50 @@ struct ca_arena
 			COPY_MALLOC_PAR_WITHOUT_PAGESIZE(pars);				\
 	} while (0)
 
+#define read_mp_no_max_total_32(v)							\
+	do {										\
+		struct malloc_par_GLIBC_2_##v##_32 pars;				\
+		g_HEAP_MAX_SIZE = HEAP_MAX_SIZE_GLIBC_2_##v##_32;			\
+		g_MAX_FAST_SIZE = MAX_FAST_SIZE_GLIBC_2_##v##_32;			\
+		rc = read_memory_wrapper(NULL, mparams_vaddr, &pars, sizeof(pars));	\
+		if (rc)									\
+			COPY_MALLOC_PAR_NO_MAX_TOTAL(pars);				\
+	} while (0)
+
+#define read_mp_no_max_total(v)								\
+	do {										\
+		struct malloc_par_GLIBC_2_##v pars;					\
+		g_HEAP_MAX_SIZE = HEAP_MAX_SIZE_GLIBC_2_##v;				\
+		g_MAX_FAST_SIZE = MAX_FAST_SIZE_GLIBC_2_##v;				\
+		rc = read_memory_wrapper(NULL, mparams_vaddr, &pars, sizeof(pars));	\
+		if (rc)									\
+			COPY_MALLOC_PAR_NO_MAX_TOTAL(pars);				\
+	} while (0)
+
+#define read_mp_tcache_32(v)								\
+	do {										\
+		struct malloc_par_GLIBC_2_##v##_32 pars;				\
+		g_HEAP_MAX_SIZE = HEAP_MAX_SIZE_GLIBC_2_##v##_32;			\
+		g_MAX_FAST_SIZE = MAX_FAST_SIZE_GLIBC_2_##v##_32;			\
+		rc = read_memory_wrapper(NULL, mparams_vaddr, &pars, sizeof(pars));	\
+		if (rc) {								\
+			COPY_MALLOC_PAR_NO_MAX_TOTAL(pars);				\
+			COPY_TCACHE_PAR(pars);						\
+		}									\
+	} while (0)
+
+#define read_mp_tcache(v)								\
+	do {										\
+		struct malloc_par_GLIBC_2_##v pars;					\
+		g_HEAP_MAX_SIZE = HEAP_MAX_SIZE_GLIBC_2_##v;				\
+		g_MAX_FAST_SIZE = MAX_FAST_SIZE_GLIBC_2_##v;				\
+		rc = read_memory_wrapper(NULL, mparams_vaddr, &pars, sizeof(pars));	\
+		if (rc) {								\
+			COPY_MALLOC_PAR_NO_MAX_TOTAL(pars);				\
+			COPY_TCACHE_PAR(pars);						\
+		}									\
+	} while (0)
+
 
 /*
  * Global variables
@@ -223,6 +351,7 @@ static int glibc_ver_minor = 0;
 
 static unsigned long g_HEAP_MAX_SIZE;
 static size_t g_MAX_FAST_SIZE;
+static size_t g_MAX_CACHED_SIZE;	// the bigger one of fastbin and tcache chunk sizes
 static struct ca_malloc_par mparams;
 
 static CA_BOOL g_heap_ready = CA_FALSE;
@@ -233,10 +362,19 @@ static unsigned int g_arena_buf_sz = 0;
 static struct ca_heap** g_sorted_heaps = NULL;	// heaps sorted by virtual address
 static unsigned int g_heap_cnt = 0;
 
+static CA_BOOL g_tcache_collected = CA_FALSE;
+static size_t g_tcache_num_cached = 0;		// free chunks cached by threads
+static unsigned int g_tcache_num_threads = 0;
+
 /*
  * Forward declaration
  */
 static CA_BOOL traverse_heap_blocks(struct ca_heap*, CA_BOOL, size_t*, size_t*, unsigned long*, unsigned long*);
+static CA_BOOL walk_heap_blocks(struct ca_heap*, CA_BOOL, CA_BOOL, struct heap_walk_stat*, struct MemHistogram*);
+static CA_BOOL finish_heap_walk(struct ca_heap*, const struct heap_walk_stat*, CA_BOOL, size_t*, size_t*, unsigned long*, unsigned long*);
+static void walk_heap_task(void*, size_t, unsigned int);
+static void count_heap_block(struct MemHistogram*, size_t, CA_BOOL);
+static const char* mapped_heap_base(struct ca_heap*, size_t);
 
 static CA_BOOL build_heaps(void);
 static CA_BOOL get_glibc_version(void);
@@ -246,10 +384,15 @@ static void release_sorted_heaps(void);
 static struct ca_heap* search_sorted_heaps(address_t);
 
 static CA_BOOL build_heap_chunks(struct ca_heap*);
+static CA_BOOL build_all_heap_chunks(void);
 static address_t search_chunk(struct ca_heap*, address_t);
 static CA_BOOL fill_heap_block(struct ca_heap*, address_t, struct heap_block*);
 
-static CA_BOOL in_fastbins_or_remainder(struct ca_malloc_state*, mchunkptr, size_t);
+static CA_BOOL in_fastbins_or_tcache(struct ca_arena*, address_t, size_t);
+static void collect_fastbin_chunks(struct ca_arena*);
+static void collect_tcache_chunks(void);
+static address_t reveal_fd(address_t, address_t);
+static void release_chunk_set(struct chunk_set*);
 
 static size_t get_mstate_size(void);
 
@@ -366,10 +509,17 @@ CA_BOOL heap_walk(address_t heapaddr, CA_BOOL verbose)
 	unsigned int mmap_arena_cnt = 0;
 	int i, num_error;
 	struct ca_heap*  heap;
+	struct heap_walk_job job;
+	size_t num_heaps, heap_index;
 
 	if (!g_heap_ready)
 		return CA_FALSE;
-	else if (heapaddr)
+
+	// free chunks in tcaches are known only after all heaps are indexed
+	if (mparams.tcache_bins)
+		build_all_heap_chunks();
+
+	if (heapaddr)
 	{
 		heap = search_sorted_heaps(heapaddr);
 		if (heap)
@@ -404,16 +554,64 @@ CA_BOOL heap_walk(address_t heapaddr, CA_BOOL verbose)
 	CA_PRINT("\t\ttotal mmap regions created=%d\n", mparams.max_n_mmaps);
 	CA_PRINT("\t\tmmapped_mem="PRINT_FORMAT_SIZE"\n", mparams.mmapped_mem);
 	CA_PRINT("\t\tsbrk_base=%p\n", mparams.sbrk_base);
+	if (mparams.tcache_bins)
+	{
+		CA_PRINT("\t\ttcache_bins="PRINT_FORMAT_SIZE"\n", mparams.tcache_bins);
+		CA_PRINT("\t\ttcache_count="PRINT_FORMAT_SIZE"\n", mparams.tcache_count);
+		CA_PRINT("\t\ttcache cached chunks="PRINT_FORMAT_SIZE" (%d threads)\n",
+				g_tcache_num_cached, g_tcache_num_threads);
+	}
 
 	if (verbose)
 		init_mem_histogram(16);
 
+	// Heaps are walked concurrently, and reported in the order of arenas below
+	num_heaps = 0;
+	for (i=0; i<g_arena_cnt; i++)
+	{
+		for (heap = g_arenas[i].mpHeap; heap; heap = heap->mpNext)
+			num_heaps++;
+	}
+	job.heaps = (struct ca_heap**) malloc(sizeof(struct ca_heap*) * (num_heaps + 1));
+	job.stats = (struct heap_walk_stat*) malloc(sizeof(struct heap_walk_stat) * (num_heaps + 1));
+	job.hists = NULL;
+	if (job.heaps && job.stats)
+	{
+		heap_index = 0;
+		for (i=0; i<g_arena_cnt; i++)
+		{
+			for (heap = g_arenas[i].mpHeap; heap; heap = heap->mpNext)
+			{
+				job.stats[heap_index].status = HEAP_WALK_SKIPPED;
+				job.heaps[heap_index++] = heap;
+			}
+		}
+		if (g_debug_core && num_heaps > 1)
+			job.hists = (struct MemHistogram*) calloc(ca_num_workers(), sizeof(struct MemHistogram));
+		if (job.hists)
+		{
+			unsigned int w;
+			for (w = 0; w < ca_num_workers(); w++)
+				init_local_mem_histogram(&job.hists[w]);
+			ca_parallel_run(num_heaps, walk_heap_task, &job, CA_FALSE);
+			for (w = 0; w < ca_num_workers(); w++)
+				merge_local_mem_histogram(&job.hists[w]);
+			free(job.hists);
+		}
+	}
+	else if (job.stats)
+	{
+		free(job.stats);
+		job.stats = NULL;
+	}
+
 	totoal_free_bytes = 0;
 	totoal_inuse_bytes = 0;
 	total_num_inuse = 0;
 	total_num_free = 0;
 	num_mmap = 0;
 	num_error = 0;
+	heap_index = 0;
 	// walk the arena
 	for (i=0; i<g_arena_cnt; i++)
 	{
@@ -437,6 +635,10 @@ CA_BOOL heap_walk(address_t heapaddr, CA_BOOL verbose)
 		else
 		{
 			CA_PRINT("Unexpected arena type %d\n", arena->mType);
+			if (job.heaps)
+				free(job.heaps);
+			if (job.stats)
+				free(job.stats);
 			return CA_FALSE;
 		}
 
@@ -444,6 +646,8 @@ CA_BOOL heap_walk(address_t heapaddr, CA_BOOL verbose)
 		while (heap)
 		{
 			unsigned long num_inuse=0, num_free=0;
+			struct heap_walk_stat* stat = job.stats ? &job.stats[heap_index++] : NULL;
+			CA_BOOL walk_ok;
 			// there might be too many mmap blocks to print
 			if (arena->mType == ENUM_HEAP_MMAP_BLOCK)
 				num_mmap++;
@@ -452,7 +656,12 @@ CA_BOOL heap_walk(address_t heapaddr, CA_BOOL verbose)
 					heap->mStartAddr + size_t_sz, heap->mEndAddr);
 			print_size(heap->mEndAddr - heap->mStartAddr);
 
-			if (traverse_heap_blocks(heap, CA_FALSE, &inuse_bytes, &free_bytes, &num_inuse, &num_free))
+			// heaps skipped by worker threads are walked here
+			if (stat && stat->status != HEAP_WALK_SKIPPED)
+				walk_ok = finish_heap_walk(heap, stat, CA_FALSE, &inuse_bytes, &free_bytes, &num_inuse, &num_free);
+			else
+				walk_ok = traverse_heap_blocks(heap, CA_FALSE, &inuse_bytes, &free_bytes, &num_inuse, &num_free);
+			if (walk_ok)
 			{
 				totoal_inuse_bytes += inuse_bytes;
 				totoal_free_bytes  += free_bytes;
@@ -504,39 +713,61 @@ CA_BOOL heap_walk(address_t heapaddr, CA_BOOL verbose)
 	else
 		CA_PRINT("%d Errors encountered while walking the heap!\n", num_error);
 
+	if (job.heaps)
+		free(job.heaps);
+	if (job.stats)
+		free(job.stats);
 	return rc;
 }
 
-// The input array blks is assumed to be sorted by size already
-static void add_one_big_block(struct heap_block* blks, unsigned int num, struct heap_block* blk)
+/*
+ * Each worker selects the biggest in-use blocks of the heaps it is given
+ * in its own min-heap, they are merged into the caller's at the end
+ */
+static void select_big_blocks(struct ca_heap* heap, struct heap_block* blks, unsigned int num, unsigned int* count)
 {
-	unsigned int i;
-	for (i=0; i<num; i++)
+	size_t size_t_sz = g_ptr_bit == 64 ? sizeof(INTERNAL_SIZE_T) : sizeof(INTERNAL_SIZE_T_32);
+	struct heap_block blk;
+	unsigned int bi;
+
+	blk.inuse = CA_TRUE;
+	for (bi = 0; heap->mChunks && bi < heap->mNumInuse; bi++)
 	{
-		if (blk->size > blks[i].size)
+		unsigned int ci = heap->mInuse[bi];
+		blk.size = heap->mChunks[ci + 1] - heap->mChunks[ci] - size_t_sz;
+		if (*count < num || blk.size > blks[0].size)
 		{
-			int k;
-			// Insert blk->blks[i]
-			// Move blks[i]->blks[i+1], .., blks[num-2]->blks[num-1]
-			for (k= ((int)num)-2; k>=(int)i; k--)
-				blks[k+1] = blks[k];
-			blks[i] = *blk;
-			break;
+			blk.addr = heap->mChunks[ci] + size_t_sz;
+			add_big_block_candidate(blks, num, count, &blk);
 		}
 	}
 }
 
+static void select_big_blocks_task(void* arg, size_t task, unsigned int worker)
+{
+	struct big_block_job* job = (struct big_block_job*) arg;
+
+	select_big_blocks(job->heaps[task], job->blks[worker], job->num, &job->counts[worker]);
+}
+
+/*
+ * Per-worker selections are limited to so many blocks in total,
+ * beyond which the heaps are scanned by one thread
+ */
+#define MAX_PARALLEL_BIG_BLOCKS (16 * 1024 * 1024)
+
 CA_BOOL get_biggest_blocks(struct heap_block* blks, unsigned int num)
 {
 	int ptr_bit = g_ptr_bit;
 	size_t mchunk_sz = ptr_bit == 64 ? sizeof(struct malloc_chunk) : sizeof(struct malloc_chunk_32);
 	size_t size_t_sz = ptr_bit == 64 ? sizeof(INTERNAL_SIZE_T) : sizeof(INTERNAL_SIZE_T_32);
-	unsigned int i;
+	unsigned int i, w, count = 0;
+	unsigned int num_workers = ca_num_workers();
 	struct ca_arena* arena;
 	struct ca_heap*  heap;
 	union ca_malloc_chunk achunk;
 	struct heap_block blk;
-	struct heap_block* smallest = &blks[num - 1];
+	struct big_block_job job;
 
 	if (!g_heap_ready)
 		return CA_FALSE;
@@ -555,69 +786,72 @@ CA_BOOL get_biggest_blocks(struct heap_block* blks, unsigned int num)
 				if (!read_memory_wrapper(NULL, heap->mStartAddr - size_t_sz, &achunk, mchunk_sz))
 					break;
 				blk.size = ca_chunksize(ptr_bit, &achunk) - size_t_sz * 2;
-				if (blk.size > smallest->size)
-				{
-					blk.addr = heap->mStartAddr + size_t_sz;
-					blk.inuse = CA_TRUE;
-					add_one_big_block(blks, num, &blk);
-				}
+				blk.addr = heap->mStartAddr + size_t_sz;
+				blk.inuse = CA_TRUE;
+				add_big_block_candidate(blks, num, &count, &blk);
 				heap = heap->mpNext;
 			}
 		}
 	}
-	if (smallest->size > 0)
+	if (count == num)
+	{
+		sort_big_blocks(blks, count);
 		return CA_TRUE;
+	}
 
 	// walk other arenas if there are fewer mmap blocks than the requested number of big blocks
-	for (i=0; i<g_arena_cnt; i++)
+	build_all_heap_chunks();
+	memset(&job, 0, sizeof(job));
+	job.num = num;
+	job.heaps = (struct ca_heap**) malloc(sizeof(struct ca_heap*) * (g_heap_cnt + 1));
+	if (job.heaps)
 	{
-		if (g_arenas[i].mType != ENUM_HEAP_MMAP_BLOCK)
+		for (i = 0; i < g_heap_cnt; i++)
 		{
-			arena = &g_arenas[i];
-			heap  = arena->mpHeap;
-			// Traverse the link list of heaps of this arena
-			while (heap)
+			if (g_sorted_heaps[i]->mArena->mType != ENUM_HEAP_MMAP_BLOCK)
+				job.heaps[job.num_heaps++] = g_sorted_heaps[i];
+		}
+	}
+	// worker 0 is the calling thread, it selects into the caller's array
+	if (job.num_heaps > 1 && num_workers > 1 && (size_t)num * num_workers <= MAX_PARALLEL_BIG_BLOCKS)
+	{
+		job.blks = (struct heap_block**) calloc(num_workers, sizeof(struct heap_block*));
+		job.counts = (unsigned int*) calloc(num_workers, sizeof(unsigned int));
+		if (job.blks && job.counts)
+		{
+			job.blks[0] = blks;
+			job.counts[0] = count;
+			for (w = 1; w < num_workers; w++)
+			{
+				job.blks[w] = (struct heap_block*) malloc(sizeof(struct heap_block) * num);
+				if (!job.blks[w])
+					break;
+			}
+			if (w == num_workers)
 			{
-				unsigned int bi;
-				// For regular heaps, build an array of sorted chunk address, then do a binary search
-				if (!heap->mChunks)
-					build_heap_chunks(heap);
-				for (bi = 0; bi < heap->mNumChunks; bi++)
+				ca_parallel_run(job.num_heaps, select_big_blocks_task, &job, CA_FALSE);
+				count = job.counts[0];
+				for (w = 1; w < num_workers; w++)
 				{
-					size_t chunksz;
-					address_t chunk_addr = heap->mChunks[bi] - size_t_sz;
-					if (!read_memory_wrapper(NULL, chunk_addr, &achunk, mchunk_sz))
-						break;
-					chunksz = ca_chunksize(ptr_bit, &achunk);
-					if (chunk_addr + chunksz + mchunk_sz >= heap->mEndAddr)
-					{
-						// top pad is free memory block
-					}
-					else
-					{
-						// Get the next chunk which has the prev_inuse bit flag
-						union ca_malloc_chunk next_chunk;
-						if (!read_memory_wrapper(NULL, chunk_addr + chunksz, &next_chunk, mchunk_sz))
-							break;
-
-						if (ca_prev_inuse(ptr_bit, &next_chunk)
-							&& (chunksz > g_MAX_FAST_SIZE || !in_fastbins_or_remainder(&heap->mArena->mpState, (mchunkptr)chunk_addr, chunksz)) )
-						{
-							// this is an in-use block
-							blk.size = chunksz - size_t_sz;
-							if (blk.size > smallest->size)
-							{
-								blk.addr = chunk_addr + size_t_sz * 2;
-								blk.inuse = CA_TRUE;
-								add_one_big_block(blks, num, &blk);
-							}
-						}
-					}
+					for (i = 0; i < job.counts[w]; i++)
+						add_big_block_candidate(blks, num, &count, &job.blks[w][i]);
 				}
-				heap = heap->mpNext;
+				job.num_heaps = 0;	// done
 			}
+			for (w = 1; w < num_workers && job.blks[w]; w++)
+				free(job.blks[w]);
 		}
+		if (job.blks)
+			free(job.blks);
+		if (job.counts)
+			free(job.counts);
 	}
+	for (i = 0; i < job.num_heaps; i++)
+		select_big_blocks(job.heaps[i], blks, num, &count);
+	if (job.heaps)
+		free(job.heaps);
+
+	sort_big_blocks(blks, count);
 	return CA_TRUE;
 }
 
@@ -633,6 +867,10 @@ CA_BOOL walk_inuse_blocks(struct inuse_block* opBlocks, unsigned long* opCount)
 	if (!g_heap_ready)
 		return CA_FALSE;
 
+	// In-use chunks are listed when heaps are indexed, counting them is cheap
+	if (!build_all_heap_chunks())
+		return CA_FALSE;
+
 	*opCount = 0;
 	for (heap_index = 0; heap_index < g_heap_cnt; heap_index++)
 	{
@@ -652,43 +890,19 @@ CA_BOOL walk_inuse_blocks(struct inuse_block* opBlocks, unsigned long* opCount)
 				pBlockinfo++;
 			}
 		}
-		else
+		else if (heap->mChunks)
 		{
-			unsigned int chunk_index;
-			// For regular heaps, use the sorted array of chunks
-			if (!heap->mChunks)
-				build_heap_chunks(heap);
-
-			for (chunk_index = 0; chunk_index < heap->mNumChunks; chunk_index++)
+			unsigned int i;
+			(*opCount) += heap->mNumInuse;
+			if (!pBlockinfo)
+				continue;
+			// For regular heaps, use the list of in-use chunks
+			for (i = 0; i < heap->mNumInuse; i++)
 			{
-				address_t chunk_addr = heap->mChunks[chunk_index] - size_t_sz;
-				size_t chunksz;
-				// read current chunk's size tag
-				if (!read_memory_wrapper(NULL, chunk_addr, &achunk, mchunk_sz))
-					break;
-				chunksz = ca_chunksize(ptr_bit, &achunk);
-				// top pad
-				if (chunk_addr + chunksz + mchunk_sz >= heap->mEndAddr)
-					break;
-				else
-				{
-					// Get the next chunk which has the prev_inuse bit flag
-					union ca_malloc_chunk next_chunk;
-					if (!read_memory_wrapper(NULL, chunk_addr + chunksz, &next_chunk, mchunk_sz))
-						break;
-
-					if (ca_prev_inuse(ptr_bit, &next_chunk)
-						&& (chunksz > g_MAX_FAST_SIZE || !in_fastbins_or_remainder(&heap->mArena->mpState, (mchunkptr)chunk_addr, chunksz)) )
-					{
-						(*opCount)++;
-						if (pBlockinfo)
-						{
-							pBlockinfo->addr = chunk_addr + size_t_sz*2;
-							pBlockinfo->size = chunksz - size_t_sz;
-							pBlockinfo++;
-						}
-					}
-				}
+				unsigned int ci = heap->mInuse[i];
+				pBlockinfo->addr = heap->mChunks[ci] + size_t_sz;
+				pBlockinfo->size = heap->mChunks[ci + 1] - heap->mChunks[ci] - size_t_sz;
+				pBlockinfo++;
 			}
 		}
 	}
@@ -858,6 +1072,7 @@ static void release_ca_arena(struct ca_arena* arena)
 	// The released one must be the last one
 	if (arena == &g_arenas[g_arena_cnt-1])
 	{
+		release_chunk_set(&arena->mCachedChunks);
 		g_arena_cnt--;
 	}
 }
@@ -869,6 +1084,8 @@ static void release_ca_heap(struct ca_heap* heap)
 {
 	if (heap->mChunks)
 		free(heap->mChunks);
+	if (heap->mInuse)
+		free(heap->mInuse);
 	memset(heap, 0xfd, sizeof(struct ca_heap));
 	free(heap);
 }
@@ -889,6 +1106,7 @@ static void release_all_ca_arenas(void)
 			heap = heap->mpNext;
 			release_ca_heap (tmp_heap);
 		}
+		release_chunk_set(&arena->mCachedChunks);
 	}
 	g_arena_cnt = 0;
 	// sorted heaps are pointers to above released ones
@@ -938,8 +1156,10 @@ static struct ca_arena* build_arena(address_t arena_vaddr, enum HEAP_TYPE type)
 				copy_mstate(&arena->mpState, &arena_state.mstate_2_5, &arena_state.mstate_2_5_32);
 			else if (glibc_ver_minor == 12 || (glibc_ver_minor >= 17 && glibc_ver_minor <= 21))
 				copy_mstate(&arena->mpState, &arena_state.mstate_2_12, &arena_state.mstate_2_12_32);
-			else if (glibc_ver_minor >= 22 && glibc_ver_minor <= 23)
+			else if (glibc_ver_minor >= 22 && glibc_ver_minor <= 26)
 				copy_mstate(&arena->mpState, &arena_state.mstate_2_22, &arena_state.mstate_2_22_32);
+			else if (glibc_ver_minor >= 27 && glibc_ver_minor <= 36)
+				copy_mstate(&arena->mpState, &arena_state.mstate_2_27, &arena_state.mstate_2_27_32);
 			else {
 				assert(0 && "internal error: glibc version not supported");
 				return NULL;
@@ -957,6 +1177,8 @@ static struct ca_arena* build_arena(address_t arena_vaddr, enum HEAP_TYPE type)
 			release_ca_arena(arena);
 			return NULL;
 		}
+		// chunks in fastbins are collected once instead of walking the lists for every chunk
+		collect_fastbin_chunks(arena);
 		// top chunk is the last chunk of the arena
 		top_addr = (address_t) arena->mpState.top;
 		segment = get_segment(top_addr, mchunk_sz);
@@ -1243,6 +1465,12 @@ static CA_BOOL build_heaps_internal_32(address_t main_arena_vaddr, address_t mpa
 		read_mp_32(12);
 	else if (glibc_ver_minor >= 22 && glibc_ver_minor <= 23)
 		read_mp_32(22);
+	else if (glibc_ver_minor >= 24 && glibc_ver_minor <= 25)
+		read_mp_no_max_total_32(24);
+	else if (glibc_ver_minor >= 26 && glibc_ver_minor <= 34)
+		read_mp_tcache_32(26);
+	else if (glibc_ver_minor >= 35 && glibc_ver_minor <= 36)
+		read_mp_tcache_32(35);
 
 	if (!rc)
 	{
@@ -1335,6 +1563,12 @@ static CA_BOOL build_heaps_internal_64(address_t main_arena_vaddr, address_t mpa
 		read_mp(12);
 	else if (glibc_ver_minor >= 22 && glibc_ver_minor <= 23)
 		read_mp(22);
+	else if (glibc_ver_minor >= 24 && glibc_ver_minor <= 25)
+		read_mp_no_max_total(24);
+	else if (glibc_ver_minor >= 26 && glibc_ver_minor <= 34)
+		read_mp_tcache(26);
+	else if (glibc_ver_minor >= 35 && glibc_ver_minor <= 36)
+		read_mp_tcache(35);
 
 	if (!rc)
 	{
@@ -1429,7 +1663,7 @@ static CA_BOOL build_heaps(void)
 		&& glibc_ver_minor != 5
 		//&& glibc_ver_minor != 11
 		&& glibc_ver_minor != 12
-		&& (glibc_ver_minor < 17 || glibc_ver_minor > 23))
+		&& (glibc_ver_minor < 17 || glibc_ver_minor > 36))
 	{
 		CA_PRINT("The memory manager of glibc %d.%d is not supported in this release\n",
 				glibc_ver_major, glibc_ver_minor);
@@ -1444,9 +1678,20 @@ static CA_BOOL build_heaps(void)
 		return CA_FALSE;
 	}
 
+	g_tcache_collected = CA_FALSE;
+	g_tcache_num_cached = 0;
+	g_tcache_num_threads = 0;
 	rc = build_heaps_internal(main_arena_vaddr, mparams_vaddr);
 	if (rc)
 	{
+		size_t minsz = g_ptr_bit == 64 ? MINSIZE : MINSIZE_32;
+		// tcache holds bigger chunks than fastbins
+		if (mparams.tcache_bins > TCACHE_MAX_BINS)
+			mparams.tcache_bins = TCACHE_MAX_BINS;
+		g_MAX_CACHED_SIZE = g_MAX_FAST_SIZE;
+		if (mparams.tcache_bins && minsz + TCACHE_ALIGNMENT * (mparams.tcache_bins - 1) > g_MAX_CACHED_SIZE)
+			g_MAX_CACHED_SIZE = minsz + TCACHE_ALIGNMENT * (mparams.tcache_bins - 1);
+
 		build_sorted_heaps();
 		g_heap_ready = CA_TRUE;
 	}
@@ -1455,157 +1700,568 @@ static CA_BOOL build_heaps(void)
 }
 
 /*
- * Blocks in fastbins are free but their tags still indicate in-use.
+ * chunk_set is probed by a multiplicative hash of the chunk address
  */
-static CA_BOOL in_fastbins_or_remainder(struct ca_malloc_state* mstate, mchunkptr chunk_p, size_t chunksz)
+static size_t chunk_set_slot(const struct chunk_set* set, address_t addr)
 {
-	int ptr_bit = g_ptr_bit;
-	int index;
+	size_t mask = set->mNumSlots - 1;
+	size_t slot = (size_t)((addr >> 4) * 2654435761u) & mask;
 
-	if (!mstate)
-		return CA_FALSE;
+	while (set->mSlots[slot] && set->mSlots[slot] != addr)
+		slot = (slot + 1) & mask;
+	return slot;
+}
 
-	if (glibc_ver_minor == 3 || glibc_ver_minor == 4)
-	{
-		if (ptr_bit == 64)
-			index = fastbin_index_GLIBC_2_3(chunksz);
-		else
-			index = fastbin_index_GLIBC_2_3_32(chunksz);
-	}
-	else if (glibc_ver_minor == 5)
+static CA_BOOL chunk_set_insert(struct chunk_set* set, address_t addr)
+{
+	size_t slot;
+
+	// keep the load factor under 1/2
+	if ((set->mCount + 1) * 2 > set->mNumSlots)
 	{
-		if (ptr_bit == 64)
-			index = fastbin_index_GLIBC_2_5(chunksz);
-		else
-			index = fastbin_index_GLIBC_2_5_32(chunksz);
+		struct chunk_set bigger;
+		size_t i;
+		bigger.mNumSlots = set->mNumSlots ? set->mNumSlots * 2 : 64;
+		bigger.mCount = set->mCount;
+		bigger.mSlots = (address_t*) calloc(bigger.mNumSlots, sizeof(address_t));
+		if (!bigger.mSlots)
+			return CA_FALSE;
+		for (i = 0; i < set->mNumSlots; i++)
+		{
+			if (set->mSlots[i])
+				bigger.mSlots[chunk_set_slot(&bigger, set->mSlots[i])] = set->mSlots[i];
+		}
+		release_chunk_set(set);
+		*set = bigger;
 	}
-	else if (glibc_ver_minor == 12 || (glibc_ver_minor >= 17 && glibc_ver_minor <= 23))
+	slot = chunk_set_slot(set, addr);
+	if (!set->mSlots[slot])
 	{
-		if (ptr_bit == 64)
-			index = fastbin_index_GLIBC_2_12(chunksz);
-		else
-			index = fastbin_index_GLIBC_2_12_32(chunksz);
+		set->mSlots[slot] = addr;
+		set->mCount++;
 	}
-	else
+	return CA_TRUE;
+}
+
+static CA_BOOL chunk_set_find(const struct chunk_set* set, address_t addr)
+{
+	if (set->mCount == 0)
 		return CA_FALSE;
+	return set->mSlots[chunk_set_slot(set, addr)] == addr ? CA_TRUE : CA_FALSE;
+}
+
+static void release_chunk_set(struct chunk_set* set)
+{
+	if (set->mSlots)
+		free(set->mSlots);
+	memset(set, 0, sizeof(struct chunk_set));
+}
 
-	// Fastbins
-	if(index < mstate->nfastbins)
+/*
+ * Remember all chunks on the arena's fastbin lists
+ *   A list ends at a chunk which can't be read or is too big for fastbins,
+ *   or at a loop, which is a sign of corruption reported by the heap walk
+ */
+static void collect_fastbin_chunks(struct ca_arena* arena)
+{
+	int ptr_bit = g_ptr_bit;
+	size_t mchunk_sz = ptr_bit == 64 ? sizeof(struct malloc_chunk) : sizeof(struct malloc_chunk_32);
+	size_t minsz = ptr_bit == 64 ? MINSIZE : MINSIZE_32;
+	size_t max_count = arena->mpState.system_mem / minsz + 1;
+	int fbi;
+
+	release_chunk_set(&arena->mCachedChunks);
+	for (fbi = 0; fbi < arena->mpState.nfastbins; fbi++)
 	{
-		size_t mchunk_sz = ptr_bit == 64 ? sizeof(struct malloc_chunk) : sizeof(struct malloc_chunk_32);
-		address_t chunk_vaddr = (address_t)mstate->fastbins[index];
-		while (chunk_vaddr)
+		address_t chunk_vaddr = (address_t)arena->mpState.fastbins[fbi];
+		size_t count = 0;
+		while (chunk_vaddr && count++ < max_count)
 		{
 			union ca_malloc_chunk fast_chunk;
-			if (chunk_vaddr == (address_t)chunk_p)
-				return CA_TRUE;
-			else if (!read_memory_wrapper(NULL, chunk_vaddr, &fast_chunk, mchunk_sz))
-				return CA_FALSE;
-			/*
-			if (chunk_vaddr == (address_t)fast_chunk.fd)
+			if (chunk_set_find(&arena->mCachedChunks, chunk_vaddr)
+				|| !chunk_set_insert(&arena->mCachedChunks, chunk_vaddr)
+				|| !read_memory_wrapper(NULL, chunk_vaddr, &fast_chunk, mchunk_sz)
+				|| ca_chunksize(ptr_bit, &fast_chunk) > g_MAX_FAST_SIZE)
 				break;
-			*/
-			if (ca_chunksize(ptr_bit, &fast_chunk) > g_MAX_FAST_SIZE)
-				return CA_FALSE;
-			chunk_vaddr = ca_chunk_fd(ptr_bit, &fast_chunk);
+			chunk_vaddr = reveal_fd(chunk_vaddr, ca_chunk_fd(ptr_bit, &fast_chunk));
 		}
 	}
-	return CA_FALSE;
 }
 
 /*
- * Build up an array of addresses (in ascending order) of chunks of pass-in heap
+ * Blocks in fastbins or tcaches are free but their tags still indicate in-use.
+ * 	The lookup doesn't read memory, worker threads may call it
  */
-static CA_BOOL build_heap_chunks(struct ca_heap* heap)
+static CA_BOOL in_fastbins_or_tcache(struct ca_arena* arena, address_t chunk_addr, size_t chunksz)
 {
-	unsigned int count;
-	address_t cursor;
-	union ca_malloc_chunk achunk;
-	size_t chunksz;
-	CA_BOOL lbFencePost;
-	int ptr_bit = g_ptr_bit;
-	size_t mchunk_sz = ptr_bit == 64 ? sizeof(struct malloc_chunk) : sizeof(struct malloc_chunk_32);
-	size_t size_t_sz = ptr_bit == 64 ? sizeof(INTERNAL_SIZE_T) : sizeof(INTERNAL_SIZE_T_32);
+	if (chunksz > g_MAX_CACHED_SIZE)
+		return CA_FALSE;
+	return chunk_set_find(&arena->mCachedChunks, chunk_addr);
+}
 
-	// First pass, count the number of blocks
-	count = 0;
-	lbFencePost = CA_FALSE;
-	cursor = heap->mStartAddr - size_t_sz;
-	while (cursor < heap->mEndAddr)
-	{
-		count++;
-		if (!read_memory_wrapper(NULL, cursor, &achunk, mchunk_sz))
-			return CA_FALSE;
+/*
+ * glibc 2.32 and later mangle a fastbin chunk's fd with the address it is stored at
+ */
+static address_t reveal_fd(address_t chunk_vaddr, address_t fd)
+{
+	size_t size_t_sz = g_ptr_bit == 64 ? sizeof(INTERNAL_SIZE_T) : sizeof(INTERNAL_SIZE_T_32);
 
-		// check if chunk size is within valid range
-		chunksz = ca_chunksize(ptr_bit, &achunk);
-		if (cursor > (address_t)(-chunksz)
-			|| cursor+chunksz+mchunk_sz > heap->mEndAddr+0x100)
+	if (glibc_ver_minor < 32)
+		return fd;
+	return REVEAL_PTR_GLIBC_2_32(chunk_vaddr + size_t_sz * 2, fd);
+}
+
+static size_t get_tcache_size(void)
+{
+	if (glibc_ver_minor >= 30)
+		return g_ptr_bit == 64 ? sizeof(struct tcache_perthread_struct_GLIBC_2_30) : sizeof(struct tcache_perthread_struct_GLIBC_2_30_32);
+	else
+		return g_ptr_bit == 64 ? sizeof(struct tcache_perthread_struct_GLIBC_2_26) : sizeof(struct tcache_perthread_struct_GLIBC_2_26_32);
+}
+
+static void decode_tcache(const union tcache_perthread* tc, unsigned int* counts, address_t* entries)
+{
+	unsigned int i;
+
+	for (i = 0; i < TCACHE_MAX_BINS; i++)
+	{
+		if (g_ptr_bit == 64 && glibc_ver_minor >= 30)
 		{
-			heap->mCorrupted = 1;
-			break;
+			counts[i] = tc->tc_2_30.counts[i];
+			entries[i] = (address_t) tc->tc_2_30.entries[i];
 		}
-
-		// top chunk is treated differently
-		if (cursor + chunksz + mchunk_sz >= heap->mEndAddr)
+		else if (g_ptr_bit == 64)
 		{
-			// this is the top chunk of the arena.
-			chunksz = heap->mEndAddr - cursor;
+			counts[i] = (unsigned char) tc->tc_2_26.counts[i];
+			entries[i] = (address_t) tc->tc_2_26.entries[i];
 		}
-		// detect double fence post
-		else if (chunksz == 2*size_t_sz)
+		else if (glibc_ver_minor >= 30)
 		{
-			if (lbFencePost)	// 2nd fence post
-				chunksz = heap->mEndAddr - cursor;
-			else
-				lbFencePost = CA_TRUE;	// 1st fence post
+			counts[i] = tc->tc_2_30_32.counts[i];
+			entries[i] = tc->tc_2_30_32.entries[i];
 		}
 		else
-			lbFencePost = CA_FALSE;
-		cursor += chunksz;
+		{
+			counts[i] = (unsigned char) tc->tc_2_26_32.counts[i];
+			entries[i] = tc->tc_2_26_32.entries[i];
+		}
 	}
+}
 
-	// Allocate memory for the array
-	heap->mChunks = (address_t*) malloc((count + 1) * sizeof(address_t));
-	heap->mNumChunks = count;
+/*
+ * Check whether a chunk of tcache_perthread_struct's size is a thread's tcache
+ *   Every non-empty bin must start with an aligned heap chunk of the bin's size
+ *   Return the number of cached chunks, or -1 if it is not a tcache
+ */
+static int validate_tcache(const unsigned int* counts, const address_t* entries)
+{
+	int ptr_bit = g_ptr_bit;
+	size_t mchunk_sz = ptr_bit == 64 ? sizeof(struct malloc_chunk) : sizeof(struct malloc_chunk_32);
+	size_t size_t_sz = ptr_bit == 64 ? sizeof(INTERNAL_SIZE_T) : sizeof(INTERNAL_SIZE_T_32);
+	size_t minsz = ptr_bit == 64 ? MINSIZE : MINSIZE_32;
+	address_t amask = ptr_bit == 64 ? 0xf : 0x7;
+	unsigned int i;
+	int total = 0;
 
-	// Second pass, fill the array with addresses of malloc_chunk
-	count = 0;
-	lbFencePost = CA_FALSE;
-	cursor = heap->mStartAddr - size_t_sz;
-	while (cursor < heap->mEndAddr)
+	for (i = 0; i < mparams.tcache_bins; i++)
 	{
-		heap->mChunks[count++] = cursor + size_t_sz;
-		read_memory_wrapper(NULL, cursor, &achunk, mchunk_sz);
-		// check if chunk size is within valid range
-		chunksz = ca_chunksize(ptr_bit, &achunk);
-		if (cursor > (address_t)(-chunksz)
-			|| cursor+chunksz+mchunk_sz > heap->mEndAddr+0x100)
-		{
+		union ca_malloc_chunk achunk;
+		struct ca_heap* heap;
+
+		if (counts[i] > mparams.tcache_count || (counts[i] == 0) != (entries[i] == 0))
+			return -1;
+		else if (counts[i] == 0)
+			continue;
+		heap = search_sorted_heaps(entries[i]);
+		if ((entries[i] & amask)
+			|| !heap
+			|| heap->mArena->mType == ENUM_HEAP_MMAP_BLOCK
+			|| !read_memory_wrapper(NULL, entries[i] - size_t_sz * 2, &achunk, mchunk_sz)
+			|| ca_chunksize(ptr_bit, &achunk) != minsz + TCACHE_ALIGNMENT * i)
+			return -1;
+		total += counts[i];
+	}
+	return total;
+}
+
+/*
+ * Follow one tcache bin, entries point to the chunks' user data
+ *   and the next pointers are mangled since glibc 2.32
+ */
+static size_t collect_tcache_bin(address_t entry, unsigned int count)
+{
+	int ptr_bit = g_ptr_bit;
+	size_t size_t_sz = ptr_bit == 64 ? sizeof(INTERNAL_SIZE_T) : sizeof(INTERNAL_SIZE_T_32);
+	size_t ptr_sz = ptr_bit == 64 ? 8 : 4;
+	address_t amask = ptr_bit == 64 ? 0xf : 0x7;
+	size_t num_collected = 0;
+
+	while (entry && num_collected < count)
+	{
+		struct ca_heap* heap = search_sorted_heaps(entry);
+		address_t chunk_addr = entry - size_t_sz * 2;
+		address_t next = 0;
+
+		if (!heap
+			|| heap->mArena->mType == ENUM_HEAP_MMAP_BLOCK
+			|| chunk_set_find(&heap->mArena->mCachedChunks, chunk_addr)
+			|| !chunk_set_insert(&heap->mArena->mCachedChunks, chunk_addr))
 			break;
-		}
+		num_collected++;
+		if (!read_memory_wrapper(NULL, entry, &next, ptr_sz))
+			break;
+		if (glibc_ver_minor >= 32)
+			next = REVEAL_PTR_GLIBC_2_32(entry, next);
+		if (next & amask)
+			break;
+		entry = next;
+	}
+	return num_collected;
+}
 
-		// top chunk is treated differently
-		if (cursor + chunksz + mchunk_sz >= heap->mEndAddr)
+/*
+ * Free chunks in threads' tcaches look in-use, just like those in fastbins.
+ *   tcache_perthread_struct is allocated by malloc, it is found among the
+ *   in-use chunks of its size after heaps are indexed. Its cached chunks are
+ *   added to their arenas' sets and dropped from the heaps' in-use lists
+ */
+static void collect_tcache_chunks(void)
+{
+	size_t size_t_sz = g_ptr_bit == 64 ? sizeof(INTERNAL_SIZE_T) : sizeof(INTERNAL_SIZE_T_32);
+	size_t tc_size = get_tcache_size();
+	size_t num_cached = 0;
+	unsigned int num_tcache = 0;
+	unsigned int heap_index;
+
+	if (g_tcache_collected || mparams.tcache_bins == 0)
+		return;
+	g_tcache_collected = CA_TRUE;
+
+	for (heap_index = 0; heap_index < g_heap_cnt; heap_index++)
+	{
+		struct ca_heap* heap = g_sorted_heaps[heap_index];
+		unsigned int i;
+
+		if (heap->mArena->mType == ENUM_HEAP_MMAP_BLOCK || !heap->mChunks)
+			continue;
+		for (i = 0; i < heap->mNumInuse; i++)
 		{
-			// this is the top chunk of the arena.
-			chunksz = heap->mEndAddr - cursor;
+			unsigned int ci = heap->mInuse[i];
+			size_t chunksz = heap->mChunks[ci + 1] - heap->mChunks[ci];
+			union tcache_perthread tc;
+			unsigned int counts[TCACHE_MAX_BINS];
+			address_t entries[TCACHE_MAX_BINS];
+			unsigned int bi;
+
+			if (chunksz < tc_size + size_t_sz || chunksz >= tc_size + size_t_sz + TCACHE_ALIGNMENT)
+				continue;
+			if (!read_memory_wrapper(NULL, heap->mChunks[ci] + size_t_sz, &tc, tc_size))
+				continue;
+			decode_tcache(&tc, counts, entries);
+			if (validate_tcache(counts, entries) <= 0)
+				continue;
+			num_tcache++;
+			for (bi = 0; bi < mparams.tcache_bins; bi++)
+				num_cached += collect_tcache_bin(entries[bi], counts[bi]);
 		}
-		// detect double fence post
-		else if (chunksz == 2*size_t_sz)
+	}
+	g_tcache_num_cached = num_cached;
+	g_tcache_num_threads = num_tcache;
+	if (num_cached == 0)
+		return;
+
+	// in-use lists were built before tcaches are known
+	for (heap_index = 0; heap_index < g_heap_cnt; heap_index++)
+	{
+		struct ca_heap* heap = g_sorted_heaps[heap_index];
+		unsigned int i, num_inuse = 0;
+
+		if (heap->mArena->mType == ENUM_HEAP_MMAP_BLOCK || !heap->mChunks)
+			continue;
+		for (i = 0; i < heap->mNumInuse; i++)
 		{
-			if (lbFencePost)	// 2nd fence post
-				chunksz = heap->mEndAddr - cursor;
-			else
-				lbFencePost = CA_TRUE;	// 1st fence post
+			unsigned int ci = heap->mInuse[i];
+			if (!in_fastbins_or_tcache(heap->mArena, heap->mChunks[ci] - size_t_sz,
+					heap->mChunks[ci + 1] - heap->mChunks[ci]))
+				heap->mInuse[num_inuse++] = ci;
 		}
-		else
-			lbFencePost = CA_FALSE;
-		cursor += chunksz;
+		heap->mNumInuse = num_inuse;
+	}
+}
+
+/*
+ * Read heap memory straight from the mmap-ed core if the range is within
+ * the heap's segment. Worker threads may not fall back to read_memory_wrapper
+ */
+static CA_BOOL read_heap_memory(struct ca_heap* heap, address_t addr, void* buf, size_t len, CA_BOOL in_worker)
+{
+	struct ca_segment* segment = heap->mSegment;
+
+	if (!in_worker)
+		return read_memory_wrapper(segment, addr, buf, len);
+	if (g_debug_core && segment && segment->m_faddr
+		&& addr >= segment->m_vaddr && addr + len <= segment->m_vaddr + segment->m_fsize)
+	{
+		memcpy(buf, segment->m_faddr + (addr - segment->m_vaddr), len);
+		return CA_TRUE;
+	}
+	return CA_FALSE;
+}
+
+/*
+ * A worker walks a heap in windows of the core file, the window being
+ * walked is pinned and the next one is read ahead
+ */
+struct heap_window
+{
+	struct ca_segment* segment;
+	size_t first;		// pointer index of the pinned window in the segment
+	size_t last;
+};
+
+static void move_heap_window(struct heap_window* window, address_t cursor)
+{
+	size_t ptr_sz = g_ptr_bit >> 3;
+	size_t window_ptrs = PREFETCH_WINDOW_SZ / ptr_sz;
+	struct ca_segment* segment = window->segment;
+	size_t index;
+
+	if (!segment || cursor < segment->m_vaddr)
+		return;
+	index = (cursor - segment->m_vaddr) / ptr_sz;
+	if (index >= window->first && index < window->last)
+		return;
+	if (window->first < window->last)
+		unpin_segment_range(segment, window->first, window->last);
+	window->first = index - index % window_ptrs;
+	window->last = window->first + window_ptrs;
+	pin_segment_range(segment, window->first, window->last);
+	prefetch_segment_range(segment, window->last, window->last + window_ptrs);
+}
+
+static void close_heap_window(struct heap_window* window)
+{
+	if (window->segment && window->first < window->last)
+		unpin_segment_range(window->segment, window->first, window->last);
+	window->first = window->last = 0;
+}
+
+/*
+ * Return the host address of the heap if it lies in one mmap-ed segment of
+ * the core, chunk headers are then read in place instead of being copied
+ */
+static const char* mapped_heap_base(struct ca_heap* heap, size_t size_t_sz)
+{
+	struct ca_segment* segment = heap->mSegment;
+
+	if (g_debug_core && segment && segment->m_faddr
+		&& heap->mStartAddr - size_t_sz >= segment->m_vaddr
+		&& heap->mEndAddr <= segment->m_vaddr + segment->m_fsize)
+		return segment->m_faddr;
+	return NULL;
+}
+
+/*
+ * Build up an array of addresses (in ascending order) of chunks of pass-in heap
+ * and the list of its in-use chunks in one walk.
+ *   The walker is generated for struct malloc_chunk and malloc_chunk_32, the
+ *   header layout is the same for all supported glibc versions. Headers are
+ *   read in place if the heap is in one mmap-ed segment, copied otherwise
+ */
+#define heap_chunk_at(mapped, addr, buf)						\
+	((mapped) ? (const void*) ((mapped) + ((addr) - heap->mSegment->m_vaddr))	\
+		: (read_heap_memory(heap, (addr), (buf), mchunk_sz, in_worker) ? (const void*) (buf) : NULL))
+
+#define DEFINE_INDEX_HEAP_CHUNKS(suffix, CHUNK, SIZE_T)					\
+static CA_BOOL index_heap_chunks_##suffix(struct ca_heap* heap, CA_BOOL in_worker)	\
+{											\
+	unsigned int count, num_inuse, capacity;					\
+	address_t* chunks;								\
+	unsigned int* inuse;								\
+	address_t cursor;								\
+	CHUNK chunk_buf, next_buf;							\
+	const CHUNK* achunk;								\
+	const CHUNK* next_chunk;							\
+	size_t chunksz;									\
+	CA_BOOL lbFencePost;								\
+	CA_BOOL rc = CA_FALSE;								\
+	struct heap_window window;							\
+	const size_t mchunk_sz = sizeof(CHUNK);						\
+	const size_t size_t_sz = sizeof(SIZE_T);					\
+	const char* mapped = mapped_heap_base(heap, size_t_sz);				\
+											\
+	/* guess the number of chunks, the arrays grow if it is too small */		\
+	capacity = (heap->mEndAddr - heap->mStartAddr) / 256 + 16;			\
+	if (capacity > 1024 * 1024)							\
+		capacity = 1024 * 1024;							\
+	chunks = (address_t*) malloc((capacity + 1) * sizeof(address_t));		\
+	inuse = (unsigned int*) malloc(capacity * sizeof(unsigned int));		\
+	if (!chunks || !inuse)								\
+		goto index_out;								\
+											\
+	window.segment = (in_worker || mapped) ? heap->mSegment : NULL;			\
+	window.first = window.last = 0;							\
+											\
+	count = 0;									\
+	num_inuse = 0;									\
+	lbFencePost = CA_FALSE;								\
+	cursor = heap->mStartAddr - size_t_sz;						\
+	move_heap_window(&window, cursor);						\
+	achunk = (const CHUNK*) heap_chunk_at(mapped, cursor, &chunk_buf);		\
+	if (!achunk)									\
+		goto index_out;								\
+	while (cursor < heap->mEndAddr)							\
+	{										\
+		if (count >= capacity)							\
+		{									\
+			address_t* new_chunks;						\
+			unsigned int* new_inuse;					\
+			if (capacity >= UINT_MAX / 2)					\
+				goto index_out;						\
+			capacity *= 2;							\
+			new_chunks = (address_t*) realloc(chunks, (capacity + 1) * sizeof(address_t));	\
+			if (new_chunks)							\
+				chunks = new_chunks;					\
+			new_inuse = (unsigned int*) realloc(inuse, capacity * sizeof(unsigned int));	\
+			if (new_inuse)							\
+				inuse = new_inuse;					\
+			if (!new_chunks || !new_inuse)					\
+				goto index_out;						\
+		}									\
+		chunks[count++] = cursor + size_t_sz;					\
+											\
+		/* check if chunk size is within valid range */				\
+		chunksz = chunksize(achunk);						\
+		if (cursor > (address_t)(-chunksz)					\
+			|| cursor+chunksz+mchunk_sz > heap->mEndAddr+0x100)		\
+		{									\
+			heap->mCorrupted = 1;						\
+			break;								\
+		}									\
+											\
+		/* top chunk is treated differently */					\
+		if (cursor + chunksz + mchunk_sz >= heap->mEndAddr)			\
+			break;								\
+		/* detect double fence post */						\
+		else if (chunksz == 2*size_t_sz)					\
+		{									\
+			if (lbFencePost)	/* 2nd fence post */			\
+				break;							\
+			else								\
+				lbFencePost = CA_TRUE;	/* 1st fence post */		\
+		}									\
+		else									\
+			lbFencePost = CA_FALSE;						\
+											\
+		/* the next chunk's tag tells whether this one is in use */		\
+		move_heap_window(&window, cursor + chunksz);				\
+		next_chunk = (const CHUNK*) heap_chunk_at(mapped, cursor + chunksz,	\
+				achunk == &chunk_buf ? &next_buf : &chunk_buf);		\
+		if (!next_chunk)							\
+			goto index_out;							\
+		if (prev_inuse(next_chunk)						\
+			&& !in_fastbins_or_tcache(heap->mArena, cursor, chunksz))	\
+			inuse[num_inuse++] = count - 1;					\
+		cursor += chunksz;							\
+		achunk = next_chunk;							\
+	}										\
+	/* Seal the array with heap's end address */					\
+	chunks[count] = heap->mEndAddr;							\
+											\
+	heap->mChunks = chunks;								\
+	heap->mNumChunks = count;							\
+	heap->mInuse = inuse;								\
+	heap->mNumInuse = num_inuse;							\
+	chunks = NULL;									\
+	inuse = NULL;									\
+	rc = CA_TRUE;									\
+											\
+index_out:										\
+	close_heap_window(&window);							\
+	if (chunks)									\
+		free(chunks);								\
+	if (inuse)									\
+		free(inuse);								\
+	return rc;									\
+}
+
+DEFINE_INDEX_HEAP_CHUNKS(64, struct malloc_chunk, INTERNAL_SIZE_T)
+DEFINE_INDEX_HEAP_CHUNKS(32, struct malloc_chunk_32, INTERNAL_SIZE_T_32)
+
+static CA_BOOL index_heap_chunks(struct ca_heap* heap, CA_BOOL in_worker)
+{
+	if (g_ptr_bit == 64)
+		return index_heap_chunks_64(heap, in_worker);
+	else
+		return index_heap_chunks_32(heap, in_worker);
+}
+
+static CA_BOOL build_heap_chunks(struct ca_heap* heap)
+{
+	return index_heap_chunks(heap, CA_FALSE);
+}
+
+/*
+ * Heaps are independent, worker threads index them concurrently
+ */
+struct heap_index_job
+{
+	struct ca_heap** heaps;
+	size_t num_heaps;
+};
+
+static void index_heap_task(void* arg, size_t task, unsigned int worker)
+{
+	struct heap_index_job* job = (struct heap_index_job*) arg;
+
+	index_heap_chunks(job->heaps[task], CA_TRUE);
+}
+
+/*
+ * Index chunks of all regular heaps, which haven't been
+ */
+static CA_BOOL build_all_heap_chunks(void)
+{
+	struct heap_index_job job;
+	unsigned int i;
+	size_t num_chunks = 0;
+	double start_time;
+
+	job.heaps = (struct ca_heap**) malloc(sizeof(struct ca_heap*) * (g_heap_cnt + 1));
+	if (!job.heaps)
+		return CA_FALSE;
+	job.num_heaps = 0;
+	for (i = 0; i < g_heap_cnt; i++)
+	{
+		struct ca_heap* heap = g_sorted_heaps[i];
+		if (heap->mArena->mType != ENUM_HEAP_MMAP_BLOCK && !heap->mChunks)
+			job.heaps[job.num_heaps++] = heap;
+	}
+	if (job.num_heaps == 0)
+	{
+		free(job.heaps);
+		collect_tcache_chunks();
+		return CA_TRUE;
 	}
-	// Seal the array with heap's end address
-	heap->mChunks[count] = heap->mEndAddr;
 
+	// Worker threads only read the mmap-ed core and the collected fastbin chunks
+	start_time = ca_wall_time();
+	if (g_debug_core && job.num_heaps > 1)
+		ca_parallel_run(job.num_heaps, index_heap_task, &job, CA_FALSE);
+	// heaps that are not done by workers, e.g. of a live process, are indexed here
+	for (i = 0; i < job.num_heaps; i++)
+	{
+		struct ca_heap* heap = job.heaps[i];
+		if (!heap->mChunks && !index_heap_chunks(heap, CA_FALSE))
+			continue;
+		num_chunks += heap->mNumChunks;
+	}
+	if (job.num_heaps > 1)
+		CA_PRINT("Heap index: "PRINT_FORMAT_SIZE" chunks of %ld heaps are indexed by %d threads in %.2f seconds\n",
+				num_chunks, job.num_heaps, g_debug_core ? ca_num_workers() : 1, ca_wall_time() - start_time);
+	free(job.heaps);
+	// tcaches are in-use chunks themselves, look for them after all heaps are indexed
+	collect_tcache_chunks();
 	return CA_TRUE;
 }
 
@@ -1656,7 +2312,10 @@ static CA_BOOL fill_heap_block(struct ca_heap* heap, address_t addr, struct heap
 	}
 
 	// For regular heaps, build an array of sorted chunk address, then do a binary search
-	if (!heap->mChunks)
+	// tcaches may be in any heap, all heaps are indexed to find them
+	if (!heap->mChunks && mparams.tcache_bins)
+		build_all_heap_chunks();
+	else if (!heap->mChunks)
 		build_heap_chunks(heap);
 	chunk_addr = search_chunk(heap, addr) - size_t_sz;
 	if (!read_memory_wrapper(NULL, chunk_addr, &achunk, mchunk_sz))
@@ -1677,7 +2336,7 @@ static CA_BOOL fill_heap_block(struct ca_heap* heap, address_t addr, struct heap
 			return CA_FALSE;
 
 		if (ca_prev_inuse(ptr_bit, &next_chunk)
-			&& (chunksz > g_MAX_FAST_SIZE || !in_fastbins_or_remainder(&heap->mArena->mpState, (mchunkptr)chunk_addr, chunksz)) )
+			&& !in_fastbins_or_tcache(heap->mArena, chunk_addr, chunksz) )
 		{
 			blk->inuse = CA_TRUE;
 		}
@@ -1748,7 +2407,7 @@ static CA_BOOL check_bin_and_fastbin(struct ca_arena* arena)
 			//			fbi, chunk_vaddr, ptr_bit==64 ? fast_chunk.chunk.size : fast_chunk.chunk_32.size, ca_chunk_fd(ptr_bit, &fast_chunk));
 			//}
 			chunk_prev_vaddr = chunk_vaddr;
-			chunk_vaddr = ca_chunk_fd(ptr_bit, &fast_chunk);
+			chunk_vaddr = reveal_fd(chunk_vaddr, ca_chunk_fd(ptr_bit, &fast_chunk));
 		}
 	}
 
@@ -1859,14 +2518,15 @@ static CA_BOOL check_bin_and_fastbin(struct ca_arena* arena)
 }
 
 /*
- * Display all blocks in a heap
+ * Walk all blocks in a heap, count them and display them if desired
+ *   A worker thread can't print, it records the chunk which stops the walk
+ *   and leaves heaps that are not in one mmap-ed segment to the main thread
  */
-static CA_BOOL traverse_heap_blocks(struct ca_heap* heap,
+static CA_BOOL walk_heap_blocks(struct ca_heap* heap,
 							CA_BOOL bDisplayBlocks,	// print detail info or not
-							size_t* opInuseBytes,	// output page in-use bytes
-							size_t* opFreeBytes,	// output page free bytes
-							unsigned long* opNumInuse,	// output number of inuse blocks
-							unsigned long* opNumFree)	// output number of free blocks
+							CA_BOOL in_worker,
+							struct heap_walk_stat* stat,
+							struct MemHistogram* hist)	// NULL for the global histogram
 {
 	int ptr_bit = g_ptr_bit;
 	size_t size_t_sz = ptr_bit == 64 ? sizeof(INTERNAL_SIZE_T) : sizeof(INTERNAL_SIZE_T_32);
@@ -1874,23 +2534,32 @@ static CA_BOOL traverse_heap_blocks(struct ca_heap* heap,
 
 	address_t cursor;
 	union ca_malloc_chunk achunk;
-	size_t totoal_free_bytes, num_free;
-	size_t totoal_inuse_bytes, num_inuse;
 	address_t heap_begin = heap->mStartAddr - size_t_sz;
 	address_t heap_end   = heap->mEndAddr;
 	struct ca_arena* arena = heap->mArena;
+	struct heap_window window;
+	CA_BOOL rc = CA_FALSE;
+
+	memset(stat, 0, sizeof(struct heap_walk_stat));
+	if (in_worker && !mapped_heap_base(heap, size_t_sz))
+	{
+		stat->status = HEAP_WALK_SKIPPED;
+		return CA_FALSE;
+	}
+	window.segment = in_worker ? heap->mSegment : NULL;
+	window.first = window.last = 0;
 
 	// Arena walk starting with the first chunk
 	cursor = heap_begin;
-	if (!read_memory_wrapper(NULL, cursor, &achunk, mchunk_sz))
+	move_heap_window(&window, cursor);
+	if (!read_heap_memory(heap, cursor, &achunk, mchunk_sz, in_worker))
 	{
-		CA_PRINT("Failed to get the first chunk at "PRINT_FORMAT_POINTER"\n", cursor);
-		return CA_FALSE;
+		stat->status = HEAP_WALK_BAD_FIRST;
+		stat->bad_chunk = cursor;
+		goto walk_out;
 	}
 
 	// The loop to walk all blocks
-	totoal_free_bytes  = num_free  = 0;
-	totoal_inuse_bytes = num_inuse = 0;
 	while (cursor < heap_end)
 	{
 		int lbFreeBlock, lbLastBlock;
@@ -1899,9 +2568,10 @@ static CA_BOOL traverse_heap_blocks(struct ca_heap* heap,
 		if (cursor > (address_t)(-chunksz) || cursor < heap_begin || cursor > heap_end
 			|| cursor+chunksz+mchunk_sz > heap_end+0x100)
 		{
-			CA_PRINT("Failed to walk arena. The chunk at "PRINT_FORMAT_POINTER" may be corrupted. Its size tag is "PRINT_FORMAT_POINTER"\n",
-					cursor, ptr_bit==64 ? achunk.chunk.size : achunk.chunk_32.size);
-			return CA_FALSE;
+			stat->status = HEAP_WALK_CORRUPTED;
+			stat->bad_chunk = cursor;
+			stat->bad_tag = ptr_bit==64 ? achunk.chunk.size : achunk.chunk_32.size;
+			goto walk_out;
 		}
 
 		// top chunk is treated differently
@@ -1912,46 +2582,48 @@ static CA_BOOL traverse_heap_blocks(struct ca_heap* heap,
 			lbLastBlock = CA_TRUE;
 			lbFreeBlock = CA_FALSE;
 			chunksz -= size_t_sz;
-			num_inuse = 1;
-			totoal_inuse_bytes = chunksz - size_t_sz;
-			add_block_mem_histogram(totoal_inuse_bytes, CA_TRUE, 1);
+			stat->num_inuse = 1;
+			stat->inuse_bytes = chunksz - size_t_sz;
+			count_heap_block(hist, stat->inuse_bytes, CA_TRUE);
 		}
 		else if (cursor + chunksz + mchunk_sz >= heap_end)
 		{
 			// this is the top chunk of the arena. the LAST chunk, no next.
 			lbLastBlock = CA_TRUE;
 			chunksz = heap_end - cursor - size_t_sz;
-			num_free++;
-			totoal_free_bytes += chunksz - size_t_sz;
+			stat->num_free++;
+			stat->free_bytes += chunksz - size_t_sz;
 			//if (bVerbose)
 			//	CA_PRINT("\t\t["PRINT_FORMAT_POINTER" - "PRINT_FORMAT_POINTER"] fence post\n", cursor+size_t_sz*2, heap_end);
 			lbFreeBlock = CA_TRUE;
-			add_block_mem_histogram(chunksz - size_t_sz, CA_FALSE, 1);
+			count_heap_block(hist, chunksz - size_t_sz, CA_FALSE);
 		}
 		else
 		{
 			// Get the next chunk
 			union ca_malloc_chunk next_chunk;
-			if (!read_memory_wrapper(NULL, cursor+chunksz, &next_chunk, mchunk_sz))
+			move_heap_window(&window, cursor + chunksz);
+			if (!read_heap_memory(heap, cursor+chunksz, &next_chunk, mchunk_sz, in_worker))
 			{
-				CA_PRINT("Failed to get chunk at "PRINT_FORMAT_POINTER"\n", cursor+chunksz);
-				return CA_FALSE;
+				stat->status = HEAP_WALK_BAD_NEXT;
+				stat->bad_chunk = cursor + chunksz;
+				goto walk_out;
 			}
 
 			if (ca_prev_inuse(ptr_bit, &next_chunk)
-				&& (chunksz > g_MAX_FAST_SIZE || !in_fastbins_or_remainder(&arena->mpState, (mchunkptr)cursor, chunksz)) )
+				&& !in_fastbins_or_tcache(arena, cursor, chunksz) )
 			{
 				lbFreeBlock = CA_FALSE;
-				num_inuse++;
-				totoal_inuse_bytes += chunksz - size_t_sz;
-				add_block_mem_histogram(chunksz - size_t_sz, CA_TRUE, 1);
+				stat->num_inuse++;
+				stat->inuse_bytes += chunksz - size_t_sz;
+				count_heap_block(hist, chunksz - size_t_sz, CA_TRUE);
 			}
 			else
 			{
 				lbFreeBlock = CA_TRUE;
-				num_free++;
-				totoal_free_bytes += chunksz - size_t_sz;
-				add_block_mem_histogram(chunksz - size_t_sz, CA_FALSE, 1);
+				stat->num_free++;
+				stat->free_bytes += chunksz - size_t_sz;
+				count_heap_block(hist, chunksz - size_t_sz, CA_FALSE);
 			}
 			// Special case of double fencepost for non-contiguous main_arena heaps
 			if (chunksz == 2*size_t_sz && ca_chunksize(ptr_bit, &next_chunk) == 2*size_t_sz)
@@ -1976,29 +2648,100 @@ static CA_BOOL traverse_heap_blocks(struct ca_heap* heap,
 		else
 			cursor += chunksz;
 	} // arena walk loop
+	stat->status = HEAP_WALK_OK;
+	rc = CA_TRUE;
+
+walk_out:
+	close_heap_window(&window);
+	return rc;
+}
+
+static void count_heap_block(struct MemHistogram* hist, size_t size, CA_BOOL inuse)
+{
+	if (hist)
+		add_block_local_mem_histogram(hist, size, inuse, 1);
+	else
+		add_block_mem_histogram(size, inuse, 1);
+}
+
+/*
+ * Report the result of a heap walk, which may be done by a worker thread,
+ * and check the arena's free lists
+ */
+static CA_BOOL finish_heap_walk(struct ca_heap* heap,
+							const struct heap_walk_stat* stat,
+							CA_BOOL bDisplayBlocks,
+							size_t* opInuseBytes,	// output page in-use bytes
+							size_t* opFreeBytes,	// output page free bytes
+							unsigned long* opNumInuse,	// output number of inuse blocks
+							unsigned long* opNumFree)	// output number of free blocks
+{
+	switch (stat->status)
+	{
+	case HEAP_WALK_OK:
+		break;
+	case HEAP_WALK_BAD_FIRST:
+		CA_PRINT("Failed to get the first chunk at "PRINT_FORMAT_POINTER"\n", stat->bad_chunk);
+		return CA_FALSE;
+	case HEAP_WALK_CORRUPTED:
+		CA_PRINT("Failed to walk arena. The chunk at "PRINT_FORMAT_POINTER" may be corrupted. Its size tag is "PRINT_FORMAT_POINTER"\n",
+				stat->bad_chunk, stat->bad_tag);
+		return CA_FALSE;
+	case HEAP_WALK_BAD_NEXT:
+		CA_PRINT("Failed to get chunk at "PRINT_FORMAT_POINTER"\n", stat->bad_chunk);
+		return CA_FALSE;
+	default:
+		return CA_FALSE;
+	}
 
 	// check free block link list in fastbins and bins
-	if (!check_bin_and_fastbin(arena))
+	if (!check_bin_and_fastbin(heap->mArena))
 		return CA_FALSE;
 
 	if (bDisplayBlocks)
 	{
 		CA_PRINT("\n");
-		CA_PRINT("\tTotal inuse "PRINT_FORMAT_SIZE" blocks "PRINT_FORMAT_SIZE" bytes\n", num_inuse, totoal_inuse_bytes);
-		CA_PRINT("\tTotal free "PRINT_FORMAT_SIZE" blocks "PRINT_FORMAT_SIZE" bytes\n", num_free, totoal_free_bytes);
+		CA_PRINT("\tTotal inuse "PRINT_FORMAT_SIZE" blocks "PRINT_FORMAT_SIZE" bytes\n", stat->num_inuse, stat->inuse_bytes);
+		CA_PRINT("\tTotal free "PRINT_FORMAT_SIZE" blocks "PRINT_FORMAT_SIZE" bytes\n", stat->num_free, stat->free_bytes);
 	}
 
 	if (opInuseBytes && opFreeBytes && opNumInuse && opNumFree)
 	{
-		*opInuseBytes = totoal_inuse_bytes;
-		*opFreeBytes  = totoal_free_bytes;
-		*opNumInuse = num_inuse;
-		*opNumFree = num_free;
+		*opInuseBytes = stat->inuse_bytes;
+		*opFreeBytes  = stat->free_bytes;
+		*opNumInuse = stat->num_inuse;
+		*opNumFree = stat->num_free;
 	}
 
 	return CA_TRUE;
 }
 
+/*
+ * Display all blocks in a heap
+ */
+static CA_BOOL traverse_heap_blocks(struct ca_heap* heap,
+							CA_BOOL bDisplayBlocks,	// print detail info or not
+							size_t* opInuseBytes,	// output page in-use bytes
+							size_t* opFreeBytes,	// output page free bytes
+							unsigned long* opNumInuse,	// output number of inuse blocks
+							unsigned long* opNumFree)	// output number of free blocks
+{
+	struct heap_walk_stat stat;
+
+	walk_heap_blocks(heap, bDisplayBlocks, CA_FALSE, &stat, NULL);
+	return finish_heap_walk(heap, &stat, bDisplayBlocks, opInuseBytes, opFreeBytes, opNumInuse, opNumFree);
+}
+
+/*
+ * Heaps are walked by worker threads, each counts blocks in its own histogram
+ */
+static void walk_heap_task(void* arg, size_t task, unsigned int worker)
+{
+	struct heap_walk_job* job = (struct heap_walk_job*) arg;
+
+	walk_heap_blocks(job->heaps[task], CA_FALSE, CA_TRUE, &job->stats[task], &job->hists[worker]);
+}
+
 /*
  * Get the glibc version of the host machine.
  * Assume it is the same or compatible with the target machine.
@@ -2050,8 +2793,10 @@ static size_t get_mstate_size(void)
 		mstate_size = g_ptr_bit == 64 ? sizeof(struct malloc_state_GLIBC_2_5) : sizeof(struct malloc_state_GLIBC_2_5_32);
 	else if (glibc_ver_minor == 12 || (glibc_ver_minor >= 17 && glibc_ver_minor <= 21))
 		mstate_size = g_ptr_bit == 64 ? sizeof(struct malloc_state_GLIBC_2_12) : sizeof(struct malloc_state_GLIBC_2_12_32);
-	else if (glibc_ver_minor >= 22 && glibc_ver_minor <= 23)
+	else if (glibc_ver_minor >= 22 && glibc_ver_minor <= 26)
 		mstate_size = g_ptr_bit == 64 ? sizeof(struct malloc_state_GLIBC_2_22) : sizeof(struct malloc_state_GLIBC_2_22_32);
+	else if (glibc_ver_minor >= 27 && glibc_ver_minor <= 36)
+		mstate_size = g_ptr_bit == 64 ? sizeof(struct malloc_state_GLIBC_2_27) : sizeof(struct malloc_state_GLIBC_2_27_32);
 	else
 		assert(0 && "internal error: glibc version not supported");
 
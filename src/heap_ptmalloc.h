@@ -20,6 +20,7 @@
  * 	2.4		?
  * 	2.5		?
  * 	2.12 - 2.23	ptmalloc2-20011215	2.7.0
+ * 	2.26 - 2.36	per-thread cache (tcache) in front of arenas
  */
 
 #ifndef size_t
@@ -417,6 +418,196 @@ struct malloc_state_GLIBC_2_22 {
 #define HEAP_MAX_SIZE_GLIBC_2_22    HEAP_MAX_SIZE_GLIBC_2_5
 #define MAX_FAST_SIZE_GLIBC_2_22    MAX_FAST_SIZE_GLIBC_2_12
 
+/************************************************************************
+**  GNU C Library version 2.24 - 2.25
+**    struct malloc_par removes member "max_total_mem"
+************************************************************************/
+#define malloc_state_GLIBC_2_24 malloc_state_GLIBC_2_22
+
+struct malloc_par_GLIBC_2_24 {
+  /* Tunable parameters */
+  unsigned long    trim_threshold;
+  INTERNAL_SIZE_T  top_pad;
+  INTERNAL_SIZE_T  mmap_threshold;
+  INTERNAL_SIZE_T  arena_test;
+  INTERNAL_SIZE_T  arena_max;
+
+  /* Memory map support */
+  int              n_mmaps;
+  int              n_mmaps_max;
+  int              max_n_mmaps;
+  int              no_dyn_threshold;
+
+  /* Statistics */
+  INTERNAL_SIZE_T  mmapped_mem;
+  INTERNAL_SIZE_T  max_mmapped_mem;
+
+  /* First address handed out by MORECORE/sbrk.  */
+  char*            sbrk_base;
+};
+
+#define HEAP_MAX_SIZE_GLIBC_2_24    HEAP_MAX_SIZE_GLIBC_2_5
+#define MAX_FAST_SIZE_GLIBC_2_24    MAX_FAST_SIZE_GLIBC_2_12
+
+/************************************************************************
+**  GNU C Library version 2.26
+**    per-thread cache (tcache), struct malloc_par adds its tunables
+************************************************************************/
+#define malloc_state_GLIBC_2_26 malloc_state_GLIBC_2_22
+
+struct malloc_par_GLIBC_2_26 {
+  /* Tunable parameters */
+  unsigned long    trim_threshold;
+  INTERNAL_SIZE_T  top_pad;
+  INTERNAL_SIZE_T  mmap_threshold;
+  INTERNAL_SIZE_T  arena_test;
+  INTERNAL_SIZE_T  arena_max;
+
+  /* Memory map support */
+  int              n_mmaps;
+  int              n_mmaps_max;
+  int              max_n_mmaps;
+  int              no_dyn_threshold;
+
+  /* Statistics */
+  INTERNAL_SIZE_T  mmapped_mem;
+  INTERNAL_SIZE_T  max_mmapped_mem;
+
+  /* First address handed out by MORECORE/sbrk.  */
+  char*            sbrk_base;
+
+  /* Maximum number of buckets to use.  */
+  size_t           tcache_bins;
+  size_t           tcache_max_bytes;
+  /* Maximum number of chunks in each bucket.  */
+  size_t           tcache_count;
+  size_t           tcache_unsorted_limit;
+};
+
+#define HEAP_MAX_SIZE_GLIBC_2_26    HEAP_MAX_SIZE_GLIBC_2_5
+#define MAX_FAST_SIZE_GLIBC_2_26    MAX_FAST_SIZE_GLIBC_2_12
+
+#define TCACHE_MAX_BINS 64
+/* MALLOC_ALIGNMENT is 16 on x86_64, and on i386 since 2.26 as well;
+ * tcache bin i holds chunks of size MINSIZE + i * TCACHE_ALIGNMENT */
+#define TCACHE_ALIGNMENT 16
+
+/* tcache_entry overlays the user data of a free chunk, not its header */
+struct tcache_entry {
+  struct tcache_entry* next;
+  /* 2.29 and later: struct tcache_perthread_struct* key; */
+};
+
+/* allocated by malloc as the first chunk a thread gets from its arena */
+struct tcache_perthread_struct_GLIBC_2_26 {
+  char                 counts[TCACHE_MAX_BINS];
+  struct tcache_entry* entries[TCACHE_MAX_BINS];
+};
+
+/************************************************************************
+**  GNU C Library version 2.27 - 2.34
+**    struct malloc_state adds a member "have_fastchunks"
+************************************************************************/
+struct malloc_state_GLIBC_2_27 {
+  int mutex; //mutex_t mutex;
+
+  /* Flags (formerly in max_fast).  */
+  int flags;
+
+  /* Set if the fastbin chunks contain recently inserted free blocks.  */
+  int have_fastchunks;
+
+  /* Fastbins */
+  mfastbinptr      fastbins[NFASTBINS_GLIBC_2_12];
+
+  /* Base of the topmost chunk -- not otherwise kept in a bin */
+  mchunkptr        top;
+
+  /* The remainder from the most recent split of a small request */
+  mchunkptr        last_remainder;
+
+  /* Normal bins packed as described above */
+  mchunkptr        bins[NBINS * 2 - 2];
+
+  /* Bitmap of bins */
+  unsigned int     binmap[BINMAPSIZE];
+
+  /* Linked list */
+  struct malloc_state_GLIBC_2_27 *next;
+
+  /* Linked list for free arenas.  */
+  struct malloc_state_GLIBC_2_27 *next_free;
+
+  /* Number of threads attached to this arena.  0 if the arena is on the free list. */
+  INTERNAL_SIZE_T attached_threads;
+
+  /* Memory allocated from the system in this arena.  */
+  INTERNAL_SIZE_T system_mem;
+  INTERNAL_SIZE_T max_system_mem;
+};
+
+#define malloc_par_GLIBC_2_27 malloc_par_GLIBC_2_26
+
+#define HEAP_MAX_SIZE_GLIBC_2_27    HEAP_MAX_SIZE_GLIBC_2_5
+#define MAX_FAST_SIZE_GLIBC_2_27    MAX_FAST_SIZE_GLIBC_2_12
+
+/************************************************************************
+**  GNU C Library version 2.30 and later
+**    tcache counts are 16-bit
+************************************************************************/
+struct tcache_perthread_struct_GLIBC_2_30 {
+  unsigned short       counts[TCACHE_MAX_BINS];
+  struct tcache_entry* entries[TCACHE_MAX_BINS];
+};
+
+/************************************************************************
+**  GNU C Library version 2.32 and later
+**    Safe-Linking, "next" pointers of tcache entries and fastbin chunks
+**    are mangled with the address where they are stored
+************************************************************************/
+#define REVEAL_PTR_GLIBC_2_32(pos, ptr) ((((address_t)(pos)) >> 12) ^ ((address_t)(ptr)))
+
+/************************************************************************
+**  GNU C Library version 2.35 - 2.36
+**    struct malloc_par adds huge page tunables
+************************************************************************/
+#define malloc_state_GLIBC_2_35 malloc_state_GLIBC_2_27
+
+struct malloc_par_GLIBC_2_35 {
+  /* Tunable parameters */
+  unsigned long    trim_threshold;
+  INTERNAL_SIZE_T  top_pad;
+  INTERNAL_SIZE_T  mmap_threshold;
+  INTERNAL_SIZE_T  arena_test;
+  INTERNAL_SIZE_T  arena_max;
+
+  /* Transparent Large Page support.  */
+  INTERNAL_SIZE_T  thp_pagesize;
+  INTERNAL_SIZE_T  hp_pagesize;
+  int              hp_flags;
+
+  /* Memory map support */
+  int              n_mmaps;
+  int              n_mmaps_max;
+  int              max_n_mmaps;
+  int              no_dyn_threshold;
+
+  /* Statistics */
+  INTERNAL_SIZE_T  mmapped_mem;
+  INTERNAL_SIZE_T  max_mmapped_mem;
+
+  /* First address handed out by MORECORE/sbrk.  */
+  char*            sbrk_base;
+
+  size_t           tcache_bins;
+  size_t           tcache_max_bytes;
+  size_t           tcache_count;
+  size_t           tcache_unsorted_limit;
+};
+
+#define HEAP_MAX_SIZE_GLIBC_2_35    HEAP_MAX_SIZE_GLIBC_2_5
+#define MAX_FAST_SIZE_GLIBC_2_35    MAX_FAST_SIZE_GLIBC_2_12
+
 /************************************************************************
 **  32-bit Target
 **  Assume the debug host is 64-bit
@@ -776,4 +967,154 @@ struct malloc_state_GLIBC_2_22_32 {
 #define HEAP_MAX_SIZE_GLIBC_2_22_32    HEAP_MAX_SIZE_GLIBC_2_5_32
 #define MAX_FAST_SIZE_GLIBC_2_22_32    MAX_FAST_SIZE_GLIBC_2_12_32
 
+#define malloc_state_GLIBC_2_24_32 malloc_state_GLIBC_2_22_32
+
+struct malloc_par_GLIBC_2_24_32 {
+  // Tunable parameters
+  unsigned int    trim_threshold;
+  INTERNAL_SIZE_T_32  top_pad;
+  INTERNAL_SIZE_T_32  mmap_threshold;
+  INTERNAL_SIZE_T_32  arena_test;
+  INTERNAL_SIZE_T_32  arena_max;
+
+  // Memory map support
+  int              n_mmaps;
+  int              n_mmaps_max;
+  int              max_n_mmaps;
+  int              no_dyn_threshold;
+
+  // Statistics
+  INTERNAL_SIZE_T_32  mmapped_mem;
+  INTERNAL_SIZE_T_32  max_mmapped_mem;
+
+  // First address handed out by MORECORE/sbrk.
+  ptr_t_32            sbrk_base;	//char*
+};
+
+#define HEAP_MAX_SIZE_GLIBC_2_24_32    HEAP_MAX_SIZE_GLIBC_2_5_32
+#define MAX_FAST_SIZE_GLIBC_2_24_32    MAX_FAST_SIZE_GLIBC_2_12_32
+
+#define malloc_state_GLIBC_2_26_32 malloc_state_GLIBC_2_22_32
+
+struct malloc_par_GLIBC_2_26_32 {
+  // Tunable parameters
+  unsigned int    trim_threshold;
+  INTERNAL_SIZE_T_32  top_pad;
+  INTERNAL_SIZE_T_32  mmap_threshold;
+  INTERNAL_SIZE_T_32  arena_test;
+  INTERNAL_SIZE_T_32  arena_max;
+
+  // Memory map support
+  int              n_mmaps;
+  int              n_mmaps_max;
+  int              max_n_mmaps;
+  int              no_dyn_threshold;
+
+  // Statistics
+  INTERNAL_SIZE_T_32  mmapped_mem;
+  INTERNAL_SIZE_T_32  max_mmapped_mem;
+
+  // First address handed out by MORECORE/sbrk.
+  ptr_t_32            sbrk_base;	//char*
+
+  // tcache tunables
+  unsigned int        tcache_bins;
+  unsigned int        tcache_max_bytes;
+  unsigned int        tcache_count;
+  unsigned int        tcache_unsorted_limit;
+};
+
+#define HEAP_MAX_SIZE_GLIBC_2_26_32    HEAP_MAX_SIZE_GLIBC_2_5_32
+#define MAX_FAST_SIZE_GLIBC_2_26_32    MAX_FAST_SIZE_GLIBC_2_12_32
+
+struct tcache_perthread_struct_GLIBC_2_26_32 {
+  char                 counts[TCACHE_MAX_BINS];
+  ptr_t_32             entries[TCACHE_MAX_BINS];	// struct tcache_entry*
+};
+
+struct malloc_state_GLIBC_2_27_32 {
+  int mutex; //mutex_t mutex;
+
+  // Flags (formerly in max_fast).
+  int flags;
+
+  // Set if the fastbin chunks contain recently inserted free blocks.
+  int have_fastchunks;
+
+  // Fastbins
+  ptr_t_32      fastbins[NFASTBINS_GLIBC_2_12_32];	//mfastbinptr_32
+
+  // Base of the topmost chunk -- not otherwise kept in a bin
+  ptr_t_32        top;	//mchunkptr_32
+
+  // The remainder from the most recent split of a small request
+  ptr_t_32        last_remainder;	//mchunkptr_32
+
+  // Normal bins packed as described above
+  ptr_t_32        bins[NBINS * 2 - 2];	//mchunkptr_32
+
+  // Bitmap of bins/
+  unsigned int     binmap[BINMAPSIZE];
+
+  // Linked list
+  ptr_t_32 next;	//struct malloc_state_GLIBC_2_27_32 *
+
+  // Linked list for free arenas.
+  ptr_t_32 next_free;	//struct malloc_state_GLIBC_2_27_32 *
+
+  // Number of threads attached to this arena.  0 if the arena is on the free list.
+  INTERNAL_SIZE_T_32 attached_threads;
+
+  // Memory allocated from the system in this arena.
+  INTERNAL_SIZE_T_32 system_mem;
+  INTERNAL_SIZE_T_32 max_system_mem;
+};
+#define malloc_par_GLIBC_2_27_32 malloc_par_GLIBC_2_26_32
+
+#define HEAP_MAX_SIZE_GLIBC_2_27_32    HEAP_MAX_SIZE_GLIBC_2_5_32
+#define MAX_FAST_SIZE_GLIBC_2_27_32    MAX_FAST_SIZE_GLIBC_2_12_32
+
+struct tcache_perthread_struct_GLIBC_2_30_32 {
+  unsigned short       counts[TCACHE_MAX_BINS];
+  ptr_t_32             entries[TCACHE_MAX_BINS];	// struct tcache_entry*
+};
+
+#define malloc_state_GLIBC_2_35_32 malloc_state_GLIBC_2_27_32
+
+struct malloc_par_GLIBC_2_35_32 {
+  // Tunable parameters
+  unsigned int    trim_threshold;
+  INTERNAL_SIZE_T_32  top_pad;
+  INTERNAL_SIZE_T_32  mmap_threshold;
+  INTERNAL_SIZE_T_32  arena_test;
+  INTERNAL_SIZE_T_32  arena_max;
+
+  // Transparent Large Page support.
+  INTERNAL_SIZE_T_32  thp_pagesize;
+  INTERNAL_SIZE_T_32  hp_pagesize;
+  int                 hp_flags;
+
+  // Memory map support
+  int              n_mmaps;
+  int              n_mmaps_max;
+  int              max_n_mmaps;
+  int              no_dyn_threshold;
+
+  // Statistics
+  INTERNAL_SIZE_T_32  mmapped_mem;
+  INTERNAL_SIZE_T_32  max_mmapped_mem;
+
+  // First address handed out by MORECORE/sbrk.
+  ptr_t_32            sbrk_base;	//char*
+
+  // tcache tunables
+  unsigned int        tcache_bins;
+  unsigned int        tcache_max_bytes;
+  unsigned int        tcache_count;
+  unsigned int        tcache_unsorted_limit;
+};
+
+#define HEAP_MAX_SIZE_GLIBC_2_35_32    HEAP_MAX_SIZE_GLIBC_2_5_32
+#define MAX_FAST_SIZE_GLIBC_2_35_32    MAX_FAST_SIZE_GLIBC_2_12_32
+
 #endif /* _MM_PTMALLOC_H */
@@ -0,0 +1,420 @@
+/*
+ * index_cache.c
+ *		Sidecar file of indexes derived from a core file, so that
+ *		a later session may map them back instead of rebuilding
+ *
+ *  Created on: Oct 16, 2026
+ */
+#ifndef WIN32
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "index_cache.h"
+#include "segment.h"
+#include "heap.h"
+#include "ptr_index.h"
+#include "parallel.h"
+
+/***************************************************************************
+* Layout of the cache file
+* 	header with the identity of the core and a table of sections,
+* 	followed by the sections, each one starts at a CACHE_ALIGN boundary
+* 	so that it can be mapped on its own
+***************************************************************************/
+#define CACHE_MAGIC "CAIDX\0\0"
+#define CACHE_ALIGN (64*1024)
+#define CACHE_HASH_SZ (64*1024)
+#define MAX_CACHE_SECTIONS 8
+
+enum cache_section_kind
+{
+	CACHE_BIT_VEC = 1,		// the monolithic buffer of segments' bit vectors
+	CACHE_BIT_VEC_READY,	// one byte per segment, m_bitvec_ready
+	CACHE_PTR_INDEX,		// struct ptr_ref sorted by value
+	CACHE_INUSE_BLOCKS		// address and size of in-use heap blocks
+};
+
+struct cache_section
+{
+	unsigned int       kind;
+	unsigned int       unit;		// size of an element
+	unsigned long long count;		// number of elements
+	unsigned long long offset;
+	unsigned long long length;
+};
+
+struct cache_header
+{
+	char               magic[8];
+	unsigned int       version;
+	unsigned int       ptr_bit;
+	// identity of the core file
+	unsigned long long core_size;
+	long long          core_mtime;
+	unsigned long long core_hash;	// of the first CACHE_HASH_SZ bytes
+	unsigned int       segment_count;
+	unsigned int       num_sections;
+	struct cache_section sections[MAX_CACHE_SECTIONS];
+};
+
+// Whether the loaded cache has everything built in this session
+static CA_BOOL g_cache_loaded = CA_FALSE;
+static CA_BOOL g_cache_has_ptr_index = CA_FALSE;
+
+#ifndef WIN32
+static char* cache_file_name(const char* core_path)
+{
+	char* fname = (char*) malloc(strlen(core_path) + sizeof(INDEX_CACHE_SUFFIX));
+	if (fname)
+	{
+		strcpy(fname, core_path);
+		strcat(fname, INDEX_CACHE_SUFFIX);
+	}
+	return fname;
+}
+
+// FNV-1a hash of the core's headers, which differ among dumps of the same size
+static CA_BOOL core_identity(const char* core_path, struct cache_header* hdr)
+{
+	struct stat lStatBuf;
+	unsigned char* buf;
+	unsigned long long hash = 14695981039346656037ULL;
+	ssize_t len, i;
+	int fd;
+
+	if (stat(core_path, &lStatBuf) != 0)
+		return CA_FALSE;
+	buf = (unsigned char*) malloc(CACHE_HASH_SZ);
+	fd = open(core_path, O_RDONLY);
+	if (!buf || fd < 0)
+	{
+		if (buf)
+			free(buf);
+		if (fd >= 0)
+			close(fd);
+		return CA_FALSE;
+	}
+	len = read(fd, buf, CACHE_HASH_SZ);
+	close(fd);
+	for (i = 0; i < len; i++)
+	{
+		hash ^= buf[i];
+		hash *= 1099511628211ULL;
+	}
+	free(buf);
+
+	memset(hdr, 0, sizeof(struct cache_header));
+	memcpy(hdr->magic, CACHE_MAGIC, sizeof(hdr->magic));
+	hdr->version = INDEX_CACHE_VERSION;
+	hdr->ptr_bit = g_ptr_bit;
+	hdr->core_size = lStatBuf.st_size;
+	hdr->core_mtime = lStatBuf.st_mtime;
+	hdr->core_hash = hash;
+	hdr->segment_count = g_segment_count;
+	return CA_TRUE;
+}
+
+// Return the opened cache file if it is made for the core, -1 otherwise
+static int open_index_cache(const char* fname, const char* core_path, struct cache_header* hdr)
+{
+	struct cache_header expected;
+	int fd;
+
+	if (!core_identity(core_path, &expected))
+		return -1;
+	fd = open(fname, O_RDONLY);
+	if (fd < 0)
+		return -1;
+	if (read(fd, hdr, sizeof(struct cache_header)) != sizeof(struct cache_header)
+		|| memcmp(hdr->magic, expected.magic, sizeof(hdr->magic)) != 0
+		|| hdr->version != expected.version
+		|| hdr->ptr_bit != expected.ptr_bit
+		|| hdr->core_size != expected.core_size
+		|| hdr->core_mtime != expected.core_mtime
+		|| hdr->core_hash != expected.core_hash
+		|| hdr->segment_count != expected.segment_count
+		|| hdr->num_sections > MAX_CACHE_SECTIONS)
+	{
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+// Private mapping, changes of the caller, e.g. lazily set bits, stay in memory
+static void* map_section(int fd, const struct cache_section* section)
+{
+	void* addr;
+	if (section->length == 0)
+		return NULL;
+	addr = mmap(NULL, section->length, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, section->offset);
+	if (addr == MAP_FAILED)
+		return NULL;
+	return addr;
+}
+
+static CA_BOOL write_section(FILE* fp, struct cache_header* hdr, unsigned int kind,
+				const void* data, unsigned int unit, size_t count)
+{
+	struct cache_section* section = &hdr->sections[hdr->num_sections++];
+	long pos = ftell(fp);
+
+	section->kind = kind;
+	section->unit = unit;
+	section->count = count;
+	section->offset = ALIGN(pos, CACHE_ALIGN);
+	section->length = (unsigned long long) unit * count;
+	if (fseek(fp, (long) section->offset, SEEK_SET) != 0)
+		return CA_FALSE;
+	if (section->length && fwrite(data, 1, section->length, fp) != section->length)
+		return CA_FALSE;
+	return CA_TRUE;
+}
+#endif
+
+/***************************************************************************
+* Exposed functions
+***************************************************************************/
+CA_BOOL load_index_cache(const char* core_path)
+{
+#ifdef WIN32
+	return CA_FALSE;
+#else
+	struct cache_header hdr;
+	char* fname;
+	unsigned int i;
+	char* bitvec = NULL;
+	unsigned char* ready = NULL;
+	size_t bitvec_len = 0, ready_len = 0;
+	size_t num_refs = 0;
+	unsigned long num_blocks = 0;
+	double start_time = ca_wall_time();
+	int fd;
+
+	g_cache_loaded = CA_FALSE;
+	g_cache_has_ptr_index = CA_FALSE;
+	if (!g_debug_core || !core_path || g_segment_count == 0)
+		return CA_FALSE;
+	fname = cache_file_name(core_path);
+	if (!fname)
+		return CA_FALSE;
+	fd = open_index_cache(fname, core_path, &hdr);
+	if (fd < 0)
+	{
+		free(fname);
+		return CA_FALSE;
+	}
+
+	for (i = 0; i < hdr.num_sections; i++)
+	{
+		const struct cache_section* section = &hdr.sections[i];
+		void* data = map_section(fd, section);
+		if (!data)
+			continue;
+		if (section->kind == CACHE_BIT_VEC)
+		{
+			bitvec = (char*) data;
+			bitvec_len = section->length;
+		}
+		else if (section->kind == CACHE_BIT_VEC_READY && section->count == g_segment_count)
+		{
+			ready = (unsigned char*) data;
+			ready_len = section->length;
+		}
+		else if (section->kind == CACHE_PTR_INDEX && section->unit == sizeof(struct ptr_ref))
+		{
+			// mapping is owned by the index from now on
+			num_refs = section->count;
+			adopt_ptr_index((struct ptr_ref*) data, num_refs, section->length);
+			g_cache_has_ptr_index = CA_TRUE;
+		}
+		else if (section->kind == CACHE_INUSE_BLOCKS && section->unit == 2 * sizeof(address_t))
+		{
+			struct inuse_block* blocks = (struct inuse_block*) calloc(section->count, sizeof(struct inuse_block));
+			const address_t* pairs = (const address_t*) data;
+			if (blocks)
+			{
+				for (num_blocks = 0; num_blocks < section->count; num_blocks++)
+				{
+					blocks[num_blocks].addr = pairs[num_blocks * 2];
+					blocks[num_blocks].size = pairs[num_blocks * 2 + 1];
+				}
+				adopt_inuse_heap_blocks(blocks, num_blocks);
+			}
+			index_cache_unmap(data, section->length);
+		}
+		else
+			index_cache_unmap(data, section->length);
+	}
+	close(fd);
+
+	// bit vectors come in pair with their ready flags
+	if (bitvec && ready && adopt_bit_vecs(bitvec, bitvec_len, ready))
+		bitvec = NULL;
+	if (bitvec)
+	{
+		index_cache_unmap(bitvec, bitvec_len);
+		bitvec_len = 0;
+	}
+	if (ready)
+		index_cache_unmap(ready, ready_len);
+
+	CA_PRINT("Index cache %s is loaded in %.2f seconds\n", fname, ca_wall_time() - start_time);
+	CA_PRINT("\tbit vectors "PRINT_FORMAT_SIZE" MB, reference index "PRINT_FORMAT_SIZE" pointers, %ld in-use blocks\n",
+			bitvec_len >> 20, num_refs, num_blocks);
+	free(fname);
+	g_cache_loaded = CA_TRUE;
+	return CA_TRUE;
+#endif
+}
+
+CA_BOOL save_index_cache(const char* core_path)
+{
+#ifdef WIN32
+	CA_PRINT("Index cache is not supported on this platform\n");
+	return CA_FALSE;
+#else
+	struct cache_header hdr;
+	char* fname;
+	char* tmpname;
+	FILE* fp;
+	char* bitvec;
+	unsigned char* ready;
+	size_t bitvec_len;
+	const struct ptr_ref* refs = NULL;
+	size_t num_refs = 0;
+	struct inuse_block_table* blocks;
+	unsigned long num_blocks = 0;
+	address_t* pairs = NULL;
+	unsigned int i;
+	CA_BOOL rc;
+	double start_time;
+
+	if (!g_debug_core || !core_path)
+	{
+		CA_PRINT("Index cache is only available for core file\n");
+		return CA_FALSE;
+	}
+	if (!core_identity(core_path, &hdr))
+	{
+		CA_PRINT("Failed to stat core file %s\n", core_path);
+		return CA_FALSE;
+	}
+
+	// Everything worth caching is built now, if not yet
+	if (!build_all_bit_vecs())
+		return CA_FALSE;
+	start_time = ca_wall_time();
+	bitvec = bit_vec_buffer(&bitvec_len);
+	ready = (unsigned char*) malloc(g_segment_count);
+	if (!ready)
+		return CA_FALSE;
+	for (i = 0; i < g_segment_count; i++)
+		ready[i] = g_segments[i].m_bitvec_ready;
+	if (ptr_index_ready())
+		refs = ptr_index_data(&num_refs);
+	blocks = build_inuse_heap_blocks();
+	if (blocks)
+	{
+		unsigned long k;
+		num_blocks = blocks->count;
+		pairs = (address_t*) malloc(num_blocks * 2 * sizeof(address_t));
+		if (!pairs)
+			num_blocks = 0;
+		for (k = 0; k < num_blocks; k++)
+		{
+			pairs[k * 2] = blocks->addrs[k];
+			pairs[k * 2 + 1] = blocks->sizes[k];
+		}
+	}
+
+	// write to a temporary file and rename it, a reader never sees a partial file
+	fname = cache_file_name(core_path);
+	tmpname = fname ? (char*) malloc(strlen(fname) + 5) : NULL;
+	if (!tmpname)
+	{
+		if (fname)
+			free(fname);
+		free(ready);
+		if (pairs)
+			free(pairs);
+		return CA_FALSE;
+	}
+	sprintf(tmpname, "%s.tmp", fname);
+	fp = fopen(tmpname, "wb");
+	rc = fp ? CA_TRUE : CA_FALSE;
+	if (rc)
+	{
+		rc = fwrite(&hdr, sizeof(hdr), 1, fp) == 1
+			&& write_section(fp, &hdr, CACHE_BIT_VEC, bitvec, 1, bitvec ? bitvec_len : 0)
+			&& write_section(fp, &hdr, CACHE_BIT_VEC_READY, ready, 1, g_segment_count)
+			&& (!refs || write_section(fp, &hdr, CACHE_PTR_INDEX, refs, sizeof(struct ptr_ref), num_refs))
+			&& (!pairs || write_section(fp, &hdr, CACHE_INUSE_BLOCKS, pairs, 2 * sizeof(address_t), num_blocks))
+			// now that the section table is filled in
+			&& fseek(fp, 0, SEEK_SET) == 0
+			&& fwrite(&hdr, sizeof(hdr), 1, fp) == 1;
+		if (fclose(fp) != 0)
+			rc = CA_FALSE;
+	}
+	if (rc && rename(tmpname, fname) != 0)
+		rc = CA_FALSE;
+	if (rc)
+	{
+		CA_PRINT("Index cache %s is saved in %.2f seconds\n", fname, ca_wall_time() - start_time);
+		CA_PRINT("\tbit vectors "PRINT_FORMAT_SIZE" MB, reference index "PRINT_FORMAT_SIZE" pointers, %ld in-use blocks\n",
+				bitvec_len >> 20, num_refs, num_blocks);
+		g_cache_loaded = CA_TRUE;
+		g_cache_has_ptr_index = refs ? CA_TRUE : CA_FALSE;
+	}
+	else
+	{
+		CA_PRINT("Failed to write index cache %s\n", tmpname);
+		unlink(tmpname);
+	}
+
+	free(tmpname);
+	free(fname);
+	free(ready);
+	if (pairs)
+		free(pairs);
+	return rc;
+#endif
+}
+
+CA_BOOL index_cache_stale(void)
+{
+	return !g_cache_loaded || (ptr_index_ready() && !g_cache_has_ptr_index);
+}
+
+void index_cache_unmap(void* addr, size_t len)
+{
+#ifndef WIN32
+	munmap((char*)addr, len);
+#endif
+}
+
+/*
+ * index_cache [load|save]
+ */
+void index_cache_command(const char* arg, const char* core_path)
+{
+	if (!core_path)
+		CA_PRINT("Index cache is only available for core file\n");
+	else if (arg && strcmp(arg, "load") == 0)
+	{
+		if (!load_index_cache(core_path))
+			CA_PRINT("There is no index cache made for %s\n", core_path);
+	}
+	else if (arg && strcmp(arg, "save") == 0)
+		save_index_cache(core_path);
+	else if (!g_cache_loaded)
+		CA_PRINT("Index cache is not in use, \"index_cache save\" to create it\n");
+	else if (index_cache_stale())
+		CA_PRINT("Index cache is in use, \"index_cache save\" to add the reference index\n");
+	else
+		CA_PRINT("Index cache is in use and up to date\n");
+}
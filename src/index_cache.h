@@ -0,0 +1,36 @@
+/*
+ * index_cache.h
+ *		Sidecar file of indexes derived from a core file, so that
+ *		a later session may map them back instead of rebuilding
+ *
+ *  Created on: Oct 16, 2026
+ */
+#ifndef INDEX_CACHE_H_
+#define INDEX_CACHE_H_
+
+#include "ref.h"
+
+// Bump it whenever the layout of any section changes
+#define INDEX_CACHE_VERSION 1
+
+// The cache file is the core file's name with this suffix
+#define INDEX_CACHE_SUFFIX ".caidx"
+
+/*
+ * Exposed functions
+ */
+// Map back all sections of a matching cache file, return CA_FALSE if there is none
+extern CA_BOOL load_index_cache(const char* core_path);
+
+// Build bit vectors of all segments and write them with other built indexes
+extern CA_BOOL save_index_cache(const char* core_path);
+
+// Return true if this session built something that the cache file doesn't have
+extern CA_BOOL index_cache_stale(void);
+
+// Release a section handed out by load_index_cache
+extern void index_cache_unmap(void* addr, size_t len);
+
+extern void index_cache_command(const char* arg, const char* core_path);
+
+#endif /* INDEX_CACHE_H_ */
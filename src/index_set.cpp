@@ -0,0 +1,104 @@
+/*
+ * index_set.c
+ *		Remove duplicates from an array of indexes, e.g. edges of a heap
+ *		block, with a reusable open-addressing set
+ *
+ *  Created on: Oct 16, 2026
+ */
+#include "index_set.h"
+
+static unsigned long
+unique_indexes_linear(unsigned long* indexes, unsigned long count)
+{
+	unsigned long i, j, num_unique = 0;
+
+	for (i = 0; i < count; i++)
+	{
+		for (j = 0; j < num_unique; j++)
+		{
+			if (indexes[j] == indexes[i])
+				break;
+		}
+		if (j == num_unique)
+			indexes[num_unique++] = indexes[i];
+	}
+	return num_unique;
+}
+
+static inline unsigned long
+index_set_slot(const struct index_set* set, unsigned long index)
+{
+	return (unsigned long)(((unsigned long long)index * 0x9E3779B97F4A7C15ull) >> set->shift);
+}
+
+/*
+ * Size the table for count indexes, a load factor of at most 1/2
+ */
+static CA_BOOL reserve_index_set(struct index_set* set, unsigned long count)
+{
+	unsigned long num_slots = 64;
+	unsigned int shift = 64 - 6;
+
+	if (set->num_slots >= count * 2)
+		return CA_TRUE;
+	while (num_slots < count * 2)
+	{
+		num_slots <<= 1;
+		shift--;
+	}
+	release_index_set(set);
+	set->slots = (unsigned long*) malloc(num_slots * sizeof(unsigned long));
+	if (!set->slots)
+		return CA_FALSE;
+	// all bits set is INDEX_SET_EMPTY
+	memset(set->slots, 0xff, num_slots * sizeof(unsigned long));
+	set->num_slots = num_slots;
+	set->shift = shift;
+	return CA_TRUE;
+}
+
+unsigned long unique_indexes(struct index_set* set, unsigned long* indexes, unsigned long count)
+{
+	unsigned long i, mask, num_unique = 0;
+
+	if (count <= MAX_LINEAR_UNIQUE)
+		return unique_indexes_linear(indexes, count);
+	// without memory for the set, it is slow but still right
+	if (!reserve_index_set(set, count))
+		return unique_indexes_linear(indexes, count);
+
+	mask = set->num_slots - 1;
+	for (i = 0; i < count; i++)
+	{
+		unsigned long index = indexes[i];
+		unsigned long slot = index_set_slot(set, index);
+
+		while (set->slots[slot] != INDEX_SET_EMPTY && set->slots[slot] != index)
+			slot = (slot + 1) & mask;
+		if (set->slots[slot] == INDEX_SET_EMPTY)
+		{
+			set->slots[slot] = index;
+			indexes[num_unique++] = index;
+		}
+	}
+
+	// Empty the slots in the reverse order of insertion, so that the probe
+	// of an index only passes indexes which are inserted before it
+	for (i = num_unique; i > 0; i--)
+	{
+		unsigned long index = indexes[i - 1];
+		unsigned long slot = index_set_slot(set, index);
+
+		while (set->slots[slot] != index)
+			slot = (slot + 1) & mask;
+		set->slots[slot] = INDEX_SET_EMPTY;
+	}
+	return num_unique;
+}
+
+void release_index_set(struct index_set* set)
+{
+	if (set->slots)
+		free(set->slots);
+	memset(set, 0, sizeof(struct index_set));
+}
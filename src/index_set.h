@@ -0,0 +1,37 @@
+/*
+ * index_set.h
+ *		Remove duplicates from an array of indexes, e.g. edges of a heap
+ *		block, with a reusable open-addressing set
+ *
+ *  Created on: Oct 16, 2026
+ */
+#ifndef INDEX_SET_H_
+#define INDEX_SET_H_
+
+#include "ref.h"
+
+/*
+ * Linear probing with a multiplicative hash, all slots are empty between
+ * calls so that the table is reused without being cleared in full
+ */
+struct index_set
+{
+	unsigned long* slots;
+	unsigned long  num_slots;	// power of 2
+	unsigned int   shift;		// 64 - log2(num_slots)
+};
+
+#define INDEX_SET_EMPTY ((unsigned long)-1)
+
+// Up to this many indexes are compared with each other directly
+#define MAX_LINEAR_UNIQUE 16
+
+/*
+ * Exposed functions
+ */
+// Keep the first of duplicate indexes in their order, return the number left
+extern unsigned long unique_indexes(struct index_set* set, unsigned long* indexes, unsigned long count);
+
+extern void release_index_set(struct index_set* set);
+
+#endif /* INDEX_SET_H_ */
@@ -41,6 +41,9 @@
 #include <stdio.h>
 
 #include "cross_platform.h"
+#ifdef CA_COMPRESSED_CORE
+#include "compressed_core.h"
+#endif
 
 // Map a disk file into current process's address space
 class MmapFile
@@ -51,6 +54,9 @@ public:
 		: mFileSize(0),	mpOrigin(NULL), mpStartAddr(NULL), mpEndAddr(NULL),
 		mpFileName(ipFileName), mbNeedSynch(ibSync)
 	{
+#ifdef CA_COMPRESSED_CORE
+		mpCompressed = NULL;
+#endif
 		// Get system page size, 4K on Win32, 8K on Win64/IA64
 		GET_SYSTEM_PAGE_SIZE(mSystemPageSize);
 #ifdef WIN32
@@ -71,6 +77,11 @@ public:
 	// We could shrink the mmaped area to reduce my program's memory footprint
 	bool AdjustMmapArea(char* ipCursor)
 	{
+#ifdef CA_COMPRESSED_CORE
+		// Pages of a compressed file are released by its own cache
+		if (mpCompressed)
+			return true;
+#endif
 #ifndef WIN32
 		if(ipCursor < mpStartAddr || ipCursor > mpEndAddr)
 		{
@@ -175,6 +186,25 @@ public:
 			::fprintf(stderr, "Failed to open file %s\n", mpFileName);
 			return false;
 		}
+#ifdef CA_COMPRESSED_CORE
+		// Compressed file is inflated on demand, in windowed mode a file
+		// bigger than the memory budget is read on demand as well
+		bool lbCompressed = CompressedCore::IsCompressed(mFileDescriptor);
+		if (lbCompressed || (mbWindowed && mFileSize > mCacheBudgetMB * 1024 * 1024))
+		{
+			mpCompressed = new CompressedCore(mFileDescriptor, mpFileName, mCacheBudgetMB, lbCompressed);
+			mpStartAddr = mpCompressed->Map();
+			if (!mpStartAddr)
+			{
+				::fprintf(stderr, "Failed to open compressed file %s\n", mpFileName);
+				return false;
+			}
+			mFileSize = mpCompressed->GetSize();
+			mpEndAddr = mpStartAddr + mFileSize;
+			mpOrigin = mpStartAddr;
+			return true;
+		}
+#endif
 		// Mmap the file
 		// It appears I have to use MAP_SHARED to be able to msync. ?
 		mpStartAddr = (char*)
@@ -213,6 +243,14 @@ public:
 			::CloseHandle(mhFile);
 		}
 #else
+#ifdef CA_COMPRESSED_CORE
+		if (mpCompressed)
+		{
+			delete mpCompressed;
+			mpCompressed = NULL;
+			mpStartAddr = mpEndAddr;
+		}
+#endif
 		if(mbNeedSynch)
 		{
 			if(::msync(mpStartAddr, mpEndAddr - mpStartAddr, MS_ASYNC))
@@ -257,6 +295,21 @@ public:
 
 	bool InitSucceed() { return mInitialized; }
 
+#ifdef CA_COMPRESSED_CORE
+	// Memory budget in MB of inflated data of a compressed file
+	static void SetCacheBudget(size_t iBudgetMB) { mCacheBudgetMB = iBudgetMB; }
+
+	// Map a file bigger than the budget in windows instead of as a whole
+	static void SetWindowed(bool ibWindowed) { mbWindowed = ibWindowed; }
+
+	// Keep data of a compressed or windowed file in memory while it is used
+	void Pin(const char* ipAddr, size_t iLen, bool ibPin)
+	{
+		if (mpCompressed)
+			mpCompressed->Pin(ipAddr, iLen, ibPin);
+	}
+#endif
+
 private:
 	// A weak pointer
 	const char* mpFileName;
@@ -272,6 +325,11 @@ private:
 	char*  mpEndAddr;
 	bool   mbNeedSynch;
 	bool   mInitialized;
+#ifdef CA_COMPRESSED_CORE
+	CompressedCore* mpCompressed;
+	static size_t mCacheBudgetMB;
+	static bool   mbWindowed;
+#endif
 };
 
 // Specialized mmap file w/ thread id
@@ -0,0 +1,274 @@
+/*
+ * parallel.c
+ *		A minimal worker pool to spread CPU-bound scans of the
+ *		mmap-ed core over all processors
+ *
+ *  Created on: Oct 16, 2026
+ */
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/time.h>
+#endif
+
+#include "parallel.h"
+
+/***************************************************************************
+* Global variables
+***************************************************************************/
+// 0 means the number of workers is not decided yet
+static unsigned int g_num_workers = 0;
+
+/***************************************************************************
+* Shared state of one parallel run
+* 	tasks are handed out one at a time under the lock, since a task is
+* 	expected to be coarse (megabytes of memory)
+***************************************************************************/
+struct parallel_run
+{
+	ca_task_func func;
+	void*        arg;
+	size_t       num_tasks;
+	size_t       next_task;
+	CA_BOOL      interruptible;
+	volatile CA_BOOL aborted;
+#ifdef WIN32
+	CRITICAL_SECTION lock;
+#else
+	pthread_mutex_t  lock;
+#endif
+};
+
+struct parallel_worker
+{
+	struct parallel_run* run;
+	unsigned int index;
+};
+
+static CA_BOOL next_task(struct parallel_run* run, size_t* task)
+{
+	CA_BOOL rc = CA_FALSE;
+#ifdef WIN32
+	EnterCriticalSection(&run->lock);
+#else
+	pthread_mutex_lock(&run->lock);
+#endif
+	if (!run->aborted && run->next_task < run->num_tasks)
+	{
+		*task = run->next_task++;
+		rc = CA_TRUE;
+	}
+#ifdef WIN32
+	LeaveCriticalSection(&run->lock);
+#else
+	pthread_mutex_unlock(&run->lock);
+#endif
+	return rc;
+}
+
+static void worker_loop(struct parallel_worker* worker)
+{
+	struct parallel_run* run = worker->run;
+	size_t task;
+
+	while (next_task(run, &task))
+	{
+		run->func(run->arg, task, worker->index);
+		// Only the calling thread may talk to the debugger
+		if (worker->index == 0 && run->interruptible && user_request_break())
+			run->aborted = CA_TRUE;
+	}
+}
+
+#ifdef WIN32
+static DWORD WINAPI worker_thread(LPVOID arg)
+{
+	worker_loop((struct parallel_worker*)arg);
+	return 0;
+}
+#else
+static void* worker_thread(void* arg)
+{
+	worker_loop((struct parallel_worker*)arg);
+	return NULL;
+}
+#endif
+
+/***************************************************************************
+* Exposed functions
+***************************************************************************/
+unsigned int ca_num_workers(void)
+{
+	if (g_num_workers == 0)
+	{
+		long ncpu;
+#ifdef WIN32
+		SYSTEM_INFO lSysInfo;
+		GetSystemInfo(&lSysInfo);
+		ncpu = lSysInfo.dwNumberOfProcessors;
+#else
+		ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+		if (ncpu < 1)
+			ncpu = 1;
+		else if (ncpu > MAX_NUM_WORKERS)
+			ncpu = MAX_NUM_WORKERS;
+		g_num_workers = (unsigned int) ncpu;
+	}
+	return g_num_workers;
+}
+
+void set_num_workers(unsigned int num)
+{
+	if (num == 0)
+		CA_PRINT("Current number of worker threads is %d\n", ca_num_workers());
+	else if (num <= MAX_NUM_WORKERS)
+	{
+		g_num_workers = num;
+		CA_PRINT("Current number of worker threads is set to %d\n", g_num_workers);
+	}
+	else
+		CA_PRINT("Invalid parameter %d, allowed range [1 ... %d]\n", num, MAX_NUM_WORKERS);
+}
+
+/////////////////////////////////////////////////////////////////////////
+// Execute func(arg, task, worker) for every task in [0, num_tasks)
+//   The calling thread works as worker 0 along with the helper threads.
+//   If interruptible, the calling thread polls user_request_break()
+//   between tasks and stops handing out new tasks when it is set.
+/////////////////////////////////////////////////////////////////////////
+CA_BOOL ca_parallel_run(size_t num_tasks, ca_task_func func, void* arg, CA_BOOL interruptible)
+{
+	struct parallel_run run;
+	struct parallel_worker workers[MAX_NUM_WORKERS];
+#ifdef WIN32
+	HANDLE threads[MAX_NUM_WORKERS];
+#else
+	pthread_t threads[MAX_NUM_WORKERS];
+#endif
+	unsigned int nworkers = ca_num_workers();
+	unsigned int nthreads = 0;
+	unsigned int i;
+
+	if (num_tasks == 0)
+		return CA_TRUE;
+	if (nworkers > num_tasks)
+		nworkers = (unsigned int) num_tasks;
+
+	run.func = func;
+	run.arg = arg;
+	run.num_tasks = num_tasks;
+	run.next_task = 0;
+	run.interruptible = interruptible;
+	run.aborted = CA_FALSE;
+#ifdef WIN32
+	InitializeCriticalSection(&run.lock);
+#else
+	pthread_mutex_init(&run.lock, NULL);
+#endif
+
+	// Spawn helpers, failure to create a thread only reduces concurrency
+	for (i = 1; i < nworkers; i++)
+	{
+		workers[i].run = &run;
+		workers[i].index = i;
+#ifdef WIN32
+		threads[nthreads] = CreateThread(NULL, 0, worker_thread, &workers[i], 0, NULL);
+		if (threads[nthreads] == NULL)
+			break;
+#else
+		if (pthread_create(&threads[nthreads], NULL, worker_thread, &workers[i]))
+			break;
+#endif
+		nthreads++;
+	}
+	workers[0].run = &run;
+	workers[0].index = 0;
+	worker_loop(&workers[0]);
+
+	// Wait for all helpers
+	for (i = 0; i < nthreads; i++)
+	{
+#ifdef WIN32
+		WaitForSingleObject(threads[i], INFINITE);
+		CloseHandle(threads[i]);
+#else
+		pthread_join(threads[i], NULL);
+#endif
+	}
+#ifdef WIN32
+	DeleteCriticalSection(&run.lock);
+#else
+	pthread_mutex_destroy(&run.lock);
+#endif
+
+	return run.aborted ? CA_FALSE : CA_TRUE;
+}
+
+double ca_wall_time(void)
+{
+#ifdef WIN32
+	return GetTickCount() / 1000.0;
+#else
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+#endif
+}
+
+unsigned int ca_atomic_or(volatile unsigned int* ptr, unsigned int bits)
+{
+#ifdef WIN32
+	return (unsigned int) InterlockedOr((volatile LONG*)ptr, (LONG)bits);
+#else
+	return __sync_fetch_and_or(ptr, bits);
+#endif
+}
+
+long ca_atomic_add(volatile long* ptr, long val)
+{
+#ifdef WIN32
+	return InterlockedExchangeAdd((volatile LONG*)ptr, (LONG)val);
+#else
+	return __sync_fetch_and_add(ptr, val);
+#endif
+}
+
+void ca_spin_lock(volatile long* lock)
+{
+#ifdef WIN32
+	while (InterlockedExchange((volatile LONG*)lock, 1))
+	{
+		while (*lock)
+			YieldProcessor();
+	}
+#else
+	while (__sync_lock_test_and_set(lock, 1))
+	{
+		// wait with plain reads, which don't bounce the cache line
+		while (*lock)
+			;
+	}
+#endif
+}
+
+void ca_spin_unlock(volatile long* lock)
+{
+#ifdef WIN32
+	InterlockedExchange((volatile LONG*)lock, 0);
+#else
+	__sync_lock_release(lock);
+#endif
+}
+
+void ca_yield(void)
+{
+#ifdef WIN32
+	SwitchToThread();
+#else
+	sched_yield();
+#endif
+}
@@ -0,0 +1,54 @@
+/*
+ * parallel.h
+ *		A minimal worker pool to spread CPU-bound scans of the
+ *		mmap-ed core over all processors
+ *
+ *  Created on: Oct 16, 2026
+ */
+#ifndef PARALLEL_H_
+#define PARALLEL_H_
+
+#include "ref.h"
+
+#define MAX_NUM_WORKERS 64
+
+/*
+ * A task is identified by its index in [0, num_tasks)
+ * worker is in [0, ca_num_workers()), worker 0 is always the calling thread
+ *
+ * Task functions run concurrently, therefore they must not call debugger
+ * services, i.e. CA_PRINT, inferior_memory_read, read_memory_wrapper,
+ * user_request_break, etc. They may only access the mmap-ed core file.
+ */
+typedef void (*ca_task_func)(void* arg, size_t task, unsigned int worker);
+
+/*
+ * Exposed functions
+ */
+extern unsigned int ca_num_workers(void);
+
+extern void set_num_workers(unsigned int);
+
+// Return CA_FALSE if user interrupted the run, some tasks may not be executed
+extern CA_BOOL ca_parallel_run(size_t num_tasks, ca_task_func func, void* arg, CA_BOOL interruptible);
+
+// Wall clock in seconds, for reporting the speed of long scans
+extern double ca_wall_time(void);
+
+/*
+ * Data shared by concurrent tasks
+ * 	atomic operations return the old value
+ * 	a spin lock is a long initialized to 0, which guards short critical sections
+ */
+extern unsigned int ca_atomic_or(volatile unsigned int* ptr, unsigned int bits);
+
+extern long ca_atomic_add(volatile long* ptr, long val);
+
+extern void ca_spin_lock(volatile long* lock);
+
+extern void ca_spin_unlock(volatile long* lock);
+
+// Let other threads run while waiting for work
+extern void ca_yield(void);
+
+#endif /* PARALLEL_H_ */
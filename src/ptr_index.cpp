@@ -0,0 +1,382 @@
+/*
+ * ptr_index.c
+ *		Reverse pointer index of a core file, i.e. for any address
+ *		range, where are the pointers that point into it
+ *
+ *  Created on: Oct 16, 2026
+ */
+#include "ptr_index.h"
+#include "segment.h"
+#include "parallel.h"
+#include "index_cache.h"
+
+/***************************************************************************
+* Global variables
+***************************************************************************/
+static struct ptr_ref* g_ptr_refs = NULL;
+static size_t g_num_ptr_refs = 0;
+static size_t g_ptr_refs_map_len = 0;	// non-zero if mapped from the index cache
+static CA_BOOL g_ptr_index_ready = CA_FALSE;
+
+/***************************************************************************
+* Index is built by worker threads in two passes over slices of segments
+* 	[1] count addressable pointers of each slice
+* 	[2] copy them out at the slice's offset in the global array
+* then sorted by pointer value
+***************************************************************************/
+// Slice size in bytes, a multiple of 32 pointers so that slices never
+// share a uint of the segment's bit vector
+#define INDEX_SLICE_SZ (4*1024*1024)
+
+struct index_slice
+{
+	struct ca_segment* segment;
+	size_t first;		// index of the first pointer of the slice
+	size_t last;		// index past the last pointer of the slice
+	size_t count;		// number of addressable pointers
+	size_t offset;		// where to store them in the global array
+	unsigned int build_bitvec:1;
+	unsigned int done:1;
+};
+
+struct index_job
+{
+	struct index_slice* slices;
+	size_t num_slices;
+	size_t ahead;		// distance of the slice to read ahead
+	struct ptr_ref* refs;
+};
+
+static void prefetch_slice(struct index_job* job, size_t task)
+{
+	if (task < job->num_slices)
+		prefetch_segment_range(job->slices[task].segment, job->slices[task].first, job->slices[task].last);
+}
+
+static unsigned int bit_count(unsigned int bits)
+{
+	unsigned int n = 0;
+	while (bits)
+	{
+		bits &= bits - 1;
+		n++;
+	}
+	return n;
+}
+
+static void count_slice_task(void* arg, size_t task, unsigned int worker)
+{
+	struct index_job* job = (struct index_job*) arg;
+	struct index_slice* slice = &job->slices[task];
+	size_t uint_index;
+
+	if (slice->build_bitvec)
+	{
+		prefetch_slice(job, task + job->ahead);
+		pin_segment_range(slice->segment, slice->first, slice->last);
+		set_addressable_bit_vec_range(slice->segment, slice->first, slice->last);
+		unpin_segment_range(slice->segment, slice->first, slice->last);
+	}
+	// bits beyond the segment's end are never set
+	slice->count = 0;
+	for (uint_index = slice->first >> 5; uint_index < (slice->last + 31) >> 5; uint_index++)
+		slice->count += bit_count(slice->segment->m_ptr_bitvec[uint_index]);
+	slice->done = 1;
+}
+
+static void fill_slice_task(void* arg, size_t task, unsigned int worker)
+{
+	struct index_job* job = (struct index_job*) arg;
+	struct index_slice* slice = &job->slices[task];
+	struct ca_segment* segment = slice->segment;
+	struct ptr_ref* ref = &job->refs[slice->offset];
+	size_t ptr_sz = g_ptr_bit >> 3;
+	size_t uint_index;
+
+	prefetch_slice(job, task + job->ahead);
+	pin_segment_range(segment, slice->first, slice->last);
+	for (uint_index = slice->first >> 5; uint_index < (slice->last + 31) >> 5; uint_index++)
+	{
+		unsigned int bits = segment->m_ptr_bitvec[uint_index];
+		size_t bit_index = uint_index << 5;
+		for (; bits; bits >>= 1, bit_index++)
+		{
+			if (bits & 0x1)
+			{
+				const char* next = segment->m_faddr + bit_index * ptr_sz;
+				if (ptr_sz == 8)
+				{
+#ifdef sun
+					// sparcv9 core aligns on 4-byte only. sigh..
+					if ((address_t)next & 0x7ul)
+						memcpy(&ref->value, next, 8);
+					else
+#endif
+						ref->value = *(address_t*)next;
+				}
+				else
+					ref->value = *(unsigned int*)next;
+				ref->vaddr = segment->m_vaddr + bit_index * ptr_sz;
+				ref++;
+			}
+		}
+	}
+	unpin_segment_range(segment, slice->first, slice->last);
+	release_segment_range(segment, slice->first, slice->last);
+	slice->done = 1;
+}
+
+static int ptr_ref_compare(const void* lhs, const void* rhs)
+{
+	const struct ptr_ref* a = (const struct ptr_ref*) lhs;
+	const struct ptr_ref* b = (const struct ptr_ref*) rhs;
+	if (a->value < b->value)
+		return -1;
+	else if (a->value > b->value)
+		return 1;
+	return 0;
+}
+
+/*
+ * LSD radix sort by value, 16 bits at a time. Pointers share most of the
+ * high bits, such passes are skipped. The sort is stable, therefore refs
+ * to the same value stay in address order.
+ */
+static void sort_ptr_refs(struct ptr_ref* refs, size_t n)
+{
+	struct ptr_ref* tmp = (struct ptr_ref*) malloc(sizeof(struct ptr_ref) * n);
+	size_t* count = (size_t*) malloc(sizeof(size_t) * 0x10000);
+	struct ptr_ref* src = refs;
+	struct ptr_ref* dst = tmp;
+	unsigned int shift;
+
+	if (!tmp || !count)
+	{
+		// merge sort is stable too, but qsort is all we have
+		if (tmp)
+			free(tmp);
+		if (count)
+			free(count);
+		qsort(refs, n, sizeof(struct ptr_ref), ptr_ref_compare);
+		return;
+	}
+
+	for (shift = 0; shift < sizeof(address_t) * 8; shift += 16)
+	{
+		size_t i, sum;
+		struct ptr_ref* swap;
+
+		memset(count, 0, sizeof(size_t) * 0x10000);
+		for (i = 0; i < n; i++)
+			count[(src[i].value >> shift) & 0xffff]++;
+		// all in one bucket, nothing to do in this pass
+		if (count[(src[0].value >> shift) & 0xffff] == n)
+			continue;
+		for (i = 0, sum = 0; i < 0x10000; i++)
+		{
+			size_t c = count[i];
+			count[i] = sum;
+			sum += c;
+		}
+		for (i = 0; i < n; i++)
+			dst[count[(src[i].value >> shift) & 0xffff]++] = src[i];
+		swap = src;
+		src = dst;
+		dst = swap;
+	}
+	if (src != refs)
+		memcpy(refs, src, sizeof(struct ptr_ref) * n);
+	free(tmp);
+	free(count);
+}
+
+/***************************************************************************
+* Exposed functions
+***************************************************************************/
+CA_BOOL build_ptr_index(void)
+{
+	size_t ptr_sz = g_ptr_bit >> 3;
+	size_t slice_ptrs = INDEX_SLICE_SZ / ptr_sz;
+	size_t num_slices = 0;
+	size_t total = 0;
+	size_t k;
+	unsigned int i;
+	struct index_job job;
+	CA_BOOL completed;
+	double start_time = ca_wall_time();
+
+	if (!g_debug_core)
+	{
+		CA_PRINT("Reference index is only available for core file\n");
+		return CA_FALSE;
+	}
+	release_ptr_index();
+
+	// carve segments into slices
+	for (i=0; i<g_segment_count; i++)
+	{
+		struct ca_segment* segment = &g_segments[i];
+		if (segment->m_fsize > 0)
+			num_slices += (segment->m_fsize / ptr_sz + slice_ptrs - 1) / slice_ptrs;
+	}
+	job.slices = (struct index_slice*) calloc(num_slices ? num_slices : 1, sizeof(struct index_slice));
+	job.num_slices = num_slices;
+	job.ahead = prefetch_distance();
+	job.refs = NULL;
+	k = 0;
+	for (i=0; i<g_segment_count; i++)
+	{
+		struct ca_segment* segment = &g_segments[i];
+		size_t max_bit_index = segment->m_fsize / ptr_sz;
+		size_t first;
+		for (first = 0; first < max_bit_index; first += slice_ptrs)
+		{
+			struct index_slice* slice = &job.slices[k++];
+			slice->segment = segment;
+			slice->first = first;
+			slice->last = first + slice_ptrs < max_bit_index ? first + slice_ptrs : max_bit_index;
+			slice->build_bitvec = segment->m_bitvec_ready ? 0 : 1;
+		}
+	}
+
+	// [1] count
+	for (k=0; k<job.ahead; k++)
+	{
+		if (k < num_slices && job.slices[k].build_bitvec)
+			prefetch_slice(&job, k);
+	}
+	completed = ca_parallel_run(num_slices, count_slice_task, &job, CA_TRUE);
+	// a segment's bit vector is ready if all its slices are done
+	for (k=0; k<num_slices; k++)
+	{
+		struct index_slice* slice = &job.slices[k];
+		if (!slice->build_bitvec)
+			continue;
+		if (slice->first == 0)
+			slice->segment->m_bitvec_ready = 1;
+		if (!slice->done)
+			slice->segment->m_bitvec_ready = 0;
+	}
+	if (!completed)
+	{
+		CA_PRINT("Abort building reference index\n");
+		free(job.slices);
+		return CA_FALSE;
+	}
+	for (k=0; k<num_slices; k++)
+	{
+		job.slices[k].offset = total;
+		job.slices[k].done = 0;
+		total += job.slices[k].count;
+	}
+
+	// [2] fill
+	job.refs = (struct ptr_ref*) malloc(sizeof(struct ptr_ref) * (total ? total : 1));
+	if (!job.refs)
+	{
+		CA_PRINT("Failed to allocate "PRINT_FORMAT_SIZE" bytes for reference index\n", sizeof(struct ptr_ref) * total);
+		free(job.slices);
+		return CA_FALSE;
+	}
+	for (k=0; k<job.ahead; k++)
+		prefetch_slice(&job, k);
+	if (!ca_parallel_run(num_slices, fill_slice_task, &job, CA_TRUE))
+	{
+		CA_PRINT("Abort building reference index\n");
+		free(job.refs);
+		free(job.slices);
+		return CA_FALSE;
+	}
+	free(job.slices);
+
+	// [3] sort by value
+	if (total > 1)
+		sort_ptr_refs(job.refs, total);
+
+	g_ptr_refs = job.refs;
+	g_num_ptr_refs = total;
+	g_ptr_index_ready = CA_TRUE;
+	CA_PRINT("Reference index of "PRINT_FORMAT_SIZE" pointers ("PRINT_FORMAT_SIZE" MB) is built in %.2f seconds\n",
+			g_num_ptr_refs, (sizeof(struct ptr_ref) * g_num_ptr_refs) >> 20, ca_wall_time() - start_time);
+	return CA_TRUE;
+}
+
+void release_ptr_index(void)
+{
+	if (g_ptr_refs && g_ptr_refs_map_len)
+		index_cache_unmap(g_ptr_refs, g_ptr_refs_map_len);
+	else if (g_ptr_refs)
+		free(g_ptr_refs);
+	g_ptr_refs = NULL;
+	g_ptr_refs_map_len = 0;
+	g_num_ptr_refs = 0;
+	g_ptr_index_ready = CA_FALSE;
+}
+
+CA_BOOL ptr_index_ready(void)
+{
+	return g_ptr_index_ready;
+}
+
+const struct ptr_ref* ptr_index_data(size_t* count)
+{
+	*count = g_num_ptr_refs;
+	return g_ptr_refs;
+}
+
+// refs are mapped from the index cache with length map_len
+void adopt_ptr_index(struct ptr_ref* refs, size_t count, size_t map_len)
+{
+	release_ptr_index();
+	g_ptr_refs = refs;
+	g_num_ptr_refs = count;
+	g_ptr_refs_map_len = map_len;
+	g_ptr_index_ready = CA_TRUE;
+}
+
+size_t ptr_index_lookup(address_t low, address_t high, const struct ptr_ref** first)
+{
+	size_t lo = 0, hi = g_num_ptr_refs;
+	size_t start;
+
+	// the 1st value >= low
+	while (lo < hi)
+	{
+		size_t mid = lo + (hi - lo) / 2;
+		if (g_ptr_refs[mid].value < low)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	start = lo;
+	// the 1st value >= high
+	hi = g_num_ptr_refs;
+	while (lo < hi)
+	{
+		size_t mid = lo + (hi - lo) / 2;
+		if (g_ptr_refs[mid].value < high)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	*first = g_ptr_refs ? &g_ptr_refs[start] : NULL;
+	return lo - start;
+}
+
+/*
+ * ref_index [on|off]
+ */
+void ptr_index_command(const char* arg)
+{
+	if (arg && (strcmp(arg, "on") == 0 || strcmp(arg, "1") == 0))
+		build_ptr_index();
+	else if (arg && (strcmp(arg, "off") == 0 || strcmp(arg, "0") == 0))
+	{
+		release_ptr_index();
+		CA_PRINT("Reference index is released\n");
+	}
+	else if (g_ptr_index_ready)
+		CA_PRINT("Reference index of "PRINT_FORMAT_SIZE" pointers is in use\n", g_num_ptr_refs);
+	else
+		CA_PRINT("Reference index is not built, \"ref_index on\" to build it\n");
+}
@@ -0,0 +1,41 @@
+/*
+ * ptr_index.h
+ *		Reverse pointer index of a core file, i.e. for any address
+ *		range, where are the pointers that point into it
+ *
+ *  Created on: Oct 16, 2026
+ */
+#ifndef PTR_INDEX_H_
+#define PTR_INDEX_H_
+
+#include "ref.h"
+
+/*
+ * Every addressable pointer of the core, sorted by its value.
+ * All pointers to a range [low, high) are adjacent in the array.
+ */
+struct ptr_ref
+{
+	address_t value;	// pointed-to address
+	address_t vaddr;	// where the pointer is
+};
+
+/*
+ * Exposed functions
+ */
+extern CA_BOOL build_ptr_index(void);
+
+extern void release_ptr_index(void);
+
+extern CA_BOOL ptr_index_ready(void);
+
+extern const struct ptr_ref* ptr_index_data(size_t* count);
+
+extern void adopt_ptr_index(struct ptr_ref* refs, size_t count, size_t map_len);
+
+// Return the number of pointers with value in [low, high), *first is the 1st of them
+extern size_t ptr_index_lookup(address_t low, address_t high, const struct ptr_ref** first);
+
+extern void ptr_index_command(const char* arg);
+
+#endif /* PTR_INDEX_H_ */
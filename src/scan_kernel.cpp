@@ -0,0 +1,341 @@
+/*
+ * scan_kernel.c
+ *		Test a block of pointer-sized words against a set of
+ *		address ranges, with SIMD instructions if the CPU has them
+ *
+ *  Created on: Oct 16, 2026
+ */
+#include "scan_kernel.h"
+
+// x86_64 kernels are compiled with function target attributes, therefore
+// the rest of the program doesn't require AVX. The kernel is chosen at
+// runtime by CPUID.
+#if defined(__x86_64__) && !defined(WIN32) \
+	&& (defined(__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define CA_X86_SIMD
+#include <immintrin.h>
+#endif
+
+typedef unsigned int (*scan_block_func)(const char*, unsigned int, const struct object_range*, unsigned int);
+
+static scan_block_func g_simd_scan_block = NULL;
+static const char* g_simd_kernel_name = NULL;
+static CA_BOOL g_scan_kernel_ready = CA_FALSE;
+
+/*
+ * A value is in [low, high) if (value - low) < (high - low) as unsigned
+ * integers. This needs one compare per range and no branch.
+ */
+static unsigned int
+scan_block_scalar(const char* block,
+				unsigned int nwords,
+				const struct object_range* ranges,
+				unsigned int nranges)
+{
+	size_t ptr_sz = g_ptr_bit >> 3;
+	unsigned int mask = 0;
+	unsigned int i, r;
+
+	for (i = 0; i < nwords; i++)
+	{
+		const char* next = block + i * ptr_sz;
+		address_t val;
+		if (ptr_sz == 8)
+		{
+#ifdef sun
+			// sparcv9 core aligns on 4-byte only. sigh..
+			if ((address_t)next & 0x7ul)
+				memcpy(&val, next, 8);
+			else
+#endif
+				val = *(address_t*)next;
+		}
+		else
+			val = *(unsigned int*)next;
+
+		for (r = 0; r < nranges; r++)
+		{
+			if (val - ranges[r].low < ranges[r].high - ranges[r].low)
+			{
+				mask |= 1u << i;
+				break;
+			}
+		}
+	}
+	return mask;
+}
+
+#ifdef CA_X86_SIMD
+/*
+ * AVX2 has no unsigned 64-bit compare, flip the sign bit of both sides
+ * and use the signed one. A full block is kept in 8 registers while the
+ * ranges are walked once.
+ */
+__attribute__((target("avx2")))
+static unsigned int
+scan_block_avx2(const char* block,
+				unsigned int nwords,
+				const struct object_range* ranges,
+				unsigned int nranges)
+{
+	const __m256i sign = _mm256_set1_epi64x((long long)0x8000000000000000ULL);
+	__m256i words[SCAN_BLOCK_WORDS / 4];
+	__m256i hits[SCAN_BLOCK_WORDS / 4];
+	unsigned int nvec = nwords / 4;
+	unsigned int mask = 0;
+	unsigned int i, r;
+
+	for (i = 0; i < nvec; i++)
+	{
+		words[i] = _mm256_loadu_si256((const __m256i*)(block + i * 32));
+		hits[i] = _mm256_setzero_si256();
+	}
+	for (r = 0; r < nranges; r++)
+	{
+		__m256i low = _mm256_set1_epi64x((long long)ranges[r].low);
+		__m256i width = _mm256_xor_si256(_mm256_set1_epi64x((long long)(ranges[r].high - ranges[r].low)), sign);
+		for (i = 0; i < nvec; i++)
+		{
+			__m256i off = _mm256_xor_si256(_mm256_sub_epi64(words[i], low), sign);
+			hits[i] = _mm256_or_si256(hits[i], _mm256_cmpgt_epi64(width, off));
+		}
+	}
+	for (i = 0; i < nvec; i++)
+		mask |= (unsigned int)_mm256_movemask_pd(_mm256_castsi256_pd(hits[i])) << (i * 4);
+	// odd words at the end of a segment
+	if (nvec * 4 < nwords)
+		mask |= scan_block_scalar(block + nvec * 32, nwords - nvec * 4, ranges, nranges) << (nvec * 4);
+	return mask;
+}
+
+__attribute__((target("avx512f")))
+static unsigned int
+scan_block_avx512(const char* block,
+				unsigned int nwords,
+				const struct object_range* ranges,
+				unsigned int nranges)
+{
+	__m512i words[SCAN_BLOCK_WORDS / 8];
+	__mmask8 hits[SCAN_BLOCK_WORDS / 8];
+	unsigned int nvec = nwords / 8;
+	unsigned int mask = 0;
+	unsigned int i, r;
+
+	for (i = 0; i < nvec; i++)
+	{
+		words[i] = _mm512_loadu_si512((const void*)(block + i * 64));
+		hits[i] = 0;
+	}
+	for (r = 0; r < nranges; r++)
+	{
+		__m512i low = _mm512_set1_epi64((long long)ranges[r].low);
+		__m512i width = _mm512_set1_epi64((long long)(ranges[r].high - ranges[r].low));
+		for (i = 0; i < nvec; i++)
+			hits[i] |= _mm512_cmplt_epu64_mask(_mm512_sub_epi64(words[i], low), width);
+	}
+	for (i = 0; i < nvec; i++)
+		mask |= (unsigned int)hits[i] << (i * 8);
+	// odd words at the end of a segment
+	if (nvec * 8 < nwords)
+		mask |= scan_block_scalar(block + nvec * 64, nwords - nvec * 8, ranges, nranges) << (nvec * 8);
+	return mask;
+}
+#endif
+
+/***************************************************************************
+* Exposed functions
+***************************************************************************/
+void init_scan_kernel(void)
+{
+	if (g_scan_kernel_ready)
+		return;
+#ifdef CA_X86_SIMD
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f"))
+	{
+		g_simd_scan_block = scan_block_avx512;
+		g_simd_kernel_name = "avx512";
+	}
+	else if (__builtin_cpu_supports("avx2"))
+	{
+		g_simd_scan_block = scan_block_avx2;
+		g_simd_kernel_name = "avx2";
+	}
+#endif
+	g_scan_kernel_ready = CA_TRUE;
+}
+
+const char* scan_kernel_name(void)
+{
+	init_scan_kernel();
+	if (g_simd_scan_block && g_ptr_bit == 64)
+		return g_simd_kernel_name;
+	return "scalar";
+}
+
+unsigned int scan_block_for_ranges(const char* block,
+					unsigned int nwords,
+					const struct object_range* ranges,
+					unsigned int nranges)
+{
+	// SIMD kernels only handle 64-bit target
+	if (g_simd_scan_block && g_ptr_bit == 64)
+		return g_simd_scan_block(block, nwords, ranges, nranges);
+	return scan_block_scalar(block, nwords, ranges, nranges);
+}
+
+/***************************************************************************
+* Sorted interval index of many targets
+***************************************************************************/
+static int range_low_compare(const void* lhs, const void* rhs)
+{
+	const struct object_range* a = (const struct object_range*) lhs;
+	const struct object_range* b = (const struct object_range*) rhs;
+	if (a->low < b->low)
+		return -1;
+	else if (a->low > b->low)
+		return 1;
+	return 0;
+}
+
+// In-order walk of the implicit tree assigns sorted ranges to BFS slots
+static size_t fill_eytzinger(struct range_index* index, size_t i, size_t k)
+{
+	if (k <= index->num_ranges)
+	{
+		i = fill_eytzinger(index, i, 2 * k);
+		index->eytz_low[k]  = index->ranges[i].low;
+		index->eytz_high[k] = index->ranges[i].high;
+		i++;
+		i = fill_eytzinger(index, i, 2 * k + 1);
+	}
+	return i;
+}
+
+CA_BOOL build_range_index(struct range_index* index, const struct object_range* ranges, unsigned int num)
+{
+	unsigned int i, n;
+
+	memset(index, 0, sizeof(struct range_index));
+	index->ranges = (struct object_range*) malloc(sizeof(struct object_range) * (num ? num : 1));
+	if (!index->ranges)
+		return CA_FALSE;
+	// drop empty ranges, sort by low and merge overlapped or adjacent ones
+	for (i = 0, n = 0; i < num; i++)
+	{
+		if (ranges[i].low < ranges[i].high)
+			index->ranges[n++] = ranges[i];
+	}
+	qsort(index->ranges, n, sizeof(struct object_range), range_low_compare);
+	index->num_ranges = 0;
+	for (i = 0; i < n; i++)
+	{
+		struct object_range* last = index->num_ranges ? &index->ranges[index->num_ranges - 1] : NULL;
+		if (last && index->ranges[i].low <= last->high)
+		{
+			if (index->ranges[i].high > last->high)
+				last->high = index->ranges[i].high;
+		}
+		else
+			index->ranges[index->num_ranges++] = index->ranges[i];
+	}
+	if (index->num_ranges == 0)
+		return CA_TRUE;
+
+	index->bound.low  = index->ranges[0].low;
+	index->bound.high = index->ranges[index->num_ranges - 1].high;
+	if (index->num_ranges > MAX_LINEAR_RANGES)
+	{
+		index->eytz_low  = (address_t*) malloc(sizeof(address_t) * (index->num_ranges + 1));
+		index->eytz_high = (address_t*) malloc(sizeof(address_t) * (index->num_ranges + 1));
+		if (!index->eytz_low || !index->eytz_high)
+		{
+			release_range_index(index);
+			return CA_FALSE;
+		}
+		fill_eytzinger(index, 0, 1);
+	}
+	return CA_TRUE;
+}
+
+void release_range_index(struct range_index* index)
+{
+	if (index->ranges)
+		free(index->ranges);
+	if (index->eytz_low)
+		free(index->eytz_low);
+	if (index->eytz_high)
+		free(index->eytz_high);
+	memset(index, 0, sizeof(struct range_index));
+}
+
+/*
+ * Ranges are disjoint and sorted, so are their highs. Find the first
+ * range whose high is above the value, the value is in it if its low
+ * is not above the value.
+ */
+CA_BOOL range_index_lookup(const struct range_index* index, address_t val)
+{
+	size_t k = 1;
+
+	if (val - index->bound.low >= index->bound.high - index->bound.low)
+		return CA_FALSE;
+	if (!index->eytz_high)
+	{
+		unsigned int r;
+		for (r = 0; r < index->num_ranges; r++)
+		{
+			if (val - index->ranges[r].low < index->ranges[r].high - index->ranges[r].low)
+				return CA_TRUE;
+		}
+		return CA_FALSE;
+	}
+	while (k <= index->num_ranges)
+		k = 2 * k + (index->eytz_high[k] <= val ? 1 : 0);
+	// cancel the right turns after the last left turn
+	while (k & 1)
+		k >>= 1;
+	k >>= 1;
+	return (k && index->eytz_low[k] <= val) ? CA_TRUE : CA_FALSE;
+}
+
+unsigned int scan_block_for_index(const char* block,
+					unsigned int nwords,
+					const struct range_index* index)
+{
+	size_t ptr_sz = g_ptr_bit >> 3;
+	unsigned int candidates, mask;
+	unsigned int i;
+
+	// SIMD kernel beats the index lookup for a few dozens of ranges
+	if (index->num_ranges <= MAX_LINEAR_RANGES
+		|| (index->num_ranges <= MAX_SIMD_LINEAR_RANGES && g_simd_scan_block && g_ptr_bit == 64))
+		return scan_block_for_ranges(block, nwords, index->ranges, index->num_ranges);
+
+	// filter by the bounding range with the block kernel first
+	candidates = scan_block_for_ranges(block, nwords, &index->bound, 1);
+	mask = 0;
+	for (i = 0; candidates; i++, candidates >>= 1)
+	{
+		if (candidates & 0x1)
+		{
+			const char* next = block + i * ptr_sz;
+			address_t val;
+			if (ptr_sz == 8)
+			{
+#ifdef sun
+				// sparcv9 core aligns on 4-byte only. sigh..
+				if ((address_t)next & 0x7ul)
+					memcpy(&val, next, 8);
+				else
+#endif
+					val = *(address_t*)next;
+			}
+			else
+				val = *(unsigned int*)next;
+			if (range_index_lookup(index, val))
+				mask |= 1u << i;
+		}
+	}
+	return mask;
+}
@@ -0,0 +1,63 @@
+/*
+ * scan_kernel.h
+ *		Test a block of pointer-sized words against a set of
+ *		address ranges, with SIMD instructions if the CPU has them
+ *
+ *  Created on: Oct 16, 2026
+ */
+#ifndef SCAN_KERNEL_H_
+#define SCAN_KERNEL_H_
+
+#include "ref.h"
+
+// A block is at most 32 words so that the match mask lines up
+// with one uint of a segment's bit vector
+#define SCAN_BLOCK_WORDS 32
+
+/*
+ * Targets of a search are sorted and merged into disjoint ranges.
+ * A few ranges are tested one by one; many ranges are first checked
+ * against their bounding range, then looked up in an Eytzinger (BFS
+ * order) array which walks the cache much better than a binary search
+ * over the sorted array.
+ */
+struct range_index
+{
+	struct object_range* ranges;	// sorted and merged
+	unsigned int num_ranges;
+	struct object_range  bound;		// [lowest low, highest high)
+	address_t* eytz_high;			// 1-based, Eytzinger order of ranges' high
+	address_t* eytz_low;			// corresponding low
+};
+
+// Up to this many ranges are tested linearly by the block kernel
+#define MAX_LINEAR_RANGES 8
+#define MAX_SIMD_LINEAR_RANGES 32
+
+/*
+ * Exposed functions
+ */
+// Pick the best kernel for the running CPU, it is safe to call it again
+extern void init_scan_kernel(void);
+
+extern const char* scan_kernel_name(void);
+
+// Return a mask whose bit i is set if the i_th word of the block
+// is in any of the ranges [low, high); nwords <= SCAN_BLOCK_WORDS
+extern unsigned int scan_block_for_ranges(const char* block,
+					unsigned int nwords,
+					const struct object_range* ranges,
+					unsigned int nranges);
+
+extern CA_BOOL build_range_index(struct range_index*, const struct object_range*, unsigned int);
+
+extern void release_range_index(struct range_index*);
+
+extern CA_BOOL range_index_lookup(const struct range_index*, address_t);
+
+// Same as above with ranges given by index
+extern unsigned int scan_block_for_index(const char* block,
+					unsigned int nwords,
+					const struct range_index* index);
+
+#endif /* SCAN_KERNEL_H_ */
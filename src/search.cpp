@@ -8,6 +8,9 @@
 #include "segment.h"
 #include "heap.h"
 #include "stl_container.h"
+#include "parallel.h"
+#include "scan_kernel.h"
+#include "ptr_index.h"
 
 /////////////////////////////////////////////////////
 // Data Structures used for implementation
@@ -62,126 +65,469 @@ static CA_BOOL has_multiple_thread_owners(struct shared_object* shrobj);
 /*
  * Params:
  * 		next_bit_index represents the i_th pointers in this segment
- * 		searched-for value is in the range of [target_low, target_high)
+ * 		the search stops before the max_bit_index_th pointer
+ * 		searched-for value is in any of the ranges [low, high) of the index
+ * 		segment's bit vector must be ready if target_is_ptr
  * Return:
  * 		CA_TRUE if the 1st match is found, CA_FALSE otherwise
  * 		next_bit_index is updated
+ * This function only reads the mmap-ed core, it may run in worker threads
+ *
+ * Memory is tested a block of 32 pointers at a time, which matches a uint
+ * of the bit vector, by SIMD kernel if available.
  */
 static CA_BOOL
 search_value_by_range(struct ca_segment* segment,
 		size_t* next_bit_index,
-		struct object_range** targets,
+		size_t max_bit_index,
+		const struct range_index* targets,
 		int target_is_ptr,
 		address_t* found_val,
 		address_t* found_vaddr)
 {
 	size_t ptr_sz = g_ptr_bit >> 3;
-	size_t max_bit_index  = segment->m_fsize / ptr_sz;
-
-	if (!segment->m_bitvec_ready)
-		set_addressable_bit_vec(segment);
 
-	// find next addressable pointer
 	while (*next_bit_index < max_bit_index)
 	{
-		unsigned int target_index;
+		size_t uint_index = *next_bit_index >> 5;
+		size_t block_start = uint_index << 5;
+		unsigned int uint_bit = *next_bit_index & (size_t)0x1F;
+		unsigned int nwords = SCAN_BLOCK_WORDS;
+		unsigned int bits;
+
 		// The bit vector of addressable can speed up search significantly
 		if (target_is_ptr)
+			bits = segment->m_ptr_bitvec[uint_index];
+		else
+			bits = ~0u;
+		// Account for unaligned next_bit_index and the end of search range
+		bits &= ~( (1u << uint_bit) - 1);
+		if (block_start + nwords > max_bit_index)
 		{
-			unsigned int i;
-			unsigned int uint_bit;
-			size_t uint_index = *next_bit_index >> 5;
-			unsigned int bits = segment->m_ptr_bitvec[uint_index];
-
-			if (bits == 0)
-			{
-				// There are no addressable ptrs in the next chunk of memory (32 ptrs)
-				// Also account for unaligned next_bit_index
-				*next_bit_index = (*next_bit_index & ~(size_t)0x1F) + 32;
-				continue;
-			}
-			// consider the bit inside the uint
-			uint_bit = *next_bit_index & (size_t)0x1F;
-			bits &= ~( (1 << uint_bit) - 1);
-			if (bits == 0)
+			nwords = max_bit_index - block_start;
+			bits &= (1u << nwords) - 1;
+		}
+		// There are no addressable ptrs in the next chunk of memory (32 ptrs)
+		if (bits)
+			bits &= scan_block_for_index(segment->m_faddr + block_start * ptr_sz, nwords, targets);
+		if (bits)
+		{
+			// the lowest bit is the next match
+			unsigned int i = 0;
+			while ((bits & 0x1) == 0)
 			{
-				*next_bit_index = (*next_bit_index & ~(size_t)0x1F) + 32;
-				continue;
+				bits >>= 1;
+				i++;
 			}
-			// find the non-zero bit
-			bits = bits >> uint_bit;
-			for (i=uint_bit; i<32; i++)
+			*next_bit_index = block_start + i;
+			*found_vaddr = segment->m_vaddr + (*next_bit_index) * ptr_sz;
+			if (ptr_sz == 8)
 			{
-				if (bits & 0x1)
-				{
-					// this is a valid ptr, check if it points to target object
-					size_t offset = *next_bit_index * ptr_sz;
-					const char* next_ref = segment->m_faddr + offset;
-					address_t val;
-					if (ptr_sz == 8)
-					{
+				const char* next_ref = segment->m_faddr + (*next_bit_index) * ptr_sz;
 #ifdef sun
-						// sparcv9 core aligns on 4-byte only. sigh..
-						if ((address_t)next_ref & 0x7ul)
-							memcpy(&val, next_ref, 8);
-						else
+				// sparcv9 core aligns on 4-byte only. sigh..
+				if ((address_t)next_ref & 0x7ul)
+					memcpy(found_val, next_ref, 8);
+				else
 #endif
-							val = *(address_t*)next_ref;
-					}
-					else
-						val = *(unsigned int*)next_ref;
+					*found_val = *(address_t*)next_ref;
+			}
+			else
+				*found_val = *(unsigned int*)(segment->m_faddr + (*next_bit_index) * ptr_sz);
+			return CA_TRUE;
+		}
+		*next_bit_index = block_start + SCAN_BLOCK_WORDS;
+	}
 
-					for (target_index=0; targets[target_index]; target_index++)
-					{
-						if (val >= targets[target_index]->low && val < targets[target_index]->high)
-						{
-							*found_val = val;
-							*found_vaddr = segment->m_vaddr + offset;
-							return CA_TRUE;
-						}
-					}
-				}
-				bits = bits >> 1;
-				(*next_bit_index)++;
+	return CA_FALSE;
+}
+
+/////////////////////////////////////////////////////////////////////////
+// Build a reference for a found value and append it to the output list
+// Return CA_TRUE if the ref is kept
+/////////////////////////////////////////////////////////////////////////
+static CA_BOOL
+add_value_ref(struct ca_segment* segment,
+			address_t val,
+			address_t vaddr,
+			struct CA_LIST* refs)
+{
+	CA_BOOL valid_ref = CA_FALSE;
+	struct object_reference* ref = (struct object_reference*) malloc(sizeof(struct object_reference));
+	ref->storage_type = segment->m_type;
+	ref->vaddr        = vaddr;
+	ref->value        = val;
+
+	// detail for various storage class
+	if (segment->m_type == ENUM_STACK)
+	{
+		ref->where.stack.tid = segment->m_thread.tid;
+		ref->where.stack.frame = get_frame_number(segment, vaddr, &ref->where.stack.offset);
+		if (ref->where.stack.frame >= 0 || !g_skip_free)
+			valid_ref = CA_TRUE;
+	}
+	else if (segment->m_type == ENUM_MODULE_TEXT || segment->m_type == ENUM_MODULE_DATA)
+	{
+		// it belongs to a module's .text or .data
+		valid_ref = CA_TRUE;
+		ref->where.module.name = segment->m_module_name;
+		ref->where.module.base = segment->m_vaddr;
+		ref->where.module.size = segment->m_vsize;
+	}
+	else if (segment->m_type == ENUM_HEAP)
+	{
+		if (is_heap_block(vaddr))
+		{
+			// otherwise, it is on heap
+			struct heap_block blk;
+			get_heap_block_info(vaddr, &blk);
+			// we generally don't care about free heap memory
+			if (blk.inuse || !g_skip_free)
+			{
+				valid_ref = CA_TRUE;
+				ref->where.heap.addr = blk.addr;
+				ref->where.heap.size = blk.size;
+				ref->where.heap.inuse = blk.inuse;
 			}
 		}
-		else	// we have to scan raw data for arbitrary target
+		else	// it is in heap segment, but not recognized by allocator
+			ref->storage_type = ENUM_UNKNOWN;
+	}
+	// keep meaningful ref, and throw away undesired one
+	if (valid_ref || (!g_skip_unknown && ref->storage_type == ENUM_UNKNOWN))
+	{
+		ca_list_push_back(refs, ref);
+		return CA_TRUE;
+	}
+	free(ref);
+	return CA_FALSE;
+}
+
+// avoid exceedingly too many refs for any human being to read
+#define MAX_NUM_REFS (16 * 1024)
+
+/////////////////////////////////////////////////////////////////////////
+// Scan [first, last) pointers of a segment on the calling thread
+// Return CA_TRUE if at least one ref is kept
+/////////////////////////////////////////////////////////////////////////
+static CA_BOOL
+search_segment_range(struct ca_segment* segment,
+					size_t first,
+					size_t last,
+					const struct range_index* target_index,
+					CA_BOOL target_is_ptr,
+					struct CA_LIST* refs,
+					CA_BOOL* full)
+{
+	CA_BOOL lbFound = CA_FALSE;
+	size_t next_bit_index = first;
+	address_t val   = 0xdeadbeef;
+	address_t vaddr = 0xdeadbeef;
+
+	while (search_value_by_range(segment, &next_bit_index, last, target_index, target_is_ptr, &val, &vaddr))
+	{
+		// find a match in this segment
+		if (add_value_ref(segment, val, vaddr, refs))
 		{
-			const char* start = segment->m_faddr;
-			const char* next  = start + (*next_bit_index * ptr_sz);
-			const char* end   = start + segment->m_fsize;
-			while (next + ptr_sz <= end)
+			lbFound = CA_TRUE;
+			if (ca_list_size(refs) > MAX_NUM_REFS)
 			{
-				address_t val;
-				if (ptr_sz == 8)
-				{
-#ifdef sun
-					// sparcv9 core aligns on 4-byte only. sigh..
-					if ((address_t)next & 0x7ul)
-						memcpy(&val, next, 8);
-					else
-#endif
-						val = *(address_t*)next;
-				}
-				else
-					val = *(unsigned int*)next;
+				*full = CA_TRUE;
+				break;
+			}
+		}
+		next_bit_index++;
+	}
+	return lbFound;
+}
+
+/////////////////////////////////////////////////////////////////////////
+// Parallel search of the mmap-ed core
+//   Selected segments are cut into slices, which are scanned by worker
+//   threads. The raw hits of each slice are buffered and then turned into
+//   references by the calling thread in slice order, i.e. the result is
+//   sorted by address just like a serial scan.
+/////////////////////////////////////////////////////////////////////////
+// Slice size in bytes, a multiple of 32 pointers so that slices never
+// share a uint of the segment's bit vector
+#define SEARCH_SLICE_SZ   (4*1024*1024)
+// A slice stops buffering when it has so many hits, the rest of the slice
+// is scanned by the calling thread if it still needs more refs
+#define MAX_SLICE_HITS    1024
+
+struct search_slice
+{
+	struct ca_segment* segment;
+	size_t    first;		// index of the first pointer of the slice
+	size_t    last;			// index past the last pointer of the slice
+	size_t    resume;		// where to continue if hits buffer is full
+	address_t* hits;		// pairs of (vaddr, value)
+	unsigned int num_hits;
+	unsigned int build_bitvec:1;	// bit vector of the range is not initialized yet
+	unsigned int done:1;
+	unsigned int overflow:1;
+};
+
+struct search_job
+{
+	struct search_slice* slices;
+	size_t num_slices;
+	size_t ahead;			// distance of the slice to read ahead
+	const struct range_index* targets;
+	CA_BOOL target_is_ptr;
+};
+
+static void search_slice_task(void* arg, size_t task, unsigned int worker)
+{
+	struct search_job* job = (struct search_job*) arg;
+	struct search_slice* slice = &job->slices[task];
+	size_t next_bit_index = slice->first;
+	address_t val, vaddr;
+
+	if (task + job->ahead < job->num_slices)
+	{
+		struct search_slice* next = &job->slices[task + job->ahead];
+		prefetch_segment_range(next->segment, next->first, next->last);
+	}
+
+	pin_segment_range(slice->segment, slice->first, slice->last);
+	if (slice->build_bitvec)
+		set_addressable_bit_vec_range(slice->segment, slice->first, slice->last);
+
+	while (search_value_by_range(slice->segment, &next_bit_index, slice->last,
+					job->targets, job->target_is_ptr, &val, &vaddr))
+	{
+		if (slice->num_hits >= MAX_SLICE_HITS)
+		{
+			slice->overflow = 1;
+			slice->resume = next_bit_index;
+			break;
+		}
+		if (!slice->hits)
+			slice->hits = (address_t*) malloc(sizeof(address_t) * 2 * MAX_SLICE_HITS);
+		slice->hits[slice->num_hits * 2] = vaddr;
+		slice->hits[slice->num_hits * 2 + 1] = val;
+		slice->num_hits++;
+		next_bit_index++;
+	}
+	unpin_segment_range(slice->segment, slice->first, slice->last);
+	release_segment_range(slice->segment, slice->first, slice->last);
+	slice->done = 1;
+}
+
+static CA_BOOL
+search_value_parallel(struct CA_LIST* targets,
+					const struct range_index* target_index,
+					CA_BOOL target_is_ptr,
+					enum storage_type stype,
+					struct CA_LIST* refs)
+{
+	CA_BOOL lbFound = CA_FALSE;
+	CA_BOOL completed;
+	size_t ptr_sz = g_ptr_bit >> 3;
+	size_t slice_ptrs = SEARCH_SLICE_SZ / ptr_sz;
+	size_t num_slices = 0;
+	size_t k;
+	unsigned int i;
+	struct search_job job;
+
+	// count and carve slices of selected segments
+	for (i=0; i<g_segment_count; i++)
+	{
+		struct ca_segment* segment = &g_segments[i];
+		if ((segment->m_type & stype) && segment->m_fsize > 0)
+			num_slices += (segment->m_fsize / ptr_sz + slice_ptrs - 1) / slice_ptrs;
+	}
+	job.slices = (struct search_slice*) calloc(num_slices ? num_slices : 1, sizeof(struct search_slice));
+	job.targets = target_index;
+	job.target_is_ptr = target_is_ptr;
+	k = 0;
+	for (i=0; i<g_segment_count; i++)
+	{
+		struct ca_segment* segment = &g_segments[i];
+		size_t max_bit_index = segment->m_fsize / ptr_sz;
+		size_t first;
+		if ((segment->m_type & stype) == 0 || segment->m_fsize == 0)
+			continue;
+		for (first = 0; first < max_bit_index; first += slice_ptrs)
+		{
+			struct search_slice* slice = &job.slices[k++];
+			slice->segment = segment;
+			slice->first = first;
+			slice->last = first + slice_ptrs < max_bit_index ? first + slice_ptrs : max_bit_index;
+			slice->build_bitvec = segment->m_bitvec_ready ? 0 : 1;
+		}
+	}
+
+	// the first slices are read ahead here, the rest by the slices before them
+	job.num_slices = num_slices;
+	job.ahead = prefetch_distance();
+	for (k=0; k<num_slices && k<job.ahead; k++)
+		prefetch_segment_range(job.slices[k].segment, job.slices[k].first, job.slices[k].last);
 
-				for (target_index=0; targets[target_index]; target_index++)
+	// scan by all workers
+	completed = ca_parallel_run(num_slices, search_slice_task, &job, CA_TRUE);
+
+	// a segment's bit vector is ready if all its slices are done
+	for (k=0; k<num_slices; k++)
+	{
+		struct search_slice* slice = &job.slices[k];
+		if (!slice->build_bitvec)
+			continue;
+		if (slice->first == 0)
+			slice->segment->m_bitvec_ready = 1;
+		if (!slice->done)
+			slice->segment->m_bitvec_ready = 0;
+	}
+
+	// merge in the order of segments and slices
+	k = 0;
+	for (i=0; i<g_segment_count; i++)
+	{
+		struct ca_segment* segment = &g_segments[i];
+		CA_BOOL full = CA_FALSE;
+
+		// registers are read if this is a thread stack
+		if (segment->m_type == ENUM_STACK && (stype & ENUM_REGISTER))
+		{
+			if (search_registers(segment, targets, refs))
+				lbFound = CA_TRUE;
+		}
+
+		// skip undesired setment
+		if ((segment->m_type & stype) == 0 || segment->m_fsize == 0)
+			continue;
+
+		for (; k < num_slices && job.slices[k].segment == segment; k++)
+		{
+			struct search_slice* slice = &job.slices[k];
+			unsigned int h;
+			if (!slice->done)
+				break;
+			for (h = 0; h < slice->num_hits && !full; h++)
+			{
+				if (add_value_ref(segment, slice->hits[h * 2 + 1], slice->hits[h * 2], refs))
 				{
-					if (val >= targets[target_index]->low && val < targets[target_index]->high)
-					{
-						*found_val = val;
-						*found_vaddr = segment->m_vaddr + (next - start);
-						return CA_TRUE;
-					}
+					lbFound = CA_TRUE;
+					if (ca_list_size(refs) > MAX_NUM_REFS)
+						full = CA_TRUE;
 				}
-				(*next_bit_index)++;
-				next += ptr_sz;
 			}
+			if (slice->overflow && !full
+				&& search_segment_range(segment, slice->resume, slice->last, target_index, target_is_ptr, refs, &full))
+				lbFound = CA_TRUE;
+			if (full)
+				break;
 		}
+		// an interrupted run leaves the rest unsearched
+		if (k < num_slices && !job.slices[k].done)
+			break;
+		// skip remaining slices of this segment
+		while (k < num_slices && job.slices[k].segment == segment)
+			k++;
 	}
+	if (!completed)
+		CA_PRINT("Abort searching\n");
 
-	return CA_FALSE;
+	// cleanup
+	for (k=0; k<num_slices; k++)
+	{
+		if (job.slices[k].hits)
+			free(job.slices[k].hits);
+	}
+	free(job.slices);
+
+	return lbFound;
+}
+
+/////////////////////////////////////////////////////////////////////////
+// Search by the reverse pointer index of the core
+//   Pointers to the targets are picked out of the index, sorted by their
+//   addresses and turned into references the same way as a full scan.
+/////////////////////////////////////////////////////////////////////////
+static int ptr_ref_vaddr_compare(const void* lhs, const void* rhs)
+{
+	const struct ptr_ref* a = (const struct ptr_ref*) lhs;
+	const struct ptr_ref* b = (const struct ptr_ref*) rhs;
+	if (a->vaddr < b->vaddr)
+		return -1;
+	else if (a->vaddr > b->vaddr)
+		return 1;
+	return 0;
+}
+
+// A raw search equals a pointer search if every target is mapped memory
+static CA_BOOL targets_in_segments(const struct range_index* target_index)
+{
+	unsigned int r;
+	for (r = 0; r < target_index->num_ranges; r++)
+	{
+		const struct object_range* range = &target_index->ranges[r];
+		struct ca_segment* segment = get_segment(range->low, range->high - range->low);
+		if (!segment || range->low < segment->m_vaddr
+			|| range->high > segment->m_vaddr + segment->m_vsize)
+			return CA_FALSE;
+	}
+	return CA_TRUE;
+}
+
+static CA_BOOL
+search_value_by_ptr_index(struct CA_LIST* targets,
+					const struct range_index* target_index,
+					enum storage_type stype,
+					struct CA_LIST* refs)
+{
+	CA_BOOL lbFound = CA_FALSE;
+	struct ptr_ref* hits = NULL;
+	size_t num_hits = 0, h;
+	unsigned int i, r;
+
+	for (r = 0; r < target_index->num_ranges; r++)
+	{
+		const struct ptr_ref* first;
+		size_t n = ptr_index_lookup(target_index->ranges[r].low, target_index->ranges[r].high, &first);
+		if (n > 0)
+		{
+			hits = (struct ptr_ref*) realloc(hits, sizeof(struct ptr_ref) * (num_hits + n));
+			memcpy(&hits[num_hits], first, sizeof(struct ptr_ref) * n);
+			num_hits += n;
+		}
+	}
+	if (num_hits > 1)
+		qsort(hits, num_hits, sizeof(struct ptr_ref), ptr_ref_vaddr_compare);
+
+	// merge in the order of segments
+	h = 0;
+	for (i=0; i<g_segment_count; i++)
+	{
+		struct ca_segment* segment = &g_segments[i];
+		address_t seg_end = segment->m_vaddr + segment->m_vsize;
+		CA_BOOL full = CA_FALSE;
+
+		// registers are read if this is a thread stack
+		if (segment->m_type == ENUM_STACK && (stype & ENUM_REGISTER))
+		{
+			if (search_registers(segment, targets, refs))
+				lbFound = CA_TRUE;
+		}
+
+		for (; h < num_hits && hits[h].vaddr < seg_end; h++)
+		{
+			// skip undesired setment
+			if ((segment->m_type & stype) == 0 || full)
+				continue;
+			if (add_value_ref(segment, hits[h].value, hits[h].vaddr, refs))
+			{
+				lbFound = CA_TRUE;
+				if (ca_list_size(refs) > MAX_NUM_REFS)
+					full = CA_TRUE;
+			}
+		}
+	}
+
+	if (hits)
+		free(hits);
+	return lbFound;
 }
 
 /////////////////////////////////////////////////////////////////////////
@@ -198,28 +544,56 @@ search_value_internal(struct CA_LIST* targets,
 	CA_BOOL lbFound = CA_FALSE;
 	unsigned int i;
 	unsigned int num_targets = ca_list_size(targets);
-	struct object_range** target_array = NULL;
+	struct range_index target_index;
 
 	if (num_targets == 0)
 		return CA_FALSE;
 	else
 	{
 		struct object_range* target;
-		// use an array terminated with NULL, for performance sake
-		target_array = (struct object_range**) malloc (sizeof(struct object_range*) * (num_targets+1));
+		struct object_range* target_array;
+		CA_BOOL rc;
+		// sort and merge targets into an index, for performance sake
+		target_array = (struct object_range*) malloc (sizeof(struct object_range) * num_targets);
 		i = 0;
 		ca_list_traverse_start(targets);
-		while ( (target = (struct object_range*) ca_list_traverse_next(targets)) )
+		while ( (target = (struct object_range*) ca_list_traverse_next(targets)) && i < num_targets)
 		{
-			target_array[i++] = target;
+			target_array[i++] = *target;
 		}
-		target_array[i++] = NULL;
-		if (i != num_targets + 1)
+		if (i != num_targets || target)
 		{
 			CA_PRINT("Internal error: corrupted targets CA_LIST\n");
 			free(target_array);
 			return CA_FALSE;
 		}
+		rc = build_range_index(&target_index, target_array, num_targets);
+		free(target_array);
+		if (!rc)
+		{
+			CA_PRINT("Failed to allocate memory for %d search targets\n", num_targets);
+			return CA_FALSE;
+		}
+	}
+
+	// the reverse pointer index, if built, saves a full-core scan
+	if (g_debug_core && ptr_index_ready()
+		&& (target_is_ptr || targets_in_segments(&target_index)))
+	{
+		lbFound = search_value_by_ptr_index(targets, &target_index, stype, refs);
+		release_range_index(&target_index);
+		return lbFound;
+	}
+
+	// choose SIMD kernel before any worker thread starts
+	init_scan_kernel();
+
+	// mmap-ed core file can be scanned by multiple threads
+	if (g_debug_core && ca_num_workers() > 1)
+	{
+		lbFound = search_value_parallel(targets, &target_index, target_is_ptr, stype, refs);
+		release_range_index(&target_index);
+		return lbFound;
 	}
 
 	// search all threads' registers/stacks
@@ -248,7 +622,10 @@ search_value_internal(struct CA_LIST* targets,
 		// search segment memory
 		if (segment->m_fsize > 0)
 		{
-			size_t next_bit_index = 0;
+			CA_BOOL full = CA_FALSE;
+			size_t max_bit_index = segment->m_fsize / (g_ptr_bit >> 3);
+			size_t window = PREFETCH_WINDOW_SZ / (g_ptr_bit >> 3);
+			size_t first;
 			// if we are debugging core file, read memory from mmap-ed file
 			// for live process, use a buffer to read in the whole segment
 			if (!g_debug_core)
@@ -269,71 +646,23 @@ search_value_internal(struct CA_LIST* targets,
 					segment->m_faddr = (char*) gp_mem_buf;
 			}
 			// begin to scan memory, pointed by segment->m_faddr
-			while (1)
+			// one window at a time while the next one is read ahead
+			for (first = 0; first < max_bit_index; first += window)
 			{
-				address_t val   = 0xdeadbeef;
-				address_t vaddr = 0xdeadbeef;
-
-				if(search_value_by_range(segment, &next_bit_index, target_array, target_is_ptr, &val, &vaddr))
-				{
-					// find a match in this segment
-					CA_BOOL valid_ref = CA_FALSE;
-					struct object_reference* ref = (struct object_reference*) malloc(sizeof(struct object_reference));
-					ref->storage_type = segment->m_type;
-					ref->vaddr        = vaddr;
-					ref->value        = val;
-
-					// detail for various storage class
-					if (segment->m_type == ENUM_STACK)
-					{
-						ref->where.stack.tid = segment->m_thread.tid;
-						ref->where.stack.frame = get_frame_number(segment, vaddr, &ref->where.stack.offset);
-						if (ref->where.stack.frame >= 0 || !g_skip_free)
-							valid_ref = CA_TRUE;
-					}
-					else if (segment->m_type == ENUM_MODULE_TEXT || segment->m_type == ENUM_MODULE_DATA)
-					{
-						// it belongs to a module's .text or .data
-						valid_ref = CA_TRUE;
-						ref->where.module.name = segment->m_module_name;
-						ref->where.module.base = segment->m_vaddr;
-						ref->where.module.size = segment->m_vsize;
-					}
-					else if (segment->m_type == ENUM_HEAP)
-					{
-						if (is_heap_block(vaddr))
-						{
-							// otherwise, it is on heap
-							struct heap_block blk;
-							get_heap_block_info(vaddr, &blk);
-							// we generally don't care about free heap memory
-							if (blk.inuse || !g_skip_free)
-							{
-								valid_ref = CA_TRUE;
-								ref->where.heap.addr = blk.addr;
-								ref->where.heap.size = blk.size;
-								ref->where.heap.inuse = blk.inuse;
-							}
-						}
-						else	// it is in heap segment, but not recognized by allocator
-							ref->storage_type = ENUM_UNKNOWN;
-					}
-					// keep meaningful ref, and throw away undesired one
-					if (valid_ref || (!g_skip_unknown && ref->storage_type == ENUM_UNKNOWN))
-					{
-						ca_list_push_back(refs, ref);
-						lbFound = CA_TRUE;
-						// avoid exceedingly too many refs for any human being to read
-						if (ca_list_size(refs) > 16 * 1024)
-							break;
-					}
-					else
-						free(ref);
-					next_bit_index++;
-				}
-				else
+				size_t last = first + window < max_bit_index ? first + window : max_bit_index;
+				if (full && segment->m_bitvec_ready)
 					break;
+				prefetch_segment_range(segment, last, last + window);
+				pin_segment_range(segment, first, last);
+				if (!segment->m_bitvec_ready)
+					set_addressable_bit_vec_range(segment, first, last);
+				if (!full && search_segment_range(segment, first, last,
+									&target_index, target_is_ptr, refs, &full))
+					lbFound = CA_TRUE;
+				unpin_segment_range(segment, first, last);
+				release_segment_range(segment, first, last);
 			}
+			segment->m_bitvec_ready = 1;
 			// remove reference to the global buffer, for the sake of peace mind
 			if (!g_debug_core)
 				segment->m_faddr = NULL;
@@ -341,8 +670,7 @@ search_value_internal(struct CA_LIST* targets,
 	}
 
 	// cleanup
-	if (target_array)
-		free(target_array);
+	release_range_index(&target_index);
 
 	return lbFound;
 }
@@ -6,6 +6,12 @@
  *      Author: myan
  */
 #include "segment.h"
+#include "ptr_index.h"
+#include "parallel.h"
+#include "scan_kernel.h"
+#ifndef WIN32
+#include <unistd.h>
+#endif
 
 
 /***************************************************************************
@@ -13,6 +19,7 @@
 ***************************************************************************/
 struct ca_segment* g_segments = NULL;
 unsigned int g_segment_count = 0;
+void (*g_pin_core_data)(const char* faddr, size_t len, CA_BOOL pin) = NULL;
 
 /***************************************************************************
 * Internal representation of memory segments
@@ -22,8 +29,68 @@ static unsigned int g_segment_buffer_size = 0;
 #define INIT_SEG_BUFFER_SZ 256
 static size_t g_bitvec_length = 0;
 
+/***************************************************************************
+* Address map from an address to its segment in constant time
+* 	Level 1 is a hash table of 1GB regions of the address space.
+* 	A region covered by a single segment refers to it directly, otherwise
+* 	level 2 has the index of the first segment overlapping each 1MB
+* 	bucket of the region. A lookup needs a hash probe or two, and a couple
+* 	of segment checks, instead of a binary search over all segments.
+* 	The map is read-only once built, worker threads may use it freely.
+***************************************************************************/
+#define SEGMENT_MAP_REGION_SHIFT 30
+#define SEGMENT_MAP_BUCKET_SHIFT 20
+#define SEGMENT_MAP_BUCKETS (1u << (SEGMENT_MAP_REGION_SHIFT - SEGMENT_MAP_BUCKET_SHIFT))
+#define SEGMENT_MAP_NONE 0xffffffffu
+#define SEGMENT_MAP_MISS ((struct ca_segment*)-1)
+
+struct segment_map_region
+{
+	address_t region;		// address >> SEGMENT_MAP_REGION_SHIFT
+	unsigned int used:1;
+	unsigned int whole;		// index of the segment covering the whole region
+	unsigned int* buckets;	// index of the first segment overlapping a bucket
+};
+
+static struct segment_map_region* g_segment_map = NULL;
+static size_t g_segment_map_size = 0;		// power of 2
+
+/***************************************************************************
+* Sorted and merged address ranges of all segments
+* 	A word is an addressable pointer if it is in any of them, which is
+* 	tested a block of words at a time with the SIMD scan kernel
+***************************************************************************/
+static struct range_index g_mapped_ranges;
+static CA_BOOL g_mapped_ranges_ready = CA_FALSE;
+static double  g_mapped_ranges_time = 0;
+
+// Build bit vectors of all segments in parallel once segments are loaded
+static CA_BOOL g_eager_bitvec = CA_FALSE;
+
+/***************************************************************************
+* Readahead of core data
+* 	A scan of the mmap-ed core stalls on page faults if the core file is
+* 	on network or spinning storage. The scan asks the kernel to read data
+* 	some distance ahead of it, so that I/O overlaps with the scan.
+* 	Optionally, pages behind the scan are dropped from the process (they
+* 	stay in the page cache) to bound the analyzer's resident size.
+***************************************************************************/
+static CA_BOOL g_prefetch = CA_TRUE;
+static CA_BOOL g_drop_behind = CA_FALSE;
+static void pin_core_range(struct ca_segment*, size_t, size_t, CA_BOOL);
+
 static void* sys_alloc(size_t sz);
 static void  sys_free(void* p, size_t sz);
+
+static void build_segment_map(void);
+static void release_segment_map(void);
+static struct ca_segment* segment_map_lookup(address_t addr, size_t len);
+
+static void build_mapped_ranges(void);
+static void release_mapped_ranges(void);
+static void set_addressable_bit_vec_range_slow(struct ca_segment*, size_t, size_t);
+static void advise_segment_range(struct ca_segment*, size_t, size_t, CA_BOOL);
+
 /////////////////////////////////////////////////////////
 // Dismantle all segments previously built
 // but keep the buffer for reuse
@@ -32,6 +99,10 @@ CA_BOOL release_all_segments(void)
 {
 	unsigned int i;
 	struct ca_segment* segment;
+	// derived index is obsolete
+	release_ptr_index();
+	release_segment_map();
+	release_mapped_ranges();
 	// release the bit vector, which is one monolithic region
 	for (i=0; i<g_segment_count; i++)
 	{
@@ -134,6 +205,10 @@ add_one_segment(address_t vaddr, size_t size,
 {
 	struct ca_segment* segment = NULL;
 
+	// Address map is rebuilt after all segments are in place
+	release_segment_map();
+	release_mapped_ranges();
+
 	// We need no more than two more slots in the buffer
 	prepare_segment_buffer(2);
 
@@ -196,6 +271,7 @@ add_one_segment(address_t vaddr, size_t size,
 
 //////////////////////////////////////////////////////////////
 // Return the segment containing the given memory range
+// use the address map if it is built, otherwise
 // use binary search since segments are sorted by vaddr
 //////////////////////////////////////////////////////////////
 struct ca_segment* get_segment(address_t addr, size_t len)
@@ -212,6 +288,13 @@ struct ca_segment* get_segment(address_t addr, size_t len)
 		|| target_end > g_segments[u_index-1].m_vaddr+g_segments[u_index-1].m_vsize)
 		return NULL;
 
+	if (g_segment_map)
+	{
+		struct ca_segment* segment = segment_map_lookup(addr, len);
+		if (segment != SEGMENT_MAP_MISS)
+			return segment;
+	}
+
 	while (l_index < u_index)
 	{
 		unsigned int m_index = (l_index + u_index) / 2;
@@ -252,6 +335,12 @@ CA_BOOL alloc_bit_vec(void)
 			buffer += ALIGN(seg_bits, 32) >> 3;
 		}
 	}
+	// Segments are final by now, the bit vector build is the first heavy
+	// user of the address map and mapped ranges
+	build_segment_map();
+	build_mapped_ranges();
+	if (g_eager_bitvec && g_debug_core)
+		build_all_bit_vecs();
 	return CA_TRUE;
 }
 
@@ -382,45 +471,462 @@ CA_BOOL set_addressable_bit_vec(struct ca_segment* segment)
 	if (segment->m_fsize>0 && !segment->m_bitvec_ready)
 	{
 		size_t ptr_sz = g_ptr_bit >> 3;
-		const char* start = segment->m_faddr;
-		const char* next  = start;
-		const char* end   = start + segment->m_fsize;
-
-		while (next + ptr_sz <= end)
+		size_t max_bit_index = segment->m_fsize / ptr_sz;
+		size_t window = PREFETCH_WINDOW_SZ / ptr_sz;
+		size_t first;
+		// one window at a time while the next one is read ahead
+		for (first = 0; first < max_bit_index; first += window)
 		{
-			address_t val = 0;
-			if (ptr_sz == 8)
-			{
+			size_t last = first + window < max_bit_index ? first + window : max_bit_index;
+			prefetch_segment_range(segment, last, last + window);
+			pin_segment_range(segment, first, last);
+			set_addressable_bit_vec_range(segment, first, last);
+			unpin_segment_range(segment, first, last);
+		}
+		// done
+		segment->m_bitvec_ready = 1;
+	}
+	return CA_TRUE;
+}
+
+static address_t block_word(const char* block, unsigned int i)
+{
+	address_t val;
+	if (g_ptr_bit == 64)
+	{
+		const char* next = block + i * 8;
 #ifdef sun
-				// data in sparcv9 core file aligns on 4-byte only. sigh..
-				if ((address_t)next & 0x7ul)
-					memcpy(&val, next, 8);
-				else
+		// data in sparcv9 core file aligns on 4-byte only. sigh..
+		if ((address_t)next & 0x7ul)
+			memcpy(&val, next, 8);
+		else
 #endif
-					val = *(address_t*)next;
+			val = *(address_t*)next;
+	}
+	else
+		val = *(unsigned int*)(block + i * 4);
+	return val;
+}
+
+//////////////////////////////////////////////////////////////
+// Set the bits of addressable pointers in [first, last) of the
+// segment's pointer-sized words. Different threads may work on
+// ranges of the same segment if the ranges are 32-word aligned,
+// i.e. they don't share any uint of the bit vector.
+// The caller is responsible to set m_bitvec_ready.
+//////////////////////////////////////////////////////////////
+void set_addressable_bit_vec_range(struct ca_segment* segment, size_t first, size_t last)
+{
+	size_t ptr_sz = g_ptr_bit >> 3;
+	size_t uint_index;
+	struct object_range own;
+
+	if (!g_mapped_ranges_ready)
+	{
+		set_addressable_bit_vec_range_slow(segment, first, last);
+		return;
+	}
+
+	if (last > segment->m_fsize / ptr_sz)
+		last = segment->m_fsize / ptr_sz;
+	own.low  = segment->m_vaddr;
+	own.high = segment->m_vaddr + segment->m_vsize;
+	for (uint_index = first >> 5; (uint_index << 5) < last; uint_index++)
+	{
+		size_t block_first = uint_index << 5;
+		unsigned int nwords = last - block_first < 32 ? (unsigned int)(last - block_first) : 32;
+		const char* block = segment->m_faddr + block_first * ptr_sz;
+		unsigned int mask, candidates, i;
+
+		// there is a good chance that a valid ptr points to its own segment where the ptr is
+		mask = scan_block_for_ranges(block, nwords, &own, 1);
+		// the rest is looked up if it is within the address space at all
+		candidates = scan_block_for_ranges(block, nwords, &g_mapped_ranges.bound, 1) & ~mask;
+		for (i = 0; candidates; i++, candidates >>= 1)
+		{
+			if ((candidates & 0x1) && range_index_lookup(&g_mapped_ranges, block_word(block, i)))
+				mask |= 1u << i;
+		}
+		if (block_first < first)
+			mask &= ~0u << (first - block_first);
+		// zero is never a pointer even if page zero is mapped
+		if (mask && g_mapped_ranges.bound.low == 0)
+		{
+			for (i = 0; i < nwords; i++)
+			{
+				if (block_word(block, i) == 0)
+					mask &= ~(1u << i);
 			}
+		}
+		// Assuming bitvec is sparse,
+		// Get its buffer by mmap therefore initial values are zero
+		segment->m_ptr_bitvec[uint_index] |= mask;
+	}
+}
+
+/////////////////////////////////////////////////////////////////////
+// Build bit vectors of all segments by worker threads, each one
+// takes a slice of a segment at a time
+/////////////////////////////////////////////////////////////////////
+// Slice size in bytes, a multiple of 32 pointers so that slices never
+// share a uint of the segment's bit vector
+#define BITVEC_SLICE_SZ (4*1024*1024)
+
+struct bitvec_slice
+{
+	struct ca_segment* segment;
+	size_t first;		// index of the first pointer of the slice
+	size_t last;		// index past the last pointer of the slice
+	unsigned int done:1;
+};
+
+struct bitvec_job
+{
+	struct bitvec_slice* slices;
+	size_t num_slices;
+	size_t ahead;		// distance of the slice to read ahead
+};
+
+static void bitvec_slice_task(void* arg, size_t task, unsigned int worker)
+{
+	struct bitvec_job* job = (struct bitvec_job*) arg;
+	struct bitvec_slice* slice = &job->slices[task];
+
+	if (task + job->ahead < job->num_slices)
+	{
+		struct bitvec_slice* next = &job->slices[task + job->ahead];
+		prefetch_segment_range(next->segment, next->first, next->last);
+	}
+	pin_segment_range(slice->segment, slice->first, slice->last);
+	set_addressable_bit_vec_range(slice->segment, slice->first, slice->last);
+	unpin_segment_range(slice->segment, slice->first, slice->last);
+	slice->done = 1;
+}
+
+CA_BOOL build_all_bit_vecs(void)
+{
+	size_t ptr_sz = g_ptr_bit >> 3;
+	size_t slice_ptrs = BITVEC_SLICE_SZ / ptr_sz;
+	size_t num_slices = 0;
+	size_t total_bytes = 0;
+	size_t k;
+	unsigned int i;
+	struct bitvec_slice* slices;
+	struct bitvec_job job;
+	CA_BOOL completed;
+	double start_time, elapsed;
+
+	if (!g_debug_core)
+	{
+		CA_PRINT("Bit vectors are built on demand for live process\n");
+		return CA_FALSE;
+	}
+	if (!g_mapped_ranges_ready)
+	{
+		CA_PRINT("Segments are not loaded yet\n");
+		return CA_FALSE;
+	}
+
+	// [1] mapped ranges are indexed when segments are loaded
+	CA_PRINT("Mapped ranges: %d segments are merged into %d ranges in %.3f seconds\n",
+			g_segment_count, g_mapped_ranges.num_ranges, g_mapped_ranges_time);
+
+	// [2] scan slices of segments whose bit vector is not ready
+	for (i=0; i<g_segment_count; i++)
+	{
+		struct ca_segment* segment = &g_segments[i];
+		if (segment->m_fsize > 0 && !segment->m_bitvec_ready)
+			num_slices += (segment->m_fsize / ptr_sz + slice_ptrs - 1) / slice_ptrs;
+	}
+	if (num_slices == 0)
+	{
+		CA_PRINT("Bit vectors of all segments are ready\n");
+		return CA_TRUE;
+	}
+	slices = (struct bitvec_slice*) calloc(num_slices, sizeof(struct bitvec_slice));
+	if (!slices)
+		return CA_FALSE;
+	k = 0;
+	for (i=0; i<g_segment_count; i++)
+	{
+		struct ca_segment* segment = &g_segments[i];
+		size_t max_bit_index = segment->m_fsize / ptr_sz;
+		size_t first;
+		if (segment->m_fsize == 0 || segment->m_bitvec_ready)
+			continue;
+		for (first = 0; first < max_bit_index; first += slice_ptrs)
+		{
+			struct bitvec_slice* slice = &slices[k++];
+			slice->segment = segment;
+			slice->first = first;
+			slice->last = first + slice_ptrs < max_bit_index ? first + slice_ptrs : max_bit_index;
+		}
+	}
+
+	job.slices = slices;
+	job.num_slices = num_slices;
+	job.ahead = prefetch_distance();
+	for (k=0; k<num_slices && k<job.ahead; k++)
+		prefetch_segment_range(slices[k].segment, slices[k].first, slices[k].last);
+
+	start_time = ca_wall_time();
+	completed = ca_parallel_run(num_slices, bitvec_slice_task, &job, CA_TRUE);
+	elapsed = ca_wall_time() - start_time;
+
+	// a segment's bit vector is ready if all its slices are done
+	for (k=0; k<num_slices; k++)
+	{
+		struct bitvec_slice* slice = &slices[k];
+		if (slice->first == 0)
+			slice->segment->m_bitvec_ready = 1;
+		if (!slice->done)
+			slice->segment->m_bitvec_ready = 0;
+		else
+			total_bytes += (slice->last - slice->first) * ptr_sz;
+	}
+	free(slices);
+
+	CA_PRINT("Bit vectors: "PRINT_FORMAT_SIZE" MB are scanned by %d threads (%s) in %.2f seconds",
+			total_bytes >> 20, ca_num_workers(), scan_kernel_name(), elapsed);
+	if (elapsed > 0)
+		CA_PRINT(", %.0f MB/s", (total_bytes >> 20) / elapsed);
+	CA_PRINT("\n");
+	if (!completed)
+		CA_PRINT("Abort building bit vectors, the rest is built on demand\n");
+	return completed;
+}
+
+/////////////////////////////////////////////////////////////////////
+// Bit vectors of all segments are carved from one buffer, which may be
+// saved to and mapped back from the index cache file
+/////////////////////////////////////////////////////////////////////
+char* bit_vec_buffer(size_t* length)
+{
+	unsigned int i;
+	for (i=0; i<g_segment_count; i++)
+	{
+		if (g_segments[i].m_ptr_bitvec)
+		{
+			*length = g_bitvec_length;
+			return (char*) g_segments[i].m_ptr_bitvec;
+		}
+	}
+	*length = 0;
+	return NULL;
+}
+
+// The buffer must be released by munmap, ready[] has a flag for each segment
+CA_BOOL adopt_bit_vecs(char* buffer, size_t length, const unsigned char* ready)
+{
+	size_t ptr_sz = g_ptr_bit >> 3;
+	size_t old_length;
+	char* old_buffer = bit_vec_buffer(&old_length);
+	unsigned int i;
+
+	if (!old_buffer || length != old_length)
+		return CA_FALSE;
+	sys_free(old_buffer, old_length);
+	for (i=0; i<g_segment_count; i++)
+	{
+		struct ca_segment* segment = &g_segments[i];
+		if (segment->m_fsize > 0)
+		{
+			size_t seg_bits = segment->m_fsize/ptr_sz;
+			segment->m_ptr_bitvec = (unsigned int*) buffer;
+			segment->m_bitvec_ready = ready[i] ? 1 : 0;
+			buffer += ALIGN(seg_bits, 32) >> 3;
+		}
+	}
+	return CA_TRUE;
+}
+
+/*
+ * eager_bitvec [on|off]
+ */
+void bit_vec_command(const char* arg)
+{
+	if (arg && (strcmp(arg, "on") == 0 || strcmp(arg, "1") == 0))
+	{
+		g_eager_bitvec = CA_TRUE;
+		if (g_mapped_ranges_ready)
+			build_all_bit_vecs();
+	}
+	else if (arg && (strcmp(arg, "off") == 0 || strcmp(arg, "0") == 0))
+	{
+		g_eager_bitvec = CA_FALSE;
+		CA_PRINT("Bit vectors are built on demand\n");
+	}
+	else
+	{
+		unsigned int i, ready = 0, total = 0;
+		for (i=0; i<g_segment_count; i++)
+		{
+			if (g_segments[i].m_fsize > 0)
+			{
+				total++;
+				if (g_segments[i].m_bitvec_ready)
+					ready++;
+			}
+		}
+		CA_PRINT("Bit vectors are built %s, %d of %d segments are ready\n",
+				g_eager_bitvec ? "upfront" : "on demand", ready, total);
+	}
+}
+
+/////////////////////////////////////////////////////////////////////
+// Readahead and drop-behind of [first, last) pointers of a segment
+// They are hints to the kernel, it is safe to call them from worker
+// threads, and they do nothing for a live process
+/////////////////////////////////////////////////////////////////////
+void prefetch_segment_range(struct ca_segment* segment, size_t first, size_t last)
+{
+	if (g_prefetch)
+		advise_segment_range(segment, first, last, CA_TRUE);
+}
+
+void release_segment_range(struct ca_segment* segment, size_t first, size_t last)
+{
+	if (g_drop_behind)
+		advise_segment_range(segment, first, last, CA_FALSE);
+}
+
+/////////////////////////////////////////////////////////////////////
+// A core mapped in windows keeps the data of [first, last) pointers of
+// a segment in memory between pin and unpin, which enclose a scan of
+// the range. Otherwise they do nothing.
+/////////////////////////////////////////////////////////////////////
+void pin_segment_range(struct ca_segment* segment, size_t first, size_t last)
+{
+	if (g_pin_core_data)
+		pin_core_range(segment, first, last, CA_TRUE);
+}
+
+void unpin_segment_range(struct ca_segment* segment, size_t first, size_t last)
+{
+	if (g_pin_core_data)
+		pin_core_range(segment, first, last, CA_FALSE);
+}
+
+static void pin_core_range(struct ca_segment* segment, size_t first, size_t last, CA_BOOL pin)
+{
+	size_t ptr_sz = g_ptr_bit >> 3;
+
+	if (!g_debug_core || !segment->m_faddr)
+		return;
+	if (last > segment->m_fsize / ptr_sz)
+		last = segment->m_fsize / ptr_sz;
+	if (first < last)
+		g_pin_core_data(segment->m_faddr + first * ptr_sz, (last - first) * ptr_sz, pin);
+}
+
+// Number of slices between the one being scanned and the one read ahead
+size_t prefetch_distance(void)
+{
+	return ca_num_workers() + PREFETCH_AHEAD_SLICES;
+}
+
+static void advise_segment_range(struct ca_segment* segment, size_t first, size_t last, CA_BOOL willneed)
+{
+#ifndef WIN32
+	size_t ptr_sz = g_ptr_bit >> 3;
+	size_t page_sz = sysconf(_SC_PAGESIZE);
+	address_t start, end;
+
+	if (!g_debug_core || !segment->m_faddr)
+		return;
+	if (last > segment->m_fsize / ptr_sz)
+		last = segment->m_fsize / ptr_sz;
+	if (first >= last)
+		return;
+	start = (address_t) (segment->m_faddr + first * ptr_sz);
+	end   = (address_t) (segment->m_faddr + last * ptr_sz);
+	if (willneed)
+	{
+		// pages partially in the range are read as well
+		start &= ~(address_t)(page_sz - 1);
+		end = ALIGN(end, page_sz);
+		madvise((void*)start, end - start, MADV_WILLNEED);
+	}
+	else
+	{
+		// pages partially in the range may be in use by a neighbor slice
+		start = ALIGN(start, page_sz);
+		end &= ~(address_t)(page_sz - 1);
+		if (end > start)
+			madvise((void*)start, end - start, MADV_DONTNEED);
+	}
+#endif
+}
+
+/*
+ * prefetch [on|off|drop]
+ */
+void prefetch_command(const char* arg)
+{
+	if (arg && (strcmp(arg, "on") == 0 || strcmp(arg, "1") == 0))
+	{
+		g_prefetch = CA_TRUE;
+		g_drop_behind = CA_FALSE;
+	}
+	else if (arg && (strcmp(arg, "off") == 0 || strcmp(arg, "0") == 0))
+	{
+		g_prefetch = CA_FALSE;
+		g_drop_behind = CA_FALSE;
+	}
+	else if (arg && strcmp(arg, "drop") == 0)
+	{
+		g_prefetch = CA_TRUE;
+		g_drop_behind = CA_TRUE;
+	}
+	if (!g_prefetch)
+		CA_PRINT("Core data is read on demand\n");
+	else
+		CA_PRINT("Core data is read ahead of scans%s\n",
+				g_drop_behind ? ", and scanned pages are dropped from memory" : "");
+}
+
+// One word at a time, used before the mapped ranges are built
+static void set_addressable_bit_vec_range_slow(struct ca_segment* segment, size_t first, size_t last)
+{
+	size_t ptr_sz = g_ptr_bit >> 3;
+	const char* start = segment->m_faddr;
+	const char* next  = start + first * ptr_sz;
+	const char* end   = start + last * ptr_sz;
+
+	if (end > start + segment->m_fsize)
+		end = start + segment->m_fsize;
+
+	while (next + ptr_sz <= end)
+	{
+		address_t val = 0;
+		if (ptr_sz == 8)
+		{
+#ifdef sun
+			// data in sparcv9 core file aligns on 4-byte only. sigh..
+			if ((address_t)next & 0x7ul)
+				memcpy(&val, next, 8);
 			else
-				val = *(unsigned int*)next;
-			// Assuming bitvec is sparse,
-			// Get its buffer by mmap therefore initial values are zero
-			// We only need to set the bits of addressable pointers
-			if (val)
+#endif
+				val = *(address_t*)next;
+		}
+		else
+			val = *(unsigned int*)next;
+		// Assuming bitvec is sparse,
+		// Get its buffer by mmap therefore initial values are zero
+		// We only need to set the bits of addressable pointers
+		if (val)
+		{
+			// there is a good chance that a valid ptr points to its own segment where the ptr is
+			if ( (val >= segment->m_vaddr && val < segment->m_vaddr + segment->m_vsize)
+				|| get_segment(val, 1) )
 			{
-				// there is a good chance that a valid ptr points to its own segment where the ptr is
-				if ( (val >= segment->m_vaddr && val < segment->m_vaddr + segment->m_vsize)
-					|| get_segment(val, 1) )
-				{
-					size_t offset = (next - start) / ptr_sz;
-					unsigned int bit = 1 << (offset & (size_t)0x1F);
-					segment->m_ptr_bitvec[offset>>5] |= bit;
-				}
+				size_t offset = (next - start) / ptr_sz;
+				unsigned int bit = 1 << (offset & (size_t)0x1F);
+				segment->m_ptr_bitvec[offset>>5] |= bit;
 			}
-			next += ptr_sz;
 		}
-		// done
-		segment->m_bitvec_ready = 1;
+		next += ptr_sz;
 	}
-	return CA_TRUE;
 }
 
 //////////////////////////////////////////////////////////////
@@ -590,6 +1096,191 @@ void* core_to_mmap_addr(address_t vaddr)
 	return NULL;
 }
 
+/////////////////////////////////////////////////////////////////////
+// Address map, see the comment at its global variables
+/////////////////////////////////////////////////////////////////////
+// Find the region's slot, or the empty slot to insert it
+static struct segment_map_region* segment_map_slot(address_t region)
+{
+	size_t mask = g_segment_map_size - 1;
+	size_t slot = (size_t)(region * 2654435761u) & mask;
+
+	while (g_segment_map[slot].used && g_segment_map[slot].region != region)
+		slot = (slot + 1) & mask;
+	return &g_segment_map[slot];
+}
+
+static void release_segment_map(void)
+{
+	size_t i;
+
+	if (!g_segment_map)
+		return;
+	for (i = 0; i < g_segment_map_size; i++)
+	{
+		if (g_segment_map[i].buckets)
+			free(g_segment_map[i].buckets);
+	}
+	free(g_segment_map);
+	g_segment_map = NULL;
+	g_segment_map_size = 0;
+}
+
+static void build_segment_map(void)
+{
+	size_t num_regions = 0;
+	unsigned int i;
+
+	release_segment_map();
+
+	// Upper bound of the number of regions
+	for (i = 0; i < g_segment_count; i++)
+	{
+		struct ca_segment* segment = &g_segments[i];
+		if (segment->m_vsize > 0)
+			num_regions += ((segment->m_vaddr + segment->m_vsize - 1) >> SEGMENT_MAP_REGION_SHIFT)
+				- (segment->m_vaddr >> SEGMENT_MAP_REGION_SHIFT) + 1;
+	}
+	// A sparse address space, e.g. huge reserved regions, isn't worth it
+	if (num_regions == 0 || num_regions > 1024*1024)
+		return;
+	for (g_segment_map_size = 1; g_segment_map_size < num_regions * 2; g_segment_map_size <<= 1)
+		;
+	g_segment_map = (struct segment_map_region*) calloc(g_segment_map_size, sizeof(struct segment_map_region));
+	if (!g_segment_map)
+	{
+		g_segment_map_size = 0;
+		return;
+	}
+
+	for (i = 0; i < g_segment_count; i++)
+	{
+		struct ca_segment* segment = &g_segments[i];
+		address_t seg_end = segment->m_vaddr + segment->m_vsize;
+		address_t region, last_region;
+
+		if (segment->m_vsize == 0)
+			continue;
+		last_region = (seg_end - 1) >> SEGMENT_MAP_REGION_SHIFT;
+		for (region = segment->m_vaddr >> SEGMENT_MAP_REGION_SHIFT; region <= last_region; region++)
+		{
+			struct segment_map_region* entry = segment_map_slot(region);
+			address_t region_start = region << SEGMENT_MAP_REGION_SHIFT;
+			address_t start, end;
+			unsigned int bucket, last_bucket;
+
+			if (!entry->used)
+			{
+				entry->used = 1;
+				entry->region = region;
+				entry->whole = SEGMENT_MAP_NONE;
+				// the segment covers the whole region
+				if (segment->m_vaddr <= region_start
+					&& seg_end - 1 >= region_start + ((address_t)1 << SEGMENT_MAP_REGION_SHIFT) - 1)
+				{
+					entry->whole = i;
+					continue;
+				}
+			}
+			if (!entry->buckets)
+			{
+				unsigned int k;
+				entry->buckets = (unsigned int*) malloc(sizeof(unsigned int) * SEGMENT_MAP_BUCKETS);
+				if (!entry->buckets)
+				{
+					release_segment_map();
+					return;
+				}
+				// overlapped segments are not expected, but be safe
+				for (k = 0; k < SEGMENT_MAP_BUCKETS; k++)
+					entry->buckets[k] = entry->whole;
+				entry->whole = SEGMENT_MAP_NONE;
+			}
+			start = segment->m_vaddr > region_start ? segment->m_vaddr : region_start;
+			end = seg_end - 1 < region_start + ((address_t)1 << SEGMENT_MAP_REGION_SHIFT) - 1 ?
+					seg_end - 1 : region_start + ((address_t)1 << SEGMENT_MAP_REGION_SHIFT) - 1;
+			last_bucket = (unsigned int)((end - region_start) >> SEGMENT_MAP_BUCKET_SHIFT);
+			for (bucket = (unsigned int)((start - region_start) >> SEGMENT_MAP_BUCKET_SHIFT); bucket <= last_bucket; bucket++)
+			{
+				// segments are sorted, keep the first one
+				if (entry->buckets[bucket] == SEGMENT_MAP_NONE)
+					entry->buckets[bucket] = i;
+			}
+		}
+	}
+}
+
+static void release_mapped_ranges(void)
+{
+	if (g_mapped_ranges_ready)
+		release_range_index(&g_mapped_ranges);
+	g_mapped_ranges_ready = CA_FALSE;
+}
+
+static void build_mapped_ranges(void)
+{
+	struct object_range* ranges;
+	unsigned int i;
+	double start_time = ca_wall_time();
+
+	release_mapped_ranges();
+	if (g_segment_count == 0)
+		return;
+	ranges = (struct object_range*) malloc(sizeof(struct object_range) * g_segment_count);
+	if (!ranges)
+		return;
+	for (i = 0; i < g_segment_count; i++)
+	{
+		ranges[i].low  = g_segments[i].m_vaddr;
+		ranges[i].high = g_segments[i].m_vaddr + g_segments[i].m_vsize;
+	}
+	if (build_range_index(&g_mapped_ranges, ranges, g_segment_count))
+	{
+		if (g_mapped_ranges.num_ranges > 0)
+			g_mapped_ranges_ready = CA_TRUE;
+		else
+			release_range_index(&g_mapped_ranges);
+	}
+	free(ranges);
+	init_scan_kernel();
+	g_mapped_ranges_time = ca_wall_time() - start_time;
+}
+
+// Return SEGMENT_MAP_MISS if the answer isn't clear-cut, caller falls back
+// to binary search then
+static struct ca_segment* segment_map_lookup(address_t addr, size_t len)
+{
+	address_t end = addr + len;
+	address_t region = addr >> SEGMENT_MAP_REGION_SHIFT;
+	struct segment_map_region* entry;
+	unsigned int index;
+
+	// range across buckets
+	if ((addr >> SEGMENT_MAP_BUCKET_SHIFT) != ((end - 1) >> SEGMENT_MAP_BUCKET_SHIFT))
+		return SEGMENT_MAP_MISS;
+
+	entry = segment_map_slot(region);
+	if (!entry->used)
+		return NULL;
+	if (!entry->buckets)
+		return &g_segments[entry->whole];
+
+	index = entry->buckets[(addr >> SEGMENT_MAP_BUCKET_SHIFT) & (SEGMENT_MAP_BUCKETS - 1)];
+	if (index == SEGMENT_MAP_NONE)
+		return NULL;
+	for (; index < g_segment_count && g_segments[index].m_vaddr < end; index++)
+	{
+		struct ca_segment* segment = &g_segments[index];
+		if (addr >= segment->m_vaddr + segment->m_vsize)
+			continue;
+		// the range is within the segment
+		if (addr >= segment->m_vaddr && end <= segment->m_vaddr + segment->m_vsize)
+			return segment;
+		return SEGMENT_MAP_MISS;
+	}
+	return NULL;
+}
+
 static void* sys_alloc(size_t sz)
 {
 	void* result;
@@ -34,6 +34,11 @@ struct ca_segment
 	const char*   m_module_name;
 };
 
+// A serial scan reads ahead one window of this size
+#define PREFETCH_WINDOW_SZ (4*1024*1024)
+// A parallel scan reads ahead so many slices besides one for each worker
+#define PREFETCH_AHEAD_SLICES 8
+
 /*
  * Exposed functions, global variables
  */
@@ -50,6 +55,28 @@ extern struct ca_segment* get_segment(address_t addr, size_t len);
 
 extern CA_BOOL set_addressable_bit_vec(struct ca_segment*);
 
+extern void set_addressable_bit_vec_range(struct ca_segment*, size_t, size_t);
+
+extern CA_BOOL build_all_bit_vecs(void);
+
+extern void bit_vec_command(const char* arg);
+
+extern void prefetch_segment_range(struct ca_segment*, size_t, size_t);
+
+extern void release_segment_range(struct ca_segment*, size_t, size_t);
+
+extern size_t prefetch_distance(void);
+
+extern void pin_segment_range(struct ca_segment*, size_t, size_t);
+
+extern void unpin_segment_range(struct ca_segment*, size_t, size_t);
+
+extern void prefetch_command(const char* arg);
+
+extern char* bit_vec_buffer(size_t* length);
+
+extern CA_BOOL adopt_bit_vecs(char* buffer, size_t length, const unsigned char* ready);
+
 extern CA_BOOL read_memory_wrapper (struct ca_segment*, address_t, void*, size_t);
 
 extern void* core_to_mmap_addr(address_t vaddr);
@@ -63,4 +90,7 @@ extern void print_set_values (void);
 extern struct ca_segment* g_segments;
 extern unsigned int g_segment_count;
 
+// Set by the host if core data is not all in memory, e.g. a windowed core
+extern void (*g_pin_core_data)(const char* faddr, size_t len, CA_BOOL pin);
+
 #endif /* SEGMENT_H_ */
@@ -56,7 +56,7 @@ extern struct ca_debug_context g_debug_context;
 #define MAX_NUM_OPTIONS 32
 extern int ca_parse_options(char* arg, char** out);
 
-extern void calc_heap_usage(char *expr);
+extern void calc_heap_usage(char *expr, CA_BOOL retained);
 
 extern void init_progress_bar(unsigned long total);
 extern void set_current_progress(unsigned long);
@@ -0,0 +1,101 @@
+/*
+ * edgeBench.cpp
+ *
+ * Measure the removal of duplicate edges of a heap block, which is a
+ * huge pointer array, e.g. slots of a hash table, from 1K to 1M slots.
+ * The open-addressing set must keep the same edges in the same order
+ * as the pairwise comparison it replaces.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "index_set.h"
+
+// the pairwise comparison is O(slots x unique), stop it early
+static const unsigned long max_linear_slots = 64 * 1024;
+
+static double
+now()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+// the old way, the edge is compared with all edges kept so far
+static unsigned long
+unique_pairwise(unsigned long* indexes, unsigned long count)
+{
+	unsigned long i, j, num_unique = 0;
+
+	for (i = 0; i < count; i++)
+	{
+		for (j = 0; j < num_unique; j++)
+		{
+			if (indexes[j] == indexes[i])
+				break;
+		}
+		if (j == num_unique)
+			indexes[num_unique++] = indexes[i];
+	}
+	return num_unique;
+}
+
+int
+main(int argc, char** argv)
+{
+	const unsigned long max_slots = 1024 * 1024;
+	unsigned long* slots = (unsigned long*) malloc(max_slots * sizeof(unsigned long));
+	unsigned long* edges = (unsigned long*) malloc(max_slots * sizeof(unsigned long));
+	unsigned long* expected = (unsigned long*) malloc(max_slots * sizeof(unsigned long));
+	struct index_set set;
+	unsigned long num_slots;
+
+	memset(&set, 0, sizeof(set));
+	srand(1);
+	printf("%10s %10s %14s %14s\n", "slots", "unique", "set(ms)", "pairwise(ms)");
+
+	for (num_slots = 1024; num_slots <= max_slots; num_slots *= 4)
+	{
+		unsigned long num_nodes = num_slots / 2;
+		unsigned long i, num_unique, num_expected = 0;
+		double t0, t1, t2 = 0;
+
+		// each slot points to one of num_nodes blocks of a big heap,
+		// about two slots per block
+		for (i = 0; i < num_slots; i++)
+			slots[i] = 5000000 + ((((unsigned long)rand() << 31) | rand()) % num_nodes) * 37;
+
+		memcpy(edges, slots, num_slots * sizeof(unsigned long));
+		t0 = now();
+		num_unique = unique_indexes(&set, edges, num_slots);
+		t1 = now();
+		if (num_slots <= max_linear_slots)
+		{
+			memcpy(expected, slots, num_slots * sizeof(unsigned long));
+			num_expected = unique_pairwise(expected, num_slots);
+			t2 = now();
+			if (num_expected != num_unique
+				|| memcmp(expected, edges, num_unique * sizeof(unsigned long)))
+			{
+				fprintf(stderr, "[Error] %ld slots: set keeps %ld edges, pairwise keeps %ld\n",
+						num_slots, num_unique, num_expected);
+				return -1;
+			}
+		}
+
+		printf("%10ld %10ld %14.2f ", num_slots, num_unique, (t1 - t0) * 1000);
+		if (num_slots <= max_linear_slots)
+			printf("%14.2f\n", (t2 - t1) * 1000);
+		else
+			printf("%14s\n", "-");
+	}
+
+	release_index_set(&set);
+	free(slots);
+	free(edges);
+	free(expected);
+	return 0;
+}
@@ -0,0 +1,108 @@
+/*
+ * scanBench.cpp
+ *
+ * Measure the pointer scan kernel against a growing number of search
+ * targets, from 1 to 1M, with and without the sorted interval index.
+ * Both ways must find the same words.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "scan_kernel.h"
+
+unsigned int g_ptr_bit = 64;
+
+// synthetic memory, roughly a quarter of the words look like heap pointers
+static const size_t num_words = 8 * 1024 * 1024;
+static const address_t heap_base = 0x7f0000000000ul;
+static const address_t heap_size = 0x40000000ul;
+
+// the unindexed scan is O(words x targets), stop it early
+static const unsigned int max_linear_targets = 1024;
+
+static double
+now()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static address_t
+rand_addr()
+{
+	return heap_base + ((((address_t)rand() << 31) | rand()) % heap_size);
+}
+
+int
+main(int argc, char** argv)
+{
+	address_t* words = (address_t*) malloc(num_words * sizeof(address_t));
+	size_t i;
+
+	srand(1);
+	for (i = 0; i < num_words; i++)
+	{
+		if (rand() % 4 == 0)
+			words[i] = rand_addr() & ~0xful;
+		else
+			words[i] = rand() % 4096;
+	}
+
+	init_scan_kernel();
+	printf("kernel: %s, memory: %ld MB\n", scan_kernel_name(), num_words * sizeof(address_t) >> 20);
+	printf("%10s %10s %12s %14s %14s %10s\n", "targets", "merged", "build(ms)", "index(MB/s)", "linear(MB/s)", "matches");
+
+	for (unsigned int num_targets = 1; num_targets <= 1024 * 1024; num_targets *= 4)
+	{
+		struct object_range* targets = (struct object_range*) malloc(num_targets * sizeof(struct object_range));
+		struct range_index index;
+		size_t matches = 0, linear_matches = 0;
+		double t0, t1, t2, t3 = 0;
+
+		for (i = 0; i < num_targets; i++)
+		{
+			targets[i].low = rand_addr() & ~0xful;
+			targets[i].high = targets[i].low + 16 + (rand() % 1024);
+		}
+
+		t0 = now();
+		if (!build_range_index(&index, targets, num_targets))
+		{
+			fprintf(stderr, "out of memory\n");
+			return -1;
+		}
+		t1 = now();
+		for (i = 0; i < num_words; i += SCAN_BLOCK_WORDS)
+			matches += __builtin_popcount(scan_block_for_index((const char*)&words[i], SCAN_BLOCK_WORDS, &index));
+		t2 = now();
+		if (num_targets <= max_linear_targets)
+		{
+			for (i = 0; i < num_words; i += SCAN_BLOCK_WORDS)
+				linear_matches += __builtin_popcount(scan_block_for_ranges((const char*)&words[i], SCAN_BLOCK_WORDS, targets, num_targets));
+			t3 = now();
+			if (linear_matches != matches)
+			{
+				fprintf(stderr, "[Error] %d targets: index finds %ld words, linear scan finds %ld\n",
+						num_targets, matches, linear_matches);
+				return -1;
+			}
+		}
+
+		printf("%10u %10u %12.2f %14.0f ", num_targets, index.num_ranges, (t1 - t0) * 1000,
+				(num_words * sizeof(address_t) >> 20) / (t2 - t1));
+		if (num_targets <= max_linear_targets)
+			printf("%14.0f ", (num_words * sizeof(address_t) >> 20) / (t3 - t2));
+		else
+			printf("%14s ", "-");
+		printf("%10ld\n", matches);
+
+		release_range_index(&index);
+		free(targets);
+	}
+
+	free(words);
+	return 0;
+}